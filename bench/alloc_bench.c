@@ -0,0 +1,318 @@
+/*
+ * alloc_bench.c
+ *
+ * Counts the heap allocations made per request by the HTTP and service layers.  A small HTTP
+ * server runs on a background thread and answers every request with the same response, so the
+ * numbers don't depend on the network.  Only allocations made on the calling thread are counted,
+ * and they are split between the ones made by this library (including cJSON), which is linked
+ * into the program, and the ones made inside libcurl and other shared libraries.
+ *
+ * usage: alloc_bench [iterations] [response size in KB]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io_services.h"
+
+
+/***********************************************************************
+ * Allocation counting
+ ***********************************************************************/
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+/* the bounds of this program's code, from the linker */
+extern char __executable_start, etext;
+
+static __thread int counting;
+static __thread long allocs, reallocs, shared_allocs;
+
+#define COUNT(counter) \
+	do { \
+		char *caller = (char *)__builtin_return_address(0); \
+		if (!counting) break; \
+		if (caller >= &__executable_start && caller < &etext) counter++; \
+		else shared_allocs++; \
+	} while (0)
+
+void *malloc(size_t size)
+{
+	COUNT(allocs);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	COUNT(allocs);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	COUNT(reallocs);
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+
+/***********************************************************************
+ * The canned HTTP server
+ ***********************************************************************/
+
+static char *response;
+static size_t response_len;
+
+static void *serve_connection(void *arg)
+{
+	int fd = (int)(long)arg;
+	char buf[8192];
+	size_t have = 0;
+	ssize_t n;
+	char *end;
+	long content_length;
+
+	for (;;) {
+
+		/* read the headers, then skip any request body */
+		while (!(end = memmem(buf, have, "\r\n\r\n", 4))) {
+			if (have == sizeof(buf) || (n = read(fd, buf + have, sizeof(buf) - have)) <= 0)
+				goto done;
+			have += n;
+		}
+
+		end += 4;
+		content_length = 0;
+		{
+			char *cl = memmem(buf, end - buf, "Content-Length:", 15);
+			if (cl) content_length = atol(cl + 15);
+		}
+
+		have -= end - buf;
+		memmove(buf, end, have);
+
+		while (content_length > 0) {
+			if ((size_t)content_length <= have) {
+				have -= content_length;
+				memmove(buf, buf + content_length, have);
+				break;
+			}
+			content_length -= have;
+			have = 0;
+			if ((n = read(fd, buf, sizeof(buf))) <= 0)
+				goto done;
+			have = n;
+		}
+
+		if (write(fd, response, response_len) != (ssize_t)response_len)
+			goto done;
+	}
+
+done:
+	close(fd);
+	return NULL;
+}
+
+static void *serve(void *arg)
+{
+	int listener = (int)(long)arg;
+	pthread_t thread;
+	int fd;
+
+	while ((fd = accept(listener, NULL, NULL)) >= 0) {
+		pthread_create(&thread, NULL, serve_connection, (void *)(long)fd);
+		pthread_detach(thread);
+	}
+
+	return NULL;
+}
+
+static int start_server(size_t body_kb)
+{
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	pthread_t thread;
+	char *body;
+	size_t body_len, i;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) || listen(listener, 64)
+			|| getsockname(listener, (struct sockaddr *)&addr, &addr_len)) {
+		perror("server");
+		exit(1);
+	}
+
+	/* a drop whose description pads the response out to the requested size */
+	body_len = body_kb * 1024;
+	body = malloc(body_len + 256);
+	i = sprintf(body, "{\"head\":{\"status\":200,\"errors\":[],\"messages\":[]},\"body\":"
+			"{\"id\":\"d1\",\"elems\":{\"num\":{\"type\":\"integer\",\"value\":7}},\"description\":\"");
+	while (i < body_len)
+		body[i++] = 'x';
+	i += sprintf(body + i, "\"}}");
+
+	response = malloc(i + 256);
+	response_len = sprintf(response, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+			"Content-Length: %zu\r\n\r\n", i);
+	memcpy(response + response_len, body, i);
+	response_len += i;
+	free(body);
+
+	pthread_create(&thread, NULL, serve, (void *)(long)listener);
+	pthread_detach(thread);
+
+	return ntohs(addr.sin_port);
+}
+
+
+/***********************************************************************
+ * The benchmark
+ ***********************************************************************/
+
+struct my_drop {
+	int num;
+};
+
+static BOOL decode_my_drop(cJSON *json_in, void *obj_out)
+{
+	struct my_drop *md = (struct my_drop *)obj_out;
+	md->num = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(json_in, "elems"), "num"), "value")->valueint;
+
+	return TRUE;
+}
+
+static BOOL encode_my_drop(void *obj_in, cJSON *json_out)
+{
+	struct my_drop *md = (struct my_drop *)obj_in;
+	cJSON *elems = cJSON_CreateObject();
+
+	cJSON_AddNumberToObject(elems, "num", md->num);
+	cJSON_AddStringToObject(elems, "label", "a drop with a label");
+	cJSON_AddItemToObject(json_out, "elems", elems);
+
+	return TRUE;
+}
+
+#define MY_DROP_FIELDS(X) \
+	X(struct my_drop, num, "elems.num", FLOWTHINGS_IO_FIELD_INT)
+
+FLOWTHINGS_IO_CODEC_DEFINE(my_drop_codec, struct my_drop, MY_DROP_FIELDS)
+
+static void start(void)
+{
+	allocs = reallocs = shared_allocs = 0;
+	counting = 1;
+}
+
+static void report(const char *name, int iterations)
+{
+	counting = 0;
+	printf("%-30s %10.2f %10.2f %10.2f\n", name, (double)allocs / iterations,
+			(double)reallocs / iterations, (double)shared_allocs / iterations);
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+	size_t body_kb = argc > 2 ? atoi(argv[2]) : 32;
+	flowthings_io_token creds = { "myaccountname", "mytoken" };
+	flowthings_io_string *s;
+	flowthings_io_api *api;
+	struct my_drop drop;
+	char host[64];
+	int i;
+
+	snprintf(host, sizeof(host), "127.0.0.1:%d", start_server(body_kb));
+
+	api = flowthings_io_api_init(FLOWTHINGS_IO_VERSION, host, FALSE, &creds);
+	/* the decoders here only copy values out, so the trees can go in arenas */
+	flowthings_io_api_set_json_arena(api, TRUE);
+
+	printf("%d requests, %zu KB responses, per request:\n", iterations, body_kb);
+	printf("%-30s %10s %10s %10s\n", "", "allocs", "reallocs", "libcurl");
+
+	/* warm up: open the connection and fill the pools */
+	s = flowthings_io_string_init();
+	for (i = 0; i < 10; i++) {
+		flowthings_io_string_reset(s);
+		flowthings_io_http_request(api->fhttp, "GET", "/drop", "/f1/d1", NULL, s);
+		flowthings_io_drop_read("f1", api, "d1", NULL, decode_my_drop, &drop);
+	}
+
+	/* a new response string for every request */
+	start();
+	for (i = 0; i < iterations; i++) {
+		flowthings_io_string *r = flowthings_io_string_init();
+		flowthings_io_http_request(api->fhttp, "GET", "/drop", "/f1/d1", NULL, r);
+		flowthings_io_string_cleanup(r);
+	}
+	report("http_request, new string", iterations);
+
+	/* one response string, reset between requests */
+	start();
+	for (i = 0; i < iterations; i++) {
+		flowthings_io_string_reset(s);
+		flowthings_io_http_request(api->fhttp, "GET", "/drop", "/f1/d1", NULL, s);
+	}
+	report("http_request, reused string", iterations);
+
+	/* the service layer, including the JSON parse and decode */
+	start();
+	for (i = 0; i < iterations; i++)
+		flowthings_io_drop_read("f1", api, "d1", NULL, decode_my_drop, &drop);
+	report("drop_read", iterations);
+
+	/* the request body is written into a pooled string */
+	start();
+	for (i = 0; i < iterations; i++)
+		flowthings_io_drop_create("f1", api, NULL, encode_my_drop, decode_my_drop, &drop);
+	report("drop_create", iterations);
+
+	flowthings_io_api_set_stream_decode(api, TRUE);
+	start();
+	for (i = 0; i < iterations; i++)
+		flowthings_io_drop_read("f1", api, "d1", NULL, decode_my_drop, &drop);
+	report("drop_read, stream decode", iterations);
+
+	/* a codec decodes straight from the text, without a cJSON tree */
+	start();
+	for (i = 0; i < iterations; i++)
+		flowthings_io_drop_read_codec("f1", api, "d1", NULL, &my_drop_codec, &drop);
+	report("drop_read_codec", iterations);
+
+	flowthings_io_string_cleanup(s);
+	flowthings_io_api_cleanup(api);
+
+	return 0;
+}
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,210 @@
+/*
+ * find_many_bench.c
+ *
+ * Compares a find_many sent as one MGET with the same find_many split into shards that are sent
+ * at once, for 10, 100 and 1000 flows, against a flowthings.io server (normally bench/mock_server).
+ *
+ * usage: find_many_bench [-h host] [-n iterations] [-d drops per flow] [-s shard size]
+ *                        [-c requests in flight]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io_services.h"
+
+
+/***********************************************************************
+ * The flows and drops
+ ***********************************************************************/
+
+#define MAX_FLOWS 1000
+
+static const int flow_counts[] = { 10, 100, 1000 };
+
+static char flow_ids[MAX_FLOWS][FLOWTHINGS_IO_ID_LEN];
+
+static BOOL encode_num(void *obj_in, cJSON *json_out)
+{
+	cJSON *cjo = cJSON_CreateObject();
+	cJSON_AddNumberToObject(cjo, "num", *(int *)obj_in);
+	cJSON_AddItemToObject(json_out, "elems", cjo);
+
+	return TRUE;
+}
+
+/* find results are written with a pointer-sized stride, so only keep the number */
+static BOOL decode_num(cJSON *json_in, void *obj_out)
+{
+	cJSON *num = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(json_in, "elems"), "num"), "value");
+
+	if (!num)
+		return FALSE;
+
+	*(int *)obj_out = num->valueint;
+	return TRUE;
+}
+
+static BOOL encode_flow(void *obj_in, cJSON *json_out)
+{
+	cJSON_AddStringToObject(json_out, "path", (const char *)obj_in);
+	return TRUE;
+}
+
+static BOOL decode_flow(cJSON *json_in, void *obj_out)
+{
+	cJSON *id = cJSON_GetObjectItem(json_in, "id");
+
+	if (!id)
+		return FALSE;
+
+	snprintf((char *)obj_out, FLOWTHINGS_IO_ID_LEN, "%s", id->valuestring);
+	return TRUE;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/***********************************************************************
+ * Main
+ ***********************************************************************/
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-h host] [-n iterations] [-d drops per flow] [-s shard size]\n"
+			"       [-c requests in flight]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *host = "127.0.0.1:8080";
+	flowthings_io_token creds = { "myaccountname", "mytoken" };
+	int iterations = 20, drops_per_flow = 5, shard_size = 0, in_flight = 0;
+	flowthings_io_api *api;
+	flowthings_io_idlist *idlist;
+	flowthings_io_params *params;
+	flowthings_io_result_code code;
+	void **results, **objects;
+	int *nums, opt, i, j, k, n, count, sharded_count;
+	char value[16];
+	double start, single, sharded;
+
+	while ((opt = getopt(argc, argv, "h:n:d:s:c:")) != -1) {
+		switch (opt) {
+		case 'h': host = optarg; break;
+		case 'n': iterations = atoi(optarg); break;
+		case 'd': drops_per_flow = atoi(optarg); break;
+		case 's': shard_size = atoi(optarg); break;
+		case 'c': in_flight = atoi(optarg); break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (iterations < 1 || drops_per_flow < 1)
+		usage(argv[0]);
+
+	api = flowthings_io_api_init(FLOWTHINGS_IO_VERSION, host, FALSE, &creds);
+	flowthings_io_api_set_json_arena(api, TRUE);
+
+	nums = malloc(sizeof(int) * drops_per_flow);
+	objects = malloc(sizeof(void *) * drops_per_flow);
+	results = malloc(sizeof(void *) * MAX_FLOWS * drops_per_flow);
+	if (!nums || !objects || !results) FAIL;
+
+	for (j = 0; j < drops_per_flow; j++) {
+		nums[j] = j;
+		objects[j] = &nums[j];
+	}
+
+	/* the flows, each with a few drops; decode_flow writes the ID over the path */
+	for (i = 0; i < MAX_FLOWS; i++) {
+		snprintf(flow_ids[i], FLOWTHINGS_IO_ID_LEN, "/%s/find_many_bench/%d", creds.account, i);
+
+		if (flowthings_io_flow_create(api, NULL, encode_flow, decode_flow, flow_ids[i]) != FLOWTHINGS_IO_OK
+				|| flowthings_io_drop_create_batch(flow_ids[i], api, NULL, encode_num, NULL,
+						objects, drops_per_flow, NULL) != FLOWTHINGS_IO_OK) {
+			fprintf(stderr, "couldn't create flows on %s\n", host);
+			return 1;
+		}
+	}
+
+	printf("%s: %d drops per flow, shards of %d, %d in flight\n", host, drops_per_flow,
+			shard_size ? shard_size : FLOWTHINGS_IO_FIND_MANY_SHARD_SIZE,
+			in_flight ? in_flight : FLOWTHINGS_IO_FIND_MANY_MAX_IN_FLIGHT);
+	printf("%8s %16s %16s %10s\n", "flows", "single calls/s", "sharded calls/s", "speedup");
+
+	snprintf(value, sizeof(value), "%d", drops_per_flow);
+
+	for (k = 0; k < (int)(sizeof(flow_counts) / sizeof(flow_counts[0])); k++) {
+
+		n = flow_counts[k];
+		idlist = flowthings_io_idlist_init();
+
+		for (i = 0; i < n; i++) {
+			params = flowthings_io_params_init();
+			flowthings_io_params_add(params, "limit", value);
+			flowthings_io_idlist_add(idlist, flow_ids[i], params);
+		}
+
+		count = sharded_count = 0;
+
+		start = now();
+		for (i = 0; i < iterations; i++) {
+			count = n * drops_per_flow;
+			code = flowthings_io_drop_find_many(api, decode_num, idlist, results, &count);
+			if (code != FLOWTHINGS_IO_OK)
+				fprintf(stderr, "find_many failed: %d\n", code);
+		}
+		single = now() - start;
+
+		start = now();
+		for (i = 0; i < iterations; i++) {
+			sharded_count = n * drops_per_flow;
+			code = flowthings_io_drop_find_many_sharded(api, decode_num, idlist, shard_size, in_flight,
+					results, &sharded_count, NULL);
+			if (code != FLOWTHINGS_IO_OK)
+				fprintf(stderr, "find_many_sharded failed: %d\n", code);
+		}
+		sharded = now() - start;
+
+		if (count != sharded_count)
+			fprintf(stderr, "%d flows: find_many found %d drops, find_many_sharded %d\n", n, count,
+					sharded_count);
+
+		printf("%8d %16.1f %16.1f %9.2fx\n", n, iterations / single, iterations / sharded,
+				single / sharded);
+
+		for (flowthings_io_idlistitem *item = idlist->start; item; item = item->next)
+			flowthings_io_params_cleanup((flowthings_io_params *)item->item);
+		flowthings_io_idlist_cleanup(idlist);
+	}
+
+	free(nums);
+	free(objects);
+	free(results);
+	flowthings_io_api_cleanup(api);
+
+	return 0;
+}
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,506 @@
+/*
+ * load_gen.c
+ *
+ * An end-to-end load generator: drives the drop service functions against a flowthings.io server
+ * (normally bench/mock_server) and reports the throughput and latency percentiles.
+ *
+ * usage: load_gen [-h host] [-c concurrency] [-a] [-t seconds | -n ops] [-s payload bytes]
+ *                 [-o read|create|update|find|mixed] [-f drops per find] [-S]
+ *
+ * -c sets the number of threads making synchronous calls, or with -a, the number of asynchronous
+ * calls kept in flight from a single thread.  -S turns on stream decoding.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io_services.h"
+
+
+/***********************************************************************
+ * The drops
+ ***********************************************************************/
+
+#define SEED_DROPS 100
+
+typedef enum op_type {
+	OP_READ,
+	OP_CREATE,
+	OP_UPDATE,
+	OP_FIND,
+	OP_COUNT
+} op_type;
+
+static const char *op_names[OP_COUNT] = { "read", "create", "update", "find" };
+
+struct my_drop {
+	char id[FLOWTHINGS_IO_ID_LEN];
+	int num;
+	char *label;
+	size_t label_size;
+};
+
+static BOOL decode_my_drop(cJSON *json_in, void *obj_out)
+{
+	struct my_drop *md = (struct my_drop *)obj_out;
+	cJSON *id = cJSON_GetObjectItem(json_in, "id");
+	cJSON *elems = cJSON_GetObjectItem(json_in, "elems");
+	cJSON *num = cJSON_GetObjectItem(cJSON_GetObjectItem(elems, "num"), "value");
+	cJSON *label = cJSON_GetObjectItem(cJSON_GetObjectItem(elems, "label"), "value");
+
+	if (!id || !num)
+		return FALSE;
+
+	snprintf(md->id, sizeof(md->id), "%s", id->valuestring);
+	md->num = num->valueint;
+
+	if (label && label->valuestring && md->label)
+		snprintf(md->label, md->label_size, "%s", label->valuestring);
+
+	return TRUE;
+}
+
+static BOOL encode_my_drop(void *obj_in, cJSON *json_out)
+{
+	struct my_drop *md = (struct my_drop *)obj_in;
+
+	cJSON *cjo = cJSON_CreateObject();
+	cJSON_AddNumberToObject(cjo, "num", md->num);
+	cJSON_AddStringToObject(cjo, "label", md->label);
+	cJSON_AddItemToObject(json_out, "elems", cjo);
+
+	return TRUE;
+}
+
+/* find results are written with a pointer-sized stride, so only keep the number */
+static BOOL decode_num(cJSON *json_in, void *obj_out)
+{
+	cJSON *num = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(json_in, "elems"), "num"), "value");
+
+	if (!num)
+		return FALSE;
+
+	*(int *)obj_out = num->valueint;
+	return TRUE;
+}
+
+static BOOL encode_flow(void *obj_in, cJSON *json_out)
+{
+	cJSON_AddStringToObject(json_out, "path", (const char *)obj_in);
+	return TRUE;
+}
+
+static BOOL decode_flow(cJSON *json_in, void *obj_out)
+{
+	cJSON *id = cJSON_GetObjectItem(json_in, "id");
+
+	if (!id)
+		return FALSE;
+
+	snprintf((char *)obj_out, FLOWTHINGS_IO_ID_LEN, "%s", id->valuestring);
+	return TRUE;
+}
+
+
+/***********************************************************************
+ * Settings and results
+ ***********************************************************************/
+
+static flowthings_io_api *api;
+static char flow_id[FLOWTHINGS_IO_ID_LEN];
+static char seed_ids[SEED_DROPS][FLOWTHINGS_IO_ID_LEN];
+static int concurrency = 4, payload_size = 100, find_size = 10, mix = -1;
+static long total_ops;
+static double duration = 5, deadline;
+static long issued;
+
+struct sample {
+	float us;
+	unsigned char op;
+};
+
+struct samples {
+	struct sample *s;
+	size_t count, capacity;
+	long errors[OP_COUNT];
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* returns FALSE once the run is over */
+static BOOL next_op(unsigned int *seed, op_type *op)
+{
+	int r;
+
+	if (total_ops ? __sync_fetch_and_add(&issued, 1) >= total_ops : now() >= deadline)
+		return FALSE;
+
+	if (mix >= 0) {
+		*op = (op_type)mix;
+		return TRUE;
+	}
+
+	/* mixed: 60% reads, 20% creates, 10% updates and 10% finds */
+	r = rand_r(seed) % 10;
+	*op = r < 6 ? OP_READ : r < 8 ? OP_CREATE : r < 9 ? OP_UPDATE : OP_FIND;
+
+	return TRUE;
+}
+
+static void record(struct samples *samples, op_type op, double start, flowthings_io_result_code code)
+{
+	if (code != FLOWTHINGS_IO_OK) {
+		samples->errors[op]++;
+		return;
+	}
+
+	if (samples->count == samples->capacity) {
+		samples->capacity = samples->capacity ? samples->capacity * 2 : 65536;
+		samples->s = realloc(samples->s, samples->capacity * sizeof(struct sample));
+		if (!samples->s) FAIL;
+	}
+
+	samples->s[samples->count].us = (float)((now() - start) * 1e6);
+	samples->s[samples->count].op = op;
+	samples->count++;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+	float x = ((const struct sample *)a)->us, y = ((const struct sample *)b)->us;
+	return x < y ? -1 : x > y;
+}
+
+static void report_row(const char *name, struct samples *all, int op, long errors, double elapsed)
+{
+	float *us = malloc(sizeof(float) * (all->count + 1));
+	size_t i, n = 0;
+
+	for (i = 0; i < all->count; i++)
+		if (op < 0 || all->s[i].op == op)
+			us[n++] = all->s[i].us;
+
+	if (n == 0 && errors == 0) {
+		free(us);
+		return;
+	}
+
+	/* the samples are already sorted */
+	printf("%-8s %10zu %8ld %12.0f", name, n, errors, n / elapsed);
+	if (n > 0)
+		printf(" %10.3f %10.3f %10.3f %10.3f", us[n / 2] / 1000, us[(size_t)(n * 0.99)] / 1000,
+				us[(size_t)(n * 0.999)] / 1000, us[n - 1] / 1000);
+	printf("\n");
+
+	free(us);
+}
+
+static void report(struct samples *all, double elapsed)
+{
+	long errors = 0;
+	int op;
+
+	qsort(all->s, all->count, sizeof(struct sample), compare_samples);
+
+	printf("%-8s %10s %8s %12s %10s %10s %10s %10s\n", "op", "count", "errors", "ops/sec",
+			"p50 ms", "p99 ms", "p99.9 ms", "max ms");
+
+	for (op = 0; op < OP_COUNT; op++) {
+		report_row(op_names[op], all, op, all->errors[op], elapsed);
+		errors += all->errors[op];
+	}
+
+	report_row("all", all, -1, errors, elapsed);
+}
+
+
+/***********************************************************************
+ * Synchronous workers
+ ***********************************************************************/
+
+struct worker {
+	pthread_t thread;
+	unsigned int seed;
+	struct samples samples;
+};
+
+static flowthings_io_result_code run_op(op_type op, struct my_drop *drop, void **found,
+		flowthings_io_params *find_params, unsigned int *seed)
+{
+	int count = find_size;
+
+	switch (op) {
+	case OP_READ:
+		return flowthings_io_drop_read(flow_id, api, seed_ids[rand_r(seed) % SEED_DROPS], NULL,
+				decode_my_drop, drop);
+	case OP_CREATE:
+		return flowthings_io_drop_create(flow_id, api, NULL, encode_my_drop, decode_my_drop, drop);
+	case OP_UPDATE:
+		return flowthings_io_drop_update(flow_id, api, seed_ids[rand_r(seed) % SEED_DROPS], NULL,
+				encode_my_drop, decode_my_drop, drop);
+	default:
+		return flowthings_io_drop_find(flow_id, api, NULL, find_params, decode_num, found, &count);
+	}
+}
+
+static void init_drop(struct my_drop *drop, int num)
+{
+	memset(drop, 0, sizeof(struct my_drop));
+	drop->num = num;
+	drop->label_size = payload_size + 1;
+	drop->label = malloc(drop->label_size);
+	if (!drop->label) FAIL;
+	memset(drop->label, 'x', payload_size);
+	drop->label[payload_size] = '\0';
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker *w = (struct worker *)arg;
+	flowthings_io_params *find_params = flowthings_io_params_init();
+	void **found = calloc(find_size + 1, sizeof(void *));
+	struct my_drop drop;
+	flowthings_io_result_code code;
+	double start;
+	op_type op;
+	char limit[16];
+
+	snprintf(limit, sizeof(limit), "%d", find_size);
+	flowthings_io_params_add(find_params, "limit", limit);
+	init_drop(&drop, 7);
+
+	while (next_op(&w->seed, &op)) {
+		start = now();
+		code = run_op(op, &drop, found, find_params, &w->seed);
+		record(&w->samples, op, start, code);
+	}
+
+	free(drop.label);
+	free(found);
+	flowthings_io_params_cleanup(find_params);
+
+	return NULL;
+}
+
+
+/***********************************************************************
+ * Asynchronous calls
+ ***********************************************************************/
+
+struct slot {
+	struct my_drop drop;
+	void **found;
+	int count;
+	op_type op;
+	double start;
+};
+
+static struct samples async_samples;
+static flowthings_io_params *async_find_params;
+static unsigned int async_seed = 1;
+
+static void async_complete(flowthings_io_op *op, flowthings_io_result_code code, void *user_data);
+
+static void async_start(struct slot *slot)
+{
+	if (!next_op(&async_seed, &slot->op))
+		return;
+
+	slot->start = now();
+	slot->count = find_size;
+
+	switch (slot->op) {
+	case OP_READ:
+		flowthings_io_drop_read_async(flow_id, api, seed_ids[rand_r(&async_seed) % SEED_DROPS], NULL,
+				decode_my_drop, &slot->drop, async_complete, slot);
+		break;
+	case OP_CREATE:
+		flowthings_io_drop_create_async(flow_id, api, NULL, encode_my_drop, decode_my_drop,
+				&slot->drop, async_complete, slot);
+		break;
+	case OP_UPDATE:
+		flowthings_io_drop_update_async(flow_id, api, seed_ids[rand_r(&async_seed) % SEED_DROPS], NULL,
+				encode_my_drop, decode_my_drop, &slot->drop, async_complete, slot);
+		break;
+	default:
+		flowthings_io_drop_find_async(flow_id, api, NULL, async_find_params, decode_num,
+				slot->found, &slot->count, async_complete, slot);
+		break;
+	}
+}
+
+static void async_complete(flowthings_io_op *op, flowthings_io_result_code code, void *user_data)
+{
+	struct slot *slot = (struct slot *)user_data;
+
+	record(&async_samples, slot->op, slot->start, code);
+	flowthings_io_op_cleanup(op);
+
+	async_start(slot);
+}
+
+static void run_async(void)
+{
+	struct slot *slots = calloc(concurrency, sizeof(struct slot));
+	char limit[16];
+	int i;
+
+	if (!slots) FAIL;
+
+	snprintf(limit, sizeof(limit), "%d", find_size);
+	async_find_params = flowthings_io_params_init();
+	flowthings_io_params_add(async_find_params, "limit", limit);
+
+	for (i = 0; i < concurrency; i++) {
+		init_drop(&slots[i].drop, 7);
+		slots[i].found = calloc(find_size + 1, sizeof(void *));
+		async_start(&slots[i]);
+	}
+
+	flowthings_io_api_run(api);
+
+	for (i = 0; i < concurrency; i++) {
+		free(slots[i].drop.label);
+		free(slots[i].found);
+	}
+	free(slots);
+	flowthings_io_params_cleanup(async_find_params);
+}
+
+
+/***********************************************************************
+ * Main
+ ***********************************************************************/
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-h host] [-c concurrency] [-a] [-t seconds | -n ops] [-s payload bytes]\n"
+			"       [-o read|create|update|find|mixed] [-f drops per find] [-S]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *host = "127.0.0.1:8080";
+	flowthings_io_token creds = { "myaccountname", "mytoken" };
+	struct samples all;
+	struct worker *workers;
+	struct my_drop drop;
+	BOOL async = FALSE, stream_decode = FALSE;
+	double start, elapsed;
+	int opt, i, op;
+
+	while ((opt = getopt(argc, argv, "h:c:at:n:s:o:f:S")) != -1) {
+		switch (opt) {
+		case 'h': host = optarg; break;
+		case 'c': concurrency = atoi(optarg); break;
+		case 'a': async = TRUE; break;
+		case 't': duration = atof(optarg); break;
+		case 'n': total_ops = atol(optarg); break;
+		case 's': payload_size = atoi(optarg); break;
+		case 'f': find_size = atoi(optarg); break;
+		case 'S': stream_decode = TRUE; break;
+		case 'o':
+			for (mix = -1, op = 0; op < OP_COUNT; op++)
+				if (!strcmp(optarg, op_names[op]))
+					mix = op;
+			if (mix < 0 && strcmp(optarg, "mixed"))
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (concurrency < 1 || payload_size < 0 || find_size < 1)
+		usage(argv[0]);
+
+	api = flowthings_io_api_init(FLOWTHINGS_IO_VERSION, host, FALSE, &creds);
+	flowthings_io_api_set_stream_decode(api, stream_decode);
+	flowthings_io_api_set_json_arena(api, TRUE);
+
+	/* a flow to work in, with some drops to read and update; decode_flow writes the ID over the path */
+	snprintf(flow_id, sizeof(flow_id), "/%s/load_gen", creds.account);
+	if (flowthings_io_flow_create(api, NULL, encode_flow, decode_flow, flow_id) != FLOWTHINGS_IO_OK) {
+		fprintf(stderr, "couldn't create a flow on %s\n", host);
+		return 1;
+	}
+
+	init_drop(&drop, 0);
+	for (i = 0; i < SEED_DROPS; i++) {
+		drop.num = i;
+		if (flowthings_io_drop_create(flow_id, api, NULL, encode_my_drop, decode_my_drop, &drop)
+				!= FLOWTHINGS_IO_OK) {
+			fprintf(stderr, "couldn't create drops on %s\n", host);
+			return 1;
+		}
+		memcpy(seed_ids[i], drop.id, FLOWTHINGS_IO_ID_LEN);
+	}
+	free(drop.label);
+
+	printf("%s: %d %s, %d byte payloads, %s%s\n", host, concurrency,
+			async ? "calls in flight" : "threads", payload_size, mix < 0 ? "mixed" : op_names[mix],
+			stream_decode ? ", stream decoding" : "");
+
+	memset(&all, 0, sizeof(all));
+	start = now();
+	deadline = start + duration;
+
+	if (async) {
+		run_async();
+		all = async_samples;
+	}
+	else {
+		workers = calloc(concurrency, sizeof(struct worker));
+		if (!workers) FAIL;
+
+		for (i = 0; i < concurrency; i++) {
+			workers[i].seed = i + 1;
+			pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+		}
+
+		for (i = 0; i < concurrency; i++) {
+			pthread_join(workers[i].thread, NULL);
+
+			all.s = realloc(all.s, (all.count + workers[i].samples.count + 1) * sizeof(struct sample));
+			if (!all.s) FAIL;
+			memcpy(all.s + all.count, workers[i].samples.s, workers[i].samples.count * sizeof(struct sample));
+			all.count += workers[i].samples.count;
+			for (op = 0; op < OP_COUNT; op++)
+				all.errors[op] += workers[i].samples.errors[op];
+			free(workers[i].samples.s);
+		}
+
+		free(workers);
+	}
+
+	elapsed = now() - start;
+	printf("%.2f seconds\n", elapsed);
+	report(&all, elapsed);
+
+	free(all.s);
+	flowthings_io_api_cleanup(api);
+
+	return 0;
+}
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,711 @@
+/*
+ * mock_server.c
+ *
+ * A local stand-in for the flowthings.io REST API, for benchmarks and offline testing.  It keeps
+ * flows, drops and any other service's objects in memory and implements the calls the service
+ * functions make:
+ *
+ *   GET    /vVERSION/ACCOUNT/SERVICE/ID          read an object
+ *   GET    /vVERSION/ACCOUNT/SERVICE             list objects (start, limit)
+ *   POST   /vVERSION/ACCOUNT/SERVICE             create an object, or each object in an array
+ *   PUT    /vVERSION/ACCOUNT/SERVICE/ID          update an object
+ *   DELETE /vVERSION/ACCOUNT/SERVICE/ID          delete an object
+ *   MGET   /vVERSION/ACCOUNT/drop                list drops from several flows (flatten=flat)
+ *
+ * Drops live under their flow, e.g. /v0.1/myaccountname/drop/FLOW_ID/DROP_ID, and drop elems are
+ * given types the way the platform does.  Filters are accepted but not evaluated, and the
+ * credentials aren't checked.
+ *
+ * usage: mock_server [-p port] [-d delay in microseconds] [-m MGET delay per flow in microseconds]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "cJSON.h"
+#include "flowthings_io.h"
+
+
+/***********************************************************************
+ * The object store
+ ***********************************************************************/
+
+#define STORE_BUCKETS 65536
+#define STORE_KEY_SIZE 160
+#define DEFAULT_LIMIT 20
+
+/* a set of objects listed together: all flows, or all drops in one flow */
+typedef struct collection {
+	char key[STORE_KEY_SIZE];
+	struct entry *first, *last;
+	int count;
+	struct collection *hnext;
+} collection;
+
+typedef struct entry {
+	char key[STORE_KEY_SIZE];
+	char id[FLOWTHINGS_IO_ID_LEN];
+	char *json;
+	collection *coll;
+	struct entry *prev, *next;
+	struct entry *hnext;
+} entry;
+
+static entry *entries[STORE_BUCKETS];
+static collection *collections[STORE_BUCKETS];
+static pthread_rwlock_t store_lock = PTHREAD_RWLOCK_INITIALIZER;
+static unsigned long next_id;
+static int delay_us, mget_delay_us;
+
+static unsigned int hash(const char *s)
+{
+	unsigned int h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+
+	return h % STORE_BUCKETS;
+}
+
+static entry *entry_find(const char *key)
+{
+	entry *e;
+
+	for (e = entries[hash(key)]; e; e = e->hnext)
+		if (!strcmp(e->key, key))
+			return e;
+
+	return NULL;
+}
+
+static collection *collection_find(const char *key, BOOL create)
+{
+	unsigned int h = hash(key);
+	collection *c;
+
+	for (c = collections[h]; c; c = c->hnext)
+		if (!strcmp(c->key, key))
+			return c;
+
+	if (!create)
+		return NULL;
+
+	c = calloc(1, sizeof(collection));
+	if (!c) FAIL;
+
+	snprintf(c->key, sizeof(c->key), "%s", key);
+	c->hnext = collections[h];
+	collections[h] = c;
+
+	return c;
+}
+
+static void entry_add(collection *c, const char *id, char *json)
+{
+	entry *e = calloc(1, sizeof(entry));
+	unsigned int h;
+
+	if (!e) FAIL;
+
+	/* handle makes sure these fit */
+	if ((size_t)snprintf(e->key, sizeof(e->key), "%s/%s", c->key, id) >= sizeof(e->key)
+			|| (size_t)snprintf(e->id, sizeof(e->id), "%s", id) >= sizeof(e->id))
+		FAIL;
+	e->json = json;
+	e->coll = c;
+
+	h = hash(e->key);
+	e->hnext = entries[h];
+	entries[h] = e;
+
+	e->prev = c->last;
+	if (c->last)
+		c->last->next = e;
+	else
+		c->first = e;
+	c->last = e;
+	c->count++;
+}
+
+static void entry_remove(entry *e)
+{
+	entry **x;
+
+	for (x = &entries[hash(e->key)]; *x; x = &(*x)->hnext) {
+		if (*x == e) {
+			*x = e->hnext;
+			break;
+		}
+	}
+
+	if (e->prev) e->prev->next = e->next;
+	else e->coll->first = e->next;
+	if (e->next) e->next->prev = e->prev;
+	else e->coll->last = e->prev;
+	e->coll->count--;
+
+	free(e->json);
+	free(e);
+}
+
+
+/***********************************************************************
+ * Request handling
+ ***********************************************************************/
+
+/*
+ * Give untyped drop elems a type and value, e.g. "num": 7 becomes
+ * "num": {"type": "integer", "value": 7}.
+ */
+static void type_elems(cJSON *obj)
+{
+	cJSON *elems = cJSON_GetObjectItem(obj, "elems"), *elem, *typed, *next;
+	const char *type;
+
+	if (!elems || elems->type != cJSON_Object)
+		return;
+
+	for (elem = elems->child; elem; elem = next) {
+
+		next = elem->next;
+
+		if (elem->type == cJSON_Object && cJSON_GetObjectItem(elem, "type") && cJSON_GetObjectItem(elem, "value"))
+			continue;
+
+		switch (elem->type) {
+		case cJSON_Number: type = elem->valuedouble == (double)elem->valueint ? "integer" : "float"; break;
+		case cJSON_String: type = "string"; break;
+		case cJSON_True:
+		case cJSON_False: type = "boolean"; break;
+		case cJSON_Array: type = "list"; break;
+		case cJSON_Object: type = "map"; break;
+		default: type = "null"; break;
+		}
+
+		typed = cJSON_CreateObject();
+		cJSON_AddStringToObject(typed, "type", type);
+		cJSON_AddItemToObject(typed, "value", cJSON_Duplicate(elem, 1));
+		cJSON_ReplaceItemInObject(elems, elem->string, typed);
+	}
+}
+
+static int query_int(const char *query, const char *name, int def)
+{
+	size_t len = strlen(name);
+	const char *p = query;
+
+	while (p && *p) {
+		if (!strncmp(p, name, len) && p[len] == '=')
+			return atoi(p + len + 1);
+		p = strchr(p, '&');
+		if (p) p++;
+	}
+
+	return def;
+}
+
+/* params may be sent as numbers or as strings */
+static int json_int(cJSON *item, int def)
+{
+	if (!item)
+		return def;
+
+	return item->type == cJSON_String ? atoi(item->valuestring) : item->valueint;
+}
+
+/* appends the objects in a collection to out as JSON array elements */
+static int list_collection(flowthings_io_string *out, collection *c, int start, int limit, int written)
+{
+	entry *e;
+
+	for (e = c ? c->first : NULL; e && start > 0; e = e->next)
+		start--;
+
+	for (; e && limit > 0; e = e->next, limit--) {
+		if (written++)
+			flowthings_io_string_append(out, ",", 1);
+		flowthings_io_string_strcat(out, e->json);
+	}
+
+	return written;
+}
+
+/* the body of an MGET: [{"flowId": "...", "params": {...}}, ...] */
+static int handle_mget(const char *query, const char *data, flowthings_io_string *out, int *flows)
+{
+	cJSON *root = cJSON_Parse(data ? data : ""), *item, *params, *flow_id, *start, *limit;
+	BOOL flat = query && strstr(query, "flatten=flat") != NULL;
+	char key[STORE_KEY_SIZE];
+	int written = 0, per_flow;
+
+	if (!root || root->type != cJSON_Array) {
+		cJSON_Delete(root);
+		return 400;
+	}
+
+	flowthings_io_string_strcat(out, flat ? "[" : "{");
+
+	for (item = root->child; item; item = item->next) {
+
+		flow_id = cJSON_GetObjectItem(item, "flowId");
+		params = cJSON_GetObjectItem(item, "params");
+		start = params ? cJSON_GetObjectItem(params, "start") : NULL;
+		limit = params ? cJSON_GetObjectItem(params, "limit") : NULL;
+
+		if (!flow_id || flow_id->type != cJSON_String)
+			continue;
+
+		(*flows)++;
+
+		/* a flow ID too long for a key can't have any drops */
+		if (snprintf(key, sizeof(key), "drop/%s", flow_id->valuestring) >= (int)sizeof(key))
+			key[0] = '\0';
+
+		if (!flat) {
+			if (written++)
+				flowthings_io_string_append(out, ",", 1);
+			flowthings_io_string_strcat(out, "\"");
+			flowthings_io_string_strcat(out, flow_id->valuestring);
+			flowthings_io_string_strcat(out, "\":[");
+			per_flow = 0;
+		}
+		else {
+			per_flow = written;
+		}
+
+		per_flow = list_collection(out, collection_find(key, FALSE), json_int(start, 0),
+				json_int(limit, DEFAULT_LIMIT), per_flow);
+
+		if (flat)
+			written = per_flow;
+		else
+			flowthings_io_string_strcat(out, "]");
+	}
+
+	flowthings_io_string_strcat(out, flat ? "]" : "}");
+	cJSON_Delete(root);
+
+	return 200;
+}
+
+/* IDs start with the service's first letter, like the platform's */
+static void new_object_id(char *id, char **parts)
+{
+	snprintf(id, FLOWTHINGS_IO_ID_LEN, "%c%024lx", parts[2][0], __sync_add_and_fetch(&next_id, 1));
+}
+
+/* sets the fields the platform fills in, frees obj and returns the JSON to store */
+static char *prepare_object(cJSON *obj, char **parts, const char *id)
+{
+	char *json;
+
+	cJSON_DeleteItemFromObject(obj, "id");
+	cJSON_AddStringToObject(obj, "id", id);
+
+	if (!strcmp(parts[2], "drop")) {
+		cJSON_DeleteItemFromObject(obj, "flowId");
+		cJSON_AddStringToObject(obj, "flowId", parts[3]);
+		if (!cJSON_GetObjectItem(obj, "creationDate"))
+			cJSON_AddNumberToObject(obj, "creationDate", 1432139871000.0);
+		type_elems(obj);
+	}
+
+	json = cJSON_PrintUnformatted(obj);
+	cJSON_Delete(obj);
+
+	return json;
+}
+
+/* a POST of an array creates each object, and answers with a head and body for each one */
+static int handle_batch(cJSON *root, char **parts, const char *coll_key, flowthings_io_string *out)
+{
+	char id[FLOWTHINGS_IO_ID_LEN], *json;
+	cJSON *item, *next;
+	collection *c;
+	int i = 0, skipped = 0;
+
+	flowthings_io_string_strcat(out, "[");
+
+	pthread_rwlock_wrlock(&store_lock);
+	c = collection_find(coll_key, TRUE);
+
+	/* created objects are detached from the array, so the skipped ones stay at the front */
+	for (item = root->child; item; item = next, i++) {
+
+		next = item->next;
+
+		if (i > 0)
+			flowthings_io_string_strcat(out, ",");
+
+		if (item->type != cJSON_Object) {
+			skipped++;
+			flowthings_io_string_strcat(out, "{\"head\":{\"status\":400,\"errors\":[\"not an object\"],\"messages\":[]},\"body\":null}");
+			continue;
+		}
+
+		new_object_id(id, parts);
+		json = prepare_object(cJSON_DetachItemFromArray(root, skipped), parts, id);
+		entry_add(c, id, json);
+
+		flowthings_io_string_strcat(out, "{\"head\":{\"status\":200,\"errors\":[],\"messages\":[]},\"body\":");
+		flowthings_io_string_strcat(out, json);
+		flowthings_io_string_strcat(out, "}");
+	}
+
+	pthread_rwlock_unlock(&store_lock);
+	flowthings_io_string_strcat(out, "]");
+	cJSON_Delete(root);
+
+	return 200;
+}
+
+/*
+ * Handles one request, filling out with the response body.  Returns the status code.
+ */
+static int handle(const char *method, char *target, const char *data, flowthings_io_string *out)
+{
+	char *query, *parts[6], *p, *id = NULL;
+	char coll_key[STORE_KEY_SIZE], key[STORE_KEY_SIZE], new_id[FLOWTHINGS_IO_ID_LEN];
+	int nparts = 0, code = 200, n;
+	entry *e;
+	cJSON *obj;
+
+	if ((query = strchr(target, '?')) != NULL)
+		*query++ = '\0';
+
+	/* /vVERSION/ACCOUNT/SERVICE[/FLOW_ID][/ID] */
+	for (p = strtok(target, "/"); p && nparts < 6; p = strtok(NULL, "/"))
+		parts[nparts++] = p;
+
+	if (nparts < 3 || parts[0][0] != 'v')
+		return 404;
+
+	if (!strcmp(parts[2], "drop") && nparts >= 4) {
+		n = snprintf(coll_key, sizeof(coll_key), "drop/%s", parts[3]);
+		if (nparts >= 5) id = parts[4];
+	}
+	else {
+		n = snprintf(coll_key, sizeof(coll_key), "%s", parts[2]);
+		if (nparts >= 4) id = parts[3];
+	}
+
+	/* a cut key could name another object, so refuse paths that don't fit; created objects get
+	 * an ID of up to FLOWTHINGS_IO_ID_LEN - 1 characters, which entry_add appends to coll_key */
+	if (n + FLOWTHINGS_IO_ID_LEN >= (int)sizeof(coll_key))
+		return 414;
+
+	if (id && (strlen(id) >= FLOWTHINGS_IO_ID_LEN
+			|| snprintf(key, sizeof(key), "%s/%s", coll_key, id) >= (int)sizeof(key)))
+		return 414;
+
+	if (!strcmp(method, "GET")) {
+
+		pthread_rwlock_rdlock(&store_lock);
+		if (id) {
+			if ((e = entry_find(key)) != NULL)
+				flowthings_io_string_strcat(out, e->json);
+			else
+				code = 404;
+		}
+		else {
+			flowthings_io_string_strcat(out, "[");
+			list_collection(out, collection_find(coll_key, FALSE), query_int(query, "start", 0),
+					query_int(query, "limit", DEFAULT_LIMIT), 0);
+			flowthings_io_string_strcat(out, "]");
+		}
+		pthread_rwlock_unlock(&store_lock);
+	}
+	else if (!strcmp(method, "MGET")) {
+
+		int flows = 0;
+
+		pthread_rwlock_rdlock(&store_lock);
+		code = handle_mget(query, data, out, &flows);
+		pthread_rwlock_unlock(&store_lock);
+
+		/* the platform's time to look up each flow */
+		if (mget_delay_us)
+			usleep(mget_delay_us * flows);
+	}
+	else if (!strcmp(method, "POST") || !strcmp(method, "PUT")) {
+
+		BOOL create = method[1] == 'O';
+		char *json;
+
+		if ((create && id) || (!create && !id))
+			return 400;
+
+		obj = cJSON_Parse(data ? data : "");
+
+		if (create && obj && obj->type == cJSON_Array)
+			return handle_batch(obj, parts, coll_key, out);
+
+		if (!obj || obj->type != cJSON_Object) {
+			cJSON_Delete(obj);
+			return 400;
+		}
+
+		if (create) {
+			new_object_id(new_id, parts);
+			id = new_id;
+		}
+
+		json = prepare_object(obj, parts, id);
+
+		pthread_rwlock_wrlock(&store_lock);
+		if (create) {
+			entry_add(collection_find(coll_key, TRUE), id, json);
+		}
+		else if ((e = entry_find(key)) != NULL) {
+			free(e->json);
+			e->json = json;
+		}
+		else {
+			free(json);
+			json = NULL;
+			code = 404;
+		}
+		if (json)
+			flowthings_io_string_strcat(out, json);
+		pthread_rwlock_unlock(&store_lock);
+	}
+	else if (!strcmp(method, "DELETE")) {
+
+		if (!id)
+			return 400;
+
+		pthread_rwlock_wrlock(&store_lock);
+		if ((e = entry_find(key)) != NULL) {
+			entry_remove(e);
+			flowthings_io_string_strcat(out, "{}");
+		}
+		else {
+			code = 404;
+		}
+		pthread_rwlock_unlock(&store_lock);
+	}
+	else {
+		code = 405;
+	}
+
+	return code;
+}
+
+
+/***********************************************************************
+ * HTTP
+ ***********************************************************************/
+
+static BOOL write_all(int fd, const char *data, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, data, len)) <= 0)
+			return FALSE;
+		data += n;
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+/* reads a body sent with chunked transfer encoding, which starts at in->ptr + at, into body */
+static BOOL read_chunked(int fd, flowthings_io_string *in, size_t at, flowthings_io_string *body,
+		size_t *consumed)
+{
+	char buf[16384], *line_end;
+	size_t size;
+	ssize_t n;
+
+	for (;;) {
+
+		/* the chunk size line, then the chunk and its CRLF */
+		while (!(line_end = strstr(in->ptr + at, "\r\n"))) {
+			if ((n = read(fd, buf, sizeof(buf))) <= 0)
+				return FALSE;
+			flowthings_io_string_append(in, buf, n);
+		}
+
+		size = strtoul(in->ptr + at, NULL, 16);
+		at = line_end + 2 - in->ptr;
+
+		while (in->len < at + size + 2) {
+			if ((n = read(fd, buf, sizeof(buf))) <= 0)
+				return FALSE;
+			flowthings_io_string_append(in, buf, n);
+		}
+
+		flowthings_io_string_append(body, in->ptr + at, size);
+		at += size + 2;
+
+		if (size == 0) {
+			*consumed = at;
+			return TRUE;
+		}
+	}
+}
+
+static void *serve_connection(void *arg)
+{
+	int fd = (int)(long)arg;
+	flowthings_io_string *in = flowthings_io_string_init();
+	flowthings_io_string *body = flowthings_io_string_init();
+	flowthings_io_string *out = flowthings_io_string_init();
+	char buf[16384], method[16], target[2048], *headers_end, *h, *data;
+	size_t header_len, content_length, consumed, status_at, body_at;
+	BOOL close_after, chunked;
+	ssize_t n;
+	int code;
+
+	for (;;) {
+
+		/* read the request line and headers */
+		while (!(headers_end = strstr(in->ptr, "\r\n\r\n"))) {
+			if ((n = read(fd, buf, sizeof(buf))) <= 0)
+				goto done;
+			flowthings_io_string_append(in, buf, n);
+		}
+
+		header_len = headers_end + 4 - in->ptr;
+		headers_end[2] = '\0';
+
+		if (sscanf(in->ptr, "%15s %2047s", method, target) != 2)
+			goto done;
+
+		h = strcasestr(in->ptr, "\r\ncontent-length:");
+		content_length = h ? strtoul(h + 17, NULL, 10) : 0;
+		chunked = strcasestr(in->ptr, "\r\ntransfer-encoding: chunked") != NULL;
+		h = strcasestr(in->ptr, "\r\nconnection:");
+		close_after = h && !strncasecmp(h + 13 + strspn(h + 13, " "), "close", 5);
+
+		if (strcasestr(in->ptr, "\r\nexpect: 100-continue"))
+			write_all(fd, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+
+		/* read the body */
+		flowthings_io_string_reset(body);
+
+		if (chunked) {
+			if (!read_chunked(fd, in, header_len, body, &consumed))
+				goto done;
+		}
+		else {
+			while (in->len < header_len + content_length) {
+				if ((n = read(fd, buf, sizeof(buf))) <= 0)
+					goto done;
+				flowthings_io_string_append(in, buf, n);
+			}
+
+			flowthings_io_string_append(body, in->ptr + header_len, content_length);
+			consumed = header_len + content_length;
+		}
+
+		data = body->len ? body->ptr : NULL;
+
+		/* keep anything after this request for the next one */
+		memmove(in->ptr, in->ptr + consumed, in->len - consumed + 1);
+		in->len -= consumed;
+
+		/* the status in the head is filled in once the request has been handled */
+		flowthings_io_string_reset(out);
+		flowthings_io_string_strcat(out, "{\"head\":{\"status\":");
+		status_at = out->len;
+		flowthings_io_string_strcat(out, "000,\"errors\":[],\"messages\":[]},\"body\":");
+		body_at = out->len;
+
+		code = handle(method, target, data, out);
+
+		if (out->len == body_at)
+			flowthings_io_string_strcat(out, "null");
+		flowthings_io_string_strcat(out, "}");
+		snprintf(buf, 4, "%03d", code);
+		memcpy(out->ptr + status_at, buf, 3);
+
+		if (delay_us)
+			usleep(delay_us);
+
+		n = snprintf(buf, sizeof(buf), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+				"Content-Length: %zu\r\n%s\r\n", code, code < 300 ? "OK" : "Error", out->len,
+				close_after ? "Connection: close\r\n" : "");
+
+		if (!write_all(fd, buf, n) || !write_all(fd, out->ptr, out->len) || close_after)
+			goto done;
+	}
+
+done:
+	close(fd);
+	flowthings_io_string_cleanup(in);
+	flowthings_io_string_cleanup(body);
+	flowthings_io_string_cleanup(out);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in addr;
+	int port = 8080, listener, fd, opt, one = 1;
+	pthread_attr_t attr;
+	pthread_t thread;
+
+	while ((opt = getopt(argc, argv, "p:d:m:")) != -1) {
+		switch (opt) {
+		case 'p': port = atoi(optarg); break;
+		case 'd': delay_us = atoi(optarg); break;
+		case 'm': mget_delay_us = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-p port] [-d delay in microseconds] [-m MGET delay per flow in microseconds]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) || listen(listener, 1024)) {
+		perror("mock_server");
+		return 1;
+	}
+
+	printf("listening on 127.0.0.1:%d\n", port);
+	fflush(stdout);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	while ((fd = accept(listener, NULL, NULL)) >= 0) {
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		pthread_create(&thread, &attr, serve_connection, (void *)(long)fd);
+	}
+
+	return 0;
+}
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,273 @@
+/*
+ * op_cost.c
+ *
+ * Measures the CPU time the library spends per service call, using the mock transport so that no
+ * time is spent on the network.
+ *
+ * usage: op_cost [iterations] [drops per find]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io_services.h"
+#include "flowthings_io_http_mock.h"
+
+
+/***********************************************************************
+ * The benchmark
+ ***********************************************************************/
+
+#define DROP_JSON "{\"id\":\"d5565c4a168056d6bd8c4c4be\",\"flowId\":\"f552a87090cf2afb329f31f37\"," \
+	"\"creationDate\":1432139871000,\"path\":\"/myaccountname/sensors\",\"version\":1," \
+	"\"elems\":{\"num\":{\"type\":\"integer\",\"value\":7},\"label\":{\"type\":\"string\"," \
+	"\"value\":\"living room\"}}}"
+
+struct my_drop {
+	int num;
+};
+
+static BOOL decode_my_drop(cJSON *json_in, void *obj_out)
+{
+	struct my_drop *md = (struct my_drop *)obj_out;
+	md->num = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(json_in, "elems"), "num"), "value")->valueint;
+
+	return TRUE;
+}
+
+static BOOL encode_my_drop(void *obj_in, cJSON *json_out)
+{
+	struct my_drop *md = (struct my_drop *)obj_in;
+
+	cJSON *cjo = cJSON_CreateObject();
+	cJSON_AddNumberToObject(cjo, "num", md->num);
+	cJSON_AddItemToObject(json_out, "elems", cjo);
+
+	return TRUE;
+}
+
+static BOOL tape_my_drop(flowthings_io_tape_value value, void *obj_out)
+{
+	struct my_drop *md = (struct my_drop *)obj_out;
+	md->num = (int)flowthings_io_tape_int(flowthings_io_tape_path(value, "elems.num.value"));
+
+	return TRUE;
+}
+
+#define MY_DROP_FIELDS(X) \
+	X(struct my_drop, num, "elems.num", FLOWTHINGS_IO_FIELD_INT)
+
+FLOWTHINGS_IO_CODEC_DEFINE(my_drop_codec, struct my_drop, MY_DROP_FIELDS)
+
+static int completed;
+
+static void read_complete(flowthings_io_op *op, flowthings_io_result_code code, void *user_data)
+{
+	completed++;
+	flowthings_io_op_cleanup(op);
+}
+
+static double cpu_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double start, int iterations)
+{
+	printf("%-30s %10.2f us/op\n", name, (cpu_now() - start) * 1e6 / iterations);
+}
+
+static void run(flowthings_io_api *api, int iterations, int find_size)
+{
+	struct my_drop drop, *drops = malloc(sizeof(struct my_drop) * 2 * find_size);
+	double start;
+	int i, count;
+
+	start = cpu_now();
+	for (i = 0; i < iterations; i++)
+		flowthings_io_drop_read("f552a87090cf2afb329f31f37", api, "d5565c4a168056d6bd8c4c4be", NULL, decode_my_drop, &drop);
+	report("drop_read", start, iterations);
+
+	start = cpu_now();
+	for (i = 0; i < iterations; i++)
+		flowthings_io_drop_create("f552a87090cf2afb329f31f37", api, NULL, encode_my_drop, decode_my_drop, &drop);
+	report("drop_create", start, iterations);
+
+	start = cpu_now();
+	for (i = 0; i < iterations / find_size + 1; i++) {
+		count = find_size;
+		flowthings_io_drop_find("f552a87090cf2afb329f31f37", api, "elems.num > 3", NULL, decode_my_drop, (void **)drops, &count);
+	}
+	report("drop_find, per drop", start, (iterations / find_size + 1) * find_size);
+
+	completed = 0;
+	start = cpu_now();
+	for (i = 0; i < iterations; i++)
+		flowthings_io_drop_read_async("f552a87090cf2afb329f31f37", api, "d5565c4a168056d6bd8c4c4be", NULL, decode_my_drop, &drop, read_complete, NULL);
+	flowthings_io_api_run(api);
+	report("drop_read_async", start, iterations);
+
+	free(drops);
+}
+
+/* the same calls with a codec, which decodes from the JSON text without a cJSON tree */
+static void run_codec(flowthings_io_api *api, int iterations, int find_size)
+{
+	struct my_drop drop, *drops = malloc(sizeof(struct my_drop) * find_size);
+	double start;
+	int i, count;
+
+	drop.num = 7;
+
+	start = cpu_now();
+	for (i = 0; i < iterations; i++)
+		flowthings_io_drop_read_codec("f552a87090cf2afb329f31f37", api, "d5565c4a168056d6bd8c4c4be", NULL, &my_drop_codec, &drop);
+	report("drop_read_codec", start, iterations);
+
+	start = cpu_now();
+	for (i = 0; i < iterations; i++)
+		flowthings_io_drop_create_codec("f552a87090cf2afb329f31f37", api, NULL, &my_drop_codec, &drop);
+	report("drop_create_codec", start, iterations);
+
+	start = cpu_now();
+	for (i = 0; i < iterations / find_size + 1; i++) {
+		count = find_size;
+		flowthings_io_drop_find_codec("f552a87090cf2afb329f31f37", api, "elems.num > 3", NULL, &my_drop_codec, drops, &count);
+	}
+	report("drop_find_codec, per drop", start, (iterations / find_size + 1) * find_size);
+
+	free(drops);
+}
+
+/* the read and find with a projection onto the one value decode_my_drop reads */
+static void run_projected(flowthings_io_api *api, int iterations, int find_size)
+{
+	const char *read_paths[] = { "body.elems.num.value" }, *find_paths[] = { "body[].elems.num.value" };
+	flowthings_io_json_projection *read_projection = flowthings_io_json_projection_init(read_paths, 1);
+	flowthings_io_json_projection *find_projection = flowthings_io_json_projection_init(find_paths, 1);
+	struct my_drop drop, *drops = malloc(sizeof(struct my_drop) * 2 * find_size);
+	double start;
+	int i, count;
+
+	start = cpu_now();
+	for (i = 0; i < iterations; i++)
+		flowthings_io_drop_read_projected("f552a87090cf2afb329f31f37", api, "d5565c4a168056d6bd8c4c4be", NULL, read_projection, decode_my_drop, &drop);
+	report("drop_read_projected", start, iterations);
+
+	start = cpu_now();
+	for (i = 0; i < iterations / find_size + 1; i++) {
+		count = find_size;
+		flowthings_io_drop_find_projected("f552a87090cf2afb329f31f37", api, "elems.num > 3", NULL, find_projection, decode_my_drop, (void **)drops, &count);
+	}
+	report("drop_find_projected, per drop", start, (iterations / find_size + 1) * find_size);
+
+	flowthings_io_json_projection_cleanup(read_projection);
+	flowthings_io_json_projection_cleanup(find_projection);
+	free(drops);
+}
+
+/* the read and find with a tape decoder, which reads the same value from a tape */
+static void run_tape(flowthings_io_api *api, int iterations, int find_size)
+{
+	struct my_drop drop, *drops = malloc(sizeof(struct my_drop) * 2 * find_size);
+	double start;
+	int i, count;
+
+	start = cpu_now();
+	for (i = 0; i < iterations; i++)
+		flowthings_io_drop_read_tape("f552a87090cf2afb329f31f37", api, "d5565c4a168056d6bd8c4c4be", NULL, tape_my_drop, &drop);
+	report("drop_read_tape", start, iterations);
+
+	start = cpu_now();
+	for (i = 0; i < iterations / find_size + 1; i++) {
+		count = find_size;
+		flowthings_io_drop_find_tape("f552a87090cf2afb329f31f37", api, "elems.num > 3", NULL, tape_my_drop, (void **)drops, &count);
+	}
+	report("drop_find_tape, per drop", start, (iterations / find_size + 1) * find_size);
+
+	free(drops);
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+	int find_size = argc > 2 ? atoi(argv[2]) : 100;
+	flowthings_io_token creds = { "myaccountname", "mytoken" };
+	flowthings_io_http_mock_response responses[2];
+	flowthings_io_http_mock_config config;
+	flowthings_io_string *find_body = flowthings_io_string_init();
+	flowthings_io_api *api;
+	int i;
+
+	/* a find returns find_size drops, everything else returns one */
+	flowthings_io_string_strcat(find_body, "{\"head\":{\"status\":200,\"errors\":[],\"messages\":[]},\"body\":[");
+	for (i = 0; i < find_size; i++) {
+		if (i) flowthings_io_string_strcat(find_body, ",");
+		flowthings_io_string_strcat(find_body, DROP_JSON);
+	}
+	flowthings_io_string_strcat(find_body, "]}");
+
+	responses[0].method = FLOWTHINGS_IO_HTTP_METHOD_GET;
+	responses[0].path = "/drop/f552a87090cf2afb329f31f37?";
+	responses[0].http_response_code = 200;
+	responses[0].body = find_body->ptr;
+
+	responses[1].method = NULL;
+	responses[1].path = NULL;
+	responses[1].http_response_code = 200;
+	responses[1].body = "{\"head\":{\"status\":200,\"errors\":[],\"messages\":[]},\"body\":" DROP_JSON "}";
+
+	memset(&config, 0, sizeof(config));
+	config.responses = responses;
+	config.response_count = 2;
+
+	api = flowthings_io_api_init(FLOWTHINGS_IO_VERSION, FLOWTHINGS_IO_HOST, FALSE, &creds);
+	flowthings_io_api_set_transport(api, &flowthings_io_http_transport_mock, &config);
+	flowthings_io_api_set_json_arena(api, TRUE);
+
+	printf("%d iterations, %d drops per find, CPU time:\n", iterations, find_size);
+	run(api, iterations, find_size);
+
+	printf("with a codec:\n");
+	run_codec(api, iterations, find_size);
+
+	printf("with a projection:\n");
+	run_projected(api, iterations, find_size);
+
+	printf("with a tape:\n");
+	run_tape(api, iterations, find_size);
+
+	printf("with stream decoding:\n");
+	flowthings_io_api_set_stream_decode(api, TRUE);
+	run(api, iterations, find_size);
+
+	printf("with stream decoding and a codec:\n");
+	run_codec(api, iterations, find_size);
+
+	printf("with stream decoding and a projection:\n");
+	run_projected(api, iterations, find_size);
+
+	printf("with stream decoding and a tape:\n");
+	run_tape(api, iterations, find_size);
+
+	flowthings_io_api_cleanup(api);
+	flowthings_io_string_cleanup(find_body);
+
+	return 0;
+}
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,287 @@
+/*
+ * parse_bench.c
+ *
+ * Measures how fast cJSON parses drop find responses, in MB of JSON per second of CPU time, so
+ * changes to the parser can be compared, and how fast elems.num.value can be decoded from every
+ * drop with a cJSON tree, a tree projected onto that path, a tape and the pull reader.
+ *
+ * usage: parse_bench [iterations per round] [drops per find]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "cJSON.h"
+#include "flowthings_io.h"
+#include "flowthings_io_json.h"
+#include "flowthings_io_tape.h"
+
+
+/***********************************************************************
+ * The benchmark
+ ***********************************************************************/
+
+/* a drop as the platform returns it, with a few kinds of elems and a longer string */
+#define DROP_JSON "{\"id\":\"d5565c4a168056d6bd8c4c4be\",\"flowId\":\"f552a87090cf2afb329f31f37\"," \
+	"\"creationDate\":1432139871000,\"lastEditDate\":1432139871000,\"path\":\"/myaccountname/sensors\"," \
+	"\"version\":1,\"fhash\":\"2fd4e1c67a2d28fced849ee1bb76e7391b93eb12\",\"location\":{\"type\":\"map\"," \
+	"\"lat\":40.7127837,\"lon\":-74.0059413,\"specifiers\":{\"zip\":\"10007\",\"city\":\"New York\"}}," \
+	"\"elems\":{\"num\":{\"type\":\"integer\",\"value\":7},\"temp\":{\"type\":\"float\",\"value\":21.5}," \
+	"\"label\":{\"type\":\"string\",\"value\":\"living room\"},\"note\":{\"type\":\"string\",\"value\":" \
+	"\"Sensor moved to the shelf by the window on the east wall, \\\"away\\\" from the radiator.\"}," \
+	"\"tags\":{\"type\":\"list\",\"value\":[\"home\",\"indoor\",\"floor 2\"]},\"ok\":{\"type\":\"boolean\",\"value\":true}}}"
+
+static double cpu_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the best of a few rounds, as the slower ones are mostly other work on the machine */
+#define ROUNDS 10
+
+enum { PARSE, PARSE_IN_SITU, MINIFY, DECODE_TREE, DECODE_PROJECTED, DECODE_TAPE, DECODE_EVENTS };
+
+/* the one path decode_tree looks at */
+static const char *const paths[] = { "body[].elems.num.value" };
+static flowthings_io_json_projection *projection;
+
+/* the decoded values go here, so the decoding isn't optimized away */
+static volatile long sink;
+
+/* decodes elems.num.value from every drop in a tree, as decode_my_drop in the README does */
+static void decode_tree(cJSON *root)
+{
+	cJSON *drop, *value;
+
+	cJSON_ArrayForEach(drop, cJSON_GetObjectItem(root, "body")) {
+		value = cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(drop, "elems"), "num"), "value");
+		if (value)
+			sink += value->valueint;
+	}
+}
+
+/* the same from a tape */
+static void decode_tape(const flowthings_io_tape *tape)
+{
+	flowthings_io_tape_value drop;
+
+	flowthings_io_tape_for_each(drop, flowthings_io_tape_get(flowthings_io_tape_root(tape), "body"))
+		sink += (int)flowthings_io_tape_int(flowthings_io_tape_path(drop, "elems.num.value"));
+}
+
+/* reads the members of an object up to its end, descending into the one called key */
+static BOOL find_key(flowthings_io_json_reader *reader, const char *key)
+{
+	while (flowthings_io_json_next(reader) == FLOWTHINGS_IO_JSON_KEY) {
+		if (flowthings_io_json_key_is(reader, key))
+			return TRUE;
+		flowthings_io_json_skip(reader);
+	}
+	return FALSE;
+}
+
+/* the same with the pull reader, as an event decoder would, skipping everything else */
+static void decode_events(const char *json, size_t len)
+{
+	flowthings_io_json_reader reader;
+
+	flowthings_io_json_reader_init(&reader, json, len);
+	flowthings_io_json_next(&reader);
+
+	if (!find_key(&reader, "body") || flowthings_io_json_next(&reader) != FLOWTHINGS_IO_JSON_BEGIN_ARRAY)
+		return;
+
+	while (flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_BEGIN_OBJECT) {
+		if (find_key(&reader, "elems") && flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_BEGIN_OBJECT
+				&& find_key(&reader, "num") && flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_BEGIN_OBJECT
+				&& find_key(&reader, "value") && flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_NUMBER) {
+			sink += (int)reader.integer;
+			/* the rest of num, elems and the drop */
+			flowthings_io_json_skip(&reader);
+			flowthings_io_json_skip(&reader);
+			flowthings_io_json_skip(&reader);
+		}
+	}
+}
+
+static double measure(int what, const char *json, size_t len, char *copy, int iterations)
+{
+	cJSON_Arena *arena = cJSON_ArenaCreate();
+	flowthings_io_tape *tape = flowthings_io_tape_init();
+	cJSON_Arena *prev = cJSON_ArenaUse(what == PARSE_IN_SITU || what == DECODE_TREE
+			|| what == DECODE_PROJECTED ? arena : NULL);
+	double start, best = 0;
+	int round, i;
+
+	for (round = 0; round < ROUNDS; round++) {
+		start = cpu_now();
+		for (i = 0; i < iterations; i++) {
+			if (what == PARSE) {
+				cJSON_Delete(cJSON_Parse(json));
+				continue;
+			}
+			if (what == DECODE_EVENTS) {
+				decode_events(json, len);
+				continue;
+			}
+			if (what == DECODE_TAPE) {
+				if (flowthings_io_tape_parse(tape, json, len))
+					decode_tape(tape);
+				continue;
+			}
+			if (what == DECODE_PROJECTED) {
+				decode_tree(flowthings_io_json_parse_projected(projection, json, len));
+				cJSON_ArenaReset(arena);
+				continue;
+			}
+			memcpy(copy, json, len + 1);
+			if (what == MINIFY) {
+				cJSON_Minify(copy);
+				continue;
+			}
+			if (what == DECODE_TREE)
+				decode_tree(cJSON_ParseInSitu(copy));
+			else
+				cJSON_ParseInSitu(copy);
+			cJSON_ArenaReset(arena);
+		}
+		if (best == 0 || cpu_now() - start < best)
+			best = cpu_now() - start;
+	}
+
+	cJSON_ArenaUse(prev);
+	cJSON_ArenaDelete(arena);
+	flowthings_io_tape_cleanup(tape);
+
+	return (double)len * iterations / best / 1e6;
+}
+
+/* the bytes cJSON has asked for since this was last zeroed, for the size of a tree without the
+ * room left in an arena's blocks */
+static size_t allocated;
+
+static void *counting_malloc(size_t sz)
+{
+	allocated += sz;
+	return malloc(sz);
+}
+
+/* parses json as cJSON_Parse, in place with an arena, and minifies it, then decodes a value from
+ * each drop */
+static void run(const char *json, int iterations)
+{
+	size_t len = strlen(json);
+	char *copy = malloc(len + 1);
+	flowthings_io_tape *tape;
+	cJSON_Hooks hooks;
+
+	printf("%-30s %10.1f MB/s\n", "cJSON_Parse", measure(PARSE, json, len, copy, iterations));
+	printf("%-30s %10.1f MB/s\n", "cJSON_ParseInSitu, arena", measure(PARSE_IN_SITU, json, len, copy, iterations));
+	printf("%-30s %10.1f MB/s\n", "cJSON_Minify", measure(MINIFY, json, len, copy, iterations));
+	printf("%-30s %10.1f MB/s\n", "decode a value, cJSON tree", measure(DECODE_TREE, json, len, copy, iterations));
+	printf("%-30s %10.1f MB/s\n", "decode a value, projected tree", measure(DECODE_PROJECTED, json, len, copy, iterations));
+	printf("%-30s %10.1f MB/s\n", "decode a value, tape", measure(DECODE_TAPE, json, len, copy, iterations));
+	printf("%-30s %10.1f MB/s\n", "decode a value, pull reader", measure(DECODE_EVENTS, json, len, copy, iterations));
+
+	/* what the trees and the tape take, without the room left in an arena or the tape's buffers;
+	 * a tree parsed in place points into the text, so the text is kept as long as the tree, while
+	 * the projected tree and the tape copy their strings; the reader allocates nothing */
+	hooks.malloc_fn = counting_malloc;
+	hooks.free_fn = free;
+	cJSON_InitHooks(&hooks);
+	memcpy(copy, json, len + 1);
+	allocated = 0;
+	cJSON_Delete(cJSON_ParseInSitu(copy));
+	printf("%-30s %10lu bytes\n", "cJSON tree, with its text", (unsigned long)(allocated + len + 1));
+	allocated = 0;
+	cJSON_Delete(flowthings_io_json_parse_projected(projection, json, len));
+	printf("%-30s %10lu bytes\n", "projected tree", (unsigned long)allocated);
+	cJSON_InitHooks(NULL);
+
+	tape = flowthings_io_tape_init();
+	flowthings_io_tape_parse(tape, json, len);
+	printf("%-30s %10lu bytes\n", "tape", (unsigned long)flowthings_io_tape_used(tape));
+	flowthings_io_tape_cleanup(tape);
+
+	free(copy);
+}
+
+/* a find response of find_size drops; with a payload, each drop also has a string elem of about 2KB, like a base64 encoded image */
+static void find_body(flowthings_io_string *body, int find_size, BOOL payload)
+{
+	static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char image[2049];
+	int i;
+
+	for (i = 0; i < 2048; i++)
+		image[i] = b64[(i * 7 + i / 64) % 64];
+	image[2048] = '\0';
+
+	flowthings_io_string_strcat(body, "{\"head\":{\"status\":200,\"errors\":[],\"messages\":[]},\"body\":[");
+	for (i = 0; i < find_size; i++) {
+		if (i) flowthings_io_string_strcat(body, ",");
+		if (payload) {
+			/* DROP_JSON with one more elem before its last two closing braces */
+			flowthings_io_string_append(body, DROP_JSON, strlen(DROP_JSON) - 2);
+			flowthings_io_string_strcat(body, ",\"image\":{\"type\":\"string\",\"value\":\"");
+			flowthings_io_string_strcat(body, image);
+			flowthings_io_string_strcat(body, "\"}}}");
+		}
+		else {
+			flowthings_io_string_strcat(body, DROP_JSON);
+		}
+	}
+	flowthings_io_string_strcat(body, "]}");
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 100;
+	int find_size = argc > 2 ? atoi(argv[2]) : 100;
+	flowthings_io_string *body = flowthings_io_string_init();
+	cJSON *json;
+	char *formatted;
+
+	projection = flowthings_io_json_projection_init(paths, 1);
+	find_body(body, find_size, FALSE);
+
+	/* the same response indented, as cJSON_Print writes it */
+	json = cJSON_Parse(body->ptr);
+	formatted = cJSON_Print(json);
+	cJSON_Delete(json);
+
+	printf("%d iterations, best of %d rounds, %d drops per find, compact (%lu bytes):\n", iterations, ROUNDS, find_size,
+			(unsigned long)body->len);
+	run(body->ptr, iterations);
+
+	printf("formatted (%lu bytes):\n", (unsigned long)strlen(formatted));
+	run(formatted, iterations);
+
+	flowthings_io_string_reset(body);
+	find_body(body, find_size, TRUE);
+
+	printf("compact, with a 2KB string in each drop (%lu bytes):\n", (unsigned long)body->len);
+	run(body->ptr, iterations);
+
+	free(formatted);
+	flowthings_io_string_cleanup(body);
+	flowthings_io_json_projection_cleanup(projection);
+
+	return 0;
+}
+
+#ifdef  __cplusplus
+}
+#endif
@@ -41,18 +41,25 @@ extern "C"
 
 /* The cJSON structure: */
 typedef struct cJSON {
-	struct cJSON *next,*prev;	/* next/prev allow you to walk array/object chains. Alternatively, use GetArraySize/GetArrayItem/GetObjectItem */
+	struct cJSON *next,*prev;	/* next/prev allow you to walk array/object chains. Alternatively, use cJSON_ArrayForEach/GetObjectItem. The first item's prev is the last item. */
 	struct cJSON *child;		/* An array or object item will have a child pointer pointing to a chain of the items in the array/object. */
 
 	int type;					/* The type of the item, as above. */
+	int valueint;				/* The item's number, if type==cJSON_Number, cut to fit an int */
 
 	char *valuestring;			/* The item's string, if type==cJSON_String */
-	int valueint;				/* The item's number, if type==cJSON_Number */
 	double valuedouble;			/* The item's number, if type==cJSON_Number */
+	long long valueint64;		/* The item's number, if type==cJSON_Number, cut to fit 64 bits; exact for whole numbers that fit, which a double isn't past 2^53.
+								   It takes an item from 64 to 72 bytes, but IDs and nanosecond times past 2^53 can't be had exactly any other way once the text is gone. */
 
 	char *string;				/* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
+
+	struct cJSON_Index *index;	/* A hash of an object's items by name, once it has cJSON_IndexThreshold of them; 0 otherwise. */
 } cJSON;
 
+/* Objects with this many items get a hash index, so looking up an item doesn't walk the list. */
+#define cJSON_IndexThreshold 16
+
 typedef struct cJSON_Hooks {
       void *(*malloc_fn)(size_t sz);
       void (*free_fn)(void *ptr);
@@ -61,9 +68,28 @@ typedef struct cJSON_Hooks {
 /* Supply malloc, realloc and free functions to cJSON */
 extern void cJSON_InitHooks(cJSON_Hooks* hooks);
 
+/* Arenas. While an arena is in use on a thread, the items parsed or created on it, their strings and object indexes are
+carved from the arena instead of malloc'd one by one, and cJSON_ArenaReset or cJSON_ArenaDelete releases all of them at
+once; the names and indexes of items kept on the heap stay on the heap. cJSON_Delete leaves arena items alone while their
+arena is in use, and must not be given them once it isn't. Unlike the hooks, an arena only affects the thread it is in use
+on. Printed text is always malloc'd. */
+typedef struct cJSON_Arena cJSON_Arena;
+extern cJSON_Arena *cJSON_ArenaCreate(void);
+/* Release everything carved from the arena, keeping its memory to carve from again. */
+extern void cJSON_ArenaReset(cJSON_Arena *arena);
+extern void cJSON_ArenaDelete(cJSON_Arena *arena);
+/* The number of bytes the arena holds. */
+extern size_t cJSON_ArenaSize(cJSON_Arena *arena);
+/* Use arena, or malloc for 0, for the items parsed or created on this thread from now on. Returns the arena that was in use. */
+extern cJSON_Arena *cJSON_ArenaUse(cJSON_Arena *arena);
+
 
 /* Supply a block of JSON, and this returns a cJSON object you can interrogate. Call cJSON_Delete when finished. */
 extern cJSON *cJSON_Parse(const char *value);
+/* Parse in place: strings are unescaped inside value, which is changed, and the items point into it instead of having
+copies. Only with an arena in use, which then owns the strings until it is reset, so value must outlive that; without one,
+this is cJSON_Parse. */
+extern cJSON *cJSON_ParseInSitu(char *value);
 /* Render a cJSON entity to text for transfer/storage. Free the char* when finished. */
 extern char  *cJSON_Print(cJSON *item);
 /* Render a cJSON entity to text for transfer/storage without any formatting. Free the char* when finished. */
@@ -71,12 +97,19 @@ extern char  *cJSON_PrintUnformatted(cJSON *item);
 /* Delete a cJSON entity and all subentities. */
 extern void   cJSON_Delete(cJSON *c);
 
+/* Walk the items of an array (or object) in order; each step is O(1), unlike GetArrayItem. */
+#define cJSON_ArrayForEach(element,array)	for (element=(array)?(array)->child:0;element;element=element->next)
+
 /* Returns the number of items in an array (or object). */
 extern int	  cJSON_GetArraySize(cJSON *array);
 /* Retrieve item number "item" from array "array". Returns NULL if unsuccessful. */
 extern cJSON *cJSON_GetArrayItem(cJSON *array,int item);
-/* Get item "string" from object. Case insensitive. */
+/* Get item "string" from object. Case insensitive. Lookups in objects with cJSON_IndexThreshold or more items go through
+the object's index, which is built when the object is parsed, or by the first lookup in an object built with the Add calls.
+Linking items into an object by hand, rather than with the Add/Detach/Replace calls, leaves its index out of date. */
 extern cJSON *cJSON_GetObjectItem(cJSON *object,const char *string);
+/* Get item "string" from object, matching its case exactly. */
+extern cJSON *cJSON_GetObjectItemCaseSensitive(cJSON *object,const char *string);
 
 /* For analysing failed parses. This returns a pointer to the parse error. You'll probably need to look a few chars back to make sense of it. Defined when cJSON_Parse() returns 0. 0 when cJSON_Parse() succeeds. */
 extern const char *cJSON_GetErrorPtr(void);
@@ -87,6 +120,7 @@ extern cJSON *cJSON_CreateTrue(void);
 extern cJSON *cJSON_CreateFalse(void);
 extern cJSON *cJSON_CreateBool(int b);
 extern cJSON *cJSON_CreateNumber(double num);
+extern cJSON *cJSON_CreateInt64(long long num);
 extern cJSON *cJSON_CreateString(const char *string);
 extern cJSON *cJSON_CreateArray(void);
 extern cJSON *cJSON_CreateObject(void);
@@ -97,7 +131,7 @@ extern cJSON *cJSON_CreateFloatArray(const float *numbers,int count);
 extern cJSON *cJSON_CreateDoubleArray(const double *numbers,int count);
 extern cJSON *cJSON_CreateStringArray(const char **strings,int count);
 
-/* Append item to the specified array/object. */
+/* Append item to the specified array/object. Appending is O(1): the first item's prev points at the last. */
 extern void cJSON_AddItemToArray(cJSON *array, cJSON *item);
 extern void	cJSON_AddItemToObject(cJSON *object,const char *string,cJSON *item);
 /* Append reference to item to the specified array/object. Use this when you want to add an existing cJSON to a new cJSON, but don't want to corrupt your existing cJSON. */
@@ -125,16 +159,28 @@ extern cJSON *cJSON_ParseWithOpts(const char *value,const char **return_parse_en
 
 extern void cJSON_Minify(char *json);
 
+/* The number conversions cJSON parses and prints with, for code that reads or writes JSON text itself.
+ReadNumber reads the number at text, as the parser does, into *number and *integer, which is exact for whole numbers that
+fit in 64 bits and otherwise the double cut to fit; it returns the end of the number. WriteNumber writes digits that
+read back as number, or null if it isn't finite: the shortest such digits in almost all cases, but now and then (under 1
+in 1000 doubles) a digit or two more, as in 1025.0059880239521 for 1025.005988023952. WriteInt64 writes an integer; both write
+at most cJSON_NumberBufferSize chars, including a terminating null, and return the length. */
+#define cJSON_NumberBufferSize 32
+extern const char *cJSON_ReadNumber(const char *text,double *number,long long *integer);
+extern int cJSON_WriteNumber(double number,char *buffer);
+extern int cJSON_WriteInt64(long long number,char *buffer);
+
 /* Macros for creating things quickly. */
 #define cJSON_AddNullToObject(object,name)		cJSON_AddItemToObject(object, name, cJSON_CreateNull())
 #define cJSON_AddTrueToObject(object,name)		cJSON_AddItemToObject(object, name, cJSON_CreateTrue())
 #define cJSON_AddFalseToObject(object,name)		cJSON_AddItemToObject(object, name, cJSON_CreateFalse())
 #define cJSON_AddBoolToObject(object,name,b)	cJSON_AddItemToObject(object, name, cJSON_CreateBool(b))
 #define cJSON_AddNumberToObject(object,name,n)	cJSON_AddItemToObject(object, name, cJSON_CreateNumber(n))
+#define cJSON_AddInt64ToObject(object,name,n)	cJSON_AddItemToObject(object, name, cJSON_CreateInt64(n))
 #define cJSON_AddStringToObject(object,name,s)	cJSON_AddItemToObject(object, name, cJSON_CreateString(s))
 
-/* When assigning an integer value, it needs to be propagated to valuedouble too. */
-#define cJSON_SetIntValue(object,val)			((object)?(object)->valueint=(object)->valuedouble=(val):(val))
+/* When assigning an integer value, it needs to be propagated to valuedouble and valueint64 too. */
+#define cJSON_SetIntValue(object,val)			((object)?((object)->valueint64=(val),(object)->valueint=(object)->valuedouble=(val)):(val))
 
 #ifdef __cplusplus
 }
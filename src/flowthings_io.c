@@ -7,7 +7,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <curl/curl.h>
 
 #ifdef  __cplusplus
 extern "C" {
@@ -36,7 +35,8 @@ flowthings_io_string *flowthings_io_string_init()
 	}
 
 	s->len = 0;
-	s->ptr = malloc(s->len + 1);
+	s->capacity = 1;
+	s->ptr = malloc(s->capacity);
 
 	if (s->ptr == NULL) {
 		FAIL;
@@ -61,6 +61,52 @@ void flowthings_io_string_cleanup(flowthings_io_string *s)
 	free(s);
 }
 
+/*
+ * NAME: flowthings_io_string_reserve
+ *
+ * Makes sure the string can grow to len characters without reallocating.
+ *
+ * PARAMS:
+ * s - the string
+ * len - the length the string needs room for, not counting the null terminator
+ */
+void flowthings_io_string_reserve(flowthings_io_string *s, size_t len)
+{
+	size_t capacity;
+
+	if (!s) FAIL;
+
+	if (len < s->capacity)
+		return;
+
+	capacity = s->capacity * 2;
+	if (capacity < FLOWTHINGS_IO_STRING_MIN_CAPACITY)
+		capacity = FLOWTHINGS_IO_STRING_MIN_CAPACITY;
+	if (capacity < len + 1)
+		capacity = len + 1;
+
+	s->ptr = realloc(s->ptr, capacity);
+	if (!s->ptr) FAIL;
+
+	s->capacity = capacity;
+}
+
+/*
+ * NAME: flowthings_io_string_reset
+ *
+ * Empties the string, keeping its buffer.
+ *
+ * PARAMS:
+ * s - the string
+ */
+void flowthings_io_string_reset(flowthings_io_string *s)
+{
+	if (!s) FAIL;
+
+	s->len = 0;
+	s->ptr[0] = '\0';
+}
+
 /*
  * NAME: flowthings_io_strcat
  *
@@ -79,6 +125,23 @@ void flowthings_io_strcat(char *dest, const char *src, int max_length)
 	}
 }
 
+/*
+ * NAME: flowthings_io_string_append
+ *
+ * Appends len bytes from src to a flowthings_io_string.  src doesn't need to be null terminated.
+ */
+void flowthings_io_string_append(flowthings_io_string *dest, const char *src, size_t len)
+{
+	if (!src || !dest) FAIL;
+
+	size_t new_len = dest->len + len;
+	flowthings_io_string_reserve(dest, new_len);
+
+	memcpy(dest->ptr + dest->len, src, len);
+	dest->ptr[new_len] = '\0';
+	dest->len = new_len;
+}
+
 /*
  * NAME: flowthings_io_string_strcat
  *
@@ -89,13 +152,7 @@ void flowthings_io_string_strcat(flowthings_io_string *dest, const char *src)
 {
 	if (!src || !dest) FAIL;
 
-	size_t new_len = dest->len + (sizeof(char) * strlen(src));
-	dest->ptr = realloc(dest->ptr, new_len+1);
-	if (!dest->ptr) FAIL;
-
-	memcpy(dest->ptr + dest->len, src, new_len);
-	dest->ptr[new_len] = '\0';
-	dest->len = new_len;
+	flowthings_io_string_append(dest, src, strlen(src));
 }
 
 
@@ -12,7 +12,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <curl/curl.h>
 
 #ifdef  __cplusplus
 extern "C" {
@@ -61,6 +60,7 @@ typedef enum flowthings_io_result_code {
 	FLOWTHINGS_IO_ERROR_BAD_REQUEST,
 	FLOWTHINGS_IO_ERROR_SERVER_ERROR,
 	FLOWTHINGS_IO_ERROR_UNKNOWN,
+	FLOWTHINGS_IO_ERROR_QUEUE_FULL,
 } flowthings_io_result_code;
 
 /*
@@ -80,9 +80,15 @@ typedef struct flowthings_io_token {
  * flowthings_io_string - a resizeable string object
  ***********************************************************************/
 
+/* the smallest buffer a flowthings_io_string allocates once something is appended */
+#define FLOWTHINGS_IO_STRING_MIN_CAPACITY 256
+
 typedef struct flowthings_io_string {
 	char *ptr;
 	size_t len;
+
+	/* the size of the buffer at ptr, including room for the null terminator */
+	size_t capacity;
 } flowthings_io_string;
 
 /*
@@ -103,6 +109,28 @@ flowthings_io_string *flowthings_io_string_init();
  */
 void flowthings_io_string_cleanup(flowthings_io_string *s);
 
+/*
+ * NAME: flowthings_io_string_reserve
+ *
+ * Makes sure the string can grow to len characters without reallocating.  The buffer grows by at
+ * least doubling, so appending n characters one chunk at a time costs O(log n) reallocations.
+ *
+ * PARAMS:
+ * s - the string
+ * len - the length the string needs room for, not counting the null terminator
+ */
+void flowthings_io_string_reserve(flowthings_io_string *s, size_t len);
+
+/*
+ * NAME: flowthings_io_string_reset
+ *
+ * Empties the string, keeping its buffer so it can be reused without allocating.
+ *
+ * PARAMS:
+ * s - the string
+ */
+void flowthings_io_string_reset(flowthings_io_string *s);
+
 /*
  * NAME: flowthings_io_string_strcat
  *
@@ -111,6 +139,13 @@ void flowthings_io_string_cleanup(flowthings_io_string *s);
  */
 void flowthings_io_string_strcat(flowthings_io_string *dest, const char *src);
 
+/*
+ * NAME: flowthings_io_string_append
+ *
+ * Appends len bytes from src to a flowthings_io_string.  src doesn't need to be null terminated.
+ */
+void flowthings_io_string_append(flowthings_io_string *dest, const char *src, size_t len);
+
 /*
  * NAME: flowthings_io_strcat
  *
@@ -5,10 +5,12 @@
  */
 
 
+/* the API's locks are POSIX mutexes */
+#define _XOPEN_SOURCE 700
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <curl/curl.h>
 
 #ifdef  __cplusplus
 extern "C" {
@@ -21,6 +23,7 @@ extern "C" {
 #include "flowthings_io.h"
 #include "flowthings_io_http.h"
 #include "flowthings_io_api.h"
+#include "flowthings_io_services.h"
 
 /***********************************************************************
  * The API functions
@@ -29,7 +32,10 @@ extern "C" {
 /*
  * NAME: flowthings_io_api_init
  *
- * Initializes the flowthings_io api object and returns it
+ * Initializes the flowthings_io api object and returns it.  One api object can be shared by all
+ * of a program's threads: the blocking service functions may be called on it from any number of
+ * threads at once, and reuse a pool of open connections.  It must be created before those
+ * threads are started.
  *
  * PARAMS:
  * version - the flowthings platform version
@@ -42,13 +48,208 @@ flowthings_io_api *flowthings_io_api_init(const char *version,
 		const char *host, BOOL secure, flowthings_io_token *creds)
 {
 	flowthings_io_api *api = malloc(sizeof(flowthings_io_api));
+	int i;
+
 	if (!api) FAIL;
 
 	api->fhttp = flowthings_io_http_init(version, host, secure, creds);
+	api->stream_decode = FALSE;
+	api->stream_upload = FALSE;
+	api->json_arena = FALSE;
+	api->batch_max_items = FLOWTHINGS_IO_API_BATCH_MAX_ITEMS;
+	api->batch_max_bytes = FLOWTHINGS_IO_API_BATCH_MAX_BYTES;
+	api->cache = NULL;
+	api->resolver = NULL;
+	api->op_pool_count = 0;
+	pthread_mutex_init(&api->op_pool_lock, NULL);
+
+	/* precompute the URL prefix for every service */
+	for (i = 0; i < __FLOWTHINGS_IO_SERVICE_COUNT; i++)
+		flowthings_io_http_add_base_path(api->fhttp, __flowthings_io_service_info[i].base_path);
 
 	return api;
 }
 
+/*
+ * NAME: flowthings_io_api_set_creds
+ *
+ * Changes the credentials used by the API.  This must also be called after changing the strings
+ * in the flowthings_io_token passed to flowthings_io_api_init, since the request headers are
+ * built from them once and reused.
+ *
+ * PARAMS:
+ * api - the API object
+ * creds - a flowthings_io_token object with the user's credentials
+ */
+void flowthings_io_api_set_creds(flowthings_io_api *api, flowthings_io_token *creds)
+{
+	if (!api || !api->fhttp) FAIL;
+
+	flowthings_io_http_set_creds(api->fhttp, creds);
+}
+
+/*
+ * NAME: flowthings_io_api_set_transport
+ *
+ * Replaces the transport that sends the API's requests.
+ *
+ * PARAMS:
+ * api - the API object
+ * transport - the transport, which must stay valid as long as the API
+ * config - the transport's configuration
+ */
+void flowthings_io_api_set_transport(flowthings_io_api *api,
+		const flowthings_io_http_transport *transport, void *config)
+{
+	if (!api || !api->fhttp) FAIL;
+
+	flowthings_io_http_set_transport(api->fhttp, transport, config);
+}
+
+/*
+ * NAME: flowthings_io_api_set_stream_decode
+ *
+ * Chooses whether responses are decoded as they arrive.
+ *
+ * PARAMS:
+ * api - the API object
+ * stream_decode - TRUE to decode responses as they arrive
+ */
+void flowthings_io_api_set_stream_decode(flowthings_io_api *api, BOOL stream_decode)
+{
+	if (!api) FAIL;
+
+	api->stream_decode = stream_decode;
+}
+
+/*
+ * NAME: flowthings_io_api_set_stream_upload
+ *
+ * Chooses whether find_many request bodies are written as they are sent.
+ *
+ * PARAMS:
+ * api - the API object
+ * stream_upload - TRUE to write request bodies as they are sent
+ */
+void flowthings_io_api_set_stream_upload(flowthings_io_api *api, BOOL stream_upload)
+{
+	if (!api) FAIL;
+
+	api->stream_upload = stream_upload;
+}
+
+/*
+ * NAME: flowthings_io_api_set_json_arena
+ *
+ * Chooses whether cJSON trees are kept in per-operation arenas.
+ *
+ * PARAMS:
+ * api - the API object
+ * json_arena - TRUE to use arenas
+ */
+void flowthings_io_api_set_json_arena(flowthings_io_api *api, BOOL json_arena)
+{
+	if (!api) FAIL;
+
+	api->json_arena = json_arena;
+}
+
+/*
+ * NAME: flowthings_io_api_set_batch_limits
+ *
+ * Sets the most objects and bytes a batch call puts in one request.
+ *
+ * PARAMS:
+ * api - the API object
+ * max_items - the most objects in one request, or 0 for the default
+ * max_bytes - the largest request body, or 0 for the default
+ */
+void flowthings_io_api_set_batch_limits(flowthings_io_api *api, int max_items, size_t max_bytes)
+{
+	if (!api) FAIL;
+
+	api->batch_max_items = max_items > 0 ? max_items : FLOWTHINGS_IO_API_BATCH_MAX_ITEMS;
+	api->batch_max_bytes = max_bytes > 0 ? max_bytes : FLOWTHINGS_IO_API_BATCH_MAX_BYTES;
+}
+
+/*
+ * NAME: flowthings_io_api_set_cache
+ *
+ * Turns the read-through cache on or off.
+ *
+ * PARAMS:
+ * api - the API object
+ * max_entries - the most objects to keep, or 0 to turn the cache off
+ * ttl_ms - how long an entry is used without asking the platform
+ */
+void flowthings_io_api_set_cache(flowthings_io_api *api, int max_entries, int ttl_ms)
+{
+	if (!api) FAIL;
+
+	flowthings_io_cache_cleanup(api->cache);
+	api->cache = max_entries > 0 ? flowthings_io_cache_init(max_entries, ttl_ms) : NULL;
+}
+
+/*
+ * NAME: flowthings_io_api_get_cache_stats
+ *
+ * Fills in the cache's counters.
+ *
+ * PARAMS:
+ * api - the API object
+ * stats - filled in
+ */
+void flowthings_io_api_get_cache_stats(flowthings_io_api *api, flowthings_io_cache_stats *stats)
+{
+	if (!api || !stats) FAIL;
+
+	if (api->cache)
+		flowthings_io_cache_get_stats(api->cache, stats);
+	else
+		memset(stats, 0, sizeof(flowthings_io_cache_stats));
+}
+
+/*
+ * NAME: flowthings_io_api_set_resolver
+ *
+ * Turns the flow path resolver on or off.
+ *
+ * PARAMS:
+ * api - the API object
+ * max_entries - the most paths to keep, or 0 to turn the resolver off
+ * ttl_ms - how long a flow ID is kept, or 0 for as long as the flow isn't changed
+ * missing_ttl_ms - how long a path with no flow is remembered
+ */
+void flowthings_io_api_set_resolver(flowthings_io_api *api, int max_entries, int ttl_ms,
+		int missing_ttl_ms)
+{
+	if (!api) FAIL;
+
+	flowthings_io_resolver_cleanup(api->resolver);
+	api->resolver = max_entries > 0 ?
+			flowthings_io_resolver_init(max_entries, ttl_ms, missing_ttl_ms) : NULL;
+}
+
+/*
+ * NAME: flowthings_io_api_get_resolver_stats
+ *
+ * Fills in the resolver's counters.
+ *
+ * PARAMS:
+ * api - the API object
+ * stats - filled in
+ */
+void flowthings_io_api_get_resolver_stats(flowthings_io_api *api,
+		flowthings_io_resolver_stats *stats)
+{
+	if (!api || !stats) FAIL;
+
+	if (api->resolver)
+		flowthings_io_resolver_get_stats(api->resolver, stats);
+	else
+		memset(stats, 0, sizeof(flowthings_io_resolver_stats));
+}
+
 /*
  * NAME: flowthings_io_api_cleanup
  *
@@ -58,12 +259,57 @@ flowthings_io_api *flowthings_io_api_init(const char *version,
 void flowthings_io_api_cleanup(flowthings_io_api *api)
 {
 	if (api) {
+		while (api->op_pool_count > 0)
+			__flowthings_io_op_free(api->op_pool[--api->op_pool_count]);
+
+		pthread_mutex_destroy(&api->op_pool_lock);
+
+		flowthings_io_cache_cleanup(api->cache);
+		flowthings_io_resolver_cleanup(api->resolver);
+
 		if (api->fhttp) flowthings_io_http_cleanup(api->fhttp);
 
 		free(api);
 	}
 }
 
+/*
+ * NAME: flowthings_io_api_poll
+ *
+ * Runs any asynchronous service calls that are in flight (see flowthings_io_service_*_async) for
+ * up to timeout_ms milliseconds.  Completion callbacks are called from inside this function.
+ *
+ * PARAMS:
+ * api - the API object
+ * timeout_ms - the longest time to wait for network activity
+ *
+ * RETURN:
+ * Returns the number of calls that haven't completed yet.
+ */
+int flowthings_io_api_poll(flowthings_io_api *api, int timeout_ms)
+{
+	if (!api || !api->fhttp) return 0;
+
+	return flowthings_io_http_poll(api->fhttp, timeout_ms);
+}
+
+/*
+ * NAME: flowthings_io_api_run
+ *
+ * Runs all asynchronous service calls that are in flight until every one of them has completed,
+ * including any calls started from completion callbacks.
+ *
+ * PARAMS:
+ * api - the API object
+ */
+void flowthings_io_api_run(flowthings_io_api *api)
+{
+	if (!api || !api->fhttp) return;
+
+	while (flowthings_io_http_poll(api->fhttp, 1000) > 0)
+		;
+}
+
 
 #ifdef  __cplusplus
 }
@@ -11,7 +11,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <curl/curl.h>
 
 #ifdef  __cplusplus
 extern "C" {
@@ -24,14 +23,53 @@ extern "C" {
 
 #include "flowthings_io.h"
 #include "flowthings_io_http.h"
+#include "flowthings_io_cache.h"
+#include "flowthings_io_resolver.h"
 
 
 /***********************************************************************
  * Flowthings API object
  ***********************************************************************/
 
+/* the number of finished service calls each API object keeps for reuse */
+#define FLOWTHINGS_IO_API_OP_POOL_SIZE 16
+
+/* response buffers bigger than this are freed instead of being kept for reuse */
+#define FLOWTHINGS_IO_API_MAX_POOLED_RESPONSE (1024 * 1024)
+
+/* the most memory a pooled operation keeps for parsed responses, see flowthings_io_api_set_json_arena */
+#define FLOWTHINGS_IO_API_MAX_POOLED_ARENA (4 * 1024 * 1024)
+
+/* the default limits on one request made by a batch call, see flowthings_io_api_set_batch_limits */
+#define FLOWTHINGS_IO_API_BATCH_MAX_ITEMS 100
+#define FLOWTHINGS_IO_API_BATCH_MAX_BYTES (256 * 1024)
+
 typedef struct flowthings_io_api {
 	flowthings_io_http *fhttp;
+
+	/* decode responses as they arrive, see flowthings_io_api_set_stream_decode */
+	BOOL stream_decode;
+
+	/* send large request bodies as they are written, see flowthings_io_api_set_stream_upload */
+	BOOL stream_upload;
+
+	/* parse and build the trees for user callbacks in a per-operation arena, see flowthings_io_api_set_json_arena */
+	BOOL json_arena;
+
+	/* how batch calls split their objects into requests, see flowthings_io_api_set_batch_limits */
+	int batch_max_items;
+	size_t batch_max_bytes;
+
+	/* reads of flows, identities, groups and tracks, or NULL; see flowthings_io_api_set_cache */
+	flowthings_io_cache *cache;
+
+	/* flow paths to flow IDs, or NULL; see flowthings_io_api_set_resolver */
+	flowthings_io_resolver *resolver;
+
+	/* finished service calls, kept with their response buffers so the next call doesn't allocate */
+	pthread_mutex_t op_pool_lock;
+	struct flowthings_io_op *op_pool[FLOWTHINGS_IO_API_OP_POOL_SIZE];
+	int op_pool_count;
 } flowthings_io_api;
 
 
@@ -42,7 +80,10 @@ typedef struct flowthings_io_api {
 /*
  * NAME: flowthings_io_api_init
  *
- * Initializes the flowthings_io api object and returns it
+ * Initializes the flowthings_io api object and returns it.  One api object can be shared by all
+ * of a program's threads: the blocking service functions may be called on it from any number of
+ * threads at once, and reuse a pool of open connections.  It must be created before those
+ * threads are started.
  *
  * PARAMS:
  * version - the flowthings platform version
@@ -54,6 +95,154 @@ typedef struct flowthings_io_api {
 flowthings_io_api *flowthings_io_api_init(const char *version,
 		const char *host, BOOL secure, flowthings_io_token *creds);
 
+/*
+ * NAME: flowthings_io_api_set_creds
+ *
+ * Changes the credentials used by the API.  This must also be called after changing the strings
+ * in the flowthings_io_token passed to flowthings_io_api_init, since the request headers are
+ * built from them once and reused.
+ *
+ * PARAMS:
+ * api - the API object
+ * creds - a flowthings_io_token object with the user's credentials
+ */
+void flowthings_io_api_set_creds(flowthings_io_api *api, flowthings_io_token *creds);
+
+/*
+ * NAME: flowthings_io_api_set_transport
+ *
+ * Replaces the transport that sends the API's requests; libcurl is used by default.  For
+ * example, flowthings_io_http_transport_mock (see flowthings_io_http_mock.h) answers requests
+ * from a table without using the network.  This must be called before any calls are made.
+ *
+ * PARAMS:
+ * api - the API object
+ * transport - the transport, which must stay valid as long as the API
+ * config - the transport's configuration
+ */
+void flowthings_io_api_set_transport(flowthings_io_api *api,
+		const flowthings_io_http_transport *transport, void *config);
+
+/*
+ * NAME: flowthings_io_api_set_stream_decode
+ *
+ * Chooses how responses are decoded.  By default the whole response is received, parsed and then
+ * decoded.  With stream decoding on, the body is decoded while the response is still arriving,
+ * and for find calls only one result is held in memory at a time, which keeps memory use flat for
+ * large responses.  This should be set before any calls are made.
+ *
+ * PARAMS:
+ * api - the API object
+ * stream_decode - TRUE to decode responses as they arrive
+ */
+void flowthings_io_api_set_stream_decode(flowthings_io_api *api, BOOL stream_decode);
+
+/*
+ * NAME: flowthings_io_api_set_stream_upload
+ *
+ * Chooses how find_many requests send their body.  By default the body for every flow is written
+ * before the request is sent.  With stream uploading on, it is written a flow at a time as the
+ * transport asks for more, with chunked transfer encoding, so memory use stays flat however many
+ * flows are asked for.  This should be set before any calls are made.
+ *
+ * PARAMS:
+ * api - the API object
+ * stream_upload - TRUE to write request bodies as they are sent
+ */
+void flowthings_io_api_set_stream_upload(flowthings_io_api *api, BOOL stream_upload);
+
+/*
+ * NAME: flowthings_io_api_set_json_arena
+ *
+ * Chooses where the cJSON trees given to your encoders and decoders are kept.  Turned on, each
+ * operation has an arena (see cJSON_ArenaCreate) that the trees are carved from and which is
+ * released all at once, rather than each item and string being malloc'd and freed on its own.
+ * The cJSON items passed to a decoder, and any it creates, are then gone once the decoder
+ * returns, so only turn it on if no decoder keeps a cJSON item in its object.  It is off by
+ * default; the library's own lookups, like flowthings_io_flow_resolve, use arenas either way.
+ * This should be set before any calls are made.
+ *
+ * PARAMS:
+ * api - the API object
+ * json_arena - TRUE to use arenas
+ */
+void flowthings_io_api_set_json_arena(flowthings_io_api *api, BOOL json_arena);
+
+/*
+ * NAME: flowthings_io_api_set_batch_limits
+ *
+ * Sets how the batch service calls (see flowthings_io_service_create_batch) split their objects
+ * into requests.  A request holds at most max_items objects, and no more than max_bytes of encoded
+ * JSON unless a single object is bigger than that on its own.
+ *
+ * PARAMS:
+ * api - the API object
+ * max_items - the most objects in one request, or 0 for FLOWTHINGS_IO_API_BATCH_MAX_ITEMS
+ * max_bytes - the largest request body, or 0 for FLOWTHINGS_IO_API_BATCH_MAX_BYTES
+ */
+void flowthings_io_api_set_batch_limits(flowthings_io_api *api, int max_items, size_t max_bytes);
+
+/*
+ * NAME: flowthings_io_api_set_cache
+ *
+ * Turns on a read-through cache for flowthings_io_flow_read, flowthings_io_identity_read,
+ * flowthings_io_group_read and flowthings_io_track_read (reads without a path extension or
+ * parameters).  A read of an object that was read less than ttl_ms ago is decoded from the cached
+ * JSON without a request.  Once an entry is older than that, the next read asks the platform for
+ * the object only if it has changed (If-None-Match with the entry's ETag), and decodes the cached
+ * JSON if it hasn't.  Updating or deleting an object through this API drops its entry; changes
+ * made elsewhere are seen once the entry goes stale.  This must be called before any calls are
+ * made.
+ *
+ * PARAMS:
+ * api - the API object
+ * max_entries - the most objects to keep, dropping the least recently used; 0 turns the cache off
+ * ttl_ms - how long an entry is used without asking the platform; 0 revalidates every read
+ */
+void flowthings_io_api_set_cache(flowthings_io_api *api, int max_entries, int ttl_ms);
+
+/*
+ * NAME: flowthings_io_api_get_cache_stats
+ *
+ * Fills in the cache's hit and miss counters (see flowthings_io_cache_stats); they're all 0 if
+ * the cache is off.
+ *
+ * PARAMS:
+ * api - the API object
+ * stats - filled in
+ */
+void flowthings_io_api_get_cache_stats(flowthings_io_api *api, flowthings_io_cache_stats *stats);
+
+/*
+ * NAME: flowthings_io_api_set_resolver
+ *
+ * Turns on the map from flow paths to flow IDs used by flowthings_io_flow_resolve.  A path is
+ * looked up on the platform the first time it's resolved, and then kept until the flow is updated
+ * or deleted through this API, or ttl_ms passes.  A path with no flow is remembered for
+ * missing_ttl_ms, or until a flow is created or updated through this API.  This must be called
+ * before any calls are made.
+ *
+ * PARAMS:
+ * api - the API object
+ * max_entries - the most paths to keep, dropping the least recently used; 0 turns the map off
+ * ttl_ms - how long a flow ID is kept, or 0 to keep it until the flow is changed through this API
+ * missing_ttl_ms - how long a path with no flow is remembered, or 0 not to remember them
+ */
+void flowthings_io_api_set_resolver(flowthings_io_api *api, int max_entries, int ttl_ms,
+		int missing_ttl_ms);
+
+/*
+ * NAME: flowthings_io_api_get_resolver_stats
+ *
+ * Fills in the resolver's counters (see flowthings_io_resolver_stats); they're all 0 if it's off.
+ *
+ * PARAMS:
+ * api - the API object
+ * stats - filled in
+ */
+void flowthings_io_api_get_resolver_stats(flowthings_io_api *api,
+		flowthings_io_resolver_stats *stats);
+
 /*
  * NAME: flowthings_io_api_cleanup
  *
@@ -62,6 +251,32 @@ flowthings_io_api *flowthings_io_api_init(const char *version,
  */
 void flowthings_io_api_cleanup(flowthings_io_api *api);
 
+/*
+ * NAME: flowthings_io_api_poll
+ *
+ * Runs any asynchronous service calls that are in flight (see flowthings_io_service_*_async) for
+ * up to timeout_ms milliseconds.  Completion callbacks are called from inside this function.
+ *
+ * PARAMS:
+ * api - the API object
+ * timeout_ms - the longest time to wait for network activity
+ *
+ * RETURN:
+ * Returns the number of calls that haven't completed yet.
+ */
+int flowthings_io_api_poll(flowthings_io_api *api, int timeout_ms);
+
+/*
+ * NAME: flowthings_io_api_run
+ *
+ * Runs all asynchronous service calls that are in flight until every one of them has completed,
+ * including any calls started from completion callbacks.
+ *
+ * PARAMS:
+ * api - the API object
+ */
+void flowthings_io_api_run(flowthings_io_api *api);
+
 
 
 #ifdef  __cplusplus
@@ -0,0 +1,392 @@
+/*
+ * flowthings_io_cache.c
+ *
+ * A read-through cache of platform objects.  Entries are kept in a hash table for lookups and in
+ * a list ordered by use for eviction, both guarded by one lock.
+ */
+
+/* the cache's clock is POSIX's monotonic one */
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io_cache.h"
+
+
+/***********************************************************************
+ * The cache object
+ ***********************************************************************/
+
+typedef struct __flowthings_io_cache_entry {
+
+	int svc;
+	char *id;
+	size_t id_len;
+	unsigned int hash;
+
+	char *body;
+	size_t body_len;
+	char etag[FLOWTHINGS_IO_HTTP_MAX_ETAG_SIZE];
+	unsigned long long expires_ms;
+
+	struct __flowthings_io_cache_entry *hash_next;
+
+	/* the use list, most recently used first */
+	struct __flowthings_io_cache_entry *prev;
+	struct __flowthings_io_cache_entry *next;
+
+} __flowthings_io_cache_entry;
+
+struct flowthings_io_cache {
+
+	pthread_mutex_t lock;
+
+	int max_entries;
+	unsigned long long ttl_ms;
+
+	__flowthings_io_cache_entry **buckets;
+	unsigned int bucket_mask;
+
+	__flowthings_io_cache_entry *first;
+	__flowthings_io_cache_entry *last;
+
+	/* counts invalidations, see flowthings_io_cache_store */
+	unsigned long version;
+
+	flowthings_io_cache_stats stats;
+};
+
+
+/***********************************************************************
+ * Helper functions
+ ***********************************************************************/
+
+static unsigned long long __flowthings_io_cache_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static unsigned int __flowthings_io_cache_hash(int svc, const char *id, size_t id_len)
+{
+	unsigned int hash = 2166136261u ^ (unsigned int)svc;
+	size_t i;
+
+	for (i = 0; i < id_len; i++)
+		hash = (hash ^ (unsigned char)id[i]) * 16777619u;
+
+	return hash;
+}
+
+/*
+ * NAME: __flowthings_io_cache_find
+ *
+ * Returns the entry for an object, or NULL.  Called with the lock held.
+ */
+static __flowthings_io_cache_entry *__flowthings_io_cache_find(flowthings_io_cache *cache,
+		int svc, const char *id, size_t id_len, unsigned int hash)
+{
+	__flowthings_io_cache_entry *e;
+
+	for (e = cache->buckets[hash & cache->bucket_mask]; e; e = e->hash_next) {
+		if (e->hash == hash && e->svc == svc && e->id_len == id_len && !memcmp(e->id, id, id_len))
+			return e;
+	}
+
+	return NULL;
+}
+
+static void __flowthings_io_cache_unlink(flowthings_io_cache *cache, __flowthings_io_cache_entry *e)
+{
+	if (e->prev) e->prev->next = e->next; else cache->first = e->next;
+	if (e->next) e->next->prev = e->prev; else cache->last = e->prev;
+	e->prev = e->next = NULL;
+}
+
+static void __flowthings_io_cache_push(flowthings_io_cache *cache, __flowthings_io_cache_entry *e)
+{
+	e->prev = NULL;
+	e->next = cache->first;
+	if (cache->first) cache->first->prev = e; else cache->last = e;
+	cache->first = e;
+}
+
+/*
+ * NAME: __flowthings_io_cache_remove
+ *
+ * Takes an entry out of the cache and frees it.  Called with the lock held.
+ */
+static void __flowthings_io_cache_remove(flowthings_io_cache *cache, __flowthings_io_cache_entry *e)
+{
+	__flowthings_io_cache_entry **p;
+
+	for (p = &cache->buckets[e->hash & cache->bucket_mask]; *p != e; p = &(*p)->hash_next)
+		;
+	*p = e->hash_next;
+
+	__flowthings_io_cache_unlink(cache, e);
+	cache->stats.entries--;
+
+	free(e->id);
+	free(e->body);
+	free(e);
+}
+
+
+/***********************************************************************
+ * The cache functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_cache_init
+ *
+ * Creates a cache.
+ *
+ * PARAMS:
+ * max_entries - the most objects to keep
+ * ttl_ms - how long an entry is used without revalidating it
+ */
+flowthings_io_cache *flowthings_io_cache_init(int max_entries, int ttl_ms)
+{
+	flowthings_io_cache *cache = malloc(sizeof(flowthings_io_cache));
+	unsigned int buckets = 16;
+
+	if (!cache || max_entries <= 0) FAIL;
+
+	memset(cache, 0, sizeof(flowthings_io_cache));
+
+	/* keep the chains short */
+	while (buckets < (unsigned int)max_entries * 2)
+		buckets *= 2;
+
+	cache->buckets = calloc(buckets, sizeof(__flowthings_io_cache_entry *));
+	if (!cache->buckets) FAIL;
+
+	cache->bucket_mask = buckets - 1;
+	cache->max_entries = max_entries;
+	cache->ttl_ms = ttl_ms > 0 ? ttl_ms : 0;
+
+	pthread_mutex_init(&cache->lock, NULL);
+
+	return cache;
+}
+
+/*
+ * NAME: flowthings_io_cache_lookup
+ *
+ * Looks up an object, copying its body and entity tag if there's an entry.
+ */
+int flowthings_io_cache_lookup(flowthings_io_cache *cache, int svc, const char *id, size_t id_len,
+		flowthings_io_string *body, char *etag, unsigned long *version)
+{
+	unsigned int hash = __flowthings_io_cache_hash(svc, id, id_len);
+	__flowthings_io_cache_entry *e;
+	int found = FLOWTHINGS_IO_CACHE_MISS;
+
+	pthread_mutex_lock(&cache->lock);
+
+	*version = cache->version;
+
+	e = __flowthings_io_cache_find(cache, svc, id, id_len, hash);
+
+	if (e) {
+		found = __flowthings_io_cache_now_ms() < e->expires_ms ?
+				FLOWTHINGS_IO_CACHE_FRESH : FLOWTHINGS_IO_CACHE_STALE;
+
+		flowthings_io_string_reset(body);
+		flowthings_io_string_append(body, e->body, e->body_len);
+		strcpy(etag, e->etag);
+
+		__flowthings_io_cache_unlink(cache, e);
+		__flowthings_io_cache_push(cache, e);
+	}
+
+	if (found == FLOWTHINGS_IO_CACHE_FRESH)
+		cache->stats.hits++;
+	else if (found == FLOWTHINGS_IO_CACHE_STALE)
+		cache->stats.stale++;
+	else
+		cache->stats.misses++;
+
+	pthread_mutex_unlock(&cache->lock);
+
+	return found;
+}
+
+/*
+ * NAME: flowthings_io_cache_store
+ *
+ * Adds or replaces an object's entry, unless an object was invalidated since the lookup.
+ */
+void flowthings_io_cache_store(flowthings_io_cache *cache, int svc, const char *id, size_t id_len,
+		const char *body, size_t body_len, const char *etag, unsigned long version)
+{
+	unsigned int hash = __flowthings_io_cache_hash(svc, id, id_len);
+	__flowthings_io_cache_entry *e;
+	char *copy;
+
+	if (strlen(etag) >= FLOWTHINGS_IO_HTTP_MAX_ETAG_SIZE)
+		etag = "";
+
+	/* copy outside the lock */
+	copy = malloc(body_len + 1);
+	if (!copy) FAIL;
+	memcpy(copy, body, body_len);
+	copy[body_len] = '\0';
+
+	pthread_mutex_lock(&cache->lock);
+
+	if (version != cache->version) {
+		pthread_mutex_unlock(&cache->lock);
+		free(copy);
+		return;
+	}
+
+	e = __flowthings_io_cache_find(cache, svc, id, id_len, hash);
+
+	if (e) {
+		free(e->body);
+		__flowthings_io_cache_unlink(cache, e);
+	}
+	else {
+		e = malloc(sizeof(__flowthings_io_cache_entry));
+		if (!e) FAIL;
+		memset(e, 0, sizeof(__flowthings_io_cache_entry));
+
+		e->id = malloc(id_len + 1);
+		if (!e->id) FAIL;
+		memcpy(e->id, id, id_len);
+		e->id[id_len] = '\0';
+
+		e->svc = svc;
+		e->id_len = id_len;
+		e->hash = hash;
+		e->hash_next = cache->buckets[hash & cache->bucket_mask];
+		cache->buckets[hash & cache->bucket_mask] = e;
+		cache->stats.entries++;
+	}
+
+	e->body = copy;
+	e->body_len = body_len;
+	strcpy(e->etag, etag);
+	e->expires_ms = __flowthings_io_cache_now_ms() + cache->ttl_ms;
+
+	__flowthings_io_cache_push(cache, e);
+
+	while (cache->stats.entries > cache->max_entries) {
+		__flowthings_io_cache_remove(cache, cache->last);
+		cache->stats.evictions++;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * NAME: flowthings_io_cache_revalidated
+ *
+ * Marks an object's entry fresh again.
+ */
+void flowthings_io_cache_revalidated(flowthings_io_cache *cache, int svc, const char *id,
+		size_t id_len)
+{
+	unsigned int hash = __flowthings_io_cache_hash(svc, id, id_len);
+	__flowthings_io_cache_entry *e;
+
+	pthread_mutex_lock(&cache->lock);
+
+	cache->stats.revalidated++;
+
+	e = __flowthings_io_cache_find(cache, svc, id, id_len, hash);
+	if (e)
+		e->expires_ms = __flowthings_io_cache_now_ms() + cache->ttl_ms;
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * NAME: flowthings_io_cache_invalidate
+ *
+ * Drops an object's entry, if it has one.
+ */
+void flowthings_io_cache_invalidate(flowthings_io_cache *cache, int svc, const char *id,
+		size_t id_len)
+{
+	unsigned int hash = __flowthings_io_cache_hash(svc, id, id_len);
+	__flowthings_io_cache_entry *e;
+
+	pthread_mutex_lock(&cache->lock);
+
+	cache->version++;
+
+	e = __flowthings_io_cache_find(cache, svc, id, id_len, hash);
+	if (e) {
+		__flowthings_io_cache_remove(cache, e);
+		cache->stats.invalidations++;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * NAME: flowthings_io_cache_clear
+ *
+ * Drops every entry.
+ */
+void flowthings_io_cache_clear(flowthings_io_cache *cache)
+{
+	pthread_mutex_lock(&cache->lock);
+
+	cache->version++;
+
+	while (cache->first)
+		__flowthings_io_cache_remove(cache, cache->first);
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * NAME: flowthings_io_cache_get_stats
+ *
+ * Fills in the cache's counters.
+ */
+void flowthings_io_cache_get_stats(flowthings_io_cache *cache, flowthings_io_cache_stats *stats)
+{
+	pthread_mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * NAME: flowthings_io_cache_cleanup
+ *
+ * Frees a cache and its entries.
+ */
+void flowthings_io_cache_cleanup(flowthings_io_cache *cache)
+{
+	if (!cache) return;
+
+	flowthings_io_cache_clear(cache);
+
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->buckets);
+	free(cache);
+}
+
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,170 @@
+/*
+ * flowthings_io_cache.h
+ *
+ * A read-through cache of platform objects, keyed by service type and ID, which keeps the JSON
+ * body of each object with its entity tag so that a stale entry can be revalidated with a
+ * conditional request instead of being fetched again.
+ */
+
+#ifndef FLOWTHINGS_IO_CACHE_H_
+#define FLOWTHINGS_IO_CACHE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io.h"
+#include "flowthings_io_http.h"
+
+
+/***********************************************************************
+ * The cache object
+ ***********************************************************************/
+
+/* what flowthings_io_cache_lookup found */
+#define FLOWTHINGS_IO_CACHE_MISS 0
+#define FLOWTHINGS_IO_CACHE_FRESH 1
+#define FLOWTHINGS_IO_CACHE_STALE 2
+
+/*
+ * NAME: flowthings_io_cache_stats
+ *
+ * hits - reads answered from a fresh entry without a request
+ * misses - reads that had no entry
+ * stale - reads that found a stale entry and sent a conditional request
+ * revalidated - conditional requests the platform answered with 304, so the entry was used
+ * evictions - entries dropped to stay under the size limit
+ * invalidations - entries dropped because the object was updated or deleted
+ * entries - the number of entries in the cache
+ */
+typedef struct flowthings_io_cache_stats {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long stale;
+	unsigned long revalidated;
+	unsigned long evictions;
+	unsigned long invalidations;
+	int entries;
+} flowthings_io_cache_stats;
+
+typedef struct flowthings_io_cache flowthings_io_cache;
+
+
+/***********************************************************************
+ * The cache functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_cache_init
+ *
+ * Creates a cache.  Shouldn't be called directly from outside this library; see
+ * flowthings_io_api_set_cache.
+ *
+ * PARAMS:
+ * max_entries - the most objects to keep; the least recently used are dropped first
+ * ttl_ms - how long an entry is used without asking the platform whether it has changed; 0 means
+ *     every read is revalidated
+ */
+flowthings_io_cache *flowthings_io_cache_init(int max_entries, int ttl_ms);
+
+/*
+ * NAME: flowthings_io_cache_lookup
+ *
+ * Looks up an object.  If there's an entry, fresh or stale, its body is copied to body and its
+ * entity tag to etag.
+ *
+ * PARAMS:
+ * cache - the cache
+ * svc - the service type
+ * id, id_len - the object ID
+ * body - set to the cached JSON body
+ * etag - a buffer of FLOWTHINGS_IO_HTTP_MAX_ETAG_SIZE, set to the entity tag, or "" if there isn't
+ *     one
+ * version - set to a value to pass to flowthings_io_cache_store, so that an object read while it
+ *     was being changed isn't stored
+ *
+ * RETURN:
+ * Returns FLOWTHINGS_IO_CACHE_MISS, FLOWTHINGS_IO_CACHE_FRESH or FLOWTHINGS_IO_CACHE_STALE.
+ */
+int flowthings_io_cache_lookup(flowthings_io_cache *cache, int svc, const char *id, size_t id_len,
+		flowthings_io_string *body, char *etag, unsigned long *version);
+
+/*
+ * NAME: flowthings_io_cache_store
+ *
+ * Adds or replaces an object's entry.  Nothing is stored if an object was invalidated since the
+ * lookup that returned version.
+ *
+ * PARAMS:
+ * cache - the cache
+ * svc - the service type
+ * id, id_len - the object ID
+ * body, body_len - the object's JSON body
+ * etag - the response's entity tag, or ""
+ * version - from flowthings_io_cache_lookup
+ */
+void flowthings_io_cache_store(flowthings_io_cache *cache, int svc, const char *id, size_t id_len,
+		const char *body, size_t body_len, const char *etag, unsigned long version);
+
+/*
+ * NAME: flowthings_io_cache_revalidated
+ *
+ * Marks an object's entry fresh again, after the platform answered a conditional request with
+ * 304.
+ *
+ * PARAMS:
+ * cache - the cache
+ * svc - the service type
+ * id, id_len - the object ID
+ */
+void flowthings_io_cache_revalidated(flowthings_io_cache *cache, int svc, const char *id,
+		size_t id_len);
+
+/*
+ * NAME: flowthings_io_cache_invalidate
+ *
+ * Drops an object's entry, if it has one.
+ *
+ * PARAMS:
+ * cache - the cache
+ * svc - the service type
+ * id, id_len - the object ID
+ */
+void flowthings_io_cache_invalidate(flowthings_io_cache *cache, int svc, const char *id,
+		size_t id_len);
+
+/*
+ * NAME: flowthings_io_cache_clear
+ *
+ * Drops every entry.
+ */
+void flowthings_io_cache_clear(flowthings_io_cache *cache);
+
+/*
+ * NAME: flowthings_io_cache_get_stats
+ *
+ * Fills in the cache's counters.
+ */
+void flowthings_io_cache_get_stats(flowthings_io_cache *cache, flowthings_io_cache_stats *stats);
+
+/*
+ * NAME: flowthings_io_cache_cleanup
+ *
+ * Frees a cache and its entries.
+ */
+void flowthings_io_cache_cleanup(flowthings_io_cache *cache);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* FLOWTHINGS_IO_CACHE_H_ */
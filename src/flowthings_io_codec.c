@@ -0,0 +1,407 @@
+/*
+ * flowthings_io_codec.c
+ *
+ * Encodes structs to JSON text and decodes them from it, following a table of fields.  Decoding
+ * walks the text once with a flowthings_io_json_reader, keeping the path of the current key, and
+ * converts the values whose paths have fields straight into the struct; everything else is
+ * skipped without being converted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io_codec.h"
+#include "flowthings_io_json.h"
+
+
+/***********************************************************************
+ * Helper functions
+ ***********************************************************************/
+
+/*
+ * NAME: __flowthings_io_codec_field_ok
+ *
+ * Returns TRUE if a field's size matches its type.
+ */
+static BOOL __flowthings_io_codec_field_ok(const flowthings_io_field *field)
+{
+	switch (field->type & FLOWTHINGS_IO_FIELD_TYPE_MASK) {
+	case FLOWTHINGS_IO_FIELD_INT:
+		return field->size == sizeof(int);
+	case FLOWTHINGS_IO_FIELD_LONG:
+		return field->size == sizeof(long long);
+	case FLOWTHINGS_IO_FIELD_DOUBLE:
+		return field->size == sizeof(double);
+	case FLOWTHINGS_IO_FIELD_BOOL:
+		return field->size == sizeof(BOOL);
+	case FLOWTHINGS_IO_FIELD_STRING:
+		return field->size > 0;
+	default:
+		return FALSE;
+	}
+}
+
+
+/***********************************************************************
+ * Encoding
+ ***********************************************************************/
+
+static void __flowthings_io_codec_put_value(flowthings_io_string *out,
+		const flowthings_io_field *field, const char *member)
+{
+	const char *end;
+	char buf[cJSON_NumberBufferSize];
+
+	switch (field->type & FLOWTHINGS_IO_FIELD_TYPE_MASK) {
+	case FLOWTHINGS_IO_FIELD_INT:
+		cJSON_WriteInt64(*(const int *)member, buf);
+		break;
+	case FLOWTHINGS_IO_FIELD_LONG:
+		cJSON_WriteInt64(*(const long long *)member, buf);
+		break;
+	case FLOWTHINGS_IO_FIELD_DOUBLE:
+		/* the shortest digits that read back the same, and null for NaN and infinity */
+		cJSON_WriteNumber(*(const double *)member, buf);
+		break;
+	case FLOWTHINGS_IO_FIELD_BOOL:
+		strcpy(buf, *(const BOOL *)member ? "true" : "false");
+		break;
+	default:
+		end = memchr(member, '\0', field->size);
+		flowthings_io_json_escape(out, member, end ? (size_t)(end - member) : field->size);
+		return;
+	}
+
+	flowthings_io_string_strcat(out, buf);
+}
+
+/*
+ * NAME: flowthings_io_codec_encode
+ *
+ * Appends an object to a string as compact JSON.  The objects in the fields' paths are opened
+ * and closed as the paths change from one field to the next.
+ */
+BOOL flowthings_io_codec_encode(const flowthings_io_codec *codec, const void *object,
+		flowthings_io_string *out)
+{
+	const char *seg[FLOWTHINGS_IO_CODEC_MAX_DEPTH], *open[FLOWTHINGS_IO_CODEC_MAX_DEPTH];
+	size_t seg_len[FLOWTHINGS_IO_CODEC_MAX_DEPTH], open_len[FLOWTHINGS_IO_CODEC_MAX_DEPTH];
+	BOOL first[FLOWTHINGS_IO_CODEC_MAX_DEPTH];
+	const flowthings_io_field *field;
+	const char *p, *dot;
+	int i, d, segs, open_count = 0, common;
+
+	if (!codec || !object || !out)
+		return FALSE;
+
+	flowthings_io_string_append(out, "{", 1);
+	first[0] = TRUE;
+
+	for (i = 0; i < codec->field_count; i++) {
+
+		field = &codec->fields[i];
+
+		if (!__flowthings_io_codec_field_ok(field))
+			return FALSE;
+
+		if (field->type & FLOWTHINGS_IO_FIELD_READ_ONLY)
+			continue;
+
+		/* split the path into its keys */
+		for (segs = 0, p = field->path; ; p = dot + 1) {
+			if (segs == FLOWTHINGS_IO_CODEC_MAX_DEPTH)
+				return FALSE;
+			dot = strchr(p, '.');
+			seg[segs] = p;
+			seg_len[segs++] = dot ? (size_t)(dot - p) : strlen(p);
+			if (!dot)
+				break;
+		}
+
+		/* close the objects this field isn't in, and open the ones it is */
+		for (common = 0; common < open_count && common < segs - 1; common++) {
+			if (open_len[common] != seg_len[common] || memcmp(open[common], seg[common], seg_len[common]))
+				break;
+		}
+
+		for (; open_count > common; open_count--)
+			flowthings_io_string_append(out, "}", 1);
+
+		for (d = 0; d < segs; d++) {
+
+			if (d < open_count)
+				continue;
+
+			if (!first[d])
+				flowthings_io_string_append(out, ",", 1);
+			first[d] = FALSE;
+
+			flowthings_io_json_escape(out, seg[d], seg_len[d]);
+			flowthings_io_string_append(out, ":", 1);
+
+			if (d == segs - 1)
+				break;
+
+			flowthings_io_string_append(out, "{", 1);
+			open[d] = seg[d];
+			open_len[d] = seg_len[d];
+			open_count++;
+			first[d + 1] = TRUE;
+		}
+
+		__flowthings_io_codec_put_value(out, field, (const char *)object + field->offset);
+	}
+
+	for (; open_count > 0; open_count--)
+		flowthings_io_string_append(out, "}", 1);
+
+	flowthings_io_string_append(out, "}", 1);
+
+	return TRUE;
+}
+
+
+/***********************************************************************
+ * Decoding
+ ***********************************************************************/
+
+typedef struct __flowthings_io_codec_parser {
+	flowthings_io_json_reader *reader;
+
+	const flowthings_io_codec *codec;
+	char *object;
+
+	/* the path of the current key, e.g. elems.num */
+	char path[FLOWTHINGS_IO_CODEC_MAX_PATH];
+	size_t path_len;
+} __flowthings_io_codec_parser;
+
+static BOOL __flowthings_io_codec_parse_value(__flowthings_io_codec_parser *parser, int field);
+
+/*
+ * NAME: __flowthings_io_codec_store
+ *
+ * Converts the value just read, event, into a field's member.  A value of the wrong type is
+ * skipped.
+ */
+static BOOL __flowthings_io_codec_store(__flowthings_io_codec_parser *parser,
+		const flowthings_io_field *field, flowthings_io_json_event event)
+{
+	flowthings_io_json_reader *reader = parser->reader;
+	char *member = parser->object + field->offset;
+
+	switch (field->type & FLOWTHINGS_IO_FIELD_TYPE_MASK) {
+
+	case FLOWTHINGS_IO_FIELD_INT:
+	case FLOWTHINGS_IO_FIELD_LONG:
+	case FLOWTHINGS_IO_FIELD_DOUBLE:
+		if (event != FLOWTHINGS_IO_JSON_NUMBER)
+			break;
+
+		/* an integer field sent as a fraction or with an exponent gets the whole part */
+		if ((field->type & FLOWTHINGS_IO_FIELD_TYPE_MASK) == FLOWTHINGS_IO_FIELD_DOUBLE)
+			*(double *)member = reader->number;
+		else if ((field->type & FLOWTHINGS_IO_FIELD_TYPE_MASK) == FLOWTHINGS_IO_FIELD_INT)
+			*(int *)member = (int)reader->integer;
+		else
+			*(long long *)member = reader->integer;
+
+		return TRUE;
+
+	case FLOWTHINGS_IO_FIELD_BOOL:
+		if (event == FLOWTHINGS_IO_JSON_TRUE || event == FLOWTHINGS_IO_JSON_FALSE) {
+			*(BOOL *)member = event == FLOWTHINGS_IO_JSON_TRUE;
+			return TRUE;
+		}
+		break;
+
+	case FLOWTHINGS_IO_FIELD_STRING:
+		if (event == FLOWTHINGS_IO_JSON_STRING)
+			return flowthings_io_json_reader_string(reader, member, field->size);
+		break;
+	}
+
+	/* an array is skipped whole; any other value has been read already */
+	if (event == FLOWTHINGS_IO_JSON_BEGIN_ARRAY)
+		return flowthings_io_json_skip(reader);
+
+	return event != FLOWTHINGS_IO_JSON_ERROR;
+}
+
+/*
+ * NAME: __flowthings_io_codec_match
+ *
+ * Returns the index of the field for the current path, or -1, and sets parent if some field is
+ * inside the object at the current path.
+ */
+static int __flowthings_io_codec_match(__flowthings_io_codec_parser *parser, BOOL *parent)
+{
+	const flowthings_io_codec *codec = parser->codec;
+	const char *path = parser->path;
+	size_t path_len = parser->path_len;
+	int i, found = -1;
+
+	*parent = FALSE;
+
+	for (i = 0; i < codec->field_count; i++) {
+
+		const char *field_path = codec->fields[i].path;
+
+		if (strncmp(field_path, path, path_len))
+			continue;
+
+		if (field_path[path_len] == '\0') {
+			if (found < 0)
+				found = i;
+		}
+		else if (field_path[path_len] == '.') {
+			*parent = TRUE;
+		}
+	}
+
+	return found;
+}
+
+/*
+ * NAME: __flowthings_io_codec_parse_object
+ *
+ * Parses an object, after the event for its opening brace.  If field isn't -1, the object is the
+ * value of that field, and its "value" key is used as the field's value.
+ */
+static BOOL __flowthings_io_codec_parse_object(__flowthings_io_codec_parser *parser, int field)
+{
+	flowthings_io_json_reader *reader = parser->reader;
+	size_t saved = parser->path_len, key_len;
+	flowthings_io_json_event event;
+	BOOL ok, parent;
+	int key_field;
+
+	for (;;) {
+
+		event = flowthings_io_json_next(reader);
+
+		if (event == FLOWTHINGS_IO_JSON_END_OBJECT)
+			return TRUE;
+
+		if (event != FLOWTHINGS_IO_JSON_KEY)
+			return FALSE;
+
+		key_len = reader->str_len;
+
+		if (field >= 0) {
+			if (flowthings_io_json_key_is(reader, "value"))
+				ok = __flowthings_io_codec_parse_value(parser, field);
+			else
+				ok = flowthings_io_json_skip(reader);
+		}
+		else if (saved + key_len + 2 > sizeof(parser->path)) {
+			ok = flowthings_io_json_skip(reader);
+		}
+		else {
+			if (saved > 0)
+				parser->path[parser->path_len++] = '.';
+			memcpy(parser->path + parser->path_len, reader->str, key_len);
+			parser->path_len += key_len;
+			parser->path[parser->path_len] = '\0';
+
+			key_field = __flowthings_io_codec_match(parser, &parent);
+
+			if (key_field >= 0 || parent)
+				ok = __flowthings_io_codec_parse_value(parser, key_field);
+			else
+				ok = flowthings_io_json_skip(reader);
+
+			parser->path_len = saved;
+			parser->path[saved] = '\0';
+		}
+
+		if (!ok)
+			return FALSE;
+	}
+}
+
+/*
+ * NAME: __flowthings_io_codec_parse_value
+ *
+ * Parses the value at the current path, which has the given field, or -1 if it only has fields
+ * inside it.
+ */
+static BOOL __flowthings_io_codec_parse_value(__flowthings_io_codec_parser *parser, int field)
+{
+	flowthings_io_json_event event = flowthings_io_json_next(parser->reader);
+
+	if (event == FLOWTHINGS_IO_JSON_BEGIN_OBJECT)
+		return __flowthings_io_codec_parse_object(parser, field);
+
+	if (field < 0) {
+		if (event == FLOWTHINGS_IO_JSON_BEGIN_ARRAY)
+			return flowthings_io_json_skip(parser->reader);
+		return event != FLOWTHINGS_IO_JSON_ERROR;
+	}
+
+	return __flowthings_io_codec_store(parser, &parser->codec->fields[field], event);
+}
+
+/*
+ * NAME: flowthings_io_codec_decode_next
+ *
+ * Decodes the next value from a reader, which must be an object, into a struct.
+ */
+BOOL flowthings_io_codec_decode_next(const flowthings_io_codec *codec,
+		flowthings_io_json_reader *reader, void *object)
+{
+	__flowthings_io_codec_parser parser;
+	int i;
+
+	if (!codec || !reader || !object)
+		return FALSE;
+
+	for (i = 0; i < codec->field_count; i++)
+		if (!__flowthings_io_codec_field_ok(&codec->fields[i]))
+			return FALSE;
+
+	parser.reader = reader;
+	parser.codec = codec;
+	parser.object = (char *)object;
+	parser.path[0] = '\0';
+	parser.path_len = 0;
+
+	if (flowthings_io_json_next(reader) != FLOWTHINGS_IO_JSON_BEGIN_OBJECT)
+		return FALSE;
+
+	return __flowthings_io_codec_parse_object(&parser, -1);
+}
+
+/*
+ * NAME: flowthings_io_codec_decode
+ *
+ * Decodes a JSON object into a struct, reading it with a flowthings_io_json_reader.
+ */
+BOOL flowthings_io_codec_decode(const flowthings_io_codec *codec, const char *json, size_t len,
+		void *object)
+{
+	flowthings_io_json_reader reader;
+
+	if (!json)
+		return FALSE;
+
+	flowthings_io_json_reader_init(&reader, json, len);
+
+	return flowthings_io_codec_decode_next(codec, &reader, object)
+			&& flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_END;
+}
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,192 @@
+/*
+ * flowthings_io_codec.h
+ *
+ * Codecs that encode and decode a C struct from a table describing its fields, instead of
+ * hand-written encoder and decoder callbacks.  Objects are written straight to JSON text and
+ * read straight from it, without building a cJSON tree.
+ *
+ * A codec is declared with a list of fields, each naming the struct member, its JSON path and
+ * its type:
+ *
+ *   struct my_drop {
+ *       char id[FLOWTHINGS_IO_ID_LEN];
+ *       int num;
+ *       char label[32];
+ *   };
+ *
+ *   #define MY_DROP_FIELDS(X) \
+ *       X(struct my_drop, id, "id", FLOWTHINGS_IO_FIELD_STRING | FLOWTHINGS_IO_FIELD_READ_ONLY) \
+ *       X(struct my_drop, num, "elems.num", FLOWTHINGS_IO_FIELD_INT) \
+ *       X(struct my_drop, label, "elems.label", FLOWTHINGS_IO_FIELD_STRING)
+ *
+ *   FLOWTHINGS_IO_CODEC_DEFINE(my_drop_codec, struct my_drop, MY_DROP_FIELDS)
+ *
+ * and passed to the *_codec service functions, e.g. flowthings_io_drop_create_codec.
+ */
+
+#ifndef FLOWTHINGS_IO_CODEC_H_
+#define FLOWTHINGS_IO_CODEC_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io.h"
+#include "flowthings_io_json.h"
+
+
+/***********************************************************************
+ * The codec object
+ ***********************************************************************/
+
+/* the most levels of objects in a field's path, e.g. elems.num has 2 */
+#define FLOWTHINGS_IO_CODEC_MAX_DEPTH 8
+
+/* the longest path of a field */
+#define FLOWTHINGS_IO_CODEC_MAX_PATH 128
+
+/*
+ * NAME: flowthings_io_field_type
+ *
+ * The C type of a field.  One of these may be or'ed with FLOWTHINGS_IO_FIELD_READ_ONLY.
+ *
+ * FLOWTHINGS_IO_FIELD_INT - an int
+ * FLOWTHINGS_IO_FIELD_LONG - a long long
+ * FLOWTHINGS_IO_FIELD_DOUBLE - a double
+ * FLOWTHINGS_IO_FIELD_BOOL - a BOOL, sent as true or false
+ * FLOWTHINGS_IO_FIELD_STRING - a char array, null terminated; longer strings are cut to fit
+ */
+typedef enum flowthings_io_field_type {
+	FLOWTHINGS_IO_FIELD_INT = 1,
+	FLOWTHINGS_IO_FIELD_LONG,
+	FLOWTHINGS_IO_FIELD_DOUBLE,
+	FLOWTHINGS_IO_FIELD_BOOL,
+	FLOWTHINGS_IO_FIELD_STRING
+} flowthings_io_field_type;
+
+/* the field is decoded but never encoded, like an object's id */
+#define FLOWTHINGS_IO_FIELD_READ_ONLY 0x100
+
+#define FLOWTHINGS_IO_FIELD_TYPE_MASK 0xff
+
+/*
+ * NAME: flowthings_io_field
+ *
+ * One field of a codec.
+ *
+ * path - where the field is in the JSON object, with a dot between the keys of nested objects,
+ *     e.g. elems.num; fields whose paths share a parent object must be next to each other
+ * type - a flowthings_io_field_type, possibly or'ed with FLOWTHINGS_IO_FIELD_READ_ONLY
+ * offset - the offset of the member in the struct
+ * size - the size of the member
+ */
+typedef struct flowthings_io_field {
+	const char *path;
+	int type;
+	size_t offset;
+	size_t size;
+} flowthings_io_field;
+
+/*
+ * NAME: flowthings_io_codec
+ *
+ * fields - the fields
+ * field_count - the number of fields
+ * size - the size of the struct, which is the stride of the result array in a find
+ */
+typedef struct flowthings_io_codec {
+	const flowthings_io_field *fields;
+	int field_count;
+	size_t size;
+} flowthings_io_codec;
+
+/* the entry for one field, for use as the X in a list of fields */
+#define FLOWTHINGS_IO_CODEC_FIELD(struct_type, member, path, type) \
+	{ path, type, offsetof(struct_type, member), sizeof(((struct_type *)0)->member) },
+
+/*
+ * NAME: FLOWTHINGS_IO_CODEC_DEFINE
+ *
+ * Defines a static codec called name for struct_type, from a list of fields FIELDS(X), which
+ * calls X(struct_type, member, path, type) for each field.
+ */
+#define FLOWTHINGS_IO_CODEC_DEFINE(name, struct_type, FIELDS) \
+	static const flowthings_io_field name##_fields[] = { FIELDS(FLOWTHINGS_IO_CODEC_FIELD) }; \
+	static const flowthings_io_codec name = { name##_fields, \
+			sizeof(name##_fields) / sizeof(name##_fields[0]), sizeof(struct_type) };
+
+
+/***********************************************************************
+ * The codec functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_codec_encode
+ *
+ * Appends an object to a string as compact JSON.  Read-only fields are left out.
+ *
+ * PARAMS:
+ * codec - the codec
+ * object - the struct to encode
+ * out - the string to append to
+ *
+ * RETURN:
+ * Returns FALSE if the codec is invalid, e.g. a field's path is too deep or its size doesn't match
+ * its type.
+ */
+BOOL flowthings_io_codec_encode(const flowthings_io_codec *codec, const void *object,
+		flowthings_io_string *out);
+
+/*
+ * NAME: flowthings_io_codec_decode
+ *
+ * Decodes a JSON object into a struct.  Members whose fields aren't in the JSON, or are null, are
+ * left as they are, and keys without a field are skipped.  Where a field's value is an object
+ * with a "value" key, as the platform sends drop elems (e.g. {"type": "integer", "value": 3}),
+ * that is used as the field's value.
+ *
+ * PARAMS:
+ * codec - the codec
+ * json - the JSON text, null terminated
+ * len - the length of json
+ * object - the struct to fill in
+ *
+ * RETURN:
+ * Returns FALSE if the JSON is malformed or isn't an object.
+ */
+BOOL flowthings_io_codec_decode(const flowthings_io_codec *codec, const char *json, size_t len,
+		void *object);
+
+/*
+ * NAME: flowthings_io_codec_decode_next
+ *
+ * Decodes the next value read by a pull reader (see flowthings_io_json.h) into a struct, as
+ * flowthings_io_codec_decode does, and leaves the reader after it.  This decodes the objects of
+ * an array where they are, e.g. the drops of a find response, without finding where each one
+ * ends first.
+ *
+ * PARAMS:
+ * codec - the codec
+ * reader - the reader; the next value it reads must be an object
+ * object - the struct to fill in
+ *
+ * RETURN:
+ * Returns FALSE if the JSON is malformed or the value isn't an object; reader->failed tells which.
+ */
+BOOL flowthings_io_codec_decode_next(const flowthings_io_codec *codec,
+		flowthings_io_json_reader *reader, void *object);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* FLOWTHINGS_IO_CODEC_H_ */
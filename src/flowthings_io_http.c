@@ -4,10 +4,13 @@
  *  Created on: May 20, 2015
  */
 
+/* recursive mutexes and <strings.h> are POSIX, not C99 */
+#define _XOPEN_SOURCE 700
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <curl/curl.h>
+#include <strings.h>
 
 
 #ifdef  __cplusplus
@@ -26,36 +29,270 @@ extern "C" {
  * HTTP utillity functions
  ***********************************************************************/
 
+/*
+ * NAME: __flowthings_io_http_string_steal
+ *
+ * Returns the buffer of a flowthings_io_string and frees the string object itself.
+ */
+static char *__flowthings_io_http_string_steal(flowthings_io_string *s, size_t *len)
+{
+	char *ptr = s->ptr;
+
+	if (len) *len = s->len;
+	free(s);
+
+	return ptr;
+}
+
+/*
+ * NAME: __flowthings_io_http_add_header
+ *
+ * Adds a "name: value" header to a template.
+ */
+static void __flowthings_io_http_add_header(flowthings_io_http_template *tmpl,
+		const char *name, const char *value)
+{
+	flowthings_io_string *s;
+
+	if (tmpl->header_count == FLOWTHINGS_IO_HTTP_MAX_HEADERS) FAIL;
+
+	s = flowthings_io_string_init();
+	flowthings_io_string_strcat(s, name);
+	flowthings_io_string_strcat(s, ": ");
+	flowthings_io_string_strcat(s, value);
+
+	tmpl->headers[tmpl->header_count++] = __flowthings_io_http_string_steal(s, NULL);
+}
+
+/*
+ * NAME: __flowthings_io_http_template_init
+ *
+ * Build a request template from the current host, version, credentials and base paths.  Called
+ * with the template lock held.
+ */
+static flowthings_io_http_template *__flowthings_io_http_template_init(flowthings_io_http *fhttp)
+{
+	flowthings_io_http_template *tmpl;
+	flowthings_io_string *s;
+	int i;
+
+	if (!fhttp || !fhttp->creds || !fhttp->creds->account || !fhttp->creds->token) FAIL;
+
+	tmpl = malloc(sizeof(flowthings_io_http_template));
+	if (!tmpl) FAIL;
+
+	memset(tmpl, 0, sizeof(flowthings_io_http_template));
+	tmpl->refs = 1;
+
+	s = flowthings_io_string_init();
+	flowthings_io_string_strcat(s, fhttp->secure ? "https://" : "http://");
+	flowthings_io_string_strcat(s, fhttp->host);
+	flowthings_io_string_strcat(s, "/v");
+	flowthings_io_string_strcat(s, fhttp->version);
+	flowthings_io_string_strcat(s, "/");
+	flowthings_io_http_escape(fhttp, fhttp->creds->account, s);
+	tmpl->url_prefix = __flowthings_io_http_string_steal(s, &tmpl->url_prefix_len);
+
+	for (i = 0; i < fhttp->base_path_count; i++) {
+		s = flowthings_io_string_init();
+		flowthings_io_string_strcat(s, tmpl->url_prefix);
+		flowthings_io_string_strcat(s, fhttp->base_paths[i]);
+
+		tmpl->services[i].base_path = fhttp->base_paths[i];
+		tmpl->services[i].url = __flowthings_io_http_string_steal(s, &tmpl->services[i].len);
+	}
+	tmpl->service_count = fhttp->base_path_count;
+
+	__flowthings_io_http_add_header(tmpl, "Content-Type", "application/json");
+	__flowthings_io_http_add_header(tmpl, "x-auth-account", fhttp->creds->account);
+	__flowthings_io_http_add_header(tmpl, "x-auth-token", fhttp->creds->token);
+
+	if (fhttp->transport && fhttp->transport->template_init)
+		fhttp->transport->template_init(fhttp->transport_state, tmpl);
+
+	return tmpl;
+}
+
+/*
+ * NAME: __flowthings_io_http_template_release
+ *
+ * Drop a reference to a template, freeing it when it's no longer used; does nothing for NULL.
+ * Called with the template lock held.
+ */
+static void __flowthings_io_http_template_release(flowthings_io_http *fhttp,
+		flowthings_io_http_template *tmpl)
+{
+	int i;
+
+	if (!tmpl) return;
+	if (!fhttp || tmpl->refs <= 0) FAIL;
+
+	if (--tmpl->refs > 0) return;
+
+	if (fhttp->transport && fhttp->transport->template_release)
+		fhttp->transport->template_release(fhttp->transport_state, tmpl);
+
+	for (i = 0; i < tmpl->service_count; i++)
+		free(tmpl->services[i].url);
+
+	for (i = 0; i < tmpl->header_count; i++)
+		free(tmpl->headers[i]);
+
+	free(tmpl->url_prefix);
+	free(tmpl);
+}
+
+/*
+ * NAME: __flowthings_io_http_template_rebuild
+ *
+ * Replace the HTTP object's template with a fresh one.
+ */
+static void __flowthings_io_http_template_rebuild(flowthings_io_http *fhttp)
+{
+	pthread_mutex_lock(&fhttp->tmpl_lock);
+
+	__flowthings_io_http_template_release(fhttp, fhttp->tmpl);
+	fhttp->tmpl = __flowthings_io_http_template_init(fhttp);
+
+	pthread_mutex_unlock(&fhttp->tmpl_lock);
+}
+
+/*
+ * NAME: __flowthings_io_http_template_get/__flowthings_io_http_template_put
+ *
+ * Take and drop a reference to the current template for the length of a transfer.  Dropping a
+ * NULL template does nothing.
+ */
+static flowthings_io_http_template *__flowthings_io_http_template_get(flowthings_io_http *fhttp)
+{
+	flowthings_io_http_template *tmpl;
+
+	if (!fhttp) FAIL;
+
+	pthread_mutex_lock(&fhttp->tmpl_lock);
+	tmpl = fhttp->tmpl;
+	if (tmpl)
+		tmpl->refs++;
+	pthread_mutex_unlock(&fhttp->tmpl_lock);
+
+	/* there is always a template until the HTTP object is cleaned up */
+	if (!tmpl) FAIL;
+
+	return tmpl;
+}
+
+static void __flowthings_io_http_template_put(flowthings_io_http *fhttp,
+		flowthings_io_http_template *tmpl)
+{
+	if (!tmpl) return;
+	if (!fhttp) FAIL;
+
+	pthread_mutex_lock(&fhttp->tmpl_lock);
+	__flowthings_io_http_template_release(fhttp, tmpl);
+	pthread_mutex_unlock(&fhttp->tmpl_lock);
+}
+
 /*
  * NAME: __flowthings_io_makeurl
  *
- * Create a URL for the flowthings platform.
+ * Create a URL for the flowthings platform from the request template.
  *
  * PARAMS:
- * fhttp - the HTTP object
+ * tmpl - the request template
  * url - a URL string to be filled, must be FLOWTHINGS_IO_MAX_URL_SIZE
+ * base_path - the service base path, e.g. /flow
  * path - the path on the server
  */
-static void __flowthings_io_makeurl(flowthings_io_http *fhttp,
+static void __flowthings_io_makeurl(flowthings_io_http_template *tmpl,
 		char *url,
+		const char *base_path,
 		const char *path)
 {
+	const char *prefix = tmpl->url_prefix;
+	size_t prefix_len = tmpl->url_prefix_len, base_path_len = 0, path_len;
+	int i;
+
 	if (!url || !path) FAIL;
 
-	if (fhttp->secure)
-		strcpy(url, "https://");
+	if (base_path) {
+
+		for (i = 0; i < tmpl->service_count; i++) {
+			if (tmpl->services[i].base_path == base_path || !strcmp(tmpl->services[i].base_path, base_path)) {
+				prefix = tmpl->services[i].url;
+				prefix_len = tmpl->services[i].len;
+				break;
+			}
+		}
+
+		if (i == tmpl->service_count)
+			base_path_len = strlen(base_path);
+	}
+
+	path_len = strlen(path);
+
+	if (prefix_len + base_path_len + path_len + 1 > FLOWTHINGS_IO_MAX_URL_SIZE) FAIL;
+
+	memcpy(url, prefix, prefix_len);
+	if (base_path_len)
+		memcpy(url + prefix_len, base_path, base_path_len);
+	memcpy(url + prefix_len + base_path_len, path, path_len + 1);
+}
+
+/*
+ * NAME: __flowthings_io_http_start
+ *
+ * Reset a transfer, take a template reference for it and build its URL.
+ */
+static void __flowthings_io_http_start(flowthings_io_http *fhttp,
+		flowthings_io_http_xfer *xfer, char *url)
+{
+	xfer->http_response_code = 0;
+	xfer->done = FALSE;
+	xfer->next = NULL;
+	xfer->handle = NULL;
+	xfer->transport_data = NULL;
+	xfer->etag[0] = '\0';
+
+	xfer->tmpl = __flowthings_io_http_template_get(fhttp);
+	__flowthings_io_makeurl(xfer->tmpl, url, xfer->base_path, xfer->path);
+}
+
+/*
+ * NAME: __flowthings_io_http_queue
+ *
+ * Put a transfer on the deferred list, to be finished on the next poll.  Called with the engine
+ * locked.
+ */
+static void __flowthings_io_http_queue(flowthings_io_http *fhttp,
+		flowthings_io_http_xfer *xfer)
+{
+	xfer->next = NULL;
+
+	/* keep these in order, so callbacks run in the order the calls were made */
+	if (fhttp->deferred_tail)
+		fhttp->deferred_tail->next = xfer;
 	else
-		strcpy(url, "http://");
+		fhttp->deferred = xfer;
+	fhttp->deferred_tail = xfer;
 
-	flowthings_io_strcat(url, fhttp->host, FLOWTHINGS_IO_MAX_URL_SIZE);
-	flowthings_io_strcat(url, "/v", FLOWTHINGS_IO_MAX_URL_SIZE);
-	flowthings_io_strcat(url, fhttp->version, FLOWTHINGS_IO_MAX_URL_SIZE);
-	flowthings_io_strcat(url, "/", FLOWTHINGS_IO_MAX_URL_SIZE);
-	flowthings_io_strcat(url, fhttp->creds->account, FLOWTHINGS_IO_MAX_URL_SIZE);
-	flowthings_io_strcat(url, fhttp->base_path, FLOWTHINGS_IO_MAX_URL_SIZE);
-	flowthings_io_strcat(url, path, FLOWTHINGS_IO_MAX_URL_SIZE);
+	fhttp->outstanding++;
 }
 
+/*
+ * NAME: __flowthings_io_http_finish
+ *
+ * Mark a transfer as finished and hand it back to its owner.  Called with the engine locked.
+ */
+static void __flowthings_io_http_finish(flowthings_io_http *fhttp,
+		flowthings_io_http_xfer *xfer)
+{
+	fhttp->outstanding--;
+	xfer->next = NULL;
+	xfer->done = TRUE;
+
+	if (xfer->on_done)
+		xfer->on_done(xfer);
+}
 
 
 /***********************************************************************
@@ -66,7 +303,8 @@ static void __flowthings_io_makeurl(flowthings_io_http *fhttp,
  * NAME: flowthings_io_http_init
  *
  * Initializes the flowthings_io_http object and returns it. Shouldn't be called directly from
- * outside this library.
+ * outside this library.  This must be called before any other threads that use the HTTP library
+ * are started.
  *
  * PARAMS:
  * version - the flowthings platform version
@@ -78,22 +316,72 @@ static void __flowthings_io_makeurl(flowthings_io_http *fhttp,
 flowthings_io_http *flowthings_io_http_init(const char *version,
 		const char *host, BOOL secure, flowthings_io_token *creds)
 {
+	pthread_mutexattr_t attr;
+
 	flowthings_io_http *fhttp = malloc(sizeof(flowthings_io_http));
 	if (!fhttp) FAIL;
 
-#ifdef USING_HTTP_LIBRARY_CURL
-	CURL *curl = curl_easy_init();
-	fhttp->curl = curl;
-#endif
+	memset(fhttp, 0, sizeof(flowthings_io_http));
+
+	/* completion callbacks may start new transfers, so the engine lock must be recursive */
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&fhttp->engine_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	pthread_mutex_init(&fhttp->tmpl_lock, NULL);
 
 	fhttp->host = host;
 	fhttp->version = version;
 	fhttp->secure = secure;
 	fhttp->creds = creds;
+	fhttp->outstanding = 0;
+	fhttp->deferred = NULL;
+	fhttp->deferred_tail = NULL;
+
+#ifndef FLOWTHINGS_IO_HTTP_NO_CURL
+	fhttp->transport = &flowthings_io_http_transport_curl;
+	fhttp->transport_state = fhttp->transport->init(fhttp, NULL);
+#endif
+
+	fhttp->tmpl = __flowthings_io_http_template_init(fhttp);
 
 	return fhttp;
 }
 
+/*
+ * NAME: flowthings_io_http_set_transport
+ *
+ * Replaces the transport used to send requests.  This must be called before any requests are
+ * made.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * transport - the transport, which must stay valid as long as fhttp
+ * config - passed to transport->init
+ */
+void flowthings_io_http_set_transport(flowthings_io_http *fhttp,
+		const flowthings_io_http_transport *transport, void *config)
+{
+	if (!fhttp || !transport || !transport->init || !transport->request) FAIL;
+
+	pthread_mutex_lock(&fhttp->tmpl_lock);
+
+	/* the template may hold headers built by the old transport */
+	__flowthings_io_http_template_release(fhttp, fhttp->tmpl);
+	fhttp->tmpl = NULL;
+
+	if (fhttp->transport)
+		fhttp->transport->cleanup(fhttp->transport_state);
+
+	fhttp->transport = transport;
+	fhttp->transport_state = transport->init(fhttp, config);
+
+	fhttp->tmpl = __flowthings_io_http_template_init(fhttp);
+
+	pthread_mutex_unlock(&fhttp->tmpl_lock);
+}
+
 
 /*
  * NAME: flowthings_io_http_writefunc
@@ -105,26 +393,295 @@ size_t flowthings_io_http_writefunc(void *ptr,
 		size_t nmemb,
 		flowthings_io_string *s)
 {
-	size_t new_len = s->len + size * nmemb;
-	s->ptr = realloc(s->ptr, new_len+1);
-	if (!s->ptr) FAIL;
-
-	memcpy(s->ptr + s->len, ptr, size * nmemb);
-	s->ptr[new_len] = '\0';
-	s->len = new_len;
+	flowthings_io_string_append(s, (const char *)ptr, size * nmemb);
 
 	return size * nmemb;
 }
 
+/*
+ * NAME: flowthings_io_http_deliver
+ *
+ * Called by transports with each chunk of a response body.  Passes the chunk to xfer->on_data if
+ * it's set, otherwise appends it to xfer->response.  xfer->http_response_code must already be set.
+ *
+ * RETURN:
+ * Returns len to continue the transfer, anything else means it should be aborted.
+ */
+size_t flowthings_io_http_deliver(flowthings_io_http_xfer *xfer, const char *data, size_t len)
+{
+	if (xfer->on_data)
+		return xfer->on_data(xfer, data, len);
+
+	flowthings_io_string_append(xfer->response, data, len);
+
+	return len;
+}
+
+/*
+ * NAME: flowthings_io_http_header
+ *
+ * Called by transports with each response header line ("Name: value", with or without the line
+ * ending), so the HTTP layer can keep the ones it uses, such as ETag.
+ */
+void flowthings_io_http_header(flowthings_io_http_xfer *xfer, const char *line, size_t len)
+{
+	if (len < 5 || strncasecmp(line, "ETag:", 5))
+		return;
+
+	line += 5;
+	len -= 5;
+
+	while (len > 0 && (*line == ' ' || *line == '\t')) {
+		line++;
+		len--;
+	}
+
+	while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == '\n' || line[len - 1] == ' '))
+		len--;
+
+	/* a tag too long to keep is as good as none */
+	if (len >= FLOWTHINGS_IO_HTTP_MAX_ETAG_SIZE)
+		len = 0;
+
+	memcpy(xfer->etag, line, len);
+	xfer->etag[len] = '\0';
+}
+
+/*
+ * NAME: flowthings_io_http_transfer_done
+ *
+ * Called by transports from their poll function when a submitted transfer has finished, with
+ * xfer->http_response_code set.  This calls xfer->on_done, which may submit new transfers.
+ */
+void flowthings_io_http_transfer_done(flowthings_io_http *fhttp, flowthings_io_http_xfer *xfer)
+{
+	__flowthings_io_http_template_put(fhttp, xfer->tmpl);
+	xfer->tmpl = NULL;
+	xfer->handle = NULL;
+
+	__flowthings_io_http_finish(fhttp, xfer);
+}
+
+
+/*
+ * NAME: flowthings_io_http_perform
+ *
+ * Run a transfer on the calling thread and wait for it to finish; xfer->on_done is called, if
+ * set, before this returns.  This may be called from several threads at once on the same HTTP
+ * object, and doesn't touch the asynchronous engine.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * xfer - the transfer; method, base_path, path and response must be set
+ *
+ * RETURN:
+ * Returns a HTTP response code, or 0 for an unknown error.
+ */
+int flowthings_io_http_perform(flowthings_io_http *fhttp,
+		flowthings_io_http_xfer *xfer)
+{
+	char url[FLOWTHINGS_IO_MAX_URL_SIZE];
+
+	if (!fhttp || !xfer || !xfer->method || !xfer->path || !xfer->response) FAIL;
+
+	__flowthings_io_http_start(fhttp, xfer, url);
+
+	if (fhttp->transport)
+		fhttp->transport->request(fhttp->transport_state, xfer, url);
+
+	__flowthings_io_http_template_put(fhttp, xfer->tmpl);
+	xfer->tmpl = NULL;
+	xfer->handle = NULL;
+
+	xfer->done = TRUE;
+
+	if (xfer->on_done)
+		xfer->on_done(xfer);
+
+	return xfer->http_response_code;
+}
+
+
+/*
+ * NAME: flowthings_io_http_submit
+ *
+ * Start an HTTP transfer without waiting for it.  The transfer runs when flowthings_io_http_poll
+ * is called, and xfer->on_done is called when it finishes.  The xfer, and the data and response
+ * it points to, must stay valid until then.  The asynchronous engine is locked while it runs, so
+ * transfers on one HTTP object progress on one thread at a time.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * xfer - the transfer; method, base_path, path, response and on_done must be set
+ */
+void flowthings_io_http_submit(flowthings_io_http *fhttp,
+		flowthings_io_http_xfer *xfer)
+{
+	char url[FLOWTHINGS_IO_MAX_URL_SIZE];
+
+	if (!fhttp || !xfer || !xfer->method || !xfer->path || !xfer->response) FAIL;
+
+	if (!fhttp->transport) {
+		/* nothing can be sent */
+		flowthings_io_http_defer(fhttp, xfer);
+		return;
+	}
+
+	__flowthings_io_http_start(fhttp, xfer, url);
+
+	if (!fhttp->transport->submit) {
+
+		/* the transport can only run transfers to completion, so run it now and finish it on
+		 * the next poll like any other */
+		fhttp->transport->request(fhttp->transport_state, xfer, url);
+
+		__flowthings_io_http_template_put(fhttp, xfer->tmpl);
+		xfer->tmpl = NULL;
+		xfer->handle = NULL;
+
+		pthread_mutex_lock(&fhttp->engine_lock);
+		__flowthings_io_http_queue(fhttp, xfer);
+		pthread_mutex_unlock(&fhttp->engine_lock);
+
+		return;
+	}
+
+	pthread_mutex_lock(&fhttp->engine_lock);
+
+	if (fhttp->transport->submit(fhttp->transport_state, xfer, url)) {
+		fhttp->outstanding++;
+	}
+	else {
+		__flowthings_io_http_template_put(fhttp, xfer->tmpl);
+		flowthings_io_http_defer(fhttp, xfer);
+	}
+
+	pthread_mutex_unlock(&fhttp->engine_lock);
+}
+
+/*
+ * NAME: flowthings_io_http_defer
+ *
+ * Finish a transfer without sending it, e.g. because the request couldn't be built.  xfer->on_done
+ * will be called with a response code of 0 on the next call to flowthings_io_http_poll.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * xfer - the transfer
+ */
+void flowthings_io_http_defer(flowthings_io_http *fhttp,
+		flowthings_io_http_xfer *xfer)
+{
+	if (!fhttp || !xfer) FAIL;
+
+	xfer->http_response_code = 0;
+	xfer->done = FALSE;
+	xfer->tmpl = NULL;
+	xfer->handle = NULL;
+
+	pthread_mutex_lock(&fhttp->engine_lock);
+	__flowthings_io_http_queue(fhttp, xfer);
+	pthread_mutex_unlock(&fhttp->engine_lock);
+}
+
+/*
+ * NAME: flowthings_io_http_cancel
+ *
+ * Abandon a transfer that has been submitted but hasn't finished.  on_done will not be called.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * xfer - the transfer
+ */
+void flowthings_io_http_cancel(flowthings_io_http *fhttp,
+		flowthings_io_http_xfer *xfer)
+{
+	flowthings_io_http_xfer **x, *prev = NULL;
+	BOOL deferred = FALSE;
+
+	if (!fhttp || !xfer) return;
+
+	pthread_mutex_lock(&fhttp->engine_lock);
+
+	if (!xfer->done) {
+
+		for (x = &fhttp->deferred; *x; prev = *x, x = &(*x)->next) {
+			if (*x == xfer) {
+				*x = xfer->next;
+				if (fhttp->deferred_tail == xfer)
+					fhttp->deferred_tail = prev;
+				deferred = TRUE;
+				break;
+			}
+		}
+
+		if (!deferred && fhttp->transport && fhttp->transport->cancel)
+			fhttp->transport->cancel(fhttp->transport_state, xfer);
+
+		if (xfer->tmpl) {
+			__flowthings_io_http_template_put(fhttp, xfer->tmpl);
+			xfer->tmpl = NULL;
+		}
+
+		fhttp->outstanding--;
+		xfer->next = NULL;
+		xfer->handle = NULL;
+		xfer->done = TRUE;
+	}
+
+	pthread_mutex_unlock(&fhttp->engine_lock);
+}
+
+/*
+ * NAME: flowthings_io_http_poll
+ *
+ * Run all submitted transfers for up to timeout_ms milliseconds, calling on_done for each one
+ * that finishes.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * timeout_ms - the longest time to wait for network activity
+ *
+ * RETURN:
+ * Returns the number of transfers that haven't finished yet.
+ */
+int flowthings_io_http_poll(flowthings_io_http *fhttp, int timeout_ms)
+{
+	flowthings_io_http_xfer *xfer;
+	int outstanding;
+
+	if (!fhttp) return 0;
+
+	pthread_mutex_lock(&fhttp->engine_lock);
+
+	while ((xfer = fhttp->deferred) != NULL) {
+		fhttp->deferred = xfer->next;
+		if (!fhttp->deferred)
+			fhttp->deferred_tail = NULL;
+		__flowthings_io_http_finish(fhttp, xfer);
+	}
+
+	if (fhttp->outstanding > 0 && fhttp->transport && fhttp->transport->poll)
+		fhttp->transport->poll(fhttp->transport_state, timeout_ms);
+
+	outstanding = fhttp->outstanding;
+
+	pthread_mutex_unlock(&fhttp->engine_lock);
+
+	return outstanding;
+}
+
 
 /*
  * NAME: flowthings_io_http_request
  *
- * Make an HTTP request to the flowthings server.
+ * Make an HTTP request to the flowthings server and wait for the response.  This may be called
+ * from several threads at once on the same HTTP object.
  *
  * PARAMS:
  * fhttp - the HTTP object
  * method - one of FLOWTHINGS_IO_HTTP_METHOD_*
+ * base_path - the service base path, e.g. /flow, or NULL
  * path - the path on the flowthings platform, starting with a /
  * data - the post data string
  * response - a flowthigns_io_string that must previously allocated
@@ -134,84 +691,127 @@ size_t flowthings_io_http_writefunc(void *ptr,
  */
 int flowthings_io_http_request(flowthings_io_http *fhttp,
 		const char *method,
+		const char *base_path,
 		const char *path,
 		const char *data,
 		flowthings_io_string *response)
 {
-
-#ifdef USING_HTTP_LIBRARY_CURL
-
-	CURLcode res;
-	char url[FLOWTHINGS_IO_MAX_URL_SIZE] = "";
+	flowthings_io_http_xfer xfer;
 
 	if (!method || !path || !fhttp || !response) return 0;
 
-	struct curl_slist *headers = NULL;
-	char x_auth_account[100] = "x-auth-account: ";
-	char x_auth_token[100] = "x-auth-token: ";
+	memset(&xfer, 0, sizeof(xfer));
+	xfer.method = method;
+	xfer.base_path = base_path;
+	xfer.path = path;
+	xfer.data = data;
+	xfer.response = response;
 
-	__flowthings_io_makeurl(fhttp, url, path);
+	return flowthings_io_http_perform(fhttp, &xfer);
+}
 
-	flowthings_io_strcat(x_auth_account, fhttp->creds->account, 100);
-	flowthings_io_strcat(x_auth_token, fhttp->creds->token, 100);
+/*
+ * NAME: flowthings_io_http_urlencode
+ *
+ * URLencodes an input and puts it in a flowthings_io_string.  Everything but letters, digits and
+ * -._~ is percent encoded, as in RFC 3986.
+ *
+ * PARAMS:
+ * input - the input value to url encode
+ * output - the flowthings_io_string (must be pre-allocated) where the encoded value will go
+ */
+void flowthings_io_http_urlencode(const char *input, flowthings_io_string *output)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	const unsigned char *c;
+	char *out;
 
-	headers = curl_slist_append(headers, "Content-Type: application/json");
-	headers = curl_slist_append(headers, x_auth_account);
-	headers = curl_slist_append(headers, x_auth_token);
+	if (!input || !output) FAIL;
 
-    curl_easy_setopt(fhttp->curl, CURLOPT_URL, url);
-    curl_easy_setopt(fhttp->curl, CURLOPT_WRITEFUNCTION, flowthings_io_http_writefunc);
-    curl_easy_setopt(fhttp->curl, CURLOPT_WRITEDATA, response);
-	curl_easy_setopt(fhttp->curl, CURLOPT_HTTPHEADER, headers);
-	curl_easy_setopt(fhttp->curl, CURLOPT_CUSTOMREQUEST, method);
+	/* at most three characters out for each one in */
+	flowthings_io_string_reserve(output, output->len + strlen(input) * 3);
+	out = output->ptr + output->len;
 
-	/* if this isn't a get, add post data */
-	if (strcmp(method, FLOWTHINGS_IO_HTTP_METHOD_DELETE) == 0) {
-	}
-	else if (strcmp(method, FLOWTHINGS_IO_HTTP_METHOD_GET)) {
-		curl_easy_setopt(fhttp->curl, CURLOPT_POSTFIELDS, data);
+	for (c = (const unsigned char *)input; *c; c++) {
+		if ((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9')
+				|| *c == '-' || *c == '.' || *c == '_' || *c == '~') {
+			*out++ = *c;
+		}
+		else {
+			*out++ = '%';
+			*out++ = hex[*c >> 4];
+			*out++ = hex[*c & 15];
+		}
 	}
 
-    res = curl_easy_perform(fhttp->curl);
-
-    curl_slist_free_all(headers);
-
-    if (res == CURLE_OK) {
-    	long rc;
-    	curl_easy_getinfo(fhttp->curl, CURLINFO_RESPONSE_CODE, &rc);
-
-    	return (int)rc;
-    }
-
-#endif
-
-    return 0;
+	*out = '\0';
+	output->len = out - output->ptr;
 }
 
 /*
- * NAME: flowthings_io_http_urlencode
+ * NAME: flowthings_io_http_escape
  *
- * URLencodes an input and puts it in a flowthings_io_string
+ * URLencodes an input with the HTTP object's transport and appends it to a flowthings_io_string
  *
  * PARAMS:
+ * fhttp - the HTTP object
  * input - the input value to url encode
  * output - the flowthings_io_string (must be pre-allocated) where the encoded value will go
  */
-void flowthings_io_http_urlencode(const char *input, flowthings_io_string *output)
+void flowthings_io_http_escape(flowthings_io_http *fhttp, const char *input,
+		flowthings_io_string *output)
+{
+	if (fhttp && fhttp->transport && fhttp->transport->urlencode)
+		fhttp->transport->urlencode(fhttp->transport_state, input, output);
+	else
+		flowthings_io_http_urlencode(input, output);
+}
+
+/*
+ * NAME: flowthings_io_http_add_base_path
+ *
+ * Registers a service base path (e.g. /flow) so that its full URL prefix is built into the
+ * request template.  Requests for base paths that aren't registered still work, but build their
+ * prefix on every request.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * base_path - the base path, which must stay valid as long as fhttp
+ */
+void flowthings_io_http_add_base_path(flowthings_io_http *fhttp, const char *base_path)
 {
+	if (!fhttp || !base_path) FAIL;
 
-#ifdef USING_HTTP_LIBRARY_CURL
+	pthread_mutex_lock(&fhttp->tmpl_lock);
 
-	CURL *curl = curl_easy_init();
+	if (fhttp->base_path_count < FLOWTHINGS_IO_HTTP_MAX_SERVICES)
+		fhttp->base_paths[fhttp->base_path_count++] = base_path;
 
-	char *str = curl_easy_escape(curl, input, 0);
-	flowthings_io_string_strcat(output, str);
-	curl_free(str);
+	pthread_mutex_unlock(&fhttp->tmpl_lock);
 
-	curl_easy_cleanup(curl);
+	__flowthings_io_http_template_rebuild(fhttp);
+}
 
-#endif
+/*
+ * NAME: flowthings_io_http_set_creds
+ *
+ * Changes the credentials used for requests and rebuilds the request template.  This must also be
+ * called if the strings in the current credentials are changed.  Transfers already started keep
+ * the credentials they started with.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * creds - a flowthings_io_token object with the user's credentials
+ */
+void flowthings_io_http_set_creds(flowthings_io_http *fhttp, flowthings_io_token *creds)
+{
+	if (!fhttp || !creds || !creds->account || !creds->token) FAIL;
+
+	pthread_mutex_lock(&fhttp->tmpl_lock);
+	fhttp->creds = creds;
+	pthread_mutex_unlock(&fhttp->tmpl_lock);
 
+	__flowthings_io_http_template_rebuild(fhttp);
 }
 
 /*
@@ -223,12 +823,14 @@ void flowthings_io_http_cleanup(flowthings_io_http *fhttp)
 {
 	if (fhttp) {
 
-#ifdef USING_HTTP_LIBRARY_CURL
-		if (fhttp->curl) {
-			curl_easy_cleanup(fhttp->curl);
-			fhttp->curl = NULL;
-		}
-#endif
+		__flowthings_io_http_template_release(fhttp, fhttp->tmpl);
+		fhttp->tmpl = NULL;
+
+		if (fhttp->transport)
+			fhttp->transport->cleanup(fhttp->transport_state);
+
+		pthread_mutex_destroy(&fhttp->tmpl_lock);
+		pthread_mutex_destroy(&fhttp->engine_lock);
 
 		free(fhttp);
 	}
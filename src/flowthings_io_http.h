@@ -10,14 +10,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <curl/curl.h>
+#include <pthread.h>
 
 #ifdef  __cplusplus
 extern "C" {
 #endif
 
-#define USING_HTTP_LIBRARY_CURL
-
 /***********************************************************************
  * Flowthings includes
  ***********************************************************************/
@@ -32,6 +30,18 @@ extern "C" {
 #define FLOWTHINGS_IO_MAX_URL_SIZE 1000
 #define FLOWTHINGS_IO_MAX_PATH_SIZE 500
 
+/* the number of idle connection handles each HTTP object keeps for reuse */
+#define FLOWTHINGS_IO_HTTP_POOL_SIZE 16
+
+/* the number of service base paths that can have a precomputed URL prefix */
+#define FLOWTHINGS_IO_HTTP_MAX_SERVICES 16
+
+/* the number of headers sent with every request */
+#define FLOWTHINGS_IO_HTTP_MAX_HEADERS 4
+
+/* the longest entity tag kept from a response, including the quotes */
+#define FLOWTHINGS_IO_HTTP_MAX_ETAG_SIZE 128
+
 #define FLOWTHINGS_IO_HTTP_METHOD_GET "GET"
 #define FLOWTHINGS_IO_HTTP_METHOD_MGET "MGET"
 #define FLOWTHINGS_IO_HTTP_METHOD_POST "POST"
@@ -39,23 +49,218 @@ extern "C" {
 #define FLOWTHINGS_IO_HTTP_METHOD_DELETE "DELETE"
 
 
+/***********************************************************************
+ * The request template, built once and shared by all requests
+ ***********************************************************************/
+
+typedef struct flowthings_io_http_service_url {
+	const char *base_path;
+	char *url;
+	size_t len;
+} flowthings_io_http_service_url;
+
+/*
+ * NAME: flowthings_io_http_template
+ *
+ * The parts of every request that only change with the credentials: the URL prefix
+ * (scheme://host/vVERSION/account) with and without each service base path, and the request
+ * headers ("Name: value").  A template is never modified after it's built; when the credentials
+ * change a new one replaces it, and the old one is freed when the last transfer using it finishes.
+ */
+typedef struct flowthings_io_http_template {
+
+	int refs;
+
+	char *url_prefix;
+	size_t url_prefix_len;
+
+	flowthings_io_http_service_url services[FLOWTHINGS_IO_HTTP_MAX_SERVICES];
+	int service_count;
+
+	char *headers[FLOWTHINGS_IO_HTTP_MAX_HEADERS];
+	int header_count;
+
+	/* the transport's own copy of the headers, see flowthings_io_http_transport */
+	void *transport_headers;
+
+} flowthings_io_http_template;
+
+
+/***********************************************************************
+ * A single HTTP transfer, which may be run asynchronously
+ ***********************************************************************/
+
+typedef struct flowthings_io_http_xfer flowthings_io_http_xfer;
+
+/*
+ * NAME: flowthings_io_http_cb_done
+ *
+ * Called once when a transfer has finished, whether it succeeded or not.  When this is called,
+ * xfer->http_response_code holds the HTTP response code, or 0 for an unknown error.
+ */
+typedef void (*flowthings_io_http_cb_done)(flowthings_io_http_xfer *xfer);
+
+/*
+ * NAME: flowthings_io_http_cb_data
+ *
+ * Called with each chunk of the response body as it arrives, instead of appending it to
+ * xfer->response.  xfer->http_response_code is already set when this is called.  Return len to
+ * continue, anything else aborts the transfer.
+ */
+typedef size_t (*flowthings_io_http_cb_data)(flowthings_io_http_xfer *xfer, const char *data, size_t len);
+
+/*
+ * NAME: flowthings_io_http_cb_send
+ *
+ * Called for the next part of the request body, when the body is produced as it is sent rather
+ * than passed in xfer->data.  Copy up to size bytes into buf and return the number copied, or 0
+ * at the end of the body.  The body is sent with chunked transfer encoding, since its length
+ * isn't known up front.
+ */
+typedef size_t (*flowthings_io_http_cb_send)(flowthings_io_http_xfer *xfer, char *buf, size_t size);
+
+/*
+ * NAME: flowthings_io_http_cb_rewind
+ *
+ * Called when a body produced with on_send has to be sent again from its start, e.g. when a
+ * reused connection turns out to have been closed and the request is retried on a new one.  The
+ * next call to on_send must start the body over.  Return FALSE if it can't be.
+ */
+typedef BOOL (*flowthings_io_http_cb_rewind)(flowthings_io_http_xfer *xfer);
+
+struct flowthings_io_http_xfer {
+
+	/* filled in by the caller before flowthings_io_http_submit */
+	const char *method;
+	const char *base_path;
+	const char *path;
+	const char *data;
+	flowthings_io_string *response;
+	flowthings_io_http_cb_done on_done;
+	void *user_data;
+
+	/* optional, see flowthings_io_http_cb_data */
+	flowthings_io_http_cb_data on_data;
+
+	/* optional, used instead of data; see flowthings_io_http_cb_send and
+	 * flowthings_io_http_cb_rewind */
+	flowthings_io_http_cb_send on_send;
+	flowthings_io_http_cb_rewind on_rewind;
+
+	/* optional; an entity tag to send as If-None-Match, so the server can answer 304 if the
+	 * resource hasn't changed */
+	const char *if_none_match;
+
+	/* filled in by the HTTP layer */
+	int http_response_code;
+	BOOL done;
+
+	/* the response's ETag header, or "" if it didn't have one */
+	char etag[FLOWTHINGS_IO_HTTP_MAX_ETAG_SIZE];
+
+	flowthings_io_http_template *tmpl;
+
+	/* belong to the transport while the transfer is running */
+	void *handle;
+	void *transport_data;
+
+	struct flowthings_io_http_xfer *next;
+};
+
+
+/***********************************************************************
+ * The transport interface, which does the actual HTTP work
+ ***********************************************************************/
+
+typedef struct flowthings_io_http flowthings_io_http;
+
+/*
+ * NAME: flowthings_io_http_transport
+ *
+ * A table of functions that sends requests for an HTTP object.  The HTTP object builds the URL
+ * and keeps the request template alive for the length of each transfer; the transport sends the
+ * request with xfer->method, the URL, xfer->tmpl->headers (and If-None-Match if
+ * xfer->if_none_match is set) and xfer->data, sets xfer->http_response_code, passes the response
+ * headers to flowthings_io_http_header and the response body to flowthings_io_http_deliver.  A
+ * transport must allow request to be called from several threads at once.
+ *
+ * init - creates the transport's state for fhttp; config is the pointer passed to
+ *     flowthings_io_http_set_transport
+ * cleanup - frees the state
+ * template_init/template_release - optional; called when a template is built and freed, so the
+ *     transport can keep its own form of the headers in tmpl->transport_headers
+ * request - runs a transfer to completion on the calling thread
+ * submit - optional; starts a transfer and returns TRUE, or returns FALSE if it can't be started.
+ *     Without submit, asynchronous transfers run inside flowthings_io_http_submit.
+ * cancel - abandons a transfer that was started with submit
+ * poll - runs started transfers for up to timeout_ms milliseconds, calling
+ *     flowthings_io_http_transfer_done for each one that finishes
+ * urlencode - optional; URL encodes input onto output, flowthings_io_http_urlencode is used if
+ *     it's not set
+ */
+typedef struct flowthings_io_http_transport {
+
+	const char *name;
+
+	void *(*init)(flowthings_io_http *fhttp, void *config);
+	void (*cleanup)(void *state);
+
+	void (*template_init)(void *state, flowthings_io_http_template *tmpl);
+	void (*template_release)(void *state, flowthings_io_http_template *tmpl);
+
+	void (*request)(void *state, flowthings_io_http_xfer *xfer, const char *url);
+
+	BOOL (*submit)(void *state, flowthings_io_http_xfer *xfer, const char *url);
+	void (*cancel)(void *state, flowthings_io_http_xfer *xfer);
+	void (*poll)(void *state, int timeout_ms);
+
+	void (*urlencode)(void *state, const char *input, flowthings_io_string *output);
+
+} flowthings_io_http_transport;
+
+#ifndef FLOWTHINGS_IO_HTTP_NO_CURL
+/*
+ * NAME: flowthings_io_http_transport_curl
+ *
+ * The libcurl transport, used by default.  Define FLOWTHINGS_IO_HTTP_NO_CURL to build without it.
+ */
+extern const flowthings_io_http_transport flowthings_io_http_transport_curl;
+#endif
+
+
 /***********************************************************************
  * The flowthings HTTP object, used for all HTTP calls
  ***********************************************************************/
 
-typedef struct flowthings_io_http {
+struct flowthings_io_http {
 
 	flowthings_io_token *creds;
 	const char *version;
 	const char *host;
-	const char *base_path;
 	BOOL secure;
 
-#ifdef USING_HTTP_LIBRARY_CURL
-	CURL* curl;
-#endif
+	const flowthings_io_http_transport *transport;
+	void *transport_state;
+
+	/* the asynchronous engine; engine_lock guards the outstanding count, the deferred list and
+	 * the transport's asynchronous transfers */
+	pthread_mutex_t engine_lock;
+
+	/* number of transfers submitted and not yet finished */
+	int outstanding;
 
-} flowthings_io_http;
+	/* transfers that finished without going to the network, and the last of them */
+	flowthings_io_http_xfer *deferred;
+	flowthings_io_http_xfer *deferred_tail;
+
+	/* the current template, shared by all threads using this object */
+	pthread_mutex_t tmpl_lock;
+
+	flowthings_io_http_template *tmpl;
+	const char *base_paths[FLOWTHINGS_IO_HTTP_MAX_SERVICES];
+	int base_path_count;
+
+};
 
 
 /***********************************************************************
@@ -66,7 +271,8 @@ typedef struct flowthings_io_http {
  * NAME: flowthings_io_http_init
  *
  * Initializes the flowthings_io_http object and returns it. Shouldn't be called directly from
- * outside this library.
+ * outside this library.  This must be called before any other threads that use the HTTP library
+ * are started.
  *
  * PARAMS:
  * version - the flowthings platform version
@@ -79,6 +285,46 @@ flowthings_io_http *flowthings_io_http_init(const char *version,
 		const char *host, BOOL secure, flowthings_io_token *creds);
 
 
+/*
+ * NAME: flowthings_io_http_add_base_path
+ *
+ * Registers a service base path (e.g. /flow) so that its full URL prefix is built into the
+ * request template.  Requests for base paths that aren't registered still work, but build their
+ * prefix on every request.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * base_path - the base path, which must stay valid as long as fhttp
+ */
+void flowthings_io_http_add_base_path(flowthings_io_http *fhttp, const char *base_path);
+
+/*
+ * NAME: flowthings_io_http_set_creds
+ *
+ * Changes the credentials used for requests and rebuilds the request template.  This must also be
+ * called if the strings in the current credentials are changed.  Transfers already started keep
+ * the credentials they started with.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * creds - a flowthings_io_token object with the user's credentials
+ */
+void flowthings_io_http_set_creds(flowthings_io_http *fhttp, flowthings_io_token *creds);
+
+/*
+ * NAME: flowthings_io_http_set_transport
+ *
+ * Replaces the transport used to send requests.  This must be called before any requests are
+ * made.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * transport - the transport, which must stay valid as long as fhttp
+ * config - passed to transport->init
+ */
+void flowthings_io_http_set_transport(flowthings_io_http *fhttp,
+		const flowthings_io_http_transport *transport, void *config);
+
 /*
  * NAME: flowthings_io_http_cleanup
  *
@@ -95,15 +341,44 @@ void flowthings_io_http_cleanup(flowthings_io_http *fhttp);
 size_t flowthings_io_http_writefunc(void *ptr, size_t size, size_t nmemb,
 		flowthings_io_string *s);
 
+/*
+ * NAME: flowthings_io_http_deliver
+ *
+ * Called by transports with each chunk of a response body.  Passes the chunk to xfer->on_data if
+ * it's set, otherwise appends it to xfer->response.  xfer->http_response_code must already be set.
+ *
+ * RETURN:
+ * Returns len to continue the transfer, anything else means it should be aborted.
+ */
+size_t flowthings_io_http_deliver(flowthings_io_http_xfer *xfer, const char *data, size_t len);
+
+/*
+ * NAME: flowthings_io_http_header
+ *
+ * Called by transports with each response header line ("Name: value", with or without the line
+ * ending), so the HTTP layer can keep the ones it uses, such as ETag.
+ */
+void flowthings_io_http_header(flowthings_io_http_xfer *xfer, const char *line, size_t len);
+
+/*
+ * NAME: flowthings_io_http_transfer_done
+ *
+ * Called by transports from their poll function when a submitted transfer has finished, with
+ * xfer->http_response_code set.  This calls xfer->on_done, which may submit new transfers.
+ */
+void flowthings_io_http_transfer_done(flowthings_io_http *fhttp, flowthings_io_http_xfer *xfer);
+
 
 /*
  * NAME: flowthings_io_http_request
  *
- * Make an HTTP request to the flowthings server.
+ * Make an HTTP request to the flowthings server and wait for the response.  This may be called
+ * from several threads at once on the same HTTP object.
  *
  * PARAMS:
  * fhttp - the HTTP object
  * method - one of FLOWTHINGS_IO_HTTP_METHOD_*
+ * base_path - the service base path, e.g. /flow, or NULL
  * path - the path on the flowthings platform, starting with a /
  * data - the post data string
  * response - a flowthigns_io_string that must previously allocated
@@ -112,7 +387,76 @@ size_t flowthings_io_http_writefunc(void *ptr, size_t size, size_t nmemb,
  * Returns a HTTP response code, or 0 for an unknown error.
  */
 int flowthings_io_http_request(flowthings_io_http *fhttp, const char *method,
-		const char *path, const char *data, flowthings_io_string *response);
+		const char *base_path, const char *path, const char *data,
+		flowthings_io_string *response);
+
+/*
+ * NAME: flowthings_io_http_perform
+ *
+ * Run a transfer on the calling thread and wait for it to finish; xfer->on_done is called, if
+ * set, before this returns.  This may be called from several threads at once on the same HTTP
+ * object, and doesn't touch the asynchronous engine.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * xfer - the transfer; method, base_path, path and response must be set
+ *
+ * RETURN:
+ * Returns a HTTP response code, or 0 for an unknown error.
+ */
+int flowthings_io_http_perform(flowthings_io_http *fhttp, flowthings_io_http_xfer *xfer);
+
+/*
+ * NAME: flowthings_io_http_submit
+ *
+ * Start an HTTP transfer without waiting for it.  The transfer runs when flowthings_io_http_poll
+ * is called, and xfer->on_done is called when it finishes.  The xfer, and the data and response
+ * it points to, must stay valid until then.  The asynchronous engine is locked while it runs, so
+ * transfers on one HTTP object progress on one thread at a time.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * xfer - the transfer; method, base_path, path, response and on_done must be set
+ */
+void flowthings_io_http_submit(flowthings_io_http *fhttp, flowthings_io_http_xfer *xfer);
+
+/*
+ * NAME: flowthings_io_http_defer
+ *
+ * Finish a transfer without sending it, e.g. because the request couldn't be built.  xfer->on_done
+ * will be called with a response code of 0 on the next call to flowthings_io_http_poll.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * xfer - the transfer
+ */
+void flowthings_io_http_defer(flowthings_io_http *fhttp, flowthings_io_http_xfer *xfer);
+
+/*
+ * NAME: flowthings_io_http_cancel
+ *
+ * Abandon a transfer that has been submitted but hasn't finished.  on_done will not be called.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * xfer - the transfer
+ */
+void flowthings_io_http_cancel(flowthings_io_http *fhttp, flowthings_io_http_xfer *xfer);
+
+/*
+ * NAME: flowthings_io_http_poll
+ *
+ * Run all submitted transfers for up to timeout_ms milliseconds, calling on_done for each one
+ * that finishes.
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * timeout_ms - the longest time to wait for network activity
+ *
+ * RETURN:
+ * Returns the number of transfers that haven't finished yet.
+ */
+int flowthings_io_http_poll(flowthings_io_http *fhttp, int timeout_ms);
 
 /*
  * NAME: flowthings_io_http_urlencode
@@ -125,6 +469,19 @@ int flowthings_io_http_request(flowthings_io_http *fhttp, const char *method,
  */
 void flowthings_io_http_urlencode(const char *input, flowthings_io_string *output);
 
+/*
+ * NAME: flowthings_io_http_escape
+ *
+ * URLencodes an input with the HTTP object's transport and appends it to a flowthings_io_string
+ *
+ * PARAMS:
+ * fhttp - the HTTP object
+ * input - the input value to url encode
+ * output - the flowthings_io_string (must be pre-allocated) where the encoded value will go
+ */
+void flowthings_io_http_escape(flowthings_io_http *fhttp, const char *input,
+		flowthings_io_string *output);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -0,0 +1,473 @@
+/*
+ * flowthings_io_http_curl.c
+ *
+ * The libcurl transport for the HTTP layer.
+ */
+
+#ifndef FLOWTHINGS_IO_HTTP_NO_CURL
+
+/* the handle pool's lock is a POSIX mutex */
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <curl/curl.h>
+
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io_http.h"
+
+
+/***********************************************************************
+ * The curl transport state
+ ***********************************************************************/
+
+typedef struct __flowthings_io_http_curl {
+
+	flowthings_io_http *fhttp;
+
+	/* the asynchronous transfers; guarded by the HTTP object's engine lock */
+	CURLM *multi;
+
+	/* idle connection handles, shared by all threads using the HTTP object */
+	pthread_mutex_t pool_lock;
+	CURL *pool[FLOWTHINGS_IO_HTTP_POOL_SIZE];
+	int pool_count;
+
+	/* connections, DNS and TLS sessions shared between the handles */
+	CURLSH *share;
+	pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+
+} __flowthings_io_http_curl;
+
+
+/***********************************************************************
+ * Helper functions
+ ***********************************************************************/
+
+/*
+ * NAME: __flowthings_io_http_curl_share_lock/__flowthings_io_http_curl_share_unlock
+ *
+ * Lock callbacks for the curl share handle.
+ */
+static void __flowthings_io_http_curl_share_lock(CURL *handle, curl_lock_data data,
+		curl_lock_access access, void *userptr)
+{
+	__flowthings_io_http_curl *state = (__flowthings_io_http_curl *)userptr;
+	(void)handle;
+	(void)access;
+	pthread_mutex_lock(&state->share_locks[data]);
+}
+
+static void __flowthings_io_http_curl_share_unlock(CURL *handle, curl_lock_data data,
+		void *userptr)
+{
+	__flowthings_io_http_curl *state = (__flowthings_io_http_curl *)userptr;
+	(void)handle;
+	pthread_mutex_unlock(&state->share_locks[data]);
+}
+
+/*
+ * NAME: __flowthings_io_http_curl_pool_get
+ *
+ * Take an idle handle from the pool, or create a new one if the pool is empty.
+ */
+static CURL *__flowthings_io_http_curl_pool_get(__flowthings_io_http_curl *state)
+{
+	CURL *curl = NULL;
+
+	pthread_mutex_lock(&state->pool_lock);
+	if (state->pool_count > 0)
+		curl = state->pool[--state->pool_count];
+	pthread_mutex_unlock(&state->pool_lock);
+
+	if (!curl) {
+		curl = curl_easy_init();
+		if (!curl) FAIL;
+	}
+
+	return curl;
+}
+
+/*
+ * NAME: __flowthings_io_http_curl_pool_put
+ *
+ * Return a handle to the pool.  The handle keeps its connection open so the next request to the
+ * same host can reuse it.
+ */
+static void __flowthings_io_http_curl_pool_put(__flowthings_io_http_curl *state, CURL *curl)
+{
+	curl_easy_reset(curl);
+
+	pthread_mutex_lock(&state->pool_lock);
+	if (state->pool_count < FLOWTHINGS_IO_HTTP_POOL_SIZE) {
+		state->pool[state->pool_count++] = curl;
+		curl = NULL;
+	}
+	pthread_mutex_unlock(&state->pool_lock);
+
+	if (curl)
+		curl_easy_cleanup(curl);
+}
+
+/*
+ * NAME: __flowthings_io_http_curl_write
+ *
+ * The write callback for a transfer.
+ */
+static size_t __flowthings_io_http_curl_write(void *ptr, size_t size, size_t nmemb,
+		flowthings_io_http_xfer *xfer)
+{
+	long rc = 0;
+
+	if (xfer->on_data) {
+		curl_easy_getinfo((CURL *)xfer->handle, CURLINFO_RESPONSE_CODE, &rc);
+		xfer->http_response_code = (int)rc;
+	}
+
+	return flowthings_io_http_deliver(xfer, (const char *)ptr, size * nmemb);
+}
+
+/*
+ * NAME: __flowthings_io_http_curl_read
+ *
+ * The read callback for a transfer whose body is produced as it is sent.
+ */
+static size_t __flowthings_io_http_curl_read(char *ptr, size_t size, size_t nmemb,
+		flowthings_io_http_xfer *xfer)
+{
+	return xfer->on_send(xfer, ptr, size * nmemb);
+}
+
+/*
+ * NAME: __flowthings_io_http_curl_seek
+ *
+ * The seek callback for a transfer whose body is produced as it is sent.  libcurl seeks back to
+ * the start when it has to send the request again, e.g. on a new connection after finding a
+ * pooled one closed; the body can be started over, but not moved anywhere else.
+ */
+static int __flowthings_io_http_curl_seek(flowthings_io_http_xfer *xfer, curl_off_t offset,
+		int origin)
+{
+	if (origin != SEEK_SET || offset != 0 || !xfer->on_rewind || !xfer->on_rewind(xfer))
+		return CURL_SEEKFUNC_CANTSEEK;
+
+	return CURL_SEEKFUNC_OK;
+}
+
+/*
+ * NAME: __flowthings_io_http_curl_header
+ *
+ * The header callback for a transfer.
+ */
+static size_t __flowthings_io_http_curl_header(char *ptr, size_t size, size_t nmemb,
+		flowthings_io_http_xfer *xfer)
+{
+	flowthings_io_http_header(xfer, ptr, size * nmemb);
+
+	return size * nmemb;
+}
+
+/*
+ * NAME: __flowthings_io_http_curl_headers
+ *
+ * Returns the request headers for a transfer: the template's, or for a conditional request, a
+ * copy of them with If-None-Match added, which is kept in xfer->transport_data until the transfer
+ * is released.
+ */
+static struct curl_slist *__flowthings_io_http_curl_headers(flowthings_io_http_xfer *xfer)
+{
+	struct curl_slist *headers = NULL;
+	flowthings_io_string *s;
+	int i;
+
+	if (!xfer->if_none_match || !*xfer->if_none_match)
+		return (struct curl_slist *)xfer->tmpl->transport_headers;
+
+	for (i = 0; i < xfer->tmpl->header_count; i++) {
+		headers = curl_slist_append(headers, xfer->tmpl->headers[i]);
+		if (!headers) FAIL;
+	}
+
+	s = flowthings_io_string_init();
+	flowthings_io_string_strcat(s, "If-None-Match: ");
+	flowthings_io_string_strcat(s, xfer->if_none_match);
+	headers = curl_slist_append(headers, s->ptr);
+	if (!headers) FAIL;
+	flowthings_io_string_cleanup(s);
+
+	xfer->transport_data = headers;
+
+	return headers;
+}
+
+/*
+ * NAME: __flowthings_io_http_curl_release
+ *
+ * Return a transfer's handle to the pool, and free its headers if it had its own.
+ */
+static void __flowthings_io_http_curl_release(__flowthings_io_http_curl *state,
+		flowthings_io_http_xfer *xfer)
+{
+	__flowthings_io_http_curl_pool_put(state, (CURL *)xfer->handle);
+	xfer->handle = NULL;
+
+	if (xfer->transport_data) {
+		curl_slist_free_all((struct curl_slist *)xfer->transport_data);
+		xfer->transport_data = NULL;
+	}
+}
+
+/*
+ * NAME: __flowthings_io_http_curl_setup
+ *
+ * Take a handle from the pool and set it up for a transfer.
+ */
+static CURL *__flowthings_io_http_curl_setup(__flowthings_io_http_curl *state,
+		flowthings_io_http_xfer *xfer, const char *url)
+{
+	CURL *curl = __flowthings_io_http_curl_pool_get(state);
+
+	xfer->handle = curl;
+
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, __flowthings_io_http_curl_write);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, xfer);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, __flowthings_io_http_curl_header);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, xfer);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, __flowthings_io_http_curl_headers(xfer));
+	curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, xfer->method);
+	curl_easy_setopt(curl, CURLOPT_PRIVATE, xfer);
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+	if (state->share)
+		curl_easy_setopt(curl, CURLOPT_SHARE, state->share);
+
+	/* if this isn't a get, add post data */
+	if (strcmp(xfer->method, FLOWTHINGS_IO_HTTP_METHOD_DELETE) == 0) {
+	}
+	else if (strcmp(xfer->method, FLOWTHINGS_IO_HTTP_METHOD_GET) && xfer->on_send) {
+		curl_easy_setopt(curl, CURLOPT_POST, 1L);
+		curl_easy_setopt(curl, CURLOPT_READFUNCTION, __flowthings_io_http_curl_read);
+		curl_easy_setopt(curl, CURLOPT_READDATA, xfer);
+		curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, __flowthings_io_http_curl_seek);
+		curl_easy_setopt(curl, CURLOPT_SEEKDATA, xfer);
+	}
+	else if (strcmp(xfer->method, FLOWTHINGS_IO_HTTP_METHOD_GET) && xfer->data) {
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, xfer->data);
+	}
+
+	return curl;
+}
+
+/*
+ * NAME: __flowthings_io_http_curl_result
+ *
+ * Set a finished transfer's response code.
+ */
+static void __flowthings_io_http_curl_result(flowthings_io_http_xfer *xfer, CURLcode result)
+{
+	long rc = 0;
+
+	if (result == CURLE_OK)
+		curl_easy_getinfo((CURL *)xfer->handle, CURLINFO_RESPONSE_CODE, &rc);
+
+	xfer->http_response_code = (int)rc;
+}
+
+
+/***********************************************************************
+ * The transport functions
+ ***********************************************************************/
+
+static void *__flowthings_io_http_curl_init(flowthings_io_http *fhttp, void *config)
+{
+	__flowthings_io_http_curl *state = malloc(sizeof(__flowthings_io_http_curl));
+	int i;
+
+	(void)config;
+
+	if (!state) FAIL;
+
+	memset(state, 0, sizeof(__flowthings_io_http_curl));
+	state->fhttp = fhttp;
+
+	if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK) FAIL;
+
+	state->multi = curl_multi_init();
+	if (!state->multi) FAIL;
+
+	pthread_mutex_init(&state->pool_lock, NULL);
+
+	for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+		pthread_mutex_init(&state->share_locks[i], NULL);
+
+	state->share = curl_share_init();
+	if (state->share) {
+		curl_share_setopt(state->share, CURLSHOPT_LOCKFUNC, __flowthings_io_http_curl_share_lock);
+		curl_share_setopt(state->share, CURLSHOPT_UNLOCKFUNC, __flowthings_io_http_curl_share_unlock);
+		curl_share_setopt(state->share, CURLSHOPT_USERDATA, state);
+		curl_share_setopt(state->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(state->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+		curl_share_setopt(state->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+	}
+
+	return state;
+}
+
+static void __flowthings_io_http_curl_cleanup(void *s)
+{
+	__flowthings_io_http_curl *state = (__flowthings_io_http_curl *)s;
+	int i;
+
+	if (!state) return;
+
+	if (state->multi)
+		curl_multi_cleanup(state->multi);
+
+	while (state->pool_count > 0)
+		curl_easy_cleanup(state->pool[--state->pool_count]);
+
+	if (state->share)
+		curl_share_cleanup(state->share);
+
+	for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+		pthread_mutex_destroy(&state->share_locks[i]);
+
+	pthread_mutex_destroy(&state->pool_lock);
+
+	curl_global_cleanup();
+
+	free(state);
+}
+
+static void __flowthings_io_http_curl_template_init(void *s, flowthings_io_http_template *tmpl)
+{
+	struct curl_slist *headers = NULL;
+	int i;
+
+	(void)s;
+
+	for (i = 0; i < tmpl->header_count; i++) {
+		headers = curl_slist_append(headers, tmpl->headers[i]);
+		if (!headers) FAIL;
+	}
+
+	tmpl->transport_headers = headers;
+}
+
+static void __flowthings_io_http_curl_template_release(void *s, flowthings_io_http_template *tmpl)
+{
+	(void)s;
+	curl_slist_free_all((struct curl_slist *)tmpl->transport_headers);
+	tmpl->transport_headers = NULL;
+}
+
+static void __flowthings_io_http_curl_request(void *s, flowthings_io_http_xfer *xfer,
+		const char *url)
+{
+	__flowthings_io_http_curl *state = (__flowthings_io_http_curl *)s;
+	CURL *curl = __flowthings_io_http_curl_setup(state, xfer, url);
+
+	__flowthings_io_http_curl_result(xfer, curl_easy_perform(curl));
+
+	__flowthings_io_http_curl_release(state, xfer);
+}
+
+static BOOL __flowthings_io_http_curl_submit(void *s, flowthings_io_http_xfer *xfer,
+		const char *url)
+{
+	__flowthings_io_http_curl *state = (__flowthings_io_http_curl *)s;
+	CURL *curl = __flowthings_io_http_curl_setup(state, xfer, url);
+
+	if (curl_multi_add_handle(state->multi, curl) == CURLM_OK)
+		return TRUE;
+
+	__flowthings_io_http_curl_release(state, xfer);
+
+	return FALSE;
+}
+
+static void __flowthings_io_http_curl_cancel(void *s, flowthings_io_http_xfer *xfer)
+{
+	__flowthings_io_http_curl *state = (__flowthings_io_http_curl *)s;
+
+	if (xfer->handle) {
+		curl_multi_remove_handle(state->multi, (CURL *)xfer->handle);
+		__flowthings_io_http_curl_release(state, xfer);
+	}
+}
+
+static void __flowthings_io_http_curl_poll(void *s, int timeout_ms)
+{
+	__flowthings_io_http_curl *state = (__flowthings_io_http_curl *)s;
+	flowthings_io_http_xfer *xfer;
+	int running = 0, msgs_left = 0;
+	CURLMsg *msg;
+
+	curl_multi_perform(state->multi, &running);
+
+	if (running) {
+		curl_multi_wait(state->multi, NULL, 0, timeout_ms, NULL);
+		curl_multi_perform(state->multi, &running);
+	}
+
+	while ((msg = curl_multi_info_read(state->multi, &msgs_left)) != NULL) {
+
+		if (msg->msg != CURLMSG_DONE) continue;
+
+		curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&xfer);
+
+		__flowthings_io_http_curl_result(xfer, msg->data.result);
+
+		curl_multi_remove_handle(state->multi, msg->easy_handle);
+		__flowthings_io_http_curl_release(state, xfer);
+
+		flowthings_io_http_transfer_done(state->fhttp, xfer);
+	}
+}
+
+static void __flowthings_io_http_curl_urlencode(void *s, const char *input,
+		flowthings_io_string *output)
+{
+	char *str = curl_easy_escape(NULL, input, 0);
+
+	(void)s;
+
+	if (!str) FAIL;
+
+	flowthings_io_string_strcat(output, str);
+	curl_free(str);
+}
+
+const flowthings_io_http_transport flowthings_io_http_transport_curl = {
+	"curl",
+	__flowthings_io_http_curl_init,
+	__flowthings_io_http_curl_cleanup,
+	__flowthings_io_http_curl_template_init,
+	__flowthings_io_http_curl_template_release,
+	__flowthings_io_http_curl_request,
+	__flowthings_io_http_curl_submit,
+	__flowthings_io_http_curl_cancel,
+	__flowthings_io_http_curl_poll,
+	__flowthings_io_http_curl_urlencode
+};
+
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* FLOWTHINGS_IO_HTTP_NO_CURL */
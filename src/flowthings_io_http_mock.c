@@ -0,0 +1,260 @@
+/*
+ * flowthings_io_http_mock.c
+ *
+ * An in-memory transport that answers requests with canned responses.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io_http_mock.h"
+
+
+/***********************************************************************
+ * The mock transport state
+ ***********************************************************************/
+
+typedef struct __flowthings_io_http_mock {
+
+	flowthings_io_http *fhttp;
+	flowthings_io_http_mock_config *config;
+
+	/* submitted transfers waiting for the next poll; guarded by the HTTP object's engine lock */
+	flowthings_io_http_xfer *pending;
+	flowthings_io_http_xfer *pending_tail;
+	int pending_count;
+
+} __flowthings_io_http_mock;
+
+
+/***********************************************************************
+ * Helper functions
+ ***********************************************************************/
+
+/*
+ * NAME: __flowthings_io_http_mock_send
+ *
+ * Deliver a response body, in chunks if the configuration asks for it.  Sets the response code
+ * to 0 if the transfer is aborted.
+ */
+static void __flowthings_io_http_mock_send(__flowthings_io_http_mock *state,
+		flowthings_io_http_xfer *xfer, int http_response_code, const char *body, size_t len)
+{
+	size_t chunk_size = state->config->chunk_size ? state->config->chunk_size : len;
+	char etag[32];
+	unsigned int hash = 2166136261u;
+	size_t n;
+
+	if (state->config->etags && http_response_code == 200
+			&& !strcmp(xfer->method, FLOWTHINGS_IO_HTTP_METHOD_GET)) {
+
+		for (n = 0; n < len; n++)
+			hash = (hash ^ (unsigned char)body[n]) * 16777619u;
+
+		snprintf(etag, sizeof(etag), "ETag: \"%08x\"", hash);
+		flowthings_io_http_header(xfer, etag, strlen(etag));
+
+		if (xfer->if_none_match && !strcmp(xfer->if_none_match, xfer->etag)) {
+			http_response_code = 304;
+			len = 0;
+		}
+	}
+
+	xfer->http_response_code = http_response_code;
+
+	while (len > 0) {
+
+		n = len < chunk_size ? len : chunk_size;
+
+		if (flowthings_io_http_deliver(xfer, body, n) != n) {
+			xfer->http_response_code = 0;
+			return;
+		}
+
+		body += n;
+		len -= n;
+	}
+}
+
+/*
+ * NAME: __flowthings_io_http_mock_read
+ *
+ * Collects a request body that is produced as it is sent, in small pieces as a real transport
+ * would ask for it.
+ */
+static flowthings_io_string *__flowthings_io_http_mock_read(flowthings_io_http_xfer *xfer)
+{
+	flowthings_io_string *sent = flowthings_io_string_init();
+	char buf[256];
+	size_t n;
+
+	while ((n = xfer->on_send(xfer, buf, sizeof(buf))) > 0)
+		flowthings_io_string_append(sent, buf, n);
+
+	return sent;
+}
+
+/*
+ * NAME: __flowthings_io_http_mock_respond
+ *
+ * Answer a transfer from the table or the handler.
+ */
+static void __flowthings_io_http_mock_respond(__flowthings_io_http_mock *state,
+		flowthings_io_http_xfer *xfer)
+{
+	flowthings_io_http_mock_config *config = state->config;
+	const flowthings_io_http_mock_response *r;
+	char path[FLOWTHINGS_IO_MAX_URL_SIZE];
+	flowthings_io_string *body, *sent;
+	int i, code;
+
+	path[0] = '\0';
+	if (xfer->base_path)
+		flowthings_io_strcat(path, xfer->base_path, FLOWTHINGS_IO_MAX_URL_SIZE);
+	flowthings_io_strcat(path, xfer->path, FLOWTHINGS_IO_MAX_URL_SIZE);
+
+	for (i = 0; i < config->response_count; i++) {
+
+		r = &config->responses[i];
+
+		if ((!r->method || !strcmp(r->method, xfer->method))
+				&& (!r->path || !strncmp(r->path, path, strlen(r->path)))) {
+			__flowthings_io_http_mock_send(state, xfer, r->http_response_code,
+					r->body ? r->body : "", r->body ? strlen(r->body) : 0);
+			return;
+		}
+	}
+
+	if (config->handler) {
+		body = flowthings_io_string_init();
+		sent = xfer->on_send ? __flowthings_io_http_mock_read(xfer) : NULL;
+		code = config->handler(xfer->method, path, sent ? sent->ptr : xfer->data, body,
+				config->user_data);
+		__flowthings_io_http_mock_send(state, xfer, code, body->ptr, body->len);
+		flowthings_io_string_cleanup(body);
+		if (sent)
+			flowthings_io_string_cleanup(sent);
+		return;
+	}
+
+	xfer->http_response_code = 404;
+}
+
+
+/***********************************************************************
+ * The transport functions
+ ***********************************************************************/
+
+static void *__flowthings_io_http_mock_init(flowthings_io_http *fhttp, void *config)
+{
+	__flowthings_io_http_mock *state = malloc(sizeof(__flowthings_io_http_mock));
+
+	if (!state || !config) FAIL;
+
+	memset(state, 0, sizeof(__flowthings_io_http_mock));
+	state->fhttp = fhttp;
+	state->config = (flowthings_io_http_mock_config *)config;
+
+	return state;
+}
+
+static void __flowthings_io_http_mock_cleanup(void *s)
+{
+	free(s);
+}
+
+static void __flowthings_io_http_mock_request(void *s, flowthings_io_http_xfer *xfer,
+		const char *url)
+{
+	(void)url;
+	__flowthings_io_http_mock_respond((__flowthings_io_http_mock *)s, xfer);
+}
+
+static BOOL __flowthings_io_http_mock_submit(void *s, flowthings_io_http_xfer *xfer,
+		const char *url)
+{
+	__flowthings_io_http_mock *state = (__flowthings_io_http_mock *)s;
+
+	(void)url;
+
+	xfer->next = NULL;
+
+	if (state->pending_tail)
+		state->pending_tail->next = xfer;
+	else
+		state->pending = xfer;
+
+	state->pending_tail = xfer;
+	state->pending_count++;
+
+	return TRUE;
+}
+
+static void __flowthings_io_http_mock_cancel(void *s, flowthings_io_http_xfer *xfer)
+{
+	__flowthings_io_http_mock *state = (__flowthings_io_http_mock *)s;
+	flowthings_io_http_xfer **x, *prev = NULL;
+
+	for (x = &state->pending; *x; prev = *x, x = &(*x)->next) {
+		if (*x == xfer) {
+			*x = xfer->next;
+			if (state->pending_tail == xfer)
+				state->pending_tail = prev;
+			state->pending_count--;
+			break;
+		}
+	}
+}
+
+static void __flowthings_io_http_mock_poll(void *s, int timeout_ms)
+{
+	__flowthings_io_http_mock *state = (__flowthings_io_http_mock *)s;
+	flowthings_io_http_xfer *xfer;
+	int n;
+
+	/* the mock has nothing to wait for */
+	(void)timeout_ms;
+
+	/* transfers submitted from completion callbacks wait for the next poll; the callbacks may
+	 * also cancel transfers, so take them off the list one at a time */
+	for (n = state->pending_count; n > 0 && (xfer = state->pending) != NULL; n--) {
+
+		state->pending = xfer->next;
+		if (!state->pending)
+			state->pending_tail = NULL;
+		state->pending_count--;
+
+		xfer->next = NULL;
+		__flowthings_io_http_mock_respond(state, xfer);
+		flowthings_io_http_transfer_done(state->fhttp, xfer);
+	}
+}
+
+const flowthings_io_http_transport flowthings_io_http_transport_mock = {
+	"mock",
+	__flowthings_io_http_mock_init,
+	__flowthings_io_http_mock_cleanup,
+	NULL,
+	NULL,
+	__flowthings_io_http_mock_request,
+	__flowthings_io_http_mock_submit,
+	__flowthings_io_http_mock_cancel,
+	__flowthings_io_http_mock_poll,
+	NULL
+};
+
+
+#ifdef  __cplusplus
+}
+#endif
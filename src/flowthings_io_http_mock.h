@@ -0,0 +1,103 @@
+/*
+ * flowthings_io_http_mock.h
+ *
+ * An in-memory transport that answers requests with canned responses, for tests and for
+ * measuring the cost of the library itself without a network.
+ */
+
+#ifndef FLOWTHINGS_IO_HTTP_MOCK_H_
+#define FLOWTHINGS_IO_HTTP_MOCK_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io.h"
+#include "flowthings_io_http.h"
+
+
+/***********************************************************************
+ * The mock transport configuration
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_http_mock_response
+ *
+ * A canned response.  A request matches if its method is the same (or method is NULL) and its
+ * path, which starts after the account in the URL (e.g. /drop/f123/d456?filter=x), starts with
+ * path (or path is NULL).  The first matching entry in the table is used.
+ */
+typedef struct flowthings_io_http_mock_response {
+	const char *method;
+	const char *path;
+	int http_response_code;
+	const char *body;
+} flowthings_io_http_mock_response;
+
+/*
+ * NAME: flowthings_io_http_mock_cb_handler
+ *
+ * Called for requests that don't match any entry in the table.
+ *
+ * PARAMS:
+ * method - the HTTP method
+ * path - the request path, as for flowthings_io_http_mock_response
+ * data - the request body, or NULL
+ * body - the response body to fill in; it's empty when this is called
+ * user_data - the pointer from the configuration
+ *
+ * RETURN:
+ * Returns the HTTP response code.
+ */
+typedef int (*flowthings_io_http_mock_cb_handler)(const char *method, const char *path,
+		const char *data, flowthings_io_string *body, void *user_data);
+
+/*
+ * NAME: flowthings_io_http_mock_config
+ *
+ * The configuration passed to flowthings_io_http_set_transport with
+ * flowthings_io_http_transport_mock.  It must stay valid as long as the HTTP object.  Requests
+ * that match neither the table nor the handler get a 404 with an empty body.
+ *
+ * responses - the table of canned responses, or NULL
+ * response_count - the number of entries in responses
+ * handler - the handler for requests the table doesn't match, or NULL
+ * user_data - passed to handler
+ * chunk_size - if not 0, response bodies are delivered in pieces of this size, like they would be
+ *     from the network
+ * etags - if TRUE, 200 responses to GET requests carry an ETag made from a hash of the body, and
+ *     a request whose If-None-Match matches it gets a 304 with no body
+ */
+typedef struct flowthings_io_http_mock_config {
+	const flowthings_io_http_mock_response *responses;
+	int response_count;
+
+	flowthings_io_http_mock_cb_handler handler;
+	void *user_data;
+
+	size_t chunk_size;
+
+	BOOL etags;
+} flowthings_io_http_mock_config;
+
+/*
+ * NAME: flowthings_io_http_transport_mock
+ *
+ * The mock transport.  Requests are answered on the calling thread; asynchronous requests are
+ * answered on the next call to flowthings_io_http_poll.
+ */
+extern const flowthings_io_http_transport flowthings_io_http_transport_mock;
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* FLOWTHINGS_IO_HTTP_MOCK_H_ */
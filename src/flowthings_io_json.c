@@ -0,0 +1,1083 @@
+/*
+ * flowthings_io_json.c
+ *
+ * Writes compact JSON straight into a growable string.  Every value is appended where it goes,
+ * so writing a body makes no allocations besides growing the string, and a string that is reset
+ * and reused stops growing once it fits the largest body.
+ *
+ * The reader goes the other way, keeping the same state as the writer to check where each token
+ * is allowed.  It never copies or allocates: keys and strings are handed out as they are in the
+ * text, and only decoded when asked for.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io_json.h"
+
+
+/***********************************************************************
+ * Helper functions
+ ***********************************************************************/
+
+/*
+ * NAME: __flowthings_io_json_value
+ *
+ * Gets ready to write a value: writes the comma before it if it isn't the first in its array, and
+ * checks that it is allowed here.  Returns FALSE if it isn't.
+ */
+static BOOL __flowthings_io_json_value(flowthings_io_json_writer *writer)
+{
+	if (writer->failed)
+		return FALSE;
+
+	/* in an object, the key has written the comma */
+	if (writer->depth > 0 && writer->open[writer->depth - 1] == '{') {
+		if (!writer->after_key) {
+			writer->failed = TRUE;
+			return FALSE;
+		}
+		writer->after_key = FALSE;
+		return TRUE;
+	}
+
+	if (writer->filled[writer->depth]) {
+		/* only one value at the top level */
+		if (writer->depth == 0) {
+			writer->failed = TRUE;
+			return FALSE;
+		}
+		flowthings_io_string_append(writer->out, ",", 1);
+	}
+
+	writer->filled[writer->depth] = TRUE;
+
+	return TRUE;
+}
+
+static void __flowthings_io_json_begin(flowthings_io_json_writer *writer, char c)
+{
+	if (!__flowthings_io_json_value(writer))
+		return;
+
+	if (writer->depth == FLOWTHINGS_IO_JSON_MAX_DEPTH) {
+		writer->failed = TRUE;
+		return;
+	}
+
+	flowthings_io_string_append(writer->out, &c, 1);
+	writer->open[writer->depth++] = c;
+	writer->filled[writer->depth] = FALSE;
+}
+
+static void __flowthings_io_json_end(flowthings_io_json_writer *writer, char open, char close)
+{
+	if (writer->failed)
+		return;
+
+	if (writer->depth == 0 || writer->open[writer->depth - 1] != open || writer->after_key) {
+		writer->failed = TRUE;
+		return;
+	}
+
+	flowthings_io_string_append(writer->out, &close, 1);
+	writer->depth--;
+}
+
+
+/***********************************************************************
+ * The writer functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_json_writer_init
+ *
+ * Sets up a writer that appends to out.
+ */
+void flowthings_io_json_writer_init(flowthings_io_json_writer *writer, flowthings_io_string *out)
+{
+	memset(writer, 0, sizeof(flowthings_io_json_writer));
+	writer->out = out;
+}
+
+/*
+ * NAME: flowthings_io_json_writer_done
+ *
+ * Returns TRUE if the writer has written one whole value.
+ */
+BOOL flowthings_io_json_writer_done(flowthings_io_json_writer *writer)
+{
+	return !writer->failed && writer->depth == 0 && writer->filled[0];
+}
+
+void flowthings_io_json_begin_object(flowthings_io_json_writer *writer)
+{
+	__flowthings_io_json_begin(writer, '{');
+}
+
+void flowthings_io_json_end_object(flowthings_io_json_writer *writer)
+{
+	__flowthings_io_json_end(writer, '{', '}');
+}
+
+void flowthings_io_json_begin_array(flowthings_io_json_writer *writer)
+{
+	__flowthings_io_json_begin(writer, '[');
+}
+
+void flowthings_io_json_end_array(flowthings_io_json_writer *writer)
+{
+	__flowthings_io_json_end(writer, '[', ']');
+}
+
+/*
+ * NAME: flowthings_io_json_key
+ *
+ * Writes the key of the next member of the open object.
+ */
+void flowthings_io_json_key(flowthings_io_json_writer *writer, const char *key)
+{
+	if (writer->failed)
+		return;
+
+	if (!key || writer->depth == 0 || writer->open[writer->depth - 1] != '{' || writer->after_key) {
+		writer->failed = TRUE;
+		return;
+	}
+
+	if (writer->filled[writer->depth])
+		flowthings_io_string_append(writer->out, ",", 1);
+	writer->filled[writer->depth] = TRUE;
+
+	flowthings_io_json_escape(writer->out, key, strlen(key));
+	flowthings_io_string_append(writer->out, ":", 1);
+	writer->after_key = TRUE;
+}
+
+void flowthings_io_json_string(flowthings_io_json_writer *writer, const char *s)
+{
+	if (!s) {
+		flowthings_io_json_null(writer);
+		return;
+	}
+
+	if (__flowthings_io_json_value(writer))
+		flowthings_io_json_escape(writer->out, s, strlen(s));
+}
+
+/*
+ * NAME: flowthings_io_json_number
+ *
+ * Writes a number with as few digits as read back as the same double, and whole numbers below
+ * 1e21 without a fraction or exponent.  Numbers that aren't finite are written as null.
+ */
+void flowthings_io_json_number(flowthings_io_json_writer *writer, double d)
+{
+	char buf[cJSON_NumberBufferSize];
+	int len = cJSON_WriteNumber(d, buf);
+
+	flowthings_io_json_raw(writer, buf, len);
+}
+
+void flowthings_io_json_integer(flowthings_io_json_writer *writer, long long i)
+{
+	char buf[cJSON_NumberBufferSize];
+	int len = cJSON_WriteInt64(i, buf);
+
+	flowthings_io_json_raw(writer, buf, len);
+}
+
+void flowthings_io_json_bool(flowthings_io_json_writer *writer, BOOL b)
+{
+	if (b)
+		flowthings_io_json_raw(writer, "true", 4);
+	else
+		flowthings_io_json_raw(writer, "false", 5);
+}
+
+void flowthings_io_json_null(flowthings_io_json_writer *writer)
+{
+	flowthings_io_json_raw(writer, "null", 4);
+}
+
+/*
+ * NAME: flowthings_io_json_raw
+ *
+ * Writes a value that is already JSON text.
+ */
+void flowthings_io_json_raw(flowthings_io_json_writer *writer, const char *json, size_t len)
+{
+	if (__flowthings_io_json_value(writer))
+		flowthings_io_string_append(writer->out, json, len);
+}
+
+/*
+ * NAME: flowthings_io_json_item
+ *
+ * Writes a cJSON item and everything in it.
+ */
+void flowthings_io_json_item(flowthings_io_json_writer *writer, const cJSON *item)
+{
+	const cJSON *child;
+
+	if (!item) {
+		writer->failed = TRUE;
+		return;
+	}
+
+	switch (item->type & 0xff) {
+
+	case cJSON_False:
+		flowthings_io_json_bool(writer, FALSE);
+		break;
+
+	case cJSON_True:
+		flowthings_io_json_bool(writer, TRUE);
+		break;
+
+	case cJSON_NULL:
+		flowthings_io_json_null(writer);
+		break;
+
+	case cJSON_Number:
+		/* whole numbers past 2^53 are only exact in valueint64 */
+		if (item->valuedouble == (double)item->valueint64)
+			flowthings_io_json_integer(writer, item->valueint64);
+		else
+			flowthings_io_json_number(writer, item->valuedouble);
+		break;
+
+	case cJSON_String:
+		flowthings_io_json_string(writer, item->valuestring);
+		break;
+
+	case cJSON_Array:
+		flowthings_io_json_begin_array(writer);
+		for (child = item->child; child && !writer->failed; child = child->next)
+			flowthings_io_json_item(writer, child);
+		flowthings_io_json_end_array(writer);
+		break;
+
+	case cJSON_Object:
+		flowthings_io_json_begin_object(writer);
+		for (child = item->child; child && !writer->failed; child = child->next) {
+			flowthings_io_json_key(writer, child->string);
+			flowthings_io_json_item(writer, child);
+		}
+		flowthings_io_json_end_object(writer);
+		break;
+
+	default:
+		writer->failed = TRUE;
+	}
+}
+
+/*
+ * NAME: flowthings_io_json_escape
+ *
+ * Appends len bytes of s to out as a quoted JSON string.  Runs of characters that don't need
+ * escaping are appended in one go.
+ */
+void flowthings_io_json_escape(flowthings_io_string *out, const char *s, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	char esc[7] = "\\u00";
+	size_t i, start = 0;
+
+	flowthings_io_string_append(out, "\"", 1);
+
+	for (i = 0; i < len; i++) {
+
+		unsigned char c = (unsigned char)s[i];
+
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		flowthings_io_string_append(out, s + start, i - start);
+		start = i + 1;
+
+		switch (c) {
+		case '"': flowthings_io_string_append(out, "\\\"", 2); break;
+		case '\\': flowthings_io_string_append(out, "\\\\", 2); break;
+		case '\n': flowthings_io_string_append(out, "\\n", 2); break;
+		case '\r': flowthings_io_string_append(out, "\\r", 2); break;
+		case '\t': flowthings_io_string_append(out, "\\t", 2); break;
+		case '\b': flowthings_io_string_append(out, "\\b", 2); break;
+		case '\f': flowthings_io_string_append(out, "\\f", 2); break;
+		default:
+			esc[4] = hex[c >> 4];
+			esc[5] = hex[c & 0xf];
+			flowthings_io_string_append(out, esc, 6);
+		}
+	}
+
+	flowthings_io_string_append(out, s + start, len - start);
+	flowthings_io_string_append(out, "\"", 1);
+}
+
+/*
+ * NAME: flowthings_io_json_print
+ *
+ * Returns a cJSON item as compact JSON, which the caller must free, or NULL if it can't be
+ * written.
+ */
+char *flowthings_io_json_print(const cJSON *item)
+{
+	flowthings_io_string *out = flowthings_io_string_init();
+	flowthings_io_json_writer writer;
+	char *json = NULL;
+
+	flowthings_io_json_writer_init(&writer, out);
+	flowthings_io_json_item(&writer, item);
+
+	/* hand over the buffer and free only the string object */
+	if (flowthings_io_json_writer_done(&writer)) {
+		json = out->ptr;
+		out->ptr = NULL;
+		free(out);
+	}
+	else {
+		flowthings_io_string_cleanup(out);
+	}
+
+	return json;
+}
+
+
+/***********************************************************************
+ * Reader helper functions
+ ***********************************************************************/
+
+static flowthings_io_json_event __flowthings_io_json_fail(flowthings_io_json_reader *reader)
+{
+	reader->failed = TRUE;
+	return FLOWTHINGS_IO_JSON_ERROR;
+}
+
+static void __flowthings_io_json_ws(flowthings_io_json_reader *reader)
+{
+	const char *p = reader->p, *end = reader->end;
+
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+		p++;
+
+	reader->p = p;
+}
+
+/*
+ * NAME: __flowthings_io_json_string_end
+ *
+ * Returns the closing quote of the string whose first character is at p, or NULL if it doesn't
+ * end before end, and sets escaped if it has escapes.  The quotes are found with memchr, which
+ * goes through long strings far faster than a loop over their characters.
+ */
+static const char *__flowthings_io_json_string_end(const char *p, const char *end, BOOL *escaped)
+{
+	const char *start = p, *q, *b;
+
+	for (;;) {
+		q = memchr(p, '"', end - p);
+		if (!q)
+			return NULL;
+
+		/* the quote ends the string unless an odd number of backslashes come before it */
+		for (b = q; b > start && b[-1] == '\\'; b--)
+			;
+		if (((q - b) & 1) == 0)
+			break;
+
+		p = q + 1;
+	}
+
+	*escaped = memchr(start, '\\', q - start) != NULL;
+
+	return q;
+}
+
+/* reads a key or string, starting at its opening quote */
+static BOOL __flowthings_io_json_read_string(flowthings_io_json_reader *reader)
+{
+	const char *q = __flowthings_io_json_string_end(reader->p + 1, reader->end, &reader->escaped);
+
+	if (!q)
+		return FALSE;
+
+	reader->str = reader->p + 1;
+	reader->str_len = q - reader->str;
+	reader->p = q + 1;
+
+	return TRUE;
+}
+
+static flowthings_io_json_event __flowthings_io_json_literal(flowthings_io_json_reader *reader,
+		const char *word, size_t len, flowthings_io_json_event event)
+{
+	if ((size_t)(reader->end - reader->p) < len || memcmp(reader->p, word, len))
+		return __flowthings_io_json_fail(reader);
+
+	reader->p += len;
+
+	return event;
+}
+
+/*
+ * NAME: __flowthings_io_json_skip_nested
+ *
+ * Skips to the end of depth open objects and arrays, only matching up brackets and finding the
+ * ends of strings.
+ */
+static BOOL __flowthings_io_json_skip_nested(flowthings_io_json_reader *reader, int depth)
+{
+	const char *p = reader->p, *end = reader->end;
+	BOOL escaped;
+
+	while (p < end) {
+
+		switch (*p++) {
+		case '"':
+			p = __flowthings_io_json_string_end(p, end, &escaped);
+			if (!p)
+				return FALSE;
+			p++;
+			break;
+		case '{':
+		case '[':
+			depth++;
+			break;
+		case '}':
+		case ']':
+			if (--depth == 0) {
+				reader->p = p;
+				return TRUE;
+			}
+			break;
+		}
+	}
+
+	return FALSE;
+}
+
+static int __flowthings_io_json_hex4(const char *p)
+{
+	int i, v = 0;
+
+	for (i = 0; i < 4; i++) {
+		v <<= 4;
+		if (p[i] >= '0' && p[i] <= '9') v |= p[i] - '0';
+		else if (p[i] >= 'a' && p[i] <= 'f') v |= p[i] - 'a' + 10;
+		else if (p[i] >= 'A' && p[i] <= 'F') v |= p[i] - 'A' + 10;
+		else return -1;
+	}
+
+	return v;
+}
+
+
+/***********************************************************************
+ * The reader functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_json_reader_init
+ *
+ * Sets up a reader over len bytes of JSON text.
+ */
+void flowthings_io_json_reader_init(flowthings_io_json_reader *reader, const char *json, size_t len)
+{
+	memset(reader, 0, sizeof(flowthings_io_json_reader));
+	reader->p = json;
+	reader->end = json + len;
+}
+
+/*
+ * NAME: flowthings_io_json_next
+ *
+ * Reads the next event.  Between values the reader expects a comma or the end of the open object
+ * or array, and in an object, a key before each value.
+ */
+flowthings_io_json_event flowthings_io_json_next(flowthings_io_json_reader *reader)
+{
+	const char *p;
+	char open;
+
+	if (reader->failed)
+		return FLOWTHINGS_IO_JSON_ERROR;
+
+	__flowthings_io_json_ws(reader);
+	p = reader->p;
+
+	if (!reader->after_key && reader->depth == 0 && reader->filled[0])
+		return p == reader->end ? FLOWTHINGS_IO_JSON_END : __flowthings_io_json_fail(reader);
+
+	if (!reader->after_key && reader->depth > 0) {
+
+		open = reader->open[reader->depth - 1];
+
+		if (p < reader->end && *p == (open == '{' ? '}' : ']')) {
+			reader->p = p + 1;
+			reader->depth--;
+			return open == '{' ? FLOWTHINGS_IO_JSON_END_OBJECT : FLOWTHINGS_IO_JSON_END_ARRAY;
+		}
+
+		if (reader->filled[reader->depth]) {
+			if (p == reader->end || *p != ',')
+				return __flowthings_io_json_fail(reader);
+			reader->p = p + 1;
+			__flowthings_io_json_ws(reader);
+			p = reader->p;
+		}
+
+		if (open == '{') {
+
+			if (p == reader->end || *p != '"' || !__flowthings_io_json_read_string(reader))
+				return __flowthings_io_json_fail(reader);
+
+			__flowthings_io_json_ws(reader);
+			if (reader->p == reader->end || *reader->p != ':')
+				return __flowthings_io_json_fail(reader);
+
+			reader->p++;
+			reader->filled[reader->depth] = TRUE;
+			reader->after_key = TRUE;
+
+			return FLOWTHINGS_IO_JSON_KEY;
+		}
+	}
+
+	if (p == reader->end)
+		return __flowthings_io_json_fail(reader);
+
+	reader->after_key = FALSE;
+	reader->filled[reader->depth] = TRUE;
+
+	switch (*p) {
+
+	case '{':
+	case '[':
+		if (reader->depth == FLOWTHINGS_IO_JSON_MAX_DEPTH)
+			return __flowthings_io_json_fail(reader);
+		reader->open[reader->depth++] = *p;
+		reader->filled[reader->depth] = FALSE;
+		reader->p = p + 1;
+		return *p == '{' ? FLOWTHINGS_IO_JSON_BEGIN_OBJECT : FLOWTHINGS_IO_JSON_BEGIN_ARRAY;
+
+	case '"':
+		if (!__flowthings_io_json_read_string(reader))
+			return __flowthings_io_json_fail(reader);
+		return FLOWTHINGS_IO_JSON_STRING;
+
+	case 't':
+		return __flowthings_io_json_literal(reader, "true", 4, FLOWTHINGS_IO_JSON_TRUE);
+
+	case 'f':
+		return __flowthings_io_json_literal(reader, "false", 5, FLOWTHINGS_IO_JSON_FALSE);
+
+	case 'n':
+		return __flowthings_io_json_literal(reader, "null", 4, FLOWTHINGS_IO_JSON_NULL);
+
+	default:
+		/* the text is null terminated, so p[1] can be looked at */
+		if ((*p == '-' ? p[1] : *p) < '0' || (*p == '-' ? p[1] : *p) > '9')
+			return __flowthings_io_json_fail(reader);
+		reader->p = cJSON_ReadNumber(p, &reader->number, &reader->integer);
+		return FLOWTHINGS_IO_JSON_NUMBER;
+	}
+}
+
+/*
+ * NAME: flowthings_io_json_skip
+ *
+ * Skips the value of the key just read, or the rest of the innermost open object or array.
+ */
+BOOL flowthings_io_json_skip(flowthings_io_json_reader *reader)
+{
+	const char *p;
+	BOOL ok;
+
+	if (reader->failed)
+		return FALSE;
+
+	if (reader->after_key || (reader->depth == 0 && !reader->filled[0])) {
+
+		__flowthings_io_json_ws(reader);
+		p = reader->p;
+
+		reader->after_key = FALSE;
+		reader->filled[reader->depth] = TRUE;
+
+		if (p == reader->end) {
+			ok = FALSE;
+		}
+		else if (*p == '{' || *p == '[') {
+			reader->p = p + 1;
+			ok = __flowthings_io_json_skip_nested(reader, 1);
+		}
+		else if (*p == '"') {
+			ok = __flowthings_io_json_read_string(reader);
+		}
+		else {
+			while (p < reader->end && !strchr(",:]} \t\r\n", *p))
+				p++;
+			ok = p > reader->p;
+			reader->p = p;
+		}
+	}
+	else if (reader->depth > 0) {
+		ok = __flowthings_io_json_skip_nested(reader, 1);
+		reader->depth--;
+	}
+	else {
+		/* the whole value has been read already */
+		return TRUE;
+	}
+
+	if (!ok)
+		reader->failed = TRUE;
+
+	return ok;
+}
+
+/*
+ * NAME: flowthings_io_json_reader_string
+ *
+ * Decodes the key or string just read into a buffer of size bytes.
+ */
+BOOL flowthings_io_json_reader_string(flowthings_io_json_reader *reader, char *dest, size_t size)
+{
+	const char *p = reader->str, *end = reader->str + reader->str_len;
+	char utf8[4];
+	size_t n = 0, len, i;
+	BOOL truncated = FALSE;
+	int cp, lo;
+
+	if (size == 0)
+		return FALSE;
+
+	while (p < end) {
+
+		if (*p != '\\') {
+			const char *run = p;
+
+			p = reader->escaped ? memchr(p, '\\', end - p) : NULL;
+			if (!p)
+				p = end;
+
+			/* once cut, the rest is only checked for malformed escapes */
+			len = truncated ? 0 : p - run;
+			if (n + len >= size) {
+				len = size - 1 - n;
+				truncated = TRUE;
+			}
+			memcpy(dest + n, run, len);
+			n += len;
+			continue;
+		}
+
+		if (++p >= end)
+			return FALSE;
+
+		len = 1;
+		switch (*p++) {
+		case '"': utf8[0] = '"'; break;
+		case '\\': utf8[0] = '\\'; break;
+		case '/': utf8[0] = '/'; break;
+		case 'b': utf8[0] = '\b'; break;
+		case 'f': utf8[0] = '\f'; break;
+		case 'n': utf8[0] = '\n'; break;
+		case 'r': utf8[0] = '\r'; break;
+		case 't': utf8[0] = '\t'; break;
+		case 'u':
+			if (end - p < 4 || (cp = __flowthings_io_json_hex4(p)) < 0)
+				return FALSE;
+			p += 4;
+
+			/* a surrogate pair; half of one on its own is malformed */
+			if (cp >= 0xd800 && cp <= 0xdbff) {
+				if (end - p < 6 || p[0] != '\\' || p[1] != 'u'
+						|| (lo = __flowthings_io_json_hex4(p + 2)) < 0xdc00 || lo > 0xdfff)
+					return FALSE;
+				cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+				p += 6;
+			}
+			else if (cp >= 0xdc00 && cp <= 0xdfff) {
+				return FALSE;
+			}
+
+			if (cp < 0x80) {
+				utf8[0] = cp;
+			}
+			else if (cp < 0x800) {
+				utf8[0] = 0xc0 | (cp >> 6);
+				utf8[1] = 0x80 | (cp & 0x3f);
+				len = 2;
+			}
+			else if (cp < 0x10000) {
+				utf8[0] = 0xe0 | (cp >> 12);
+				utf8[1] = 0x80 | ((cp >> 6) & 0x3f);
+				utf8[2] = 0x80 | (cp & 0x3f);
+				len = 3;
+			}
+			else {
+				utf8[0] = 0xf0 | (cp >> 18);
+				utf8[1] = 0x80 | ((cp >> 12) & 0x3f);
+				utf8[2] = 0x80 | ((cp >> 6) & 0x3f);
+				utf8[3] = 0x80 | (cp & 0x3f);
+				len = 4;
+			}
+			break;
+		default:
+			return FALSE;
+		}
+
+		if (!truncated && n + len < size) {
+			for (i = 0; i < len; i++)
+				dest[n++] = utf8[i];
+		}
+		else {
+			truncated = TRUE;
+		}
+	}
+
+	/* don't leave part of a character at the end */
+	if (truncated && n > 0) {
+		for (i = n; i > 0 && ((unsigned char)dest[i - 1] & 0xc0) == 0x80; i--)
+			;
+		if (i > 0 && (unsigned char)dest[i - 1] >= 0xc0) {
+			unsigned char lead = dest[i - 1];
+			len = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : 2;
+			if (n - (i - 1) < len)
+				n = i - 1;
+		}
+	}
+
+	dest[n] = '\0';
+
+	return TRUE;
+}
+
+/*
+ * NAME: flowthings_io_json_key_is
+ *
+ * Returns TRUE if the key or string just read is key.  A key with escapes is decoded to compare
+ * it, which is only done for keys of up to 255 characters.
+ */
+BOOL flowthings_io_json_key_is(flowthings_io_json_reader *reader, const char *key)
+{
+	size_t len = strlen(key);
+	char decoded[256];
+
+	if (!reader->escaped)
+		return reader->str_len == len && !memcmp(reader->str, key, len);
+
+	if (len >= sizeof(decoded) - 1 || !flowthings_io_json_reader_string(reader, decoded, sizeof(decoded)))
+		return FALSE;
+
+	return !strcmp(decoded, key);
+}
+
+
+/***********************************************************************
+ * Projections
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_json_projection
+ *
+ * One key of a projection.  All the nodes of a projection, and their keys, are in one
+ * allocation; the first node is the top of the document, and each node's children are linked
+ * through next.
+ *
+ * key - the key, without any "[]"
+ * child - the first of the keys below this one on some path
+ * next - the next key with the same parent
+ * whole - a path ends here, so the value is kept whole
+ */
+struct flowthings_io_json_projection {
+	const char *key;
+	struct flowthings_io_json_projection *child;
+	struct flowthings_io_json_projection *next;
+	BOOL whole;
+};
+
+/*
+ * NAME: __flowthings_io_json_decoded
+ *
+ * Decodes the key or string just read into small, or into a buffer allocated for it if it may
+ * not fit, which the caller must free.  Returns NULL if it can't be decoded.
+ */
+static char *__flowthings_io_json_decoded(flowthings_io_json_reader *reader, char *small, size_t size)
+{
+	char *buf = small;
+
+	/* a string is never longer decoded than it is in the text */
+	if (reader->str_len >= size) {
+		size = reader->str_len + 1;
+		buf = malloc(size);
+		if (!buf)
+			return NULL;
+	}
+
+	if (!flowthings_io_json_reader_string(reader, buf, size)) {
+		if (buf != small)
+			free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+/*
+ * NAME: __flowthings_io_json_project
+ *
+ * Builds the cJSON item for the value whose first event is event, keeping only what is on the
+ * paths below node.  Returns NULL if the text is malformed.
+ */
+static cJSON *__flowthings_io_json_project(flowthings_io_json_reader *reader,
+		const flowthings_io_json_projection *node, flowthings_io_json_event event)
+{
+	const flowthings_io_json_projection *child;
+	cJSON *item, *value;
+	char small[64], *s;
+
+	switch (event) {
+
+	case FLOWTHINGS_IO_JSON_BEGIN_OBJECT:
+		item = cJSON_CreateObject();
+
+		while (item && (event = flowthings_io_json_next(reader)) == FLOWTHINGS_IO_JSON_KEY) {
+
+			if (node && node->whole) {
+				s = __flowthings_io_json_decoded(reader, small, sizeof(small));
+				value = s ? __flowthings_io_json_project(reader, node, flowthings_io_json_next(reader)) : NULL;
+				if (value)
+					cJSON_AddItemToObject(item, s, value);
+				if (s != small)
+					free(s);
+			}
+			else {
+				for (child = node ? node->child : NULL; child; child = child->next)
+					if (flowthings_io_json_key_is(reader, child->key))
+						break;
+
+				if (!child) {
+					if (!flowthings_io_json_skip(reader))
+						break;
+					continue;
+				}
+
+				value = __flowthings_io_json_project(reader, child, flowthings_io_json_next(reader));
+				if (value)
+					cJSON_AddItemToObject(item, child->key, value);
+			}
+
+			if (!value)
+				break;
+		}
+
+		if (item && event != FLOWTHINGS_IO_JSON_END_OBJECT) {
+			cJSON_Delete(item);
+			item = NULL;
+		}
+		return item;
+
+	case FLOWTHINGS_IO_JSON_BEGIN_ARRAY:
+		item = cJSON_CreateArray();
+
+		while (item && (event = flowthings_io_json_next(reader)) != FLOWTHINGS_IO_JSON_END_ARRAY) {
+			value = __flowthings_io_json_project(reader, node, event);
+			if (!value) {
+				cJSON_Delete(item);
+				return NULL;
+			}
+			cJSON_AddItemToArray(item, value);
+		}
+		return item;
+
+	case FLOWTHINGS_IO_JSON_STRING:
+		s = __flowthings_io_json_decoded(reader, small, sizeof(small));
+		if (!s)
+			return NULL;
+		item = cJSON_CreateString(s);
+		if (s != small)
+			free(s);
+		return item;
+
+	case FLOWTHINGS_IO_JSON_NUMBER:
+		/* keep whole numbers past 2^53 exact, as the parser does */
+		if (reader->number == (double)reader->integer)
+			return cJSON_CreateInt64(reader->integer);
+		return cJSON_CreateNumber(reader->number);
+
+	case FLOWTHINGS_IO_JSON_TRUE:
+		return cJSON_CreateTrue();
+
+	case FLOWTHINGS_IO_JSON_FALSE:
+		return cJSON_CreateFalse();
+
+	case FLOWTHINGS_IO_JSON_NULL:
+		return cJSON_CreateNull();
+
+	default:
+		return NULL;
+	}
+}
+
+/*
+ * NAME: flowthings_io_json_projection_init
+ *
+ * Compiles paths into a projection.  The paths are copied after the nodes, with a null in place
+ * of each dot and "[]", so the keys point into the copies.
+ */
+flowthings_io_json_projection *flowthings_io_json_projection_init(const char *const paths[], int count)
+{
+	flowthings_io_json_projection *nodes, *node, *child;
+	size_t node_count = 1, text_size = 0;
+	char *text, *key, *dot, *end;
+	const char *c;
+	int i, depth;
+
+	if (!paths || count <= 0)
+		return NULL;
+
+	/* at most one node for each key of each path, plus the top */
+	for (i = 0; i < count; i++) {
+		if (!paths[i])
+			return NULL;
+		for (c = paths[i]; *c; c++)
+			node_count += *c == '.';
+		node_count++;
+		text_size += c - paths[i] + 1;
+	}
+
+	nodes = calloc(1, node_count * sizeof(flowthings_io_json_projection) + text_size);
+	if (!nodes)
+		return NULL;
+
+	text = (char *)(nodes + node_count);
+	node_count = 1;
+
+	for (i = 0; i < count; i++) {
+
+		strcpy(text, paths[i]);
+		node = nodes;
+		depth = 0;
+
+		for (key = text; ; key = dot + 1) {
+
+			dot = strchr(key, '.');
+			end = dot ? dot : key + strlen(key);
+			*end = '\0';
+
+			while (end - key >= 2 && end[-2] == '[' && end[-1] == ']') {
+				end -= 2;
+				*end = '\0';
+			}
+
+			if (end == key || strchr(key, '[') || ++depth > FLOWTHINGS_IO_JSON_MAX_DEPTH) {
+				free(nodes);
+				return NULL;
+			}
+
+			for (child = node->child; child && strcmp(child->key, key); child = child->next)
+				;
+
+			if (!child) {
+				child = &nodes[node_count++];
+				child->key = key;
+				child->next = node->child;
+				node->child = child;
+			}
+
+			node = child;
+
+			if (!dot)
+				break;
+		}
+
+		node->whole = TRUE;
+		text += strlen(paths[i]) + 1;
+	}
+
+	return nodes;
+}
+
+/*
+ * NAME: flowthings_io_json_projection_cleanup
+ *
+ * Frees a projection.
+ */
+void flowthings_io_json_projection_cleanup(flowthings_io_json_projection *projection)
+{
+	free(projection);
+}
+
+/*
+ * NAME: flowthings_io_json_projection_at
+ *
+ * Returns the part of a projection below key.  Below the end of a path everything is kept, so
+ * that is the same node.
+ */
+const flowthings_io_json_projection *flowthings_io_json_projection_at(
+		const flowthings_io_json_projection *projection, const char *key)
+{
+	const flowthings_io_json_projection *child;
+
+	if (!projection || projection->whole)
+		return projection;
+
+	for (child = projection->child; child; child = child->next)
+		if (!strcmp(child->key, key))
+			return child;
+
+	return NULL;
+}
+
+/*
+ * NAME: flowthings_io_json_parse_projected
+ *
+ * Parses JSON text into a cJSON tree with only what is on a projection's paths.
+ */
+cJSON *flowthings_io_json_parse_projected(const flowthings_io_json_projection *projection,
+		const char *json, size_t len)
+{
+	flowthings_io_json_reader reader;
+	cJSON *root;
+
+	flowthings_io_json_reader_init(&reader, json, len);
+
+	root = __flowthings_io_json_project(&reader, projection, flowthings_io_json_next(&reader));
+
+	if (root && flowthings_io_json_next(&reader) != FLOWTHINGS_IO_JSON_END) {
+		cJSON_Delete(root);
+		root = NULL;
+	}
+
+	return root;
+}
+
+/*
+ * NAME: flowthings_io_json_parse_projected_next
+ *
+ * Parses the next value from a reader into a cJSON tree with only what is on a projection's paths.
+ */
+cJSON *flowthings_io_json_parse_projected_next(const flowthings_io_json_projection *projection,
+		flowthings_io_json_reader *reader)
+{
+	return __flowthings_io_json_project(reader, projection, flowthings_io_json_next(reader));
+}
+
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,324 @@
+/*
+ * flowthings_io_json.h
+ *
+ * A JSON writer that appends compact JSON to a flowthings_io_string in one pass.  Request bodies
+ * are written with it, either value by value or from a cJSON tree built by an encoder callback,
+ * instead of with cJSON_Print, which indents its output and allocates a string for every member
+ * and array element before joining them.
+ *
+ * And its counterpart, a pull reader that walks JSON text one event at a time (the start of an
+ * object, a key, a string, ...) without building anything, so a decoder only converts the values
+ * it wants and skips the rest.  With it, a projection parses only the parts of a document on a
+ * set of paths into a cJSON tree, and skips everything else.
+ */
+
+#ifndef FLOWTHINGS_IO_JSON_H_
+#define FLOWTHINGS_IO_JSON_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "cJSON.h"
+#include "flowthings_io.h"
+
+
+/***********************************************************************
+ * The writer object
+ ***********************************************************************/
+
+/* the deepest nesting of objects and arrays the writer accepts */
+#define FLOWTHINGS_IO_JSON_MAX_DEPTH 32
+
+/*
+ * NAME: flowthings_io_json_writer
+ *
+ * out - the string the JSON is appended to
+ * depth - the number of open objects and arrays
+ * open - the open objects and arrays, as '{' or '['
+ * filled - for the top level and each open object or array, whether it has a value yet, so a
+ *     comma is needed before the next one
+ * after_key - a key was just written, so the next value is its value
+ * failed - something was written out of place, e.g. a value in an object without a key
+ */
+typedef struct flowthings_io_json_writer {
+	flowthings_io_string *out;
+	int depth;
+	char open[FLOWTHINGS_IO_JSON_MAX_DEPTH];
+	BOOL filled[FLOWTHINGS_IO_JSON_MAX_DEPTH + 1];
+	BOOL after_key;
+	BOOL failed;
+} flowthings_io_json_writer;
+
+
+/***********************************************************************
+ * The writer functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_json_writer_init
+ *
+ * Sets up a writer that appends to out.  Nothing needs to be freed afterwards.
+ */
+void flowthings_io_json_writer_init(flowthings_io_json_writer *writer, flowthings_io_string *out);
+
+/*
+ * NAME: flowthings_io_json_writer_done
+ *
+ * Returns TRUE if the writer has written exactly one whole value: everything it opened is closed
+ * and nothing was written out of place.
+ */
+BOOL flowthings_io_json_writer_done(flowthings_io_json_writer *writer);
+
+/*
+ * NAME: flowthings_io_json_begin_object, flowthings_io_json_end_object,
+ *       flowthings_io_json_begin_array, flowthings_io_json_end_array
+ *
+ * Open and close an object or array.
+ */
+void flowthings_io_json_begin_object(flowthings_io_json_writer *writer);
+void flowthings_io_json_end_object(flowthings_io_json_writer *writer);
+void flowthings_io_json_begin_array(flowthings_io_json_writer *writer);
+void flowthings_io_json_end_array(flowthings_io_json_writer *writer);
+
+/*
+ * NAME: flowthings_io_json_key
+ *
+ * Writes the key of the next member of the open object.
+ */
+void flowthings_io_json_key(flowthings_io_json_writer *writer, const char *key);
+
+/*
+ * NAME: flowthings_io_json_string, flowthings_io_json_number, flowthings_io_json_integer,
+ *       flowthings_io_json_bool, flowthings_io_json_null
+ *
+ * Write a value.  A NULL string is written as null, and so are numbers that aren't finite.
+ */
+void flowthings_io_json_string(flowthings_io_json_writer *writer, const char *s);
+void flowthings_io_json_number(flowthings_io_json_writer *writer, double d);
+void flowthings_io_json_integer(flowthings_io_json_writer *writer, long long i);
+void flowthings_io_json_bool(flowthings_io_json_writer *writer, BOOL b);
+void flowthings_io_json_null(flowthings_io_json_writer *writer);
+
+/*
+ * NAME: flowthings_io_json_raw
+ *
+ * Writes a value that is already JSON text, as is.
+ */
+void flowthings_io_json_raw(flowthings_io_json_writer *writer, const char *json, size_t len);
+
+/*
+ * NAME: flowthings_io_json_item
+ *
+ * Writes a cJSON item and everything in it.
+ */
+void flowthings_io_json_item(flowthings_io_json_writer *writer, const cJSON *item);
+
+/*
+ * NAME: flowthings_io_json_escape
+ *
+ * Appends len bytes of s to out as a quoted JSON string, escaping what JSON requires.
+ */
+void flowthings_io_json_escape(flowthings_io_string *out, const char *s, size_t len);
+
+/*
+ * NAME: flowthings_io_json_print
+ *
+ * Returns a cJSON item as compact JSON, in one allocation; a replacement for
+ * cJSON_PrintUnformatted.  The caller must free the result.
+ */
+char *flowthings_io_json_print(const cJSON *item);
+
+
+/***********************************************************************
+ * The reader object
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_json_event
+ *
+ * What flowthings_io_json_next found.
+ *
+ * FLOWTHINGS_IO_JSON_ERROR - the text is malformed, or nested deeper than
+ *     FLOWTHINGS_IO_JSON_MAX_DEPTH; every later call returns this too
+ * FLOWTHINGS_IO_JSON_END - the end of the text, after the one value it holds
+ * FLOWTHINGS_IO_JSON_KEY - the key of an object member; its value comes next
+ */
+typedef enum flowthings_io_json_event {
+	FLOWTHINGS_IO_JSON_ERROR = 0,
+	FLOWTHINGS_IO_JSON_END,
+	FLOWTHINGS_IO_JSON_BEGIN_OBJECT,
+	FLOWTHINGS_IO_JSON_END_OBJECT,
+	FLOWTHINGS_IO_JSON_BEGIN_ARRAY,
+	FLOWTHINGS_IO_JSON_END_ARRAY,
+	FLOWTHINGS_IO_JSON_KEY,
+	FLOWTHINGS_IO_JSON_STRING,
+	FLOWTHINGS_IO_JSON_NUMBER,
+	FLOWTHINGS_IO_JSON_TRUE,
+	FLOWTHINGS_IO_JSON_FALSE,
+	FLOWTHINGS_IO_JSON_NULL
+} flowthings_io_json_event;
+
+/*
+ * NAME: flowthings_io_json_reader
+ *
+ * p - the next character to read
+ * end - the end of the text
+ * depth, open, filled, after_key, failed - as for the writer
+ * str - for a key or string, its text as it is in the JSON, without the quotes and with any escapes
+ *     left in; use flowthings_io_json_reader_string to decode it
+ * str_len - the length of str
+ * escaped - str has escapes in it
+ * number - for a number, its value
+ * integer - for a number, its value as a 64-bit integer, which is exact for whole numbers and
+ *     otherwise the whole part
+ */
+typedef struct flowthings_io_json_reader {
+	const char *p;
+	const char *end;
+	int depth;
+	char open[FLOWTHINGS_IO_JSON_MAX_DEPTH];
+	BOOL filled[FLOWTHINGS_IO_JSON_MAX_DEPTH + 1];
+	BOOL after_key;
+	BOOL failed;
+
+	const char *str;
+	size_t str_len;
+	BOOL escaped;
+	double number;
+	long long integer;
+} flowthings_io_json_reader;
+
+
+/***********************************************************************
+ * The reader functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_json_reader_init
+ *
+ * Sets up a reader over len bytes of JSON text, which must be followed by a null (as the
+ * responses passed to decoders are), so a number at the very end can be read.  Nothing needs to
+ * be freed afterwards, and nothing is copied: the text must stay as it is while it is read.
+ */
+void flowthings_io_json_reader_init(flowthings_io_json_reader *reader, const char *json, size_t len);
+
+/*
+ * NAME: flowthings_io_json_next
+ *
+ * Reads the next event.  Strings and numbers are only checked as far as finding their end;
+ * escapes are checked when a string is decoded.
+ */
+flowthings_io_json_event flowthings_io_json_next(flowthings_io_json_reader *reader);
+
+/*
+ * NAME: flowthings_io_json_skip
+ *
+ * Skips the value of the key just read or, after any other event, the rest of the innermost open
+ * object or array, up to and including its end: after FLOWTHINGS_IO_JSON_BEGIN_OBJECT, the whole
+ * object.  What is skipped is only matched up, not read, so skipping costs little more than
+ * finding the end of it.
+ *
+ * RETURN:
+ * Returns FALSE if the end of the text comes first.
+ */
+BOOL flowthings_io_json_skip(flowthings_io_json_reader *reader);
+
+/*
+ * NAME: flowthings_io_json_reader_string
+ *
+ * Decodes the key or string just read into a buffer of size bytes, null terminated.  A string
+ * that doesn't fit is cut at the end of the last whole UTF-8 character that does.
+ *
+ * RETURN:
+ * Returns FALSE if the string has a malformed escape, such as half of a surrogate pair, even in
+ * the part that was cut off.
+ */
+BOOL flowthings_io_json_reader_string(flowthings_io_json_reader *reader, char *dest, size_t size);
+
+/*
+ * NAME: flowthings_io_json_key_is
+ *
+ * Returns TRUE if the key or string just read is key.
+ */
+BOOL flowthings_io_json_key_is(flowthings_io_json_reader *reader, const char *key);
+
+
+/***********************************************************************
+ * Projections
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_json_projection
+ *
+ * A set of paths into a JSON document, compiled into a tree of keys.  A path is the keys from the
+ * top of the document down to a value, with a dot between them, e.g. body[].elems.num.value.
+ * "[]" after a key shows that its value is an array whose elements the path goes on into; it is
+ * only there to be read, as arrays are always gone into.
+ *
+ * When a document is parsed with a projection, objects keep only the members that are on a path,
+ * arrays keep all their elements, and the value at the end of a path is kept whole.
+ */
+typedef struct flowthings_io_json_projection flowthings_io_json_projection;
+
+/*
+ * NAME: flowthings_io_json_projection_init
+ *
+ * Compiles count paths into a projection, which must be freed with
+ * flowthings_io_json_projection_cleanup.  The paths are copied.  Returns NULL if a path is empty,
+ * has an empty key, or is nested more than FLOWTHINGS_IO_JSON_MAX_DEPTH keys deep.
+ */
+flowthings_io_json_projection *flowthings_io_json_projection_init(const char *const paths[], int count);
+
+/*
+ * NAME: flowthings_io_json_projection_cleanup
+ *
+ * Frees a projection made by flowthings_io_json_projection_init.
+ */
+void flowthings_io_json_projection_cleanup(flowthings_io_json_projection *projection);
+
+/*
+ * NAME: flowthings_io_json_projection_at
+ *
+ * Returns the part of a projection below key, which projects the value of that key, e.g. "body"
+ * for the objects in a response's body; or NULL if no path goes through key.  It belongs to
+ * projection and is not freed on its own.
+ */
+const flowthings_io_json_projection *flowthings_io_json_projection_at(
+		const flowthings_io_json_projection *projection, const char *key);
+
+/*
+ * NAME: flowthings_io_json_parse_projected
+ *
+ * Parses len bytes of JSON text, followed by a null, into a cJSON tree holding only what is on
+ * projection's paths; the rest is skipped without being converted.  A NULL projection keeps
+ * nothing from any object.  The tree is built with the cJSON_Create functions, so in the arena in
+ * use, if there is one.  Returns NULL if the text is malformed.
+ */
+cJSON *flowthings_io_json_parse_projected(const flowthings_io_json_projection *projection,
+		const char *json, size_t len);
+
+/*
+ * NAME: flowthings_io_json_parse_projected_next
+ *
+ * Parses the next value read by a pull reader, as flowthings_io_json_parse_projected does, and
+ * leaves the reader after it.  This parses the objects of an array where they are, e.g. the drops
+ * of a find response, without finding where each one ends first.  Returns NULL if the value is
+ * malformed.
+ */
+cJSON *flowthings_io_json_parse_projected_next(const flowthings_io_json_projection *projection,
+		flowthings_io_json_reader *reader);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* FLOWTHINGS_IO_JSON_H_ */
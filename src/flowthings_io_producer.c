@@ -0,0 +1,551 @@
+/*
+ * flowthings_io_producer.c
+ *
+ * A write-behind drop producer.  The queue is a bounded multi-producer, multi-consumer ring (each
+ * slot carries a sequence number that says whether it is ready to be written or read), so sending
+ * threads never take a lock unless the queue is full or the background thread is asleep.
+ */
+
+/* the monotonic clock, and waiting on a condition against it, are POSIX */
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+
+/* the queue's positions and slots are updated with the GCC __atomic builtins, which Clang has too */
+#if !defined(__GNUC__)
+#error "the producer needs the __atomic builtins of GCC or Clang"
+#endif
+
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "cJSON.h"
+#include "flowthings_io_json.h"
+#include "flowthings_io_producer.h"
+
+
+/***********************************************************************
+ * The producer object
+ ***********************************************************************/
+
+/* what the background thread is waiting for, see flowthings_io_producer.sleeping */
+#define FLOWTHINGS_IO_PRODUCER_AWAKE 0
+#define FLOWTHINGS_IO_PRODUCER_IDLE 1
+#define FLOWTHINGS_IO_PRODUCER_LINGERING 2
+
+typedef struct __flowthings_io_producer_slot {
+	unsigned long seq;
+	unsigned long long queued_ns;
+	char *json;
+	void *object;
+} __flowthings_io_producer_slot;
+
+struct flowthings_io_producer {
+
+	flowthings_io_api *api;
+	char flow_id[FLOWTHINGS_IO_ID_LEN];
+	flowthings_io_cb_encode_object encoder;
+	flowthings_io_producer_config config;
+
+	/* the queue; positions only increase, and a position's slot is slots[pos & mask] */
+	__flowthings_io_producer_slot *slots;
+	unsigned long mask;
+	unsigned long enqueue_pos;
+	unsigned long dequeue_pos;
+
+	/* the background thread, and the batch it is sending */
+	pthread_t thread;
+	char **batch_json;
+	void **batch_objects;
+	flowthings_io_result_code *batch_codes;
+
+	/* the lowest position that may be in the batch being sent, or ULONG_MAX */
+	unsigned long sending_from;
+
+	/* the number of senders delivering drops they pushed out of a full queue */
+	int evicting;
+
+	/* send everything before this position now; set by flowthings_io_producer_flush */
+	unsigned long flush_to;
+	int closing;
+
+	/* the lock is only taken to sleep and to wake sleepers: the background thread sleeps on wake,
+	 * and blocked senders and flushes sleep on progress */
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t progress;
+	int sleeping;
+	int waiters;
+};
+
+
+/***********************************************************************
+ * Helper functions
+ ***********************************************************************/
+
+static unsigned long long __flowthings_io_producer_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * NAME: __flowthings_io_producer_push
+ *
+ * Puts an encoded drop on the queue.  Returns FALSE if the queue is full.
+ */
+static BOOL __flowthings_io_producer_push(flowthings_io_producer *p, char *json, void *object)
+{
+	unsigned long pos = __atomic_load_n(&p->enqueue_pos, __ATOMIC_RELAXED), seq;
+	__flowthings_io_producer_slot *slot;
+	long diff;
+
+	for (;;) {
+
+		slot = &p->slots[pos & p->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (long)seq - (long)pos;
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&p->enqueue_pos, &pos, pos + 1, TRUE,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (diff < 0) {
+			return FALSE;
+		}
+		else {
+			pos = __atomic_load_n(&p->enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->json = json;
+	slot->object = object;
+	__atomic_store_n(&slot->queued_ns, __flowthings_io_producer_now(), __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return TRUE;
+}
+
+/*
+ * NAME: __flowthings_io_producer_pop
+ *
+ * Takes the oldest drop off the queue.  Returns FALSE if the queue is empty.
+ */
+static BOOL __flowthings_io_producer_pop(flowthings_io_producer *p, char **json, void **object)
+{
+	unsigned long pos = __atomic_load_n(&p->dequeue_pos, __ATOMIC_RELAXED), seq;
+	__flowthings_io_producer_slot *slot;
+	long diff;
+
+	for (;;) {
+
+		slot = &p->slots[pos & p->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (long)seq - (long)(pos + 1);
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&p->dequeue_pos, &pos, pos + 1, TRUE,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (diff < 0) {
+			return FALSE;
+		}
+		else {
+			pos = __atomic_load_n(&p->dequeue_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	*json = slot->json;
+	*object = slot->object;
+	__atomic_store_n(&slot->seq, pos + p->mask + 1, __ATOMIC_RELEASE);
+
+	return TRUE;
+}
+
+/*
+ * NAME: __flowthings_io_producer_oldest
+ *
+ * Returns when the oldest drop on the queue was queued, or 0 if there isn't one ready.
+ */
+static unsigned long long __flowthings_io_producer_oldest(flowthings_io_producer *p)
+{
+	unsigned long pos = __atomic_load_n(&p->dequeue_pos, __ATOMIC_ACQUIRE);
+	__flowthings_io_producer_slot *slot = &p->slots[pos & p->mask];
+
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+		return 0;
+
+	return __atomic_load_n(&slot->queued_ns, __ATOMIC_RELAXED);
+}
+
+/*
+ * NAME: __flowthings_io_producer_notify
+ *
+ * Wakes blocked senders and flushes, if there are any.
+ */
+static void __flowthings_io_producer_notify(flowthings_io_producer *p)
+{
+	if (__atomic_load_n(&p->waiters, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&p->lock);
+		pthread_cond_broadcast(&p->progress);
+		pthread_mutex_unlock(&p->lock);
+	}
+}
+
+/*
+ * NAME: __flowthings_io_producer_wake
+ *
+ * Wakes the background thread.
+ */
+static void __flowthings_io_producer_wake(flowthings_io_producer *p)
+{
+	pthread_mutex_lock(&p->lock);
+	pthread_cond_signal(&p->wake);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * NAME: __flowthings_io_producer_wait
+ *
+ * Sleeps on cond for up to timeout_ns, or until it's signalled.  Must be called with the lock held.
+ */
+static void __flowthings_io_producer_wait(flowthings_io_producer *p, pthread_cond_t *cond,
+		unsigned long long timeout_ns)
+{
+	unsigned long long until = __flowthings_io_producer_now() + timeout_ns;
+	struct timespec ts;
+
+	ts.tv_sec = until / 1000000000ULL;
+	ts.tv_nsec = until % 1000000000ULL;
+
+	pthread_cond_timedwait(cond, &p->lock, &ts);
+}
+
+/*
+ * NAME: __flowthings_io_producer_send_batch
+ *
+ * Takes up to a batch of drops off the queue, creates them and calls their delivery callbacks.
+ */
+static void __flowthings_io_producer_send_batch(flowthings_io_producer *p)
+{
+	int count = 0, i;
+
+	/* record where this batch may start before taking anything, for flowthings_io_producer_flush */
+	__atomic_store_n(&p->sending_from, __atomic_load_n(&p->dequeue_pos, __ATOMIC_SEQ_CST),
+			__ATOMIC_SEQ_CST);
+
+	while (count < p->config.batch_size
+			&& __flowthings_io_producer_pop(p, &p->batch_json[count], &p->batch_objects[count]))
+		count++;
+
+	if (count > 0) {
+
+		__flowthings_io_service_create_encoded(FLOWTHINGS_IO_SERVICE_TYPE_DROP, p->flow_id,
+				p->api, NULL, p->batch_json, count, p->batch_codes);
+
+		for (i = 0; i < count; i++) {
+			if (p->config.delivery)
+				p->config.delivery(p->batch_objects[i], p->batch_codes[i], p->config.user_data);
+			free(p->batch_json[i]);
+		}
+	}
+
+	__atomic_store_n(&p->sending_from, ULONG_MAX, __ATOMIC_SEQ_CST);
+	__flowthings_io_producer_notify(p);
+}
+
+/*
+ * NAME: __flowthings_io_producer_main
+ *
+ * The background thread.  Sends a batch whenever one is full, the oldest drop has lingered long
+ * enough, or a flush or cleanup asks for it; otherwise sleeps.
+ */
+static void *__flowthings_io_producer_main(void *arg)
+{
+	flowthings_io_producer *p = (flowthings_io_producer *)arg;
+	unsigned long long linger_ns = (unsigned long long)p->config.linger_ms * 1000000ULL;
+	unsigned long long oldest, now;
+	unsigned long enqueued, dequeued;
+	BOOL closing;
+
+	for (;;) {
+
+		enqueued = __atomic_load_n(&p->enqueue_pos, __ATOMIC_SEQ_CST);
+		dequeued = __atomic_load_n(&p->dequeue_pos, __ATOMIC_SEQ_CST);
+		closing = __atomic_load_n(&p->closing, __ATOMIC_SEQ_CST);
+		oldest = __flowthings_io_producer_oldest(p);
+		now = __flowthings_io_producer_now();
+
+		if (enqueued == dequeued && closing)
+			break;
+
+		if (enqueued - dequeued >= (unsigned long)p->config.batch_size
+				|| (enqueued != dequeued && (closing || oldest == 0 || now >= oldest + linger_ns
+				|| __atomic_load_n(&p->flush_to, __ATOMIC_SEQ_CST) > dequeued))) {
+			__flowthings_io_producer_send_batch(p);
+			continue;
+		}
+
+		/* sleep until the oldest drop has lingered long enough, or a sender wakes us; senders check
+		 * sleeping after queueing, so check the queue again after setting it */
+		pthread_mutex_lock(&p->lock);
+
+		__atomic_store_n(&p->sleeping, enqueued == dequeued ?
+				FLOWTHINGS_IO_PRODUCER_IDLE : FLOWTHINGS_IO_PRODUCER_LINGERING, __ATOMIC_SEQ_CST);
+
+		if (__atomic_load_n(&p->enqueue_pos, __ATOMIC_SEQ_CST) == enqueued
+				&& !__atomic_load_n(&p->closing, __ATOMIC_SEQ_CST)
+				&& __atomic_load_n(&p->flush_to, __ATOMIC_SEQ_CST) <= dequeued)
+			__flowthings_io_producer_wait(p, &p->wake,
+					enqueued == dequeued ? 1000000000ULL : oldest + linger_ns - now);
+
+		__atomic_store_n(&p->sleeping, FLOWTHINGS_IO_PRODUCER_AWAKE, __ATOMIC_SEQ_CST);
+
+		pthread_mutex_unlock(&p->lock);
+	}
+
+	return NULL;
+}
+
+
+/***********************************************************************
+ * The producer functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_producer_init
+ *
+ * Creates a producer and starts its background thread.
+ *
+ * PARAMS:
+ * api - the API object
+ * flow_id - the ID of the flow to create drops in
+ * encoder - the drop encoder
+ * config - the configuration, or NULL for the defaults
+ */
+flowthings_io_producer *flowthings_io_producer_init(flowthings_io_api *api, const char *flow_id,
+		flowthings_io_cb_encode_object encoder, flowthings_io_producer_config *config)
+{
+	flowthings_io_producer *p;
+	pthread_condattr_t attr;
+	unsigned long capacity = 1, i;
+
+	if (!api || !flow_id || !encoder) FAIL;
+
+	p = malloc(sizeof(flowthings_io_producer));
+	if (!p) FAIL;
+
+	memset(p, 0, sizeof(flowthings_io_producer));
+
+	p->api = api;
+	flowthings_io_strcat(p->flow_id, flow_id, FLOWTHINGS_IO_ID_LEN);
+	p->encoder = encoder;
+
+	if (config)
+		p->config = *config;
+	if (p->config.capacity <= 0)
+		p->config.capacity = FLOWTHINGS_IO_PRODUCER_CAPACITY;
+	if (p->config.batch_size <= 0)
+		p->config.batch_size = FLOWTHINGS_IO_PRODUCER_BATCH_SIZE;
+	if (p->config.linger_ms <= 0)
+		p->config.linger_ms = FLOWTHINGS_IO_PRODUCER_LINGER_MS;
+
+	while (capacity < (unsigned long)p->config.capacity)
+		capacity <<= 1;
+
+	/* a batch has to fit in the queue, or a full queue would wait to linger */
+	if ((unsigned long)p->config.batch_size > capacity)
+		p->config.batch_size = capacity;
+
+	p->slots = malloc(sizeof(__flowthings_io_producer_slot) * capacity);
+	p->batch_json = malloc(sizeof(char *) * p->config.batch_size);
+	p->batch_objects = malloc(sizeof(void *) * p->config.batch_size);
+	p->batch_codes = malloc(sizeof(flowthings_io_result_code) * p->config.batch_size);
+
+	if (!p->slots || !p->batch_json || !p->batch_objects || !p->batch_codes) FAIL;
+
+	p->mask = capacity - 1;
+	for (i = 0; i < capacity; i++)
+		p->slots[i].seq = i;
+
+	p->sending_from = ULONG_MAX;
+
+	/* the timed waits use the monotonic clock, so they don't jump with the time of day */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->wake, &attr);
+	pthread_cond_init(&p->progress, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if (pthread_create(&p->thread, NULL, __flowthings_io_producer_main, p)) FAIL;
+
+	return p;
+}
+
+/*
+ * NAME: flowthings_io_producer_send
+ *
+ * Encodes a drop and queues it to be created.
+ *
+ * PARAMS:
+ * producer - the producer
+ * object - the drop to encode
+ */
+flowthings_io_result_code flowthings_io_producer_send(flowthings_io_producer *producer,
+		void *object)
+{
+	flowthings_io_producer *p = producer;
+	char *json, *old_json;
+	void *old_object;
+	unsigned long depth;
+	int sleeping;
+	cJSON *in_root;
+
+	if (!p || __atomic_load_n(&p->closing, __ATOMIC_SEQ_CST))
+		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+
+	in_root = cJSON_CreateObject();
+	json = p->encoder(object, in_root) ? flowthings_io_json_print(in_root) : NULL;
+	cJSON_Delete(in_root);
+
+	if (!json)
+		return FLOWTHINGS_IO_ERROR_COULDNT_ENCODE;
+
+	while (!__flowthings_io_producer_push(p, json, object)) {
+
+		switch (p->config.overflow) {
+
+		case FLOWTHINGS_IO_PRODUCER_DROP_NEWEST:
+			free(json);
+			return FLOWTHINGS_IO_ERROR_QUEUE_FULL;
+
+		case FLOWTHINGS_IO_PRODUCER_DROP_OLDEST:
+			__atomic_add_fetch(&p->evicting, 1, __ATOMIC_SEQ_CST);
+			if (__flowthings_io_producer_pop(p, &old_json, &old_object)) {
+				if (p->config.delivery)
+					p->config.delivery(old_object, FLOWTHINGS_IO_ERROR_QUEUE_FULL, p->config.user_data);
+				free(old_json);
+			}
+			__atomic_sub_fetch(&p->evicting, 1, __ATOMIC_SEQ_CST);
+			__flowthings_io_producer_notify(p);
+			break;
+
+		default:
+			/* the background thread notifies after every batch; the timeout covers a batch that
+			 * finished between the push and the wait */
+			pthread_mutex_lock(&p->lock);
+			__atomic_add_fetch(&p->waiters, 1, __ATOMIC_SEQ_CST);
+			pthread_cond_signal(&p->wake);
+			if (!__atomic_load_n(&p->closing, __ATOMIC_SEQ_CST))
+				__flowthings_io_producer_wait(p, &p->progress, 10000000ULL);
+			__atomic_sub_fetch(&p->waiters, 1, __ATOMIC_SEQ_CST);
+			pthread_mutex_unlock(&p->lock);
+			break;
+		}
+
+		if (__atomic_load_n(&p->closing, __ATOMIC_SEQ_CST)) {
+			free(json);
+			return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+		}
+	}
+
+	/* wake the background thread if it's idle, or lingering and a batch is now full */
+	sleeping = __atomic_load_n(&p->sleeping, __ATOMIC_SEQ_CST);
+
+	if (sleeping != FLOWTHINGS_IO_PRODUCER_AWAKE) {
+		depth = __atomic_load_n(&p->enqueue_pos, __ATOMIC_RELAXED)
+				- __atomic_load_n(&p->dequeue_pos, __ATOMIC_RELAXED);
+		if (sleeping == FLOWTHINGS_IO_PRODUCER_IDLE || depth >= (unsigned long)p->config.batch_size)
+			__flowthings_io_producer_wake(p);
+	}
+
+	return FLOWTHINGS_IO_OK;
+}
+
+/*
+ * NAME: flowthings_io_producer_flush
+ *
+ * Sends every drop queued before this call and waits for their delivery callbacks.
+ *
+ * PARAMS:
+ * producer - the producer
+ */
+void flowthings_io_producer_flush(flowthings_io_producer *producer)
+{
+	flowthings_io_producer *p = producer;
+	unsigned long target, flush_to;
+
+	if (!p) return;
+
+	target = __atomic_load_n(&p->enqueue_pos, __ATOMIC_SEQ_CST);
+
+	flush_to = __atomic_load_n(&p->flush_to, __ATOMIC_SEQ_CST);
+	while (flush_to < target && !__atomic_compare_exchange_n(&p->flush_to, &flush_to, target,
+			FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+		;
+
+	__flowthings_io_producer_wake(p);
+
+	/* everything before target has been taken off the queue, and isn't still being sent or
+	 * delivered; dequeue_pos must be read first, see __flowthings_io_producer_send_batch */
+	pthread_mutex_lock(&p->lock);
+	__atomic_add_fetch(&p->waiters, 1, __ATOMIC_SEQ_CST);
+
+	while (__atomic_load_n(&p->dequeue_pos, __ATOMIC_SEQ_CST) < target
+			|| __atomic_load_n(&p->sending_from, __ATOMIC_SEQ_CST) < target
+			|| __atomic_load_n(&p->evicting, __ATOMIC_SEQ_CST) > 0)
+		__flowthings_io_producer_wait(p, &p->progress, 10000000ULL);
+
+	__atomic_sub_fetch(&p->waiters, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * NAME: flowthings_io_producer_cleanup
+ *
+ * Sends every queued drop, stops the background thread and frees the producer.
+ *
+ * PARAMS:
+ * producer - the producer
+ */
+void flowthings_io_producer_cleanup(flowthings_io_producer *producer)
+{
+	flowthings_io_producer *p = producer;
+
+	if (!p) return;
+
+	__atomic_store_n(&p->closing, TRUE, __ATOMIC_SEQ_CST);
+	__flowthings_io_producer_wake(p);
+	pthread_join(p->thread, NULL);
+
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->wake);
+	pthread_cond_destroy(&p->progress);
+
+	free(p->slots);
+	free(p->batch_json);
+	free(p->batch_objects);
+	free(p->batch_codes);
+	free(p);
+}
+
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,160 @@
+/*
+ * flowthings_io_producer.h
+ *
+ * A write-behind drop producer.  Drops are encoded on the calling thread and put on a bounded
+ * queue, and a background thread sends them to the platform in batches, so sending a drop doesn't
+ * wait for the network.
+ */
+
+#ifndef FLOWTHINGS_IO_PRODUCER_H_
+#define FLOWTHINGS_IO_PRODUCER_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io.h"
+#include "flowthings_io_api.h"
+#include "flowthings_io_services.h"
+
+
+/***********************************************************************
+ * The producer configuration
+ ***********************************************************************/
+
+/* the defaults for a flowthings_io_producer_config field left at 0 */
+#define FLOWTHINGS_IO_PRODUCER_CAPACITY 1024
+#define FLOWTHINGS_IO_PRODUCER_BATCH_SIZE 100
+#define FLOWTHINGS_IO_PRODUCER_LINGER_MS 100
+
+/*
+ * NAME: flowthings_io_producer_overflow
+ *
+ * What flowthings_io_producer_send does when the queue is full:
+ *
+ * FLOWTHINGS_IO_PRODUCER_BLOCK - waits for room
+ * FLOWTHINGS_IO_PRODUCER_DROP_OLDEST - takes the oldest drop off the queue to make room; its
+ *     delivery callback is called with FLOWTHINGS_IO_ERROR_QUEUE_FULL
+ * FLOWTHINGS_IO_PRODUCER_DROP_NEWEST - doesn't queue the new drop, and returns
+ *     FLOWTHINGS_IO_ERROR_QUEUE_FULL
+ */
+typedef enum flowthings_io_producer_overflow {
+	FLOWTHINGS_IO_PRODUCER_BLOCK,
+	FLOWTHINGS_IO_PRODUCER_DROP_OLDEST,
+	FLOWTHINGS_IO_PRODUCER_DROP_NEWEST
+} flowthings_io_producer_overflow;
+
+/*
+ * NAME: flowthings_io_producer_cb_delivery
+ *
+ * Called once for every drop that was queued, with its final result.  It's called from the
+ * producer's background thread, or for drops pushed out of a full queue, from the thread that
+ * pushed them out.  It must not call flowthings_io_producer_flush or
+ * flowthings_io_producer_cleanup.
+ *
+ * object - the pointer passed to flowthings_io_producer_send; the producer never reads it after
+ *     encoding, so it doesn't have to stay valid
+ * code - FLOWTHINGS_IO_OK if the drop was created, or else the error
+ * user_data - the pointer from the configuration
+ */
+typedef void (*flowthings_io_producer_cb_delivery)(void *object, flowthings_io_result_code code,
+		void *user_data);
+
+/*
+ * NAME: flowthings_io_producer_config
+ *
+ * The configuration passed to flowthings_io_producer_init.  Fields left at 0 get the defaults
+ * above.
+ *
+ * capacity - the most drops the queue holds; rounded up to a power of 2
+ * batch_size - a batch is sent as soon as this many drops are waiting
+ * linger_ms - or as soon as the oldest waiting drop has waited this long
+ * overflow - what to do when the queue is full
+ * delivery - called with each drop's result, or NULL
+ * user_data - passed to delivery
+ */
+typedef struct flowthings_io_producer_config {
+	int capacity;
+	int batch_size;
+	int linger_ms;
+	flowthings_io_producer_overflow overflow;
+
+	flowthings_io_producer_cb_delivery delivery;
+	void *user_data;
+} flowthings_io_producer_config;
+
+typedef struct flowthings_io_producer flowthings_io_producer;
+
+
+/***********************************************************************
+ * The producer functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_producer_init
+ *
+ * Creates a producer that creates drops in a flow, and starts its background thread.  The caller
+ * is responsible for calling flowthings_io_producer_cleanup when done.
+ *
+ * PARAMS:
+ * api - the API object, which must stay valid until the producer is cleaned up
+ * flow_id - the ID of the flow to create drops in
+ * encoder - the drop encoder (see flowthings_io_cb_encode_object)
+ * config - the configuration, or NULL for the defaults
+ */
+flowthings_io_producer *flowthings_io_producer_init(flowthings_io_api *api, const char *flow_id,
+		flowthings_io_cb_encode_object encoder, flowthings_io_producer_config *config);
+
+/*
+ * NAME: flowthings_io_producer_send
+ *
+ * Encodes a drop and queues it to be created.  May be called from any number of threads at once.
+ *
+ * PARAMS:
+ * producer - the producer
+ * object - the drop to encode; it can be reused as soon as this function returns
+ *
+ * RETURN:
+ * Returns FLOWTHINGS_IO_OK if the drop was queued, in which case its delivery callback will be
+ * called later.  Otherwise returns FLOWTHINGS_IO_ERROR_COULDNT_ENCODE,
+ * FLOWTHINGS_IO_ERROR_QUEUE_FULL, or FLOWTHINGS_IO_ERROR_NOT_INITIALIZED if the producer is being
+ * cleaned up, and the callback isn't called.
+ */
+flowthings_io_result_code flowthings_io_producer_send(flowthings_io_producer *producer,
+		void *object);
+
+/*
+ * NAME: flowthings_io_producer_flush
+ *
+ * Sends every drop queued before this call without waiting for the batch to fill, and waits until
+ * each one's delivery callback has been called.
+ *
+ * PARAMS:
+ * producer - the producer
+ */
+void flowthings_io_producer_flush(flowthings_io_producer *producer);
+
+/*
+ * NAME: flowthings_io_producer_cleanup
+ *
+ * Sends every queued drop, stops the background thread and frees the producer.  No other thread
+ * may be using the producer when this is called.
+ *
+ * PARAMS:
+ * producer - the producer
+ */
+void flowthings_io_producer_cleanup(flowthings_io_producer *producer);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* FLOWTHINGS_IO_PRODUCER_H_ */
@@ -0,0 +1,474 @@
+/*
+ * flowthings_io_resolver.c
+ *
+ * A map from flow paths to flow IDs.  The map is split into shards by a hash of the path, and
+ * each shard has its own lock, hash table and list ordered by use for eviction, so threads looking
+ * up different paths rarely wait for each other.
+ */
+
+/* CLOCK_MONOTONIC is POSIX */
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* the version that tells a lookup whether a store is stale is kept with the GCC __atomic builtins */
+#if !defined(__GNUC__)
+#error "the resolver needs the __atomic builtins of GCC or Clang"
+#endif
+
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io_resolver.h"
+
+
+/***********************************************************************
+ * The resolver object
+ ***********************************************************************/
+
+typedef struct __flowthings_io_resolver_entry {
+
+	char *path;
+	size_t path_len;
+	unsigned int hash;
+
+	/* "" for a path with no flow */
+	char flow_id[FLOWTHINGS_IO_ID_LEN];
+	unsigned long long expires_ms;
+
+	struct __flowthings_io_resolver_entry *hash_next;
+
+	/* the use list, most recently used first */
+	struct __flowthings_io_resolver_entry *prev;
+	struct __flowthings_io_resolver_entry *next;
+
+} __flowthings_io_resolver_entry;
+
+typedef struct __flowthings_io_resolver_shard {
+
+	pthread_mutex_t lock;
+
+	int max_entries;
+
+	__flowthings_io_resolver_entry **buckets;
+	unsigned int bucket_mask;
+
+	__flowthings_io_resolver_entry *first;
+	__flowthings_io_resolver_entry *last;
+
+	flowthings_io_resolver_stats stats;
+
+} __flowthings_io_resolver_shard;
+
+struct flowthings_io_resolver {
+
+	__flowthings_io_resolver_shard shards[FLOWTHINGS_IO_RESOLVER_SHARDS];
+
+	unsigned long long ttl_ms;
+	unsigned long long missing_ttl_ms;
+
+	/* counts invalidations, see flowthings_io_resolver_store */
+	unsigned long version;
+};
+
+
+/***********************************************************************
+ * Helper functions
+ ***********************************************************************/
+
+static unsigned long long __flowthings_io_resolver_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static unsigned int __flowthings_io_resolver_hash(const char *path, size_t path_len)
+{
+	unsigned int hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < path_len; i++)
+		hash = (hash ^ (unsigned char)path[i]) * 16777619u;
+
+	return hash;
+}
+
+/* the low bits pick the bucket, so the shard comes from the high ones */
+static __flowthings_io_resolver_shard *__flowthings_io_resolver_shard_of(
+		flowthings_io_resolver *resolver, unsigned int hash)
+{
+	return &resolver->shards[(hash >> 24) % FLOWTHINGS_IO_RESOLVER_SHARDS];
+}
+
+/*
+ * NAME: __flowthings_io_resolver_find
+ *
+ * Returns the entry for a path, or NULL.  Called with the shard's lock held.
+ */
+static __flowthings_io_resolver_entry *__flowthings_io_resolver_find(
+		__flowthings_io_resolver_shard *shard, const char *path, size_t path_len,
+		unsigned int hash)
+{
+	__flowthings_io_resolver_entry *e;
+
+	for (e = shard->buckets[hash & shard->bucket_mask]; e; e = e->hash_next) {
+		if (e->hash == hash && e->path_len == path_len && !memcmp(e->path, path, path_len))
+			return e;
+	}
+
+	return NULL;
+}
+
+static void __flowthings_io_resolver_unlink(__flowthings_io_resolver_shard *shard,
+		__flowthings_io_resolver_entry *e)
+{
+	if (e->prev) e->prev->next = e->next; else shard->first = e->next;
+	if (e->next) e->next->prev = e->prev; else shard->last = e->prev;
+	e->prev = e->next = NULL;
+}
+
+static void __flowthings_io_resolver_push(__flowthings_io_resolver_shard *shard,
+		__flowthings_io_resolver_entry *e)
+{
+	e->prev = NULL;
+	e->next = shard->first;
+	if (shard->first) shard->first->prev = e; else shard->last = e;
+	shard->first = e;
+}
+
+/*
+ * NAME: __flowthings_io_resolver_remove
+ *
+ * Takes an entry out of its shard and frees it.  Called with the shard's lock held.
+ */
+static void __flowthings_io_resolver_remove(__flowthings_io_resolver_shard *shard,
+		__flowthings_io_resolver_entry *e)
+{
+	__flowthings_io_resolver_entry **p;
+
+	for (p = &shard->buckets[e->hash & shard->bucket_mask]; *p != e; p = &(*p)->hash_next)
+		;
+	*p = e->hash_next;
+
+	__flowthings_io_resolver_unlink(shard, e);
+	shard->stats.entries--;
+
+	free(e->path);
+	free(e);
+}
+
+/*
+ * NAME: __flowthings_io_resolver_forget
+ *
+ * Drops the entries for a flow ID, or for paths with no flow if flow_id is NULL.
+ */
+static void __flowthings_io_resolver_forget(flowthings_io_resolver *resolver,
+		const char *flow_id, size_t flow_id_len)
+{
+	__flowthings_io_resolver_shard *shard;
+	__flowthings_io_resolver_entry *e, *next;
+	int i;
+
+	/* before the entries go, so that a lookup already in flight doesn't store them again */
+	__atomic_add_fetch(&resolver->version, 1, __ATOMIC_ACQ_REL);
+
+	for (i = 0; i < FLOWTHINGS_IO_RESOLVER_SHARDS; i++) {
+
+		shard = &resolver->shards[i];
+		pthread_mutex_lock(&shard->lock);
+
+		for (e = shard->first; e; e = next) {
+			next = e->next;
+
+			if (flow_id ? strlen(e->flow_id) == flow_id_len && !memcmp(e->flow_id, flow_id, flow_id_len)
+					: e->flow_id[0] == '\0') {
+				__flowthings_io_resolver_remove(shard, e);
+				shard->stats.invalidations++;
+			}
+		}
+
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
+
+
+/***********************************************************************
+ * The resolver functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_resolver_init
+ *
+ * Creates a resolver.
+ *
+ * PARAMS:
+ * max_entries - the most paths to keep
+ * ttl_ms - how long a flow ID is kept, or 0 for as long as the flow isn't changed
+ * missing_ttl_ms - how long a path with no flow is remembered
+ */
+flowthings_io_resolver *flowthings_io_resolver_init(int max_entries, int ttl_ms, int missing_ttl_ms)
+{
+	flowthings_io_resolver *resolver = malloc(sizeof(flowthings_io_resolver));
+	__flowthings_io_resolver_shard *shard;
+	unsigned int buckets = 16;
+	int i;
+
+	if (!resolver || max_entries <= 0) FAIL;
+
+	memset(resolver, 0, sizeof(flowthings_io_resolver));
+
+	resolver->ttl_ms = ttl_ms > 0 ? ttl_ms : 0;
+	resolver->missing_ttl_ms = missing_ttl_ms > 0 ? missing_ttl_ms : 0;
+
+	/* keep the chains short */
+	while (buckets * FLOWTHINGS_IO_RESOLVER_SHARDS < (unsigned int)max_entries * 2)
+		buckets *= 2;
+
+	for (i = 0; i < FLOWTHINGS_IO_RESOLVER_SHARDS; i++) {
+
+		shard = &resolver->shards[i];
+
+		shard->buckets = calloc(buckets, sizeof(__flowthings_io_resolver_entry *));
+		if (!shard->buckets) FAIL;
+
+		shard->bucket_mask = buckets - 1;
+		shard->max_entries = max_entries > FLOWTHINGS_IO_RESOLVER_SHARDS ?
+				max_entries / FLOWTHINGS_IO_RESOLVER_SHARDS : 1;
+
+		pthread_mutex_init(&shard->lock, NULL);
+	}
+
+	return resolver;
+}
+
+/*
+ * NAME: flowthings_io_resolver_lookup
+ *
+ * Looks up a flow path.
+ */
+int flowthings_io_resolver_lookup(flowthings_io_resolver *resolver, const char *path,
+		char *flow_id, unsigned long *version)
+{
+	size_t path_len = strlen(path);
+	unsigned int hash = __flowthings_io_resolver_hash(path, path_len);
+	__flowthings_io_resolver_shard *shard = __flowthings_io_resolver_shard_of(resolver, hash);
+	__flowthings_io_resolver_entry *e;
+	int found = FLOWTHINGS_IO_RESOLVER_MISS;
+
+	*version = __atomic_load_n(&resolver->version, __ATOMIC_ACQUIRE);
+
+	pthread_mutex_lock(&shard->lock);
+
+	e = __flowthings_io_resolver_find(shard, path, path_len, hash);
+
+	if (e && e->expires_ms && __flowthings_io_resolver_now_ms() >= e->expires_ms) {
+		__flowthings_io_resolver_remove(shard, e);
+		e = NULL;
+	}
+
+	if (e) {
+		if (e->flow_id[0]) {
+			found = FLOWTHINGS_IO_RESOLVER_FOUND;
+			strcpy(flow_id, e->flow_id);
+		}
+		else {
+			found = FLOWTHINGS_IO_RESOLVER_MISSING;
+		}
+
+		__flowthings_io_resolver_unlink(shard, e);
+		__flowthings_io_resolver_push(shard, e);
+	}
+
+	if (found == FLOWTHINGS_IO_RESOLVER_FOUND)
+		shard->stats.hits++;
+	else if (found == FLOWTHINGS_IO_RESOLVER_MISSING)
+		shard->stats.missing++;
+	else
+		shard->stats.misses++;
+
+	pthread_mutex_unlock(&shard->lock);
+
+	return found;
+}
+
+/*
+ * NAME: flowthings_io_resolver_version
+ *
+ * Returns the value to pass to flowthings_io_resolver_store for flows listed from now on.
+ */
+unsigned long flowthings_io_resolver_version(flowthings_io_resolver *resolver)
+{
+	return __atomic_load_n(&resolver->version, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * NAME: flowthings_io_resolver_store
+ *
+ * Adds or replaces a path's entry, unless a flow was changed since version was returned.
+ */
+void flowthings_io_resolver_store(flowthings_io_resolver *resolver, const char *path,
+		const char *flow_id, unsigned long version)
+{
+	size_t path_len = strlen(path);
+	unsigned int hash = __flowthings_io_resolver_hash(path, path_len);
+	__flowthings_io_resolver_shard *shard = __flowthings_io_resolver_shard_of(resolver, hash);
+	__flowthings_io_resolver_entry *e;
+	unsigned long long ttl_ms = flow_id ? resolver->ttl_ms : resolver->missing_ttl_ms;
+
+	if (!flow_id && !ttl_ms)
+		return;
+
+	if (flow_id && strlen(flow_id) >= FLOWTHINGS_IO_ID_LEN)
+		return;
+
+	pthread_mutex_lock(&shard->lock);
+
+	if (version != __atomic_load_n(&resolver->version, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_unlock(&shard->lock);
+		return;
+	}
+
+	e = __flowthings_io_resolver_find(shard, path, path_len, hash);
+
+	if (e) {
+		__flowthings_io_resolver_unlink(shard, e);
+	}
+	else {
+		e = malloc(sizeof(__flowthings_io_resolver_entry));
+		if (!e) FAIL;
+		memset(e, 0, sizeof(__flowthings_io_resolver_entry));
+
+		e->path = malloc(path_len + 1);
+		if (!e->path) FAIL;
+		memcpy(e->path, path, path_len + 1);
+
+		e->path_len = path_len;
+		e->hash = hash;
+		e->hash_next = shard->buckets[hash & shard->bucket_mask];
+		shard->buckets[hash & shard->bucket_mask] = e;
+		shard->stats.entries++;
+	}
+
+	strcpy(e->flow_id, flow_id ? flow_id : "");
+	e->expires_ms = ttl_ms ? __flowthings_io_resolver_now_ms() + ttl_ms : 0;
+
+	__flowthings_io_resolver_push(shard, e);
+
+	while (shard->stats.entries > shard->max_entries) {
+		__flowthings_io_resolver_remove(shard, shard->last);
+		shard->stats.evictions++;
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+}
+
+/*
+ * NAME: flowthings_io_resolver_forget_id
+ *
+ * Drops the entries for a flow.
+ */
+void flowthings_io_resolver_forget_id(flowthings_io_resolver *resolver, const char *flow_id,
+		size_t flow_id_len)
+{
+	__flowthings_io_resolver_forget(resolver, flow_id, flow_id_len);
+}
+
+/*
+ * NAME: flowthings_io_resolver_forget_missing
+ *
+ * Drops the entries for paths with no flow.
+ */
+void flowthings_io_resolver_forget_missing(flowthings_io_resolver *resolver)
+{
+	__flowthings_io_resolver_forget(resolver, NULL, 0);
+}
+
+/*
+ * NAME: flowthings_io_resolver_clear
+ *
+ * Drops every entry.
+ */
+void flowthings_io_resolver_clear(flowthings_io_resolver *resolver)
+{
+	__flowthings_io_resolver_shard *shard;
+	int i;
+
+	__atomic_add_fetch(&resolver->version, 1, __ATOMIC_ACQ_REL);
+
+	for (i = 0; i < FLOWTHINGS_IO_RESOLVER_SHARDS; i++) {
+
+		shard = &resolver->shards[i];
+		pthread_mutex_lock(&shard->lock);
+
+		while (shard->first)
+			__flowthings_io_resolver_remove(shard, shard->first);
+
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
+
+/*
+ * NAME: flowthings_io_resolver_get_stats
+ *
+ * Fills in the resolver's counters, added up over its shards.
+ */
+void flowthings_io_resolver_get_stats(flowthings_io_resolver *resolver,
+		flowthings_io_resolver_stats *stats)
+{
+	__flowthings_io_resolver_shard *shard;
+	int i;
+
+	memset(stats, 0, sizeof(flowthings_io_resolver_stats));
+
+	for (i = 0; i < FLOWTHINGS_IO_RESOLVER_SHARDS; i++) {
+
+		shard = &resolver->shards[i];
+		pthread_mutex_lock(&shard->lock);
+
+		stats->hits += shard->stats.hits;
+		stats->misses += shard->stats.misses;
+		stats->missing += shard->stats.missing;
+		stats->evictions += shard->stats.evictions;
+		stats->invalidations += shard->stats.invalidations;
+		stats->entries += shard->stats.entries;
+
+		pthread_mutex_unlock(&shard->lock);
+	}
+}
+
+/*
+ * NAME: flowthings_io_resolver_cleanup
+ *
+ * Frees a resolver and its entries.
+ */
+void flowthings_io_resolver_cleanup(flowthings_io_resolver *resolver)
+{
+	int i;
+
+	if (!resolver) return;
+
+	flowthings_io_resolver_clear(resolver);
+
+	for (i = 0; i < FLOWTHINGS_IO_RESOLVER_SHARDS; i++) {
+		pthread_mutex_destroy(&resolver->shards[i].lock);
+		free(resolver->shards[i].buckets);
+	}
+
+	free(resolver);
+}
+
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,166 @@
+/*
+ * flowthings_io_resolver.h
+ *
+ * A map from flow paths (e.g. /myaccountname/sensors/kitchen) to flow IDs, so that the drop
+ * service functions, which need the flow ID, can be called with a path without asking the
+ * platform each time.  Paths that have no flow are remembered too, for a shorter time.
+ */
+
+#ifndef FLOWTHINGS_IO_RESOLVER_H_
+#define FLOWTHINGS_IO_RESOLVER_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io.h"
+
+
+/***********************************************************************
+ * The resolver object
+ ***********************************************************************/
+
+/* the map is split into this many independently locked parts */
+#define FLOWTHINGS_IO_RESOLVER_SHARDS 16
+
+/* what flowthings_io_resolver_lookup found */
+#define FLOWTHINGS_IO_RESOLVER_MISS 0
+#define FLOWTHINGS_IO_RESOLVER_FOUND 1
+#define FLOWTHINGS_IO_RESOLVER_MISSING 2
+
+/*
+ * NAME: flowthings_io_resolver_stats
+ *
+ * hits - lookups that found the flow ID
+ * misses - lookups that found nothing, so the platform had to be asked
+ * missing - lookups that found the path was recently looked up and has no flow
+ * evictions - entries dropped to stay under the size limit
+ * invalidations - entries dropped because a flow was created, updated or deleted
+ * entries - the number of entries in the map, including paths with no flow
+ */
+typedef struct flowthings_io_resolver_stats {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long missing;
+	unsigned long evictions;
+	unsigned long invalidations;
+	int entries;
+} flowthings_io_resolver_stats;
+
+typedef struct flowthings_io_resolver flowthings_io_resolver;
+
+
+/***********************************************************************
+ * The resolver functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_resolver_init
+ *
+ * Creates a resolver.  Shouldn't be called directly from outside this library; see
+ * flowthings_io_api_set_resolver.
+ *
+ * PARAMS:
+ * max_entries - the most paths to keep; the least recently used are dropped first
+ * ttl_ms - how long a flow ID is kept, or 0 to keep it until the flow is changed through the API
+ * missing_ttl_ms - how long a path with no flow is remembered, or 0 not to remember them
+ */
+flowthings_io_resolver *flowthings_io_resolver_init(int max_entries, int ttl_ms, int missing_ttl_ms);
+
+/*
+ * NAME: flowthings_io_resolver_lookup
+ *
+ * Looks up a flow path.
+ *
+ * PARAMS:
+ * resolver - the resolver
+ * path - the flow path
+ * flow_id - a buffer of FLOWTHINGS_IO_ID_LEN, set to the flow ID if it's found
+ * version - set to a value to pass to flowthings_io_resolver_store, so that a flow looked up
+ *     while it was being changed isn't stored
+ *
+ * RETURN:
+ * Returns FLOWTHINGS_IO_RESOLVER_MISS, FLOWTHINGS_IO_RESOLVER_FOUND or
+ * FLOWTHINGS_IO_RESOLVER_MISSING.
+ */
+int flowthings_io_resolver_lookup(flowthings_io_resolver *resolver, const char *path,
+		char *flow_id, unsigned long *version);
+
+/*
+ * NAME: flowthings_io_resolver_version
+ *
+ * Returns the value to pass to flowthings_io_resolver_store for flows listed from now on.
+ */
+unsigned long flowthings_io_resolver_version(flowthings_io_resolver *resolver);
+
+/*
+ * NAME: flowthings_io_resolver_store
+ *
+ * Adds or replaces a path's entry.  Nothing is stored if a flow was changed since version was
+ * returned.
+ *
+ * PARAMS:
+ * resolver - the resolver
+ * path - the flow path
+ * flow_id - the flow ID, or NULL if the path has no flow
+ * version - from flowthings_io_resolver_lookup or flowthings_io_resolver_version
+ */
+void flowthings_io_resolver_store(flowthings_io_resolver *resolver, const char *path,
+		const char *flow_id, unsigned long version);
+
+/*
+ * NAME: flowthings_io_resolver_forget_id
+ *
+ * Drops the entries for a flow, after it was updated or deleted.  Flows are changed rarely, so
+ * this looks through the whole map.
+ *
+ * PARAMS:
+ * resolver - the resolver
+ * flow_id, flow_id_len - the flow ID
+ */
+void flowthings_io_resolver_forget_id(flowthings_io_resolver *resolver, const char *flow_id,
+		size_t flow_id_len);
+
+/*
+ * NAME: flowthings_io_resolver_forget_missing
+ *
+ * Drops the entries for paths with no flow, after a flow was created or moved.
+ */
+void flowthings_io_resolver_forget_missing(flowthings_io_resolver *resolver);
+
+/*
+ * NAME: flowthings_io_resolver_clear
+ *
+ * Drops every entry.
+ */
+void flowthings_io_resolver_clear(flowthings_io_resolver *resolver);
+
+/*
+ * NAME: flowthings_io_resolver_get_stats
+ *
+ * Fills in the resolver's counters.
+ */
+void flowthings_io_resolver_get_stats(flowthings_io_resolver *resolver,
+		flowthings_io_resolver_stats *stats);
+
+/*
+ * NAME: flowthings_io_resolver_cleanup
+ *
+ * Frees a resolver and its entries.
+ */
+void flowthings_io_resolver_cleanup(flowthings_io_resolver *resolver);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* FLOWTHINGS_IO_RESOLVER_H_ */
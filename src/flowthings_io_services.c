@@ -7,10 +7,12 @@
 #ifndef FLOWTHINGS_IO_SERVICES_C_
 #define FLOWTHINGS_IO_SERVICES_C_
 
+/* pooled operations are handed out under a POSIX mutex */
+#define _XOPEN_SOURCE 700
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <curl/curl.h>
 
 #ifdef  __cplusplus
 extern "C" {
@@ -25,6 +27,123 @@ extern "C" {
 #include "flowthings_io_http.h"
 #include "flowthings_io_api.h"
 #include "flowthings_io_services.h"
+#include "flowthings_io_stream.h"
+#include "flowthings_io_codec.h"
+#include "flowthings_io_json.h"
+
+
+/***********************************************************************
+ * Service type definitions
+ ***********************************************************************/
+
+/*
+ * NAME: __flowthings_io_service_info
+ *
+ * The service definitions, see flowthings_io_services.h
+ */
+struct __flowthings_io_service_info_item __flowthings_io_service_info[__FLOWTHINGS_IO_SERVICE_COUNT] = {
+	{ FLOWTHINGS_IO_SERVICE_TYPE_FLOW, "flow", "/flow", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_UPDATE | FLOWTHINGS_IO_ACTION_DELETE },
+	{ FLOWTHINGS_IO_SERVICE_TYPE_DROP, "drop", "/drop", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_UPDATE | FLOWTHINGS_IO_ACTION_DELETE },
+	{ FLOWTHINGS_IO_SERVICE_TYPE_IDENTITY, "identity", "/identity", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_UPDATE },
+	{ FLOWTHINGS_IO_SERVICE_TYPE_GROUP, "group", "/group", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_UPDATE | FLOWTHINGS_IO_ACTION_DELETE },
+	{ FLOWTHINGS_IO_SERVICE_TYPE_TRACK, "track", "/track", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_UPDATE | FLOWTHINGS_IO_ACTION_DELETE },
+	{ FLOWTHINGS_IO_SERVICE_TYPE_API_TASK, "api-task", "/api-task", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_UPDATE | FLOWTHINGS_IO_ACTION_DELETE },
+	{ FLOWTHINGS_IO_SERVICE_TYPE_MQTT_TASK, "mqtt", "/mqtt", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_UPDATE | FLOWTHINGS_IO_ACTION_DELETE },
+	{ FLOWTHINGS_IO_SERVICE_TYPE_TOKEN, "token", "/token", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_DELETE },
+	{ FLOWTHINGS_IO_SERVICE_TYPE_SHARE, "share", "/share", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_DELETE }
+};
+
+
+/***********************************************************************
+ * The asynchronous operation object
+ ***********************************************************************/
+
+#define FLOWTHINGS_IO_OP_DECODE_NONE 0
+#define FLOWTHINGS_IO_OP_DECODE_ONE 1
+#define FLOWTHINGS_IO_OP_DECODE_MANY 2
+#define FLOWTHINGS_IO_OP_DECODE_BATCH 3
+
+#define FLOWTHINGS_IO_OP_CACHE_NONE 0
+#define FLOWTHINGS_IO_OP_CACHE_READ 1
+#define FLOWTHINGS_IO_OP_CACHE_INVALIDATE 2
+
+struct flowthings_io_op {
+
+	flowthings_io_http_xfer xfer;
+	flowthings_io_api *api;
+	flowthings_io_service_type svc;
+
+	char path[FLOWTHINGS_IO_MAX_PATH_SIZE];
+	flowthings_io_string *response;
+
+	/* the request body, if it has one; kept with pooled operations like response */
+	flowthings_io_string *request;
+
+	/* for an MGET body written as it is sent (see flowthings_io_api_set_stream_upload): the flows
+	 * it starts with, to send it again, the flows not written yet, how much of request has been
+	 * sent, and the writer's state */
+	flowthings_io_idlistitem *send_first;
+	int send_first_count;
+	flowthings_io_idlistitem *send_item;
+	int send_count;
+	size_t send_offset;
+	flowthings_io_json_writer send_writer;
+
+	int decode_type;
+	flowthings_io_cb_decode_object decoder;
+
+	/* set instead of the decoder by the *_events functions */
+	flowthings_io_cb_decode_events events;
+
+	/* set instead of the decoder by the *_tape functions, which parse each object onto tape, or
+	 * the whole body when stream decoding is off; the tape is kept with pooled operations, as the
+	 * arena is */
+	flowthings_io_cb_decode_tape tape_decoder;
+	flowthings_io_tape *tape;
+
+	/* set by the *_projected functions; the decoder is then given trees of only what is on the
+	 * projection's paths */
+	const flowthings_io_json_projection *projection;
+
+	/* set instead of the encoder and decoder by the *_codec functions; find results are then an
+	 * array of structs of codec->size */
+	const flowthings_io_codec *codec;
+	void *result;
+	void **results;
+	int *result_count;
+
+	/* for batch calls, the objects in this request are results[batch_index[0..batch_count-1]], and
+	 * each one's code is written to batch_codes at the same index */
+	int *batch_index;
+	int batch_count;
+	flowthings_io_result_code *batch_codes;
+
+	/* for calls on one object when the API has a cache (see flowthings_io_api_set_cache): the
+	 * object's ID, which is in path, whether the call reads through the cache or changes the
+	 * object, and for reads, what the lookup found and the cached body */
+	const char *cache_id;
+	size_t cache_id_len;
+	int cache_use;
+	int cache_found;
+	unsigned long cache_version;
+	char cache_etag[FLOWTHINGS_IO_HTTP_MAX_ETAG_SIZE];
+	flowthings_io_string *cached;
+
+	/* set when the response is decoded as it arrives, see flowthings_io_api_set_stream_decode */
+	flowthings_io_stream *stream;
+	int decoded;
+	flowthings_io_result_code stream_code;
+
+	/* the arena the response and request trees are kept in, if they are kept in one (see
+	 * __flowthings_io_arena_for); kept with pooled operations */
+	cJSON_Arena *arena;
+
+	flowthings_io_result_code code;
+	BOOL done;
+
+	flowthings_io_cb_complete complete;
+	void *user_data;
+};
 
 
 /***********************************************************************
@@ -39,535 +158,2955 @@ void __flowthings_io_add_path_ext(char *path, const char *path_ext)
 	}
 }
 
-
-/***********************************************************************
- * The Service functions
- ***********************************************************************/
+/*
+ * NAME: __flowthings_io_add_id
+ *
+ * Adds /id to an operation's path, and remembers where the ID is for the cache.
+ */
+static void __flowthings_io_add_id(flowthings_io_op *op, const char *id)
+{
+	flowthings_io_strcat(op->path, "/", FLOWTHINGS_IO_MAX_PATH_SIZE);
+	op->cache_id = op->path + strlen(op->path);
+	flowthings_io_strcat(op->path, id, FLOWTHINGS_IO_MAX_PATH_SIZE);
+	op->cache_id_len = strlen(op->cache_id);
+}
 
 /*
- * NAME: flowthings_io_service_read
+ * NAME: __flowthings_io_cacheable
  *
- * Perform a create on valid objects from the platform.  This function should not be called directly --
- * one of the defines below should be called depending on the object type.  For example, to create a
- * drop, call flowthings_io_drop_create(...)
+ * Returns TRUE for the services whose objects are kept in the API's cache.  Drops change too often
+ * to be worth it.
+ */
+static BOOL __flowthings_io_cacheable(flowthings_io_api *api, flowthings_io_service_type svc)
+{
+	if (!api->cache)
+		return FALSE;
+
+	switch (svc) {
+	case FLOWTHINGS_IO_SERVICE_TYPE_FLOW:
+	case FLOWTHINGS_IO_SERVICE_TYPE_IDENTITY:
+	case FLOWTHINGS_IO_SERVICE_TYPE_GROUP:
+	case FLOWTHINGS_IO_SERVICE_TYPE_TRACK:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/*
+ * NAME: __flowthings_io_add_query
  *
- * PARAMS:
- * svc - the service type
- * path_ext - any path extension to add in creating the URL
- * api - the API object
- * id - the ID of the object to delete
- * params - any additional query string parameters to be passed to the platform
- * decoder - the object decoder (see flowthings_io_cb_decode_object)
- * result - must be preallocated; will be filled with the output of decode(return from platform)
+ * Adds a key=value pair to the query string of path, starting the query string if there isn't
+ * one yet.  The value is URL encoded.
  */
-flowthings_io_result_code flowthings_io_service_read(
-		flowthings_io_service_type svc, const char *path_ext,
-		flowthings_io_api *api, const char *id, flowthings_io_params *params,
-		flowthings_io_cb_decode_object decoder, void *result)
+static void __flowthings_io_add_query(flowthings_io_api *api, char *path, const char *key,
+		const char *value)
 {
-	if (!api || !api->fhttp)
-		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+	flowthings_io_string *encoded_value = flowthings_io_string_init();
+	flowthings_io_http_escape(api ? api->fhttp : NULL, value, encoded_value);
 
-	if (!decoder || !result)
-		return FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+	flowthings_io_strcat(path, strchr(path, '?') ? "&" : "?", FLOWTHINGS_IO_MAX_PATH_SIZE);
+	flowthings_io_strcat(path, key, FLOWTHINGS_IO_MAX_PATH_SIZE);
+	flowthings_io_strcat(path, "=", FLOWTHINGS_IO_MAX_PATH_SIZE);
+	flowthings_io_strcat(path, encoded_value->ptr, FLOWTHINGS_IO_MAX_PATH_SIZE);
 
-	if (!id) {
-		FAIL
-		;
+	flowthings_io_string_cleanup(encoded_value);
+}
+
+/*
+ * NAME: __flowthings_io_result_from_http
+ *
+ * Converts an HTTP response code into a flowthings_io_result_code.
+ */
+static flowthings_io_result_code __flowthings_io_result_from_http(int http_response_code)
+{
+	if (http_response_code >= 200 && http_response_code < 400)
+		return FLOWTHINGS_IO_OK;
+
+	switch (http_response_code) {
+	case 400:
+		return FLOWTHINGS_IO_ERROR_BAD_REQUEST;
+	case 403:
+		return FLOWTHINGS_IO_ERROR_FORBIDDEN;
+	case 404:
+		return FLOWTHINGS_IO_ERROR_NOT_FOUND;
+	case 500:
+		return FLOWTHINGS_IO_ERROR_SERVER_ERROR;
+	default:
+		return FLOWTHINGS_IO_ERROR_UNKNOWN;
 	}
+}
+
+/*
+ * NAME: __flowthings_io_op_decode_batch_item
+ *
+ * Decodes the i-th result of a batch request, { "head": { "status": ... }, "body": ... }, into its
+ * object and records its code.
+ */
+static void __flowthings_io_op_decode_batch_item(flowthings_io_op *op, int i, cJSON *item)
+{
+	cJSON *head = cJSON_GetObjectItem(item, "head");
+	cJSON *status = head ? cJSON_GetObjectItem(head, "status") : NULL;
+	cJSON *body = cJSON_GetObjectItem(item, "body");
+	int index = op->batch_index[i];
+	flowthings_io_result_code code;
 
-	char path[FLOWTHINGS_IO_MAX_PATH_SIZE] = "";
-	flowthings_io_string *response = flowthings_io_string_init();
+	if (!status || status->type != cJSON_Number)
+		code = FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+	else
+		code = __flowthings_io_result_from_http(status->valueint);
 
-	struct __flowthings_io_service_info_item *service_item =
-			&__flowthings_io_service_info[svc];
+	if (code == FLOWTHINGS_IO_OK && op->decoder)
+		code = body && op->decoder(body, op->results[index]) ?
+				FLOWTHINGS_IO_OK : FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
 
-	api->fhttp->base_path = service_item->base_path;
+	op->batch_codes[index] = code;
+}
 
-	__flowthings_io_add_path_ext(path, path_ext);
-	flowthings_io_strcat(path, "/", FLOWTHINGS_IO_MAX_PATH_SIZE);
-	flowthings_io_strcat(path, id, FLOWTHINGS_IO_MAX_PATH_SIZE);
+/*
+ * NAME: __flowthings_io_op_cache_lookup
+ *
+ * Looks up a read's object in the API's cache.  A fresh entry means the read won't be sent; a
+ * stale one with an entity tag makes the read conditional.
+ */
+static void __flowthings_io_op_cache_lookup(flowthings_io_op *op)
+{
+	if (!op->cached)
+		op->cached = flowthings_io_string_init();
 
-	if (params)
-		flowthings_io_params_to_url(params, path, FLOWTHINGS_IO_MAX_PATH_SIZE);
-
-	int http_response_code = flowthings_io_http_request(api->fhttp,
-			FLOWTHINGS_IO_HTTP_METHOD_GET, path, NULL, response);
-
-	if (http_response_code < 200 || http_response_code >= 400) {
-		switch (http_response_code) {
-		case 400:
-			return FLOWTHINGS_IO_ERROR_BAD_REQUEST;
-		case 403:
-			return FLOWTHINGS_IO_ERROR_FORBIDDEN;
-		case 404:
-			return FLOWTHINGS_IO_ERROR_NOT_FOUND;
-		case 500:
-			return FLOWTHINGS_IO_ERROR_SERVER_ERROR;
-		default:
-			return FLOWTHINGS_IO_ERROR_UNKNOWN;
-		}
-	}
+	op->cache_use = FLOWTHINGS_IO_OP_CACHE_READ;
+	op->cache_found = flowthings_io_cache_lookup(op->api->cache, op->svc, op->cache_id,
+			op->cache_id_len, op->cached, op->cache_etag, &op->cache_version);
 
-	cJSON *root = cJSON_Parse(response->ptr);
-	flowthings_io_string_cleanup(response);
+	if (op->cache_found == FLOWTHINGS_IO_CACHE_STALE && op->cache_etag[0])
+		op->xfer.if_none_match = op->cache_etag;
+}
 
-	cJSON *body = cJSON_GetObjectItem(root, "body");
-	if (!body)
-		return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+/*
+ * NAME: __flowthings_io_op_cache_store
+ *
+ * Keeps the body of a read's response in the API's cache.
+ */
+static void __flowthings_io_op_cache_store(flowthings_io_op *op, const char *json, size_t len)
+{
+	if (op->cache_use == FLOWTHINGS_IO_OP_CACHE_READ)
+		flowthings_io_cache_store(op->api->cache, op->svc, op->cache_id, op->cache_id_len,
+				json, len, op->xfer.etag, op->cache_version);
+}
 
-	flowthings_io_result_code code =
-			decoder(body, result) ?
-					FLOWTHINGS_IO_OK : FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+/*
+ * NAME: __flowthings_io_op_resolver_forget
+ *
+ * Updates the API's resolver for a call that changes a flow: an updated or deleted flow's path
+ * may now be wrong, and a created or updated flow may have a path that was remembered as having
+ * no flow.
+ */
+static void __flowthings_io_op_resolver_forget(flowthings_io_op *op)
+{
+	const char *method = op->xfer.method;
 
-	cJSON_Delete(root);
+	if (!strcmp(method, FLOWTHINGS_IO_HTTP_METHOD_GET) || !strcmp(method, FLOWTHINGS_IO_HTTP_METHOD_MGET))
+		return;
 
-	return code;
+	if (op->cache_id)
+		flowthings_io_resolver_forget_id(op->api->resolver, op->cache_id, op->cache_id_len);
+
+	if (strcmp(method, FLOWTHINGS_IO_HTTP_METHOD_DELETE))
+		flowthings_io_resolver_forget_missing(op->api->resolver);
 }
 
+static BOOL __flowthings_io_decode_flow_path(cJSON *json_in, void *obj_out);
+
 /*
- * NAME: flowthings_io_service_create
+ * NAME: __flowthings_io_arena_for
  *
- * Perform a create on valid objects from the platform.  This function should not be called directly --
- * one of the defines below should be called depending on the object type.  For example, to create a
- * drop, call flowthings_io_drop_create(...)
+ * Whether the cJSON trees given to decoder are kept in an arena.  The library's own decoders
+ * (and calls with none) copy what they need, so they always have one; the caller's decoders
+ * only if the API has arenas turned on, since they may keep items.
+ */
+static BOOL __flowthings_io_arena_for(flowthings_io_api *api, flowthings_io_cb_decode_object decoder)
+{
+	return api->json_arena || !decoder || decoder == __flowthings_io_decode_flow_path;
+}
+
+/*
+ * NAME: __flowthings_io_op_arena_for
  *
- * PARAMS:
- * svc - the service type
- * path_ext - any path extension to add in creating the URL
- * api - the API object
- * params - any additional query string parameters to be passed to the platform
- * encoder - the object encoder, which will be called on void *object (see flowthings_io_cb_encode_object)
- * decoder - the object decoder (see flowthings_io_cb_decode_object)
- * object - the object with the fields to create; encoder will be called on this object and the result
- *     will be passed to the platform; when this function returns, object will be filled with the resulting
- *     object from the platform
+ * Returns the arena for an operation's cJSON trees that are given to decoder, or NULL if they
+ * aren't kept in one.
  */
-flowthings_io_result_code flowthings_io_service_create(
-		flowthings_io_service_type svc, const char *path_ext,
-		flowthings_io_api *api, flowthings_io_params *params,
-		flowthings_io_cb_encode_object encoder,
-		flowthings_io_cb_decode_object decoder, void *object)
+static cJSON_Arena *__flowthings_io_op_arena_for(flowthings_io_op *op,
+		flowthings_io_cb_decode_object decoder)
 {
-	if (!api || !api->fhttp)
-		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+	if (!op->api || !__flowthings_io_arena_for(op->api, decoder))
+		return NULL;
 
-	char path[FLOWTHINGS_IO_MAX_PATH_SIZE] = "";
-	flowthings_io_result_code code;
-	flowthings_io_string *response = flowthings_io_string_init();
-	cJSON *in_root, *out_root;
-	struct __flowthings_io_service_info_item *service_item =
-			&__flowthings_io_service_info[svc];
+	if (!op->arena)
+		op->arena = cJSON_ArenaCreate();
 
-	api->fhttp->base_path = service_item->base_path;
+	return op->arena;
+}
 
-	__flowthings_io_add_path_ext(path, path_ext);
+/*
+ * NAME: __flowthings_io_op_arena
+ *
+ * Returns the arena for an operation's cJSON trees, or NULL if they aren't kept in one.
+ */
+static cJSON_Arena *__flowthings_io_op_arena(flowthings_io_op *op)
+{
+	return __flowthings_io_op_arena_for(op, op->decoder);
+}
 
-	if (!encoder || !object)
-		return FLOWTHINGS_IO_ERROR_COULDNT_ENCODE;
+/*
+ * NAME: __flowthings_io_json_release
+ *
+ * Frees a cJSON tree parsed or built after cJSON_ArenaUse(arena), and puts back prev, the arena
+ * that was in use before.  A tree in an arena is freed by resetting the arena.
+ */
+static void __flowthings_io_json_release(cJSON_Arena *arena, cJSON_Arena *prev, cJSON *root)
+{
+	cJSON_ArenaUse(prev);
 
-	in_root = cJSON_CreateObject();
-	encoder(object, in_root);
+	if (arena)
+		cJSON_ArenaReset(arena);
+	else
+		cJSON_Delete(root);
+}
 
-	int http_response_code = flowthings_io_http_request(api->fhttp,
-			FLOWTHINGS_IO_HTTP_METHOD_POST, path, cJSON_Print(in_root), response);
+/*
+ * NAME: __flowthings_io_op_decode_text
+ *
+ * Decodes an object straight from JSON text, with an operation's codec, event decoder or tape
+ * decoder.
+ */
+static BOOL __flowthings_io_op_decode_text(flowthings_io_op *op, const char *json, size_t len,
+		void *out)
+{
+	flowthings_io_json_reader reader;
 
-	cJSON_Delete(in_root);
+	if (op->codec)
+		return flowthings_io_codec_decode(op->codec, json, len, out);
 
-	if (http_response_code < 200 || http_response_code >= 400) {
-		switch (http_response_code) {
-		case 400:
-			return FLOWTHINGS_IO_ERROR_BAD_REQUEST;
-		case 403:
-			return FLOWTHINGS_IO_ERROR_FORBIDDEN;
-		case 404:
-			return FLOWTHINGS_IO_ERROR_NOT_FOUND;
-		case 500:
-			return FLOWTHINGS_IO_ERROR_SERVER_ERROR;
-		default:
-			return FLOWTHINGS_IO_ERROR_UNKNOWN;
-		}
+	if (op->tape_decoder) {
+		if (!op->tape)
+			op->tape = flowthings_io_tape_init();
+		return op->tape && flowthings_io_tape_parse(op->tape, json, len)
+				&& op->tape_decoder(flowthings_io_tape_root(op->tape), out);
 	}
 
-	out_root = cJSON_Parse(response->ptr);
-	flowthings_io_string_cleanup(response);
+	/* the decoder may stop before the end of the object, but not at an error */
+	flowthings_io_json_reader_init(&reader, json, len);
 
-	cJSON *body = cJSON_GetObjectItem(out_root, "body");
-	if (!body)
-		return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+	return op->events(&reader, out) && !reader.failed;
+}
+
+/*
+ * NAME: __flowthings_io_op_parse_projected
+ *
+ * Parses an object of an operation's response body with only what is on the operation's
+ * projection.  The projection's paths start at the top of the response, so the part of it below
+ * "body" is used.
+ */
+static cJSON *__flowthings_io_op_parse_projected(flowthings_io_op *op, const char *json, size_t len)
+{
+	return flowthings_io_json_parse_projected(flowthings_io_json_projection_at(op->projection, "body"),
+			json, len);
+}
+
+/*
+ * NAME: __flowthings_io_op_decode_cached
+ *
+ * Decodes a read from the body found in the cache, when the entry was fresh or the platform said
+ * it hasn't changed.
+ */
+static flowthings_io_result_code __flowthings_io_op_decode_cached(flowthings_io_op *op)
+{
+	flowthings_io_result_code code = FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+	cJSON_Arena *arena, *prev;
+	cJSON *body;
 
-	if (decoder)
-		code = decoder(body, object) ?
+	if (op->cache_found == FLOWTHINGS_IO_CACHE_STALE)
+		flowthings_io_cache_revalidated(op->api->cache, op->svc, op->cache_id, op->cache_id_len);
+
+	if (op->codec || op->events || op->tape_decoder)
+		return __flowthings_io_op_decode_text(op, op->cached->ptr, op->cached->len, op->result) ?
 				FLOWTHINGS_IO_OK : FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+
+	arena = __flowthings_io_op_arena(op);
+	prev = cJSON_ArenaUse(arena);
+	if (op->projection)
+		body = __flowthings_io_op_parse_projected(op, op->cached->ptr, op->cached->len);
 	else
-		code = FLOWTHINGS_IO_OK;
+		body = cJSON_ParseInSitu(op->cached->ptr);
 
-	cJSON_Delete(out_root);
+	if (body)
+		code = op->decoder(body, op->result) ? FLOWTHINGS_IO_OK : FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+
+	__flowthings_io_json_release(arena, prev, body);
 
 	return code;
 }
 
+static BOOL __flowthings_io_op_on_value(char *json, size_t len, void *user_data);
+
+/* returns p moved past any JSON whitespace */
+static char *__flowthings_io_skip_ws(char *p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+		p++;
+
+	return p;
+}
+
 /*
- * NAME: flowthings_io_service_update
- *
- * Perform an update on valid objects from the platform.  This function should not be called directly --
- * one of the defines below should be called depending on the object type.  For example, to update a
- * drop, call flowthings_io_drop_update(...)
+ * NAME: __flowthings_io_op_decode_value
  *
- * PARAMS:
- * svc - the service type
- * path_ext - any path extension to add in creating the URL
- * api - the API object
- * id - the ID of the object to delete
- * params - any additional query string parameters to be passed to the platform
- * encoder - the object encoder, which will be called on void *object (see flowthings_io_cb_encode_object)
- * decoder - the object decoder (see flowthings_io_cb_decode_object)
- * object - the object with the fields to update; encoder will be called on this object and the result
- *     will be passed to the platform; when this function returns, this will be filled with the updated
- *     object from the platform
+ * Hands the value from start to end in an operation's response to __flowthings_io_op_on_value,
+ * null terminated as the stream would have left it.
  */
-flowthings_io_result_code flowthings_io_service_update(
-		flowthings_io_service_type svc, const char *path_ext,
-		flowthings_io_api *api, const char *id, flowthings_io_params *params,
-		flowthings_io_cb_encode_object encoder,
-		flowthings_io_cb_decode_object decoder, void *object)
+static BOOL __flowthings_io_op_decode_value(flowthings_io_op *op, char *start, char *end)
 {
-	if (!api || !api->fhttp)
-		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
-
-	char path[FLOWTHINGS_IO_MAX_PATH_SIZE] = "/";
-	flowthings_io_result_code code;
-	flowthings_io_string *response = flowthings_io_string_init();
-	cJSON *in_root, *out_root;
-
-	struct __flowthings_io_service_info_item *service_item =
-			&__flowthings_io_service_info[svc];
+	char c = *end;
+	BOOL more;
 
-	api->fhttp->base_path = service_item->base_path;
+	*end = '\0';
+	more = __flowthings_io_op_on_value(start, end - start, op);
+	*end = c;
 
-	__flowthings_io_add_path_ext(path, path_ext);
-	flowthings_io_strcat(path, "/", FLOWTHINGS_IO_MAX_PATH_SIZE);
-	flowthings_io_strcat(path, id, FLOWTHINGS_IO_MAX_PATH_SIZE);
-
-	if (!encoder || !object)
-		return FLOWTHINGS_IO_ERROR_COULDNT_ENCODE;
+	return more;
+}
 
-	in_root = cJSON_CreateObject();
-	encoder(object, in_root);
+/*
+ * NAME: __flowthings_io_op_decode_next
+ *
+ * Decodes the next value from reader into out with an operation's codec, or parses it with the
+ * operation's projection and runs its decoder on the tree.  Returns FALSE, having set the
+ * operation's code, if it can't.
+ */
+static BOOL __flowthings_io_op_decode_next(flowthings_io_op *op, flowthings_io_json_reader *reader,
+		void *out)
+{
+	cJSON_Arena *arena, *prev;
+	cJSON *item;
+	BOOL decoded = FALSE;
 
-	int http_response_code = flowthings_io_http_request(api->fhttp,
-			FLOWTHINGS_IO_HTTP_METHOD_PUT, path, cJSON_Print(in_root),
-			response);
+	if (op->codec) {
+		if (flowthings_io_codec_decode_next(op->codec, reader, out))
+			return TRUE;
 
-	cJSON_Delete(in_root);
+		op->stream_code = reader->failed ?
+				FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE : FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
 
-	if (http_response_code < 200 || http_response_code >= 400) {
-		switch (http_response_code) {
-		case 400:
-			return FLOWTHINGS_IO_ERROR_BAD_REQUEST;
-		case 403:
-			return FLOWTHINGS_IO_ERROR_FORBIDDEN;
-		case 404:
-			return FLOWTHINGS_IO_ERROR_NOT_FOUND;
-		case 500:
-			return FLOWTHINGS_IO_ERROR_SERVER_ERROR;
-		default:
-			return FLOWTHINGS_IO_ERROR_UNKNOWN;
-		}
+		return FALSE;
 	}
 
-	out_root = cJSON_Parse(response->ptr);
-	flowthings_io_string_cleanup(response);
+	arena = __flowthings_io_op_arena(op);
+	prev = cJSON_ArenaUse(arena);
 
-	cJSON *body = cJSON_GetObjectItem(out_root, "body");
-	if (!body)
-		return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+	item = flowthings_io_json_parse_projected_next(
+			flowthings_io_json_projection_at(op->projection, "body"), reader);
 
-	if (decoder)
-		code = decoder(body, object) ?
-				FLOWTHINGS_IO_OK : FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+	if (!item)
+		op->stream_code = FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+	else if (op->decoder && !op->decoder(item, out))
+		op->stream_code = FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
 	else
-		code = FLOWTHINGS_IO_OK;
+		decoded = TRUE;
 
-	cJSON_Delete(out_root);
+	__flowthings_io_json_release(arena, prev, item);
 
-	return code;
+	return decoded;
 }
 
 /*
- * NAME: flowthings_io_service_delete
- *
- * Perform a delete on valid objects from the platform.  This function should not be called directly --
- * one of the defines below should be called depending on the object type.  For example, to delete a
- * drop, call flowthings_io_drop_delete(...)
+ * NAME: __flowthings_io_op_decode_tape
  *
- * PARAMS:
- * svc - the service type
- * path_ext - any path extension to add in creating the URL
- * api - the API object
- * id - the ID of the object to delete
- * params - any additional query string parameters to be passed to the platform
+ * Parses the body, from start to end in an operation's response, onto the operation's tape in one
+ * go, and runs its tape decoder on the body, or on each element of the body for find operations.
  */
-flowthings_io_result_code flowthings_io_service_delete(
-		flowthings_io_service_type svc, const char *path_ext,
-		flowthings_io_api *api, const char *id, flowthings_io_params *params)
+static flowthings_io_result_code __flowthings_io_op_decode_tape(flowthings_io_op *op, char *start,
+		char *end)
 {
-	if (!api || !api->fhttp)
-		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+	flowthings_io_tape_value body, item;
+	char c = *end;
+	BOOL parsed;
 
-	char path[FLOWTHINGS_IO_MAX_PATH_SIZE] = "/";
-	flowthings_io_string *response = flowthings_io_string_init();
+	if (!op->tape)
+		op->tape = flowthings_io_tape_init();
+	if (!op->tape)
+		return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
 
-	struct __flowthings_io_service_info_item *service_item =
-			&__flowthings_io_service_info[svc];
+	*end = '\0';
+	parsed = flowthings_io_tape_parse(op->tape, start, end - start);
+	*end = c;
 
-	api->fhttp->base_path = service_item->base_path;
-	__flowthings_io_add_path_ext(path, path_ext);
-	flowthings_io_strcat(path, id, FLOWTHINGS_IO_MAX_PATH_SIZE);
+	if (!parsed)
+		return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
 
-	int http_response_code = flowthings_io_http_request(api->fhttp,
-			FLOWTHINGS_IO_HTTP_METHOD_DELETE, path, NULL, response);
+	body = flowthings_io_tape_root(op->tape);
 
-	if (http_response_code < 200 || http_response_code >= 400) {
-		switch (http_response_code) {
-		case 400:
-			return FLOWTHINGS_IO_ERROR_BAD_REQUEST;
-		case 403:
-			return FLOWTHINGS_IO_ERROR_FORBIDDEN;
-		case 404:
-			return FLOWTHINGS_IO_ERROR_NOT_FOUND;
-		case 500:
-			return FLOWTHINGS_IO_ERROR_SERVER_ERROR;
-		default:
-			return FLOWTHINGS_IO_ERROR_UNKNOWN;
+	if (op->decode_type == FLOWTHINGS_IO_OP_DECODE_ONE) {
+		if (!op->tape_decoder(body, op->result))
+			return FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+		__flowthings_io_op_cache_store(op, start, end - start);
+		return FLOWTHINGS_IO_OK;
+	}
+
+	/* as with the stream, a find whose body isn't an array finds nothing */
+	if (flowthings_io_tape_value_type(body) == FLOWTHINGS_IO_TAPE_ARRAY) {
+		flowthings_io_tape_for_each(item, body) {
+			if (op->decoded >= *op->result_count)
+				break;
+			if (!op->tape_decoder(item, &op->results[op->decoded])) {
+				op->stream_code = FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+				break;
+			}
+			op->decoded++;
 		}
 	}
 
-	flowthings_io_string_cleanup(response);
+	*op->result_count = op->decoded;
 
-	return FLOWTHINGS_IO_OK;
+	return op->stream_code;
 }
 
-
-/***********************************************************************
- * The drop-only service functions
- ***********************************************************************/
-
 /*
- * NAME: flowthings_io_service_find
+ * NAME: __flowthings_io_op_decode_body
  *
- * Perform a find on drops from the platform.  This function should not be called directly --
- * one of the defines below should be called depending on the object type.
- *
- * PARAMS:
- * svc - the service type
- * path_ext - any path extension to add in creating the URL
- * api - the API object
- * filter - a filter string for drops (see https://flowthings.io/docs/flow-filter-language)
- * params - any additional query string parameters to be passed to the platform
- * decoder - the object decoder (see flowthings_io_cb_decode_object)
- * result - the array of result pointers; this array and all result objects must be pre-allocated
- *     and initialized; decode will be performed on all platform results and they will be placed
- *     in the result array
- * result_count - must initially be set to the allocated size of the result array; when this
- *     function completes, it will be set to the number of items in the array
+ * Decodes a response that has been received whole the way it would have been decoded as it
+ * arrived: the body is found with the pull reader, and it, or each element of it for find
+ * operations, is handed to __flowthings_io_op_on_value.  A codec decodes each one, and a
+ * projection parses each one, where the reader finds it.  Nothing else in the response is parsed,
+ * so operations that decode from the JSON text, or parse it with a projection, don't pay for the
+ * stream's scanner when stream decoding is off.  A tape decoder is given the body parsed onto one
+ * tape.
  */
-flowthings_io_result_code flowthings_io_service_find(
-		flowthings_io_service_type svc, const char *path_ext,
-		flowthings_io_api *api, const char *filter,
-		flowthings_io_params *params, flowthings_io_cb_decode_object decoder,
-		void *result[],
-		int *result_count)
+static flowthings_io_result_code __flowthings_io_op_decode_body(flowthings_io_op *op)
 {
-	flowthings_io_params *my_params = params;
-	flowthings_io_result_code code;
-	int i;
+	flowthings_io_json_reader reader;
+	flowthings_io_json_event event;
+	char *json = op->response->ptr, *start;
 
-	if (!my_params) {
-		my_params = flowthings_io_params_init();
-	}
+	op->decoded = 0;
+	op->stream_code = FLOWTHINGS_IO_OK;
 
-	flowthings_io_params_add(my_params, "filter", filter);
+	flowthings_io_json_reader_init(&reader, json, op->response->len);
 
-	if (!api || !api->fhttp)
-		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+	if (flowthings_io_json_next(&reader) != FLOWTHINGS_IO_JSON_BEGIN_OBJECT)
+		return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
 
-	if (!decoder || !result)
-		return FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+	while ((event = flowthings_io_json_next(&reader)) == FLOWTHINGS_IO_JSON_KEY
+			&& !flowthings_io_json_key_is(&reader, "body")) {
+		if (!flowthings_io_json_skip(&reader))
+			return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+	}
+
+	if (event != FLOWTHINGS_IO_JSON_KEY)
+		return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+
+	start = __flowthings_io_skip_ws((char *)reader.p);
+
+	if (op->tape_decoder) {
+		if (!flowthings_io_json_skip(&reader))
+			return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+		return __flowthings_io_op_decode_tape(op, start, (char *)reader.p);
+	}
+
+	if (op->decode_type == FLOWTHINGS_IO_OP_DECODE_ONE) {
+
+		if (op->codec || op->projection) {
+			if (__flowthings_io_op_decode_next(op, &reader, op->result))
+				__flowthings_io_op_cache_store(op, start, reader.p - start);
+		}
+		else if (!flowthings_io_json_skip(&reader)) {
+			return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+		}
+		else {
+			__flowthings_io_op_decode_value(op, start, (char *)reader.p);
+		}
+	}
+	else if (*start != '[') {
+
+		/* as with the stream, a find whose body isn't an array finds nothing */
+		if (!flowthings_io_json_skip(&reader))
+			return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+	}
+	else {
+
+		flowthings_io_json_next(&reader);
+
+		for (;;) {
+
+			start = __flowthings_io_skip_ws((char *)reader.p);
+
+			if (*start == ']') {
+				flowthings_io_json_next(&reader);
+				break;
+			}
+
+			if (*start == ',')
+				start = __flowthings_io_skip_ws(start + 1);
+
+			if (op->codec || op->projection) {
+				if (op->decoded >= *op->result_count || !__flowthings_io_op_decode_next(op, &reader,
+						op->codec ? (char *)op->results + op->decoded * op->codec->size
+						: (void *)&op->results[op->decoded]))
+					break;
+				op->decoded++;
+				continue;
+			}
+
+			event = flowthings_io_json_next(&reader);
+
+			if (event == FLOWTHINGS_IO_JSON_ERROR || ((event == FLOWTHINGS_IO_JSON_BEGIN_OBJECT
+					|| event == FLOWTHINGS_IO_JSON_BEGIN_ARRAY) && !flowthings_io_json_skip(&reader)))
+				return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+
+			if (!__flowthings_io_op_decode_value(op, start, (char *)reader.p))
+				break;
+		}
+	}
+
+	if (op->decode_type == FLOWTHINGS_IO_OP_DECODE_MANY)
+		*op->result_count = op->decoded;
+
+	return op->stream_code;
+}
+
+/*
+ * NAME: __flowthings_io_op_decode
+ *
+ * Parses the platform response for an operation and runs its decoder on the body.
+ */
+static flowthings_io_result_code __flowthings_io_op_decode(flowthings_io_op *op)
+{
+	flowthings_io_result_code code = __flowthings_io_result_from_http(op->xfer.http_response_code);
+	flowthings_io_json_writer writer;
+	cJSON_Arena *arena, *prev;
+	cJSON *item;
+	int i;
+
+	if (op->cache_found == FLOWTHINGS_IO_CACHE_FRESH
+			|| (op->cache_found == FLOWTHINGS_IO_CACHE_STALE && op->xfer.http_response_code == 304))
+		return __flowthings_io_op_decode_cached(op);
+
+	if (code != FLOWTHINGS_IO_OK || op->decode_type == FLOWTHINGS_IO_OP_DECODE_NONE)
+		return code;
+
+	/* the body has already been decoded by __flowthings_io_op_on_value */
+	if (op->xfer.on_data) {
+
+		if (!flowthings_io_stream_complete(op->stream))
+			return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+
+		if (op->decode_type == FLOWTHINGS_IO_OP_DECODE_MANY)
+			*op->result_count = op->decoded;
+
+		return op->stream_code;
+	}
+
+	/* a codec or event decoder reads the body's text, so no tree is built, a projection only
+	 * builds trees of the body's objects, and a tape decoder reads the body from a tape */
+	if (op->codec || op->events || op->tape_decoder || op->projection)
+		return __flowthings_io_op_decode_body(op);
+
+	/* decoders run with the arena in use, so what they build is released with the tree, and the
+	 * tree's strings are left in the response */
+	arena = __flowthings_io_op_arena(op);
+	prev = cJSON_ArenaUse(arena);
+
+	cJSON *root = cJSON_ParseInSitu(op->response->ptr);
+	cJSON *body = root ? cJSON_GetObjectItem(root, "body") : NULL;
+
+	if (!body) {
+		__flowthings_io_json_release(arena, prev, root);
+		return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+	}
+
+	if (op->decode_type == FLOWTHINGS_IO_OP_DECODE_ONE) {
+
+		if (op->decoder)
+			code = op->decoder(body, op->result) ?
+					FLOWTHINGS_IO_OK : FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+
+		if (code == FLOWTHINGS_IO_OK && op->cache_use == FLOWTHINGS_IO_OP_CACHE_READ) {
+			flowthings_io_string_reset(op->cached);
+			flowthings_io_json_writer_init(&writer, op->cached);
+			flowthings_io_json_item(&writer, body);
+			if (flowthings_io_json_writer_done(&writer))
+				__flowthings_io_op_cache_store(op, op->cached->ptr, op->cached->len);
+		}
+	}
+	else if (op->decode_type == FLOWTHINGS_IO_OP_DECODE_BATCH) {
+
+		if (body->type != cJSON_Array)
+			code = FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+
+		i = 0;
+		if (body->type == cJSON_Array) {
+			cJSON_ArrayForEach(item, body) {
+				if (i >= op->batch_count)
+					break;
+				__flowthings_io_op_decode_batch_item(op, i++, item);
+			}
+		}
+	}
+	else {
+
+		/* walk the list once rather than counting and indexing it for every result */
+		i = 0;
+		if (body->type == cJSON_Array) {
+			cJSON_ArrayForEach(item, body) {
+				if (i >= *op->result_count)
+					break;
+				code = op->decoder(item, &op->results[i]) ? FLOWTHINGS_IO_OK : FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+				if (code != FLOWTHINGS_IO_OK)
+					break;
+				i++;
+			}
+		}
+
+		*op->result_count = i;
+	}
+
+	__flowthings_io_json_release(arena, prev, root);
+
+	return code;
+}
+
+/*
+ * NAME: __flowthings_io_op_on_value
+ *
+ * The stream callback for an operation; decodes the body, or one element of the body for find
+ * operations, as soon as it has been received.
+ */
+static BOOL __flowthings_io_op_on_value(char *json, size_t len, void *user_data)
+{
+	flowthings_io_op *op = (flowthings_io_op *)user_data;
+	void *out = op->result;
+	cJSON_Arena *arena, *prev;
+	cJSON *item;
+
+	if (op->decode_type == FLOWTHINGS_IO_OP_DECODE_MANY) {
+		if (op->decoded >= *op->result_count)
+			return FALSE;
+		out = op->codec ? (char *)op->results + op->decoded * op->codec->size
+				: (void *)&op->results[op->decoded];
+	}
+	else if (op->decode_type == FLOWTHINGS_IO_OP_DECODE_BATCH && op->decoded >= op->batch_count) {
+		return FALSE;
+	}
+
+	/* a codec, event decoder or tape decoder reads the JSON text directly */
+	if (op->codec || op->events || op->tape_decoder) {
+
+		if (!__flowthings_io_op_decode_text(op, json, len, out)) {
+			op->stream_code = FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+			return FALSE;
+		}
+
+		if (op->decode_type == FLOWTHINGS_IO_OP_DECODE_ONE)
+			__flowthings_io_op_cache_store(op, json, len);
+
+		op->decoded++;
+
+		return TRUE;
+	}
+
+	/* the arena is reset after every value, so it only ever holds one; a read that will be cached
+	 * needs the text afterwards, so it isn't parsed in place (a projected parse leaves it as is) */
+	arena = __flowthings_io_op_arena(op);
+	prev = cJSON_ArenaUse(arena);
+
+	if (op->projection)
+		item = __flowthings_io_op_parse_projected(op, json, len);
+	else if (op->cache_use == FLOWTHINGS_IO_OP_CACHE_READ)
+		item = cJSON_Parse(json);
+	else
+		item = cJSON_ParseInSitu(json);
+
+	if (!item) {
+		__flowthings_io_json_release(arena, prev, NULL);
+		op->stream_code = FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+		return FALSE;
+	}
+
+	if (op->decode_type == FLOWTHINGS_IO_OP_DECODE_BATCH) {
+		__flowthings_io_op_decode_batch_item(op, op->decoded++, item);
+		__flowthings_io_json_release(arena, prev, item);
+		return TRUE;
+	}
+
+	if (op->decoder && !op->decoder(item, out)) {
+		op->stream_code = FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+		__flowthings_io_json_release(arena, prev, item);
+		return FALSE;
+	}
+
+	if (op->decode_type == FLOWTHINGS_IO_OP_DECODE_ONE)
+		__flowthings_io_op_cache_store(op, json, len);
+
+	__flowthings_io_json_release(arena, prev, item);
+	op->decoded++;
+
+	return TRUE;
+}
+
+/*
+ * NAME: __flowthings_io_op_on_data
+ *
+ * The HTTP layer data callback for an operation that decodes its response as it arrives.  Error
+ * responses aren't decoded.
+ */
+static size_t __flowthings_io_op_on_data(flowthings_io_http_xfer *xfer, const char *data, size_t len)
+{
+	flowthings_io_op *op = (flowthings_io_op *)xfer->user_data;
+
+	if (__flowthings_io_result_from_http(xfer->http_response_code) == FLOWTHINGS_IO_OK)
+		flowthings_io_stream_feed(op->stream, data, len);
+
+	return len;
+}
+
+/*
+ * NAME: __flowthings_io_op_on_done
+ *
+ * The HTTP layer callback for an operation's transfer.
+ */
+static void __flowthings_io_op_on_done(flowthings_io_http_xfer *xfer)
+{
+	flowthings_io_op *op = (flowthings_io_op *)xfer->user_data;
+
+	if (op->cache_use == FLOWTHINGS_IO_OP_CACHE_INVALIDATE)
+		flowthings_io_cache_invalidate(op->api->cache, op->svc, op->cache_id, op->cache_id_len);
+
+	if (op->svc == FLOWTHINGS_IO_SERVICE_TYPE_FLOW && op->api->resolver)
+		__flowthings_io_op_resolver_forget(op);
+
+	if (op->code == FLOWTHINGS_IO_OK)
+		op->code = __flowthings_io_op_decode(op);
+
+	op->done = TRUE;
+
+	/* this must be last, the callback may clean up the op */
+	if (op->complete)
+		op->complete(op, op->code, op->user_data);
+}
+
+/*
+ * NAME: __flowthings_io_op_pool_get
+ *
+ * Takes a finished operation from the API's pool, or returns NULL if the pool is empty.
+ */
+static flowthings_io_op *__flowthings_io_op_pool_get(flowthings_io_api *api)
+{
+	flowthings_io_op *op = NULL;
+
+	if (!api)
+		return NULL;
+
+	pthread_mutex_lock(&api->op_pool_lock);
+	if (api->op_pool_count > 0)
+		op = api->op_pool[--api->op_pool_count];
+	pthread_mutex_unlock(&api->op_pool_lock);
+
+	return op;
+}
+
+/*
+ * NAME: __flowthings_io_op_pool_put
+ *
+ * Returns a finished operation to its API's pool.  Returns FALSE if the pool is full or the
+ * operation's response buffer is too big to keep, in which case the caller must free it.
+ */
+static BOOL __flowthings_io_op_pool_put(flowthings_io_op *op)
+{
+	flowthings_io_api *api = op->api;
+	BOOL pooled = FALSE;
+
+	if (!api || op->response->capacity > FLOWTHINGS_IO_API_MAX_POOLED_RESPONSE
+			|| (op->request && op->request->capacity > FLOWTHINGS_IO_API_MAX_POOLED_RESPONSE)
+			|| cJSON_ArenaSize(op->arena) > FLOWTHINGS_IO_API_MAX_POOLED_ARENA
+			|| flowthings_io_tape_size(op->tape) > FLOWTHINGS_IO_API_MAX_POOLED_ARENA)
+		return FALSE;
+
+	pthread_mutex_lock(&api->op_pool_lock);
+	if (api->op_pool_count < FLOWTHINGS_IO_API_OP_POOL_SIZE) {
+		api->op_pool[api->op_pool_count++] = op;
+		pooled = TRUE;
+	}
+	pthread_mutex_unlock(&api->op_pool_lock);
+
+	return pooled;
+}
+
+/*
+ * NAME: __flowthings_io_op_stream
+ *
+ * Makes an operation decode its response as it arrives, reusing its stream if it has one.
+ */
+static void __flowthings_io_op_stream(flowthings_io_op *op)
+{
+	BOOL split_arrays = op->decode_type != FLOWTHINGS_IO_OP_DECODE_ONE;
+
+	if (op->stream)
+		flowthings_io_stream_reset(op->stream, split_arrays);
+	else
+		op->stream = flowthings_io_stream_init(split_arrays, __flowthings_io_op_on_value, op);
+
+	op->stream_code = FLOWTHINGS_IO_OK;
+	op->xfer.on_data = __flowthings_io_op_on_data;
+}
+
+/*
+ * NAME: __flowthings_io_op_init
+ *
+ * Sets up an operation for the given service and HTTP method, reusing a finished one and its
+ * buffers if the API has one.
+ */
+static flowthings_io_op *__flowthings_io_op_init(flowthings_io_service_type svc,
+		flowthings_io_api *api, const char *method, int decode_type,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	flowthings_io_op *op = __flowthings_io_op_pool_get(api);
+	flowthings_io_string *response, *request = NULL, *cached = NULL;
+	flowthings_io_stream *stream = NULL;
+	cJSON_Arena *arena = NULL;
+	flowthings_io_tape *tape = NULL;
+
+	if (op) {
+		response = op->response;
+		request = op->request;
+		stream = op->stream;
+		cached = op->cached;
+		arena = op->arena;
+		tape = op->tape;
+		flowthings_io_string_reset(response);
+		if (request)
+			flowthings_io_string_reset(request);
+	}
+	else {
+		op = malloc(sizeof(flowthings_io_op));
+		if (!op) FAIL;
+		response = flowthings_io_string_init();
+	}
+
+	memset(op, 0, sizeof(flowthings_io_op));
+
+	op->api = api;
+	op->svc = svc;
+	op->response = response;
+	op->request = request;
+	op->stream = stream;
+	op->cached = cached;
+	op->arena = arena;
+	op->tape = tape;
+	op->decode_type = decode_type;
+	op->code = FLOWTHINGS_IO_OK;
+	op->complete = complete;
+	op->user_data = user_data;
+
+	op->xfer.method = method;
+	op->xfer.base_path = __flowthings_io_service_info[svc].base_path;
+	op->xfer.path = op->path;
+	op->xfer.response = op->response;
+	op->xfer.on_done = __flowthings_io_op_on_done;
+	op->xfer.user_data = op;
+
+	if (api && api->stream_decode && decode_type != FLOWTHINGS_IO_OP_DECODE_NONE)
+		__flowthings_io_op_stream(op);
+
+	return op;
+}
+
+/*
+ * NAME: __flowthings_io_op_use_text
+ *
+ * Makes an operation decode with a codec, an event decoder or a tape decoder.  These read the
+ * JSON text rather than a cJSON tree, found in the whole response when stream decoding is off.
+ */
+static void __flowthings_io_op_use_text(flowthings_io_op *op, const flowthings_io_codec *codec,
+		flowthings_io_cb_decode_events events, flowthings_io_cb_decode_tape tape_decoder)
+{
+	op->codec = codec;
+	op->events = events;
+	op->tape_decoder = tape_decoder;
+}
+
+/*
+ * NAME: __flowthings_io_op_project
+ *
+ * Makes an operation give its decoder trees of only what is on projection's paths.  These are
+ * parsed from each object's text, found in the whole response when stream decoding is off.
+ */
+static flowthings_io_op *__flowthings_io_op_project(flowthings_io_op *op,
+		const flowthings_io_json_projection *projection)
+{
+	if (!op)
+		return NULL;
+
+	op->projection = projection;
+
+	return op;
+}
+
+/*
+ * NAME: __flowthings_io_op_request
+ *
+ * Returns the buffer an operation's body is written into, which is kept with pooled operations.
+ */
+static flowthings_io_string *__flowthings_io_op_request(flowthings_io_op *op)
+{
+	if (!op->request)
+		op->request = flowthings_io_string_init();
+
+	return op->request;
+}
+
+/*
+ * NAME: __flowthings_io_op_encode_codec
+ *
+ * Writes an operation's body with its codec.  Returns FALSE if the codec can't encode the object.
+ */
+static BOOL __flowthings_io_op_encode_codec(flowthings_io_op *op, const void *object)
+{
+	return flowthings_io_codec_encode(op->codec, object, __flowthings_io_op_request(op));
+}
+
+/*
+ * NAME: __flowthings_io_op_ready
+ *
+ * Marks an operation as built.  If code isn't FLOWTHINGS_IO_OK the request couldn't be built, and
+ * the operation will complete with that code without anything being sent.
+ */
+static flowthings_io_op *__flowthings_io_op_ready(flowthings_io_op *op,
+		flowthings_io_result_code code)
+{
+	op->code = code;
+	op->xfer.data = NULL;
+
+	if (!op->xfer.on_send && op->request && op->request->len > 0)
+		op->xfer.data = op->request->ptr;
+
+	return op;
+}
+
+/*
+ * NAME: __flowthings_io_op_submit
+ *
+ * Starts a built operation on the API's asynchronous engine.  Its completion callback is called
+ * from flowthings_io_api_poll.
+ */
+static flowthings_io_op *__flowthings_io_op_submit(flowthings_io_op *op)
+{
+	if (!op)
+		return NULL;
+
+	/* a read from a fresh cache entry finishes without being sent */
+	if (op->code == FLOWTHINGS_IO_OK && op->cache_found != FLOWTHINGS_IO_CACHE_FRESH)
+		flowthings_io_http_submit(op->api->fhttp, &op->xfer);
+	else
+		flowthings_io_http_defer(op->api->fhttp, &op->xfer);
+
+	return op;
+}
+
+/*
+ * NAME: __flowthings_io_op_perform
+ *
+ * Runs a built operation on the calling thread, waits for it and frees it.  This is how the
+ * blocking service functions run, so they can be called from any number of threads at once.
+ */
+static flowthings_io_result_code __flowthings_io_op_perform(flowthings_io_op *op)
+{
+	flowthings_io_result_code code;
+
+	if (!op)
+		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+
+	if (op->code == FLOWTHINGS_IO_OK && op->cache_found != FLOWTHINGS_IO_CACHE_FRESH) {
+		flowthings_io_http_perform(op->api->fhttp, &op->xfer);
+	}
+	else {
+		op->xfer.done = TRUE;
+		__flowthings_io_op_on_done(&op->xfer);
+	}
+
+	code = op->code;
+	flowthings_io_op_cleanup(op);
+
+	return code;
+}
+
+/*
+ * NAME: __flowthings_io_encode
+ *
+ * Runs the encoder on object and appends the resulting JSON to out, compact.  The encoder builds
+ * its tree in arena, unless that is NULL.  Returns FALSE on failure.
+ */
+static BOOL __flowthings_io_encode(cJSON_Arena *arena, flowthings_io_cb_encode_object encoder,
+		void *object, flowthings_io_string *out)
+{
+	cJSON_Arena *prev = cJSON_ArenaUse(arena);
+	cJSON *in_root = cJSON_CreateObject();
+	flowthings_io_json_writer writer;
+	BOOL encoded = FALSE;
+
+	if (encoder(object, in_root)) {
+		flowthings_io_json_writer_init(&writer, out);
+		flowthings_io_json_item(&writer, in_root);
+		encoded = flowthings_io_json_writer_done(&writer);
+	}
+
+	__flowthings_io_json_release(arena, prev, in_root);
+
+	return encoded;
+}
+
+
+/***********************************************************************
+ * The asynchronous operation functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_op_done
+ *
+ * Returns TRUE once the operation has completed.
+ */
+BOOL flowthings_io_op_done(flowthings_io_op *op)
+{
+	return op ? op->done : TRUE;
+}
+
+/*
+ * NAME: flowthings_io_op_result
+ *
+ * Returns the result of a completed operation.  For find operations, the result_count passed in
+ * is set when the operation completes.
+ */
+flowthings_io_result_code flowthings_io_op_result(flowthings_io_op *op)
+{
+	if (!op)
+		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+
+	return op->done ? op->code : FLOWTHINGS_IO_ERROR_UNKNOWN;
+}
+
+/*
+ * NAME: flowthings_io_op_wait
+ *
+ * Runs the API's calls until this operation has completed, and returns its result.  Other calls
+ * in flight on the same API object will also make progress.
+ */
+flowthings_io_result_code flowthings_io_op_wait(flowthings_io_op *op)
+{
+	if (!op)
+		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+
+	while (!op->done)
+		flowthings_io_api_poll(op->api, 1000);
+
+	return op->code;
+}
+
+/*
+ * NAME: flowthings_io_op_cleanup
+ *
+ * Frees an operation.  Must be called once for every operation returned by a *_async function.
+ * If the operation hasn't completed yet it is cancelled, and its callback will not be called.
+ */
+void flowthings_io_op_cleanup(flowthings_io_op *op)
+{
+	if (!op) return;
+
+	if (!op->done)
+		flowthings_io_http_cancel(op->api->fhttp, &op->xfer);
+
+	if (!__flowthings_io_op_pool_put(op))
+		__flowthings_io_op_free(op);
+}
+
+/*
+ * NAME: __flowthings_io_op_free
+ *
+ * Frees an operation and its buffers.
+ */
+void __flowthings_io_op_free(flowthings_io_op *op)
+{
+	if (!op) return;
+
+	flowthings_io_stream_cleanup(op->stream);
+	flowthings_io_string_cleanup(op->response);
+	if (op->request)
+		flowthings_io_string_cleanup(op->request);
+	if (op->cached)
+		flowthings_io_string_cleanup(op->cached);
+	cJSON_ArenaDelete(op->arena);
+	flowthings_io_tape_cleanup(op->tape);
+	free(op);
+}
+
+
+/***********************************************************************
+ * The Service functions
+ ***********************************************************************/
+
+/*
+ * NAME: __flowthings_io_read_op
+ *
+ * Builds the operation for flowthings_io_service_read, without starting it.
+ */
+static flowthings_io_op *__flowthings_io_read_op(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_decode_object decoder, flowthings_io_cb_decode_events events,
+		flowthings_io_cb_decode_tape tape_decoder, const flowthings_io_codec *codec, void *result,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	if (!api || !api->fhttp)
+		return NULL;
+
+	if (!id) {
+		FAIL
+		;
+	}
+
+	flowthings_io_op *op = __flowthings_io_op_init(svc, api,
+			FLOWTHINGS_IO_HTTP_METHOD_GET, FLOWTHINGS_IO_OP_DECODE_ONE, complete, user_data);
+
+	if ((!decoder && !events && !tape_decoder && !codec) || !result)
+		return __flowthings_io_op_ready(op, FLOWTHINGS_IO_ERROR_COULDNT_DECODE);
+
+	op->decoder = decoder;
+	op->result = result;
+
+	if (codec || events || tape_decoder)
+		__flowthings_io_op_use_text(op, codec, events, tape_decoder);
+
+	__flowthings_io_add_path_ext(op->path, path_ext);
+	__flowthings_io_add_id(op, id);
+
+	if (params)
+		flowthings_io_params_to_url(params, op->path, FLOWTHINGS_IO_MAX_PATH_SIZE);
+	else if (!path_ext && __flowthings_io_cacheable(api, svc))
+		__flowthings_io_op_cache_lookup(op);
+
+	return __flowthings_io_op_ready(op, FLOWTHINGS_IO_OK);
+}
+
+/*
+ * NAME: flowthings_io_service_read
+ *
+ * Perform a create on valid objects from the platform.  This function should not be called directly --
+ * one of the defines below should be called depending on the object type.  For example, to create a
+ * drop, call flowthings_io_drop_create(...)
+ *
+ * PARAMS:
+ * svc - the service type
+ * path_ext - any path extension to add in creating the URL
+ * api - the API object
+ * id - the ID of the object to delete
+ * params - any additional query string parameters to be passed to the platform
+ * decoder - the object decoder (see flowthings_io_cb_decode_object)
+ * result - must be preallocated; will be filled with the output of decode(return from platform)
+ */
+flowthings_io_result_code flowthings_io_service_read(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_decode_object decoder, void *result)
+{
+	return __flowthings_io_op_perform(__flowthings_io_read_op(svc,
+			path_ext, api, id, params, decoder, NULL, NULL, NULL, result, NULL, NULL));
+}
+
+/*
+ * NAME: flowthings_io_service_read_async
+ *
+ * The asynchronous version of flowthings_io_service_read.
+ */
+flowthings_io_op *flowthings_io_service_read_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_decode_object decoder, void *result,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	return __flowthings_io_op_submit(__flowthings_io_read_op(svc,
+			path_ext, api, id, params, decoder, NULL, NULL, NULL, result, complete, user_data));
+}
+
+/*
+ * NAME: __flowthings_io_create_op
+ *
+ * Builds the operation for flowthings_io_service_create, without starting it.
+ */
+static flowthings_io_op *__flowthings_io_create_op(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_object decoder, flowthings_io_cb_decode_events events,
+		const flowthings_io_codec *codec, void *object,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	if (!api || !api->fhttp)
+		return NULL;
+
+	flowthings_io_op *op = __flowthings_io_op_init(svc, api,
+			FLOWTHINGS_IO_HTTP_METHOD_POST, FLOWTHINGS_IO_OP_DECODE_ONE, complete, user_data);
+
+	if ((!encoder && !codec) || !object)
+		return __flowthings_io_op_ready(op, FLOWTHINGS_IO_ERROR_COULDNT_ENCODE);
+
+	op->decoder = decoder;
+	op->result = object;
+
+	__flowthings_io_add_path_ext(op->path, path_ext);
+
+	if (params)
+		flowthings_io_params_to_url(params, op->path, FLOWTHINGS_IO_MAX_PATH_SIZE);
+
+	if (codec || events)
+		__flowthings_io_op_use_text(op, codec, events, NULL);
+
+	if (codec) {
+		if (!__flowthings_io_op_encode_codec(op, object))
+			return __flowthings_io_op_ready(op, FLOWTHINGS_IO_ERROR_COULDNT_ENCODE);
+	}
+	else if (!__flowthings_io_encode(__flowthings_io_op_arena(op), encoder, object,
+			__flowthings_io_op_request(op))) {
+		return __flowthings_io_op_ready(op, FLOWTHINGS_IO_ERROR_COULDNT_ENCODE);
+	}
+
+	return __flowthings_io_op_ready(op, FLOWTHINGS_IO_OK);
+}
+
+/*
+ * NAME: flowthings_io_service_create
+ *
+ * Perform a create on valid objects from the platform.  This function should not be called directly --
+ * one of the defines below should be called depending on the object type.  For example, to create a
+ * drop, call flowthings_io_drop_create(...)
+ *
+ * PARAMS:
+ * svc - the service type
+ * path_ext - any path extension to add in creating the URL
+ * api - the API object
+ * params - any additional query string parameters to be passed to the platform
+ * encoder - the object encoder, which will be called on void *object (see flowthings_io_cb_encode_object)
+ * decoder - the object decoder (see flowthings_io_cb_decode_object)
+ * object - the object with the fields to create; encoder will be called on this object and the result
+ *     will be passed to the platform; when this function returns, object will be filled with the resulting
+ *     object from the platform
+ */
+flowthings_io_result_code flowthings_io_service_create(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_object decoder, void *object)
+{
+	return __flowthings_io_op_perform(__flowthings_io_create_op(svc,
+			path_ext, api, params, encoder, decoder, NULL, NULL, object, NULL, NULL));
+}
+
+/*
+ * NAME: flowthings_io_service_create_async
+ *
+ * The asynchronous version of flowthings_io_service_create.
+ */
+flowthings_io_op *flowthings_io_service_create_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_object decoder, void *object,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	return __flowthings_io_op_submit(__flowthings_io_create_op(svc,
+			path_ext, api, params, encoder, decoder, NULL, NULL, object, complete, user_data));
+}
+
+/*
+ * NAME: __flowthings_io_batch
+ *
+ * A batch call while its objects are being added to requests.  chunk holds the encoded objects of
+ * the next request, separated by commas, and index[first..first+count-1] their positions in
+ * objects and codes.
+ */
+typedef struct __flowthings_io_batch {
+	flowthings_io_service_type svc;
+	const char *path_ext;
+	flowthings_io_api *api;
+	flowthings_io_params *params;
+	flowthings_io_cb_decode_object decoder;
+	void **objects;
+	flowthings_io_result_code *codes;
+
+	flowthings_io_string *chunk;
+	int *index;
+	int first;
+	int count;
+} __flowthings_io_batch;
+
+/*
+ * NAME: __flowthings_io_create_batch_op
+ *
+ * Builds the operation that POSTs the next request of a batch.
+ */
+static flowthings_io_op *__flowthings_io_create_batch_op(__flowthings_io_batch *batch)
+{
+	flowthings_io_string *chunk = batch->chunk, *request;
+	flowthings_io_op *op = __flowthings_io_op_init(batch->svc, batch->api,
+			FLOWTHINGS_IO_HTTP_METHOD_POST, FLOWTHINGS_IO_OP_DECODE_BATCH, NULL, NULL);
+
+	op->decoder = batch->decoder;
+	op->results = batch->objects;
+	op->batch_index = batch->index + batch->first;
+	op->batch_count = batch->count;
+	op->batch_codes = batch->codes;
+
+	__flowthings_io_add_path_ext(op->path, batch->path_ext);
+
+	if (batch->params)
+		flowthings_io_params_to_url(batch->params, op->path, FLOWTHINGS_IO_MAX_PATH_SIZE);
+
+	request = __flowthings_io_op_request(op);
+	flowthings_io_string_append(request, "[", 1);
+	flowthings_io_string_append(request, chunk->ptr, chunk->len);
+	flowthings_io_string_append(request, "]", 1);
+
+	return __flowthings_io_op_ready(op, FLOWTHINGS_IO_OK);
+}
+
+/*
+ * NAME: __flowthings_io_batch_send
+ *
+ * Sends the next request of a batch, if it has any objects, and waits for it.  Objects the
+ * platform didn't answer for are given the request's error, or
+ * FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE if the request succeeded.
+ */
+static void __flowthings_io_batch_send(__flowthings_io_batch *batch)
+{
+	int *index = batch->index + batch->first;
+	flowthings_io_result_code code;
+	int i;
+
+	if (batch->count == 0)
+		return;
+
+	for (i = 0; i < batch->count; i++)
+		batch->codes[index[i]] = FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+
+	code = __flowthings_io_op_perform(__flowthings_io_create_batch_op(batch));
+
+	if (code != FLOWTHINGS_IO_OK)
+		for (i = 0; i < batch->count; i++)
+			batch->codes[index[i]] = code;
+
+	flowthings_io_string_reset(batch->chunk);
+	batch->first += batch->count;
+	batch->count = 0;
+}
+
+/*
+ * NAME: __flowthings_io_batch_add
+ *
+ * Adds the i-th object of a batch, encoded, to the next request, sending requests as they reach
+ * the API's batch limits.
+ */
+static void __flowthings_io_batch_add(__flowthings_io_batch *batch, int i, const char *encoded,
+		size_t len)
+{
+	/* the brackets and a comma go around each object */
+	if (batch->count > 0 && batch->chunk->len + len + 3 > batch->api->batch_max_bytes)
+		__flowthings_io_batch_send(batch);
+
+	if (batch->count > 0)
+		flowthings_io_string_append(batch->chunk, ",", 1);
+	flowthings_io_string_append(batch->chunk, encoded, len);
+
+	batch->index[batch->first + batch->count++] = i;
+
+	if (batch->count >= batch->api->batch_max_items)
+		__flowthings_io_batch_send(batch);
+}
+
+/*
+ * NAME: __flowthings_io_batch_init
+ *
+ * Sets up a batch call for count objects.
+ */
+static void __flowthings_io_batch_init(__flowthings_io_batch *batch,
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_params *params,
+		flowthings_io_cb_decode_object decoder, void *objects[], int count,
+		flowthings_io_result_code codes[])
+{
+	memset(batch, 0, sizeof(__flowthings_io_batch));
+
+	batch->svc = svc;
+	batch->path_ext = path_ext;
+	batch->api = api;
+	batch->params = params;
+	batch->decoder = decoder;
+	batch->objects = objects;
+	batch->codes = codes;
+
+	batch->index = malloc(sizeof(int) * count);
+	if (!batch->index) FAIL;
+
+	batch->chunk = flowthings_io_string_init();
+}
+
+/*
+ * NAME: __flowthings_io_batch_finish
+ *
+ * Sends the last request of a batch call and frees it.  Returns FLOWTHINGS_IO_OK if every one of
+ * its count objects was created, or else the first error.
+ */
+static flowthings_io_result_code __flowthings_io_batch_finish(__flowthings_io_batch *batch,
+		int count)
+{
+	flowthings_io_result_code code = FLOWTHINGS_IO_OK;
+	int i;
+
+	__flowthings_io_batch_send(batch);
+
+	for (i = 0; i < count && code == FLOWTHINGS_IO_OK; i++)
+		code = batch->codes[i];
+
+	flowthings_io_string_cleanup(batch->chunk);
+	free(batch->index);
+
+	return code;
+}
+
+/*
+ * NAME: flowthings_io_service_create_batch
+ *
+ * Creates many objects, splitting them into requests under the API's batch limits.
+ *
+ * PARAMS:
+ * svc - the service type
+ * path_ext - any path extension to add in creating the URL
+ * api - the API object
+ * params - any additional query string parameters to be passed to the platform
+ * encoder - the object encoder, which will be called on each object (see flowthings_io_cb_encode_object)
+ * decoder - the object decoder (see flowthings_io_cb_decode_object), or NULL
+ * objects - the objects to create; each one is filled with the resulting object from the platform
+ * object_count - the number of objects
+ * results - if not NULL, filled with the result for each object
+ */
+flowthings_io_result_code flowthings_io_service_create_batch(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_object decoder,
+		void *objects[], int object_count,
+		flowthings_io_result_code results[])
+{
+	flowthings_io_result_code code, *codes = results;
+	flowthings_io_string *encoded;
+	cJSON_Arena *arena;
+	__flowthings_io_batch batch;
+	int i;
+
+	if (!api || !api->fhttp)
+		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+
+	if (!encoder || !objects || object_count < 0)
+		return FLOWTHINGS_IO_ERROR_COULDNT_ENCODE;
+
+	if (object_count == 0)
+		return FLOWTHINGS_IO_OK;
+
+	if (!codes) {
+		codes = malloc(sizeof(flowthings_io_result_code) * object_count);
+		if (!codes) FAIL;
+	}
+
+	__flowthings_io_batch_init(&batch, svc, path_ext, api, params, decoder, objects,
+			object_count, codes);
+
+	/* each object is built in the same arena and written into the same buffer, then copied into
+	 * the request */
+	encoded = flowthings_io_string_init();
+	arena = __flowthings_io_arena_for(api, decoder) ? cJSON_ArenaCreate() : NULL;
+
+	for (i = 0; i < object_count; i++) {
+
+		flowthings_io_string_reset(encoded);
+
+		if (!objects[i] || !__flowthings_io_encode(arena, encoder, objects[i], encoded)) {
+			codes[i] = FLOWTHINGS_IO_ERROR_COULDNT_ENCODE;
+			continue;
+		}
+
+		__flowthings_io_batch_add(&batch, i, encoded->ptr, encoded->len);
+	}
+
+	flowthings_io_string_cleanup(encoded);
+	cJSON_ArenaDelete(arena);
+
+	code = __flowthings_io_batch_finish(&batch, object_count);
+
+	if (codes != results)
+		free(codes);
+
+	return code;
+}
+
+/*
+ * NAME: __flowthings_io_service_create_encoded
+ *
+ * Creates objects that have already been encoded to JSON, splitting them into requests under the
+ * API's batch limits.
+ */
+flowthings_io_result_code __flowthings_io_service_create_encoded(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_params *params,
+		char *encoded[], int count,
+		flowthings_io_result_code results[])
+{
+	__flowthings_io_batch batch;
+	int i;
+
+	if (!api || !api->fhttp)
+		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+
+	if (count <= 0)
+		return FLOWTHINGS_IO_OK;
+
+	__flowthings_io_batch_init(&batch, svc, path_ext, api, params, NULL, NULL, count, results);
+
+	for (i = 0; i < count; i++)
+		__flowthings_io_batch_add(&batch, i, encoded[i], strlen(encoded[i]));
+
+	return __flowthings_io_batch_finish(&batch, count);
+}
+
+/*
+ * NAME: __flowthings_io_update_op
+ *
+ * Builds the operation for flowthings_io_service_update, without starting it.
+ */
+static flowthings_io_op *__flowthings_io_update_op(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_object decoder, flowthings_io_cb_decode_events events,
+		const flowthings_io_codec *codec, void *object,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	if (!api || !api->fhttp)
+		return NULL;
+
+	if (!id) {
+		FAIL
+		;
+	}
+
+	flowthings_io_op *op = __flowthings_io_op_init(svc, api,
+			FLOWTHINGS_IO_HTTP_METHOD_PUT, FLOWTHINGS_IO_OP_DECODE_ONE, complete, user_data);
+
+	if ((!encoder && !codec) || !object)
+		return __flowthings_io_op_ready(op, FLOWTHINGS_IO_ERROR_COULDNT_ENCODE);
+
+	op->decoder = decoder;
+	op->result = object;
+
+	__flowthings_io_add_path_ext(op->path, path_ext);
+	__flowthings_io_add_id(op, id);
+
+	if (__flowthings_io_cacheable(api, svc))
+		op->cache_use = FLOWTHINGS_IO_OP_CACHE_INVALIDATE;
+
+	if (params)
+		flowthings_io_params_to_url(params, op->path, FLOWTHINGS_IO_MAX_PATH_SIZE);
+
+	if (codec || events)
+		__flowthings_io_op_use_text(op, codec, events, NULL);
+
+	if (codec) {
+		if (!__flowthings_io_op_encode_codec(op, object))
+			return __flowthings_io_op_ready(op, FLOWTHINGS_IO_ERROR_COULDNT_ENCODE);
+	}
+	else if (!__flowthings_io_encode(__flowthings_io_op_arena(op), encoder, object,
+			__flowthings_io_op_request(op))) {
+		return __flowthings_io_op_ready(op, FLOWTHINGS_IO_ERROR_COULDNT_ENCODE);
+	}
+
+	return __flowthings_io_op_ready(op, FLOWTHINGS_IO_OK);
+}
+
+/*
+ * NAME: flowthings_io_service_update
+ *
+ * Perform an update on valid objects from the platform.  This function should not be called directly --
+ * one of the defines below should be called depending on the object type.  For example, to update a
+ * drop, call flowthings_io_drop_update(...)
+ *
+ * PARAMS:
+ * svc - the service type
+ * path_ext - any path extension to add in creating the URL
+ * api - the API object
+ * id - the ID of the object to delete
+ * params - any additional query string parameters to be passed to the platform
+ * encoder - the object encoder, which will be called on void *object (see flowthings_io_cb_encode_object)
+ * decoder - the object decoder (see flowthings_io_cb_decode_object)
+ * object - the object with the fields to update; encoder will be called on this object and the result
+ *     will be passed to the platform; when this function returns, this will be filled with the updated
+ *     object from the platform
+ */
+flowthings_io_result_code flowthings_io_service_update(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_object decoder, void *object)
+{
+	return __flowthings_io_op_perform(__flowthings_io_update_op(svc,
+			path_ext, api, id, params, encoder, decoder, NULL, NULL, object, NULL, NULL));
+}
+
+/*
+ * NAME: flowthings_io_service_update_async
+ *
+ * The asynchronous version of flowthings_io_service_update.
+ */
+flowthings_io_op *flowthings_io_service_update_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_object decoder, void *object,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	return __flowthings_io_op_submit(__flowthings_io_update_op(svc,
+			path_ext, api, id, params, encoder, decoder, NULL, NULL, object, complete, user_data));
+}
+
+/*
+ * NAME: __flowthings_io_delete_op
+ *
+ * Builds the operation for flowthings_io_service_delete, without starting it.
+ */
+static flowthings_io_op *__flowthings_io_delete_op(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	if (!api || !api->fhttp)
+		return NULL;
+
+	if (!id) {
+		FAIL
+		;
+	}
+
+	flowthings_io_op *op = __flowthings_io_op_init(svc, api,
+			FLOWTHINGS_IO_HTTP_METHOD_DELETE, FLOWTHINGS_IO_OP_DECODE_NONE, complete, user_data);
+
+	__flowthings_io_add_path_ext(op->path, path_ext);
+	__flowthings_io_add_id(op, id);
+
+	if (__flowthings_io_cacheable(api, svc))
+		op->cache_use = FLOWTHINGS_IO_OP_CACHE_INVALIDATE;
+
+	if (params)
+		flowthings_io_params_to_url(params, op->path, FLOWTHINGS_IO_MAX_PATH_SIZE);
+
+	return __flowthings_io_op_ready(op, FLOWTHINGS_IO_OK);
+}
+
+/*
+ * NAME: flowthings_io_service_delete
+ *
+ * Perform a delete on valid objects from the platform.  This function should not be called directly --
+ * one of the defines below should be called depending on the object type.  For example, to delete a
+ * drop, call flowthings_io_drop_delete(...)
+ *
+ * PARAMS:
+ * svc - the service type
+ * path_ext - any path extension to add in creating the URL
+ * api - the API object
+ * id - the ID of the object to delete
+ * params - any additional query string parameters to be passed to the platform
+ */
+flowthings_io_result_code flowthings_io_service_delete(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params)
+{
+	return __flowthings_io_op_perform(__flowthings_io_delete_op(svc,
+			path_ext, api, id, params, NULL, NULL));
+}
+
+/*
+ * NAME: flowthings_io_service_delete_async
+ *
+ * The asynchronous version of flowthings_io_service_delete.
+ */
+flowthings_io_op *flowthings_io_service_delete_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	return __flowthings_io_op_submit(__flowthings_io_delete_op(svc,
+			path_ext, api, id, params, complete, user_data));
+}
+
+
+/***********************************************************************
+ * The drop-only service functions
+ ***********************************************************************/
+
+/*
+ * NAME: __flowthings_io_find_op
+ *
+ * Builds the operation for flowthings_io_service_find, without starting it.
+ */
+static flowthings_io_op *__flowthings_io_find_op(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, flowthings_io_cb_decode_object decoder,
+		flowthings_io_cb_decode_events events, flowthings_io_cb_decode_tape tape_decoder,
+		const flowthings_io_codec *codec,
+		void *result[],
+		int *result_count,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	if (!api || !api->fhttp)
+		return NULL;
+
+	flowthings_io_op *op = __flowthings_io_op_init(svc, api,
+			FLOWTHINGS_IO_HTTP_METHOD_GET, FLOWTHINGS_IO_OP_DECODE_MANY, complete, user_data);
+
+	if ((!decoder && !events && !tape_decoder && !codec) || !result || !result_count)
+		return __flowthings_io_op_ready(op, FLOWTHINGS_IO_ERROR_COULDNT_DECODE);
+
+	op->decoder = decoder;
+	op->results = result;
+	op->result_count = result_count;
+
+	if (codec || events || tape_decoder)
+		__flowthings_io_op_use_text(op, codec, events, tape_decoder);
+
+	__flowthings_io_add_path_ext(op->path, path_ext);
+
+	if (params)
+		flowthings_io_params_to_url(params, op->path, FLOWTHINGS_IO_MAX_PATH_SIZE);
+
+	if (filter)
+		__flowthings_io_add_query(api, op->path, "filter", filter);
+
+	return __flowthings_io_op_ready(op, FLOWTHINGS_IO_OK);
+}
+
+/*
+ * NAME: flowthings_io_service_find
+ *
+ * Perform a find on drops from the platform.  This function should not be called directly --
+ * one of the defines below should be called depending on the object type.
+ *
+ * PARAMS:
+ * svc - the service type
+ * path_ext - any path extension to add in creating the URL
+ * api - the API object
+ * filter - a filter string for drops (see https://flowthings.io/docs/flow-filter-language)
+ * params - any additional query string parameters to be passed to the platform
+ * decoder - the object decoder (see flowthings_io_cb_decode_object)
+ * result - the array of result pointers; this array and all result objects must be pre-allocated
+ *     and initialized; decode will be performed on all platform results and they will be placed
+ *     in the result array
+ * result_count - must initially be set to the allocated size of the result array; when this
+ *     function completes, it will be set to the number of items in the array
+ */
+flowthings_io_result_code flowthings_io_service_find(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, flowthings_io_cb_decode_object decoder,
+		void *result[],
+		int *result_count)
+{
+	return __flowthings_io_op_perform(__flowthings_io_find_op(svc,
+			path_ext, api, filter, params, decoder, NULL, NULL, NULL, result, result_count,
+			NULL, NULL));
+}
+
+/*
+ * NAME: flowthings_io_service_find_async
+ *
+ * The asynchronous version of flowthings_io_service_find.
+ */
+flowthings_io_op *flowthings_io_service_find_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, flowthings_io_cb_decode_object decoder,
+		void *result[],
+		int *result_count,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	return __flowthings_io_op_submit(__flowthings_io_find_op(svc,
+			path_ext, api, filter, params, decoder, NULL, NULL, NULL, result, result_count,
+			complete, user_data));
+}
+
+/*
+ * NAME: flowthings_io_find_iter
+ *
+ * A paged find.  Each page is fetched with its own transfer into its own buffer; while the
+ * objects of one page are handed out, the other page's transfer fetches the next one.
+ */
+typedef struct __flowthings_io_find_page {
+	flowthings_io_http_xfer xfer;
+	char path[FLOWTHINGS_IO_MAX_PATH_SIZE];
+	flowthings_io_string *response;
+	BOOL pending;
+} __flowthings_io_find_page;
+
+struct flowthings_io_find_iter {
+
+	flowthings_io_api *api;
+	flowthings_io_cb_decode_object decoder;
+	const char *base_path;
+
+	/* the path with the filter and parameters, which each page adds start and limit to */
+	char path[FLOWTHINGS_IO_MAX_PATH_SIZE];
+	int page_size;
+	long start;
+
+	/* the ID of the first object of the last page, to notice the same page coming back */
+	char first_id[FLOWTHINGS_IO_ID_LEN];
+
+	__flowthings_io_find_page pages[2];
+	int current;
+
+	/* the page being handed out, its next object, and the arena it is kept in, if the API uses
+	 * arenas */
+	cJSON *root;
+	cJSON *item;
+	cJSON_Arena *arena;
+
+	flowthings_io_result_code code;
+};
+
+/*
+ * NAME: __flowthings_io_find_iter_fetch
+ *
+ * Starts fetching the next page into one of the iterator's pages.
+ */
+static void __flowthings_io_find_iter_fetch(flowthings_io_find_iter *iter,
+		__flowthings_io_find_page *page)
+{
+	char value[32];
+
+	strcpy(page->path, iter->path);
+
+	snprintf(value, sizeof(value), "%ld", iter->start);
+	__flowthings_io_add_query(iter->api, page->path, "start", value);
+	snprintf(value, sizeof(value), "%d", iter->page_size);
+	__flowthings_io_add_query(iter->api, page->path, "limit", value);
+
+	iter->start += iter->page_size;
+
+	flowthings_io_string_reset(page->response);
+	memset(&page->xfer, 0, sizeof(flowthings_io_http_xfer));
+	page->xfer.method = FLOWTHINGS_IO_HTTP_METHOD_GET;
+	page->xfer.base_path = iter->base_path;
+	page->xfer.path = page->path;
+	page->xfer.response = page->response;
+	page->pending = TRUE;
+
+	flowthings_io_http_submit(iter->api->fhttp, &page->xfer);
+}
+
+/*
+ * NAME: __flowthings_io_find_iter_repeated
+ *
+ * Returns TRUE if a page starts with the same object as the page before it, which means the
+ * server didn't honour start, and remembers the page's first object for the next one.
+ */
+static BOOL __flowthings_io_find_iter_repeated(flowthings_io_find_iter *iter, cJSON *first)
+{
+	cJSON *id = cJSON_GetObjectItem(first, "id");
+
+	if (!id || id->type != cJSON_String) {
+		iter->first_id[0] = '\0';
+		return FALSE;
+	}
+
+	if (iter->first_id[0] && !strcmp(iter->first_id, id->valuestring))
+		return TRUE;
+
+	iter->first_id[0] = '\0';
+	flowthings_io_strcat(iter->first_id, id->valuestring, FLOWTHINGS_IO_ID_LEN);
+
+	return FALSE;
+}
+
+/*
+ * NAME: __flowthings_io_find_iter_turn
+ *
+ * Waits for the next page and makes it the one being handed out, and if it's full, starts
+ * fetching the one after it.  Returns FALSE if there are no more pages or the page failed.
+ */
+static BOOL __flowthings_io_find_iter_turn(flowthings_io_find_iter *iter)
+{
+	__flowthings_io_find_page *page = &iter->pages[iter->current];
+	cJSON_Arena *prev;
+	cJSON *body;
+
+	if (iter->arena)
+		cJSON_ArenaReset(iter->arena);
+	else
+		cJSON_Delete(iter->root);
+	iter->root = NULL;
+	iter->item = NULL;
+
+	if (!page->pending)
+		return FALSE;
+
+	while (!page->xfer.done)
+		flowthings_io_api_poll(iter->api, 1000);
+
+	page->pending = FALSE;
+
+	iter->code = __flowthings_io_result_from_http(page->xfer.http_response_code);
+	if (iter->code != FLOWTHINGS_IO_OK)
+		return FALSE;
+
+	prev = cJSON_ArenaUse(iter->arena);
+	iter->root = cJSON_ParseInSitu(page->response->ptr);
+	cJSON_ArenaUse(prev);
+	body = iter->root ? cJSON_GetObjectItem(iter->root, "body") : NULL;
+
+	if (!body || body->type != cJSON_Array) {
+		iter->code = FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+		return FALSE;
+	}
+
+	/* an empty page, or the last page again, is the end */
+	if (!body->child || __flowthings_io_find_iter_repeated(iter, body->child))
+		return FALSE;
+
+	iter->item = body->child;
+	iter->current ^= 1;
+
+	/* a short page is the last one */
+	if (cJSON_GetArraySize(body) >= iter->page_size)
+		__flowthings_io_find_iter_fetch(iter, &iter->pages[iter->current]);
+
+	return TRUE;
+}
+
+/*
+ * NAME: flowthings_io_service_find_iter_open
+ *
+ * Starts a find that pages through every matching object.
+ *
+ * PARAMS:
+ * svc - the service type
+ * path_ext - any path extension to add in creating the URL
+ * api - the API object
+ * filter - a filter string for drops
+ * params - any additional query string parameters, other than start and limit
+ * decoder - the object decoder
+ * page_size - the number of objects to ask for at a time, or 0 for the default
+ */
+flowthings_io_find_iter *flowthings_io_service_find_iter_open(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, flowthings_io_cb_decode_object decoder,
+		int page_size)
+{
+	flowthings_io_find_iter *iter;
+	int i;
+
+	if (!api || !api->fhttp)
+		return NULL;
+
+	iter = malloc(sizeof(flowthings_io_find_iter));
+	if (!iter) FAIL;
+
+	memset(iter, 0, sizeof(flowthings_io_find_iter));
+	iter->api = api;
+	iter->decoder = decoder;
+	iter->base_path = __flowthings_io_service_info[svc].base_path;
+	iter->page_size = page_size > 0 ? page_size : FLOWTHINGS_IO_FIND_ITER_PAGE_SIZE;
+	iter->code = decoder ? FLOWTHINGS_IO_OK : FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+	iter->arena = __flowthings_io_arena_for(api, decoder) ? cJSON_ArenaCreate() : NULL;
+
+	for (i = 0; i < 2; i++)
+		iter->pages[i].response = flowthings_io_string_init();
+
+	__flowthings_io_add_path_ext(iter->path, path_ext);
+
+	if (params)
+		flowthings_io_params_to_url(params, iter->path, FLOWTHINGS_IO_MAX_PATH_SIZE);
+
+	if (filter)
+		__flowthings_io_add_query(api, iter->path, "filter", filter);
+
+	if (iter->code == FLOWTHINGS_IO_OK)
+		__flowthings_io_find_iter_fetch(iter, &iter->pages[0]);
+
+	return iter;
+}
+
+/*
+ * NAME: flowthings_io_find_iter_next
+ *
+ * Decodes the next object, waiting for its page if it hasn't arrived yet.
+ *
+ * PARAMS:
+ * iter - the iterator
+ * result - filled with the output of decode
+ */
+BOOL flowthings_io_find_iter_next(flowthings_io_find_iter *iter, void *result)
+{
+	__flowthings_io_find_page *next;
+	cJSON_Arena *prev;
+	cJSON *item;
+	BOOL decoded;
+
+	if (!iter || iter->code != FLOWTHINGS_IO_OK)
+		return FALSE;
+
+	while (!iter->item) {
+		if (!__flowthings_io_find_iter_turn(iter))
+			return FALSE;
+	}
+
+	item = iter->item;
+	iter->item = item->next;
+
+	/* keep the next page moving while this one is decoded */
+	next = &iter->pages[iter->current];
+	if (next->pending && !next->xfer.done)
+		flowthings_io_api_poll(iter->api, 0);
+
+	prev = cJSON_ArenaUse(iter->arena);
+	decoded = iter->decoder(item, result);
+	cJSON_ArenaUse(prev);
+
+	if (!decoded) {
+		iter->code = FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * NAME: flowthings_io_find_iter_result
+ *
+ * Returns FLOWTHINGS_IO_OK, or the error that stopped the find.
+ */
+flowthings_io_result_code flowthings_io_find_iter_result(flowthings_io_find_iter *iter)
+{
+	return iter ? iter->code : FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+}
+
+/*
+ * NAME: flowthings_io_find_iter_close
+ *
+ * Frees an iterator, abandoning any page that is still being fetched.
+ */
+void flowthings_io_find_iter_close(flowthings_io_find_iter *iter)
+{
+	int i;
+
+	if (!iter) return;
+
+	for (i = 0; i < 2; i++) {
+		if (iter->pages[i].pending)
+			flowthings_io_http_cancel(iter->api->fhttp, &iter->pages[i].xfer);
+		flowthings_io_string_cleanup(iter->pages[i].response);
+	}
+
+	if (iter->arena)
+		cJSON_ArenaDelete(iter->arena);
+	else
+		cJSON_Delete(iter->root);
+	free(iter);
+}
+
+/*
+ * NAME: __flowthings_io_find_many_entry
+ *
+ * Writes the entry of an MGET body for one flow of an idlist, { "flowId": ..., "params": ... }.
+ */
+static void __flowthings_io_find_many_entry(flowthings_io_json_writer *writer,
+		flowthings_io_idlistitem *item)
+{
+	flowthings_io_params *params = (flowthings_io_params *)item->item;
+	flowthings_io_param *param;
+
+	flowthings_io_json_begin_object(writer);
+	flowthings_io_json_key(writer, "flowId");
+	flowthings_io_json_string(writer, item->id);
+
+	flowthings_io_json_key(writer, "params");
+	flowthings_io_json_begin_object(writer);
+
+	for (param = params ? params->start : NULL; param != NULL; param = param->next) {
+		flowthings_io_json_key(writer, param->key->ptr);
+		flowthings_io_json_string(writer, param->value->ptr);
+	}
+
+	flowthings_io_json_end_object(writer);
+	flowthings_io_json_end_object(writer);
+}
+
+/*
+ * NAME: __flowthings_io_op_on_send
+ *
+ * The HTTP layer send callback for an MGET whose body is written as it is sent.  Once everything
+ * in the request buffer has been sent, the buffer is reused for the next flow's entry.
+ */
+static size_t __flowthings_io_op_on_send(flowthings_io_http_xfer *xfer, char *buf, size_t size)
+{
+	flowthings_io_op *op = (flowthings_io_op *)xfer->user_data;
+	flowthings_io_string *request = op->request;
+	size_t n, sent = 0;
+
+	while (sent < size) {
+
+		if (op->send_offset == request->len) {
+
+			/* the array has been closed and sent */
+			if (op->send_writer.depth == 0)
+				break;
+
+			flowthings_io_string_reset(request);
+			op->send_offset = 0;
+
+			if (op->send_item != NULL && op->send_count != 0) {
+				__flowthings_io_find_many_entry(&op->send_writer, op->send_item);
+				op->send_item = op->send_item->next;
+				op->send_count--;
+			}
+			else {
+				flowthings_io_json_end_array(&op->send_writer);
+			}
+		}
+
+		n = request->len - op->send_offset;
+		if (n > size - sent)
+			n = size - sent;
+
+		memcpy(buf + sent, request->ptr + op->send_offset, n);
+		op->send_offset += n;
+		sent += n;
+	}
+
+	return sent;
+}
+
+/*
+ * NAME: __flowthings_io_op_send_start
+ *
+ * Starts an MGET body that is written as it is sent: only the opening bracket is written here.
+ */
+static void __flowthings_io_op_send_start(flowthings_io_op *op)
+{
+	flowthings_io_json_writer_init(&op->send_writer, __flowthings_io_op_request(op));
+	flowthings_io_json_begin_array(&op->send_writer);
+
+	op->send_item = op->send_first;
+	op->send_count = op->send_first_count;
+	op->send_offset = 0;
+}
+
+/*
+ * NAME: __flowthings_io_op_on_rewind
+ *
+ * The HTTP layer rewind callback for an MGET whose body is written as it is sent; writes the body
+ * again from the first flow.
+ */
+static BOOL __flowthings_io_op_on_rewind(flowthings_io_http_xfer *xfer)
+{
+	flowthings_io_op *op = (flowthings_io_op *)xfer->user_data;
+
+	flowthings_io_string_reset(op->request);
+	__flowthings_io_op_send_start(op);
+
+	return TRUE;
+}
+
+/*
+ * NAME: __flowthings_io_find_many_body
+ *
+ * Sets up the MGET body of an operation for count flows of an idlist, starting at item, or for
+ * all of them if count is negative.  If the API streams uploads, only the opening bracket is
+ * written here, and the rest as the body is sent.  Returns FALSE if the body couldn't be written.
+ */
+static BOOL __flowthings_io_find_many_body(flowthings_io_op *op, flowthings_io_idlistitem *item,
+		int count)
+{
+	flowthings_io_json_writer *writer = &op->send_writer;
+
+	if (op->api->stream_upload) {
+		op->send_first = item;
+		op->send_first_count = count;
+		__flowthings_io_op_send_start(op);
+		op->xfer.on_send = __flowthings_io_op_on_send;
+		op->xfer.on_rewind = __flowthings_io_op_on_rewind;
+		return TRUE;
+	}
+
+	flowthings_io_json_writer_init(writer, __flowthings_io_op_request(op));
+	flowthings_io_json_begin_array(writer);
+
+	while (item != NULL && count-- != 0) {
+		__flowthings_io_find_many_entry(writer, item);
+		item = item->next;
+	}
+
+	flowthings_io_json_end_array(writer);
+
+	return flowthings_io_json_writer_done(writer);
+}
+
+/*
+ * NAME: __flowthings_io_find_many_op
+ *
+ * Builds the operation for flowthings_io_service_find_many, without starting it.
+ */
+static flowthings_io_op *__flowthings_io_find_many_op(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_cb_decode_object decoder,
+		flowthings_io_idlist *idlist,
+		void *result[],
+		int *result_count,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	if (!api || !api->fhttp)
+		return NULL;
+
+	flowthings_io_op *op = __flowthings_io_op_init(svc, api,
+			FLOWTHINGS_IO_HTTP_METHOD_MGET, FLOWTHINGS_IO_OP_DECODE_MANY, complete, user_data);
+
+	if (!decoder || !result || !result_count)
+		return __flowthings_io_op_ready(op, FLOWTHINGS_IO_ERROR_COULDNT_DECODE);
+
+	if (!idlist)
+		return __flowthings_io_op_ready(op, FLOWTHINGS_IO_ERROR_BAD_REQUEST);
+
+	op->decoder = decoder;
+	op->results = result;
+	op->result_count = result_count;
+
+	__flowthings_io_add_path_ext(op->path, path_ext);
+	flowthings_io_strcat(op->path, "?flatten=flat", FLOWTHINGS_IO_MAX_PATH_SIZE);
+
+	if (!__flowthings_io_find_many_body(op, idlist->start, -1))
+		return __flowthings_io_op_ready(op, FLOWTHINGS_IO_ERROR_COULDNT_ENCODE);
+
+	return __flowthings_io_op_ready(op, FLOWTHINGS_IO_OK);
+}
+
+/*
+ * NAME: flowthings_io_service_find_many
+ *
+ * Perform a find_many on drops from the platform.  This function should not be called directly --
+ * one of the defines below should be called depending on the object type.
+ *
+ * PARAMS:
+ * svc - the service type
+ * path_ext - any path extension to add in creating the URL
+ * api - the API object
+ * decoder - the object decoder (see flowthings_io_cb_decode_object)
+ * idlist - the list of [ flowId => { param1=value, param2=value, ... } ]; idlist must
+ *     have flowthings_io_param as the void* item value
+ * result - the array of result pointers; this array and all result objects must be pre-allocated
+ *     and initialized; decode will be performed on all platform results and they will be placed
+ *     in the result array
+ * result_count - must initially be set to the allocated size of the result array; when this
+ *     function completes, it will be set to the number of items in the array
+ */
+flowthings_io_result_code flowthings_io_service_find_many(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_cb_decode_object decoder,
+		flowthings_io_idlist *idlist,
+		void *result[],
+		int *result_count)
+{
+	return __flowthings_io_op_perform(__flowthings_io_find_many_op(svc,
+			path_ext, api, decoder, idlist, result, result_count, NULL, NULL));
+}
+
+/*
+ * NAME: flowthings_io_service_find_many_async
+ *
+ * The asynchronous version of flowthings_io_service_find_many.
+ */
+flowthings_io_op *flowthings_io_service_find_many_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_cb_decode_object decoder,
+		flowthings_io_idlist *idlist,
+		void *result[],
+		int *result_count,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	return __flowthings_io_op_submit(__flowthings_io_find_many_op(svc,
+			path_ext, api, decoder, idlist, result, result_count,
+			complete, user_data));
+}
+
+/*
+ * NAME: __flowthings_io_find_many_shards
+ *
+ * A sharded find_many while its requests are in flight.  Each shard's objects are decoded into
+ * results[result_count..] as it completes.
+ */
+typedef struct __flowthings_io_find_many_shards {
+	flowthings_io_cb_decode_object decoder;
+	void **results;
+	int result_size;
+	int result_count;
+
+	flowthings_io_find_many_flow *flows;
+	int in_flight;
+} __flowthings_io_find_many_shards;
+
+/*
+ * NAME: __flowthings_io_find_many_shard
+ *
+ * One request of a sharded find_many: count flows of the idlist starting at item, whose outcomes
+ * go to flows[first..first+count-1].
+ */
+typedef struct __flowthings_io_find_many_shard {
+	__flowthings_io_find_many_shards *shards;
+	flowthings_io_idlistitem *item;
+	int first;
+	int count;
+} __flowthings_io_find_many_shard;
+
+/*
+ * NAME: __flowthings_io_find_many_shard_done
+ *
+ * The completion callback for one shard's request.  Without flatten=flat, the body of an MGET
+ * response is an object with an array of objects for each flow.
+ */
+static void __flowthings_io_find_many_shard_done(flowthings_io_op *op,
+		flowthings_io_result_code code, void *user_data)
+{
+	__flowthings_io_find_many_shard *shard = (__flowthings_io_find_many_shard *)user_data;
+	__flowthings_io_find_many_shards *shards = shard->shards;
+	flowthings_io_find_many_flow *flow;
+	cJSON *root = NULL, *body = NULL, *array, *item;
+	cJSON_Arena *arena = __flowthings_io_op_arena_for(op, shards->decoder);
+	cJSON_Arena *prev = cJSON_ArenaUse(arena);
+	int i;
+
+	if (code == FLOWTHINGS_IO_OK) {
+		root = cJSON_ParseInSitu(op->response->ptr);
+		body = root ? cJSON_GetObjectItem(root, "body") : NULL;
+
+		if (!body || body->type != cJSON_Object)
+			code = FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+	}
+
+	for (i = 0; i < shard->count; i++) {
+
+		flow = &shards->flows[shard->first + i];
+		flow->code = code;
+		flow->first = shards->result_count;
+		flow->count = 0;
+
+		if (code != FLOWTHINGS_IO_OK)
+			continue;
+
+		array = cJSON_GetObjectItem(body, flow->flow_id);
+
+		if (array && array->type != cJSON_Array) {
+			flow->code = FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+			continue;
+		}
+
+		for (item = array ? array->child : NULL;
+				item && shards->result_count < shards->result_size; item = item->next) {
+
+			if (!shards->decoder(item, &shards->results[shards->result_count])) {
+				flow->code = FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+				break;
+			}
+
+			shards->result_count++;
+			flow->count++;
+		}
+	}
+
+	__flowthings_io_json_release(arena, prev, root);
+	shards->in_flight--;
+
+	flowthings_io_op_cleanup(op);
+}
+
+/*
+ * NAME: __flowthings_io_find_many_shard_op
+ *
+ * Builds the operation for one shard of a sharded find_many, without starting it.
+ */
+static flowthings_io_op *__flowthings_io_find_many_shard_op(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, __flowthings_io_find_many_shard *shard)
+{
+	flowthings_io_op *op = __flowthings_io_op_init(svc, api, FLOWTHINGS_IO_HTTP_METHOD_MGET,
+			FLOWTHINGS_IO_OP_DECODE_NONE, __flowthings_io_find_many_shard_done, shard);
+
+	__flowthings_io_add_path_ext(op->path, path_ext);
+
+	if (!__flowthings_io_find_many_body(op, shard->item, shard->count))
+		return __flowthings_io_op_ready(op, FLOWTHINGS_IO_ERROR_COULDNT_ENCODE);
+
+	return __flowthings_io_op_ready(op, FLOWTHINGS_IO_OK);
+}
+
+/*
+ * NAME: flowthings_io_service_find_many_sharded
+ *
+ * Performs a find_many as several requests at once, splitting the flows into shards.
+ *
+ * PARAMS:
+ * svc - the service type
+ * path_ext - any path extension to add in creating the URL
+ * api - the API object
+ * decoder - the object decoder
+ * idlist - the list of [ flowId => { param1=value, param2=value, ... } ]
+ * shard_size - the most flows in one request, or 0 for the default
+ * max_in_flight - the most requests at once, or 0 for the default
+ * result - the array of result pointers
+ * result_count - the allocated size of result, set to the number of items in it
+ * flows - if not NULL, filled with the outcome for each flow in idlist
+ */
+flowthings_io_result_code flowthings_io_service_find_many_sharded(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_cb_decode_object decoder,
+		flowthings_io_idlist *idlist,
+		int shard_size, int max_in_flight,
+		void *result[],
+		int *result_count,
+		flowthings_io_find_many_flow flows[])
+{
+	__flowthings_io_find_many_shards shards;
+	__flowthings_io_find_many_shard *shard_list;
+	flowthings_io_idlistitem *item;
+	flowthings_io_result_code code = FLOWTHINGS_IO_OK;
+	int flow_count = 0, shard_count, next = 0, i, j;
+
+	if (!api || !api->fhttp)
+		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
 
-	char path[FLOWTHINGS_IO_MAX_PATH_SIZE] = "";
-	flowthings_io_string *response = flowthings_io_string_init();
+	if (!decoder || !result || !result_count)
+		return FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
 
-	struct __flowthings_io_service_info_item *service_item =
-			&__flowthings_io_service_info[svc];
+	if (!idlist)
+		return FLOWTHINGS_IO_ERROR_BAD_REQUEST;
 
-	api->fhttp->base_path = service_item->base_path;
+	if (shard_size <= 0)
+		shard_size = FLOWTHINGS_IO_FIND_MANY_SHARD_SIZE;
 
-	__flowthings_io_add_path_ext(path, path_ext);
+	if (max_in_flight <= 0)
+		max_in_flight = FLOWTHINGS_IO_FIND_MANY_MAX_IN_FLIGHT;
 
-	if (my_params)
-		flowthings_io_params_to_url(my_params, path, FLOWTHINGS_IO_MAX_PATH_SIZE);
+	for (item = idlist->start; item; item = item->next)
+		flow_count++;
 
-	int http_response_code = flowthings_io_http_request(api->fhttp,
-			FLOWTHINGS_IO_HTTP_METHOD_GET, path, NULL, response);
+	memset(&shards, 0, sizeof(__flowthings_io_find_many_shards));
+	shards.decoder = decoder;
+	shards.results = result;
+	shards.result_size = *result_count;
 
-	if (http_response_code < 200 || http_response_code >= 400) {
-		switch (http_response_code) {
-		case 400:
-			return FLOWTHINGS_IO_ERROR_BAD_REQUEST;
-		case 403:
-			return FLOWTHINGS_IO_ERROR_FORBIDDEN;
-		case 404:
-			return FLOWTHINGS_IO_ERROR_NOT_FOUND;
-		case 500:
-			return FLOWTHINGS_IO_ERROR_SERVER_ERROR;
-		default:
-			return FLOWTHINGS_IO_ERROR_UNKNOWN;
-		}
+	if (flow_count == 0) {
+		*result_count = 0;
+		return FLOWTHINGS_IO_OK;
 	}
 
-	cJSON *root = cJSON_Parse(response->ptr);
-	flowthings_io_string_cleanup(response);
+	shards.flows = flows;
+	if (!shards.flows) {
+		shards.flows = malloc(sizeof(flowthings_io_find_many_flow) * flow_count);
+		if (!shards.flows) FAIL;
+	}
 
-	cJSON *body = cJSON_GetObjectItem(root, "body");
-	if (!body)
-		return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+	shard_count = (flow_count + shard_size - 1) / shard_size;
+	shard_list = malloc(sizeof(__flowthings_io_find_many_shard) * shard_count);
+	if (!shard_list) FAIL;
 
-	for (i = 0; i < *result_count && body->type == cJSON_Array && i < cJSON_GetArraySize(body); i++) {
+	for (i = 0, item = idlist->start; i < shard_count; i++) {
 
-		code = decoder(cJSON_GetArrayItem(body, i), &result[i]) ? FLOWTHINGS_IO_OK : FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
-		if (code != FLOWTHINGS_IO_OK) break;
+		shard_list[i].shards = &shards;
+		shard_list[i].item = item;
+		shard_list[i].first = i * shard_size;
+		shard_list[i].count = 0;
 
+		for (j = 0; j < shard_size && item; j++, item = item->next) {
+			shards.flows[i * shard_size + j].flow_id = item->id;
+			shard_list[i].count++;
+		}
 	}
 
-	*result_count = i;
+	/* shards are decoded by their callbacks as they complete */
+	while (next < shard_count || shards.in_flight > 0) {
 
-	cJSON_Delete(root);
+		while (next < shard_count && shards.in_flight < max_in_flight) {
+			shards.in_flight++;
+			__flowthings_io_op_submit(__flowthings_io_find_many_shard_op(svc, path_ext, api,
+					&shard_list[next++]));
+		}
 
-	if (!params) {
-		flowthings_io_params_cleanup(my_params);
+		flowthings_io_api_poll(api, 1000);
 	}
 
+	*result_count = shards.result_count;
+
+	for (i = 0; i < flow_count && code == FLOWTHINGS_IO_OK; i++)
+		code = shards.flows[i].code;
+
+	if (shards.flows != flows)
+		free(shards.flows);
+	free(shard_list);
+
 	return code;
 }
 
+
+/***********************************************************************
+ * The codec service functions
+ ***********************************************************************/
+
 /*
- * NAME: flowthings_io_service_find_many
+ * NAME: flowthings_io_service_read_codec
  *
- * Perform a find_many on drops from the platform.  This function should not be called directly --
- * one of the defines below should be called depending on the object type.
+ * flowthings_io_service_read with a codec in place of the decoder.
+ */
+flowthings_io_result_code flowthings_io_service_read_codec(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		const flowthings_io_codec *codec, void *result)
+{
+	if (!codec)
+		return FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+
+	return __flowthings_io_op_perform(__flowthings_io_read_op(svc,
+			path_ext, api, id, params, NULL, NULL, NULL, codec, result, NULL, NULL));
+}
+
+/*
+ * NAME: flowthings_io_service_create_codec
  *
- * PARAMS:
- * svc - the service type
- * path_ext - any path extension to add in creating the URL
- * api - the API object
- * decoder - the object decoder (see flowthings_io_cb_decode_object)
- * idlist - the list of [ flowId => { param1=value, param2=value, ... } ]; idlist must
- *     have flowthings_io_param as the void* item value
- * result - the array of result pointers; this array and all result objects must be pre-allocated
- *     and initialized; decode will be performed on all platform results and they will be placed
- *     in the result array
- * result_count - must initially be set to the allocated size of the result array; when this
- *     function completes, it will be set to the number of items in the array
+ * flowthings_io_service_create with a codec in place of the encoder and decoder.
  */
-flowthings_io_result_code flowthings_io_service_find_many(
+flowthings_io_result_code flowthings_io_service_create_codec(
 		flowthings_io_service_type svc, const char *path_ext,
-		flowthings_io_api *api, flowthings_io_cb_decode_object decoder,
-		flowthings_io_idlist *idlist,
-		void *result[],
-		int *result_count)
+		flowthings_io_api *api, flowthings_io_params *params,
+		const flowthings_io_codec *codec, void *object)
 {
-	cJSON *in_root, *jitem, *jsubitem;
-	flowthings_io_result_code code = FLOWTHINGS_IO_ERROR_UNKNOWN;
-	int i;
+	if (!codec)
+		return FLOWTHINGS_IO_ERROR_COULDNT_ENCODE;
+
+	return __flowthings_io_op_perform(__flowthings_io_create_op(svc,
+			path_ext, api, params, NULL, NULL, NULL, codec, object, NULL, NULL));
+}
+
+/*
+ * NAME: flowthings_io_service_update_codec
+ *
+ * flowthings_io_service_update with a codec in place of the encoder and decoder.
+ */
+flowthings_io_result_code flowthings_io_service_update_codec(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		const flowthings_io_codec *codec, void *object)
+{
+	if (!codec)
+		return FLOWTHINGS_IO_ERROR_COULDNT_ENCODE;
+
+	return __flowthings_io_op_perform(__flowthings_io_update_op(svc,
+			path_ext, api, id, params, NULL, NULL, NULL, codec, object, NULL, NULL));
+}
+
+/*
+ * NAME: flowthings_io_service_find_codec
+ *
+ * flowthings_io_service_find with a codec in place of the decoder; results is an array of the
+ * codec's struct.
+ */
+flowthings_io_result_code flowthings_io_service_find_codec(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, const flowthings_io_codec *codec,
+		void *results, int *result_count)
+{
+	if (!codec)
+		return FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
+
+	return __flowthings_io_op_perform(__flowthings_io_find_op(svc,
+			path_ext, api, filter, params, NULL, NULL, NULL, codec, (void **)results, result_count,
+			NULL, NULL));
+}
 
-	if (!api || !api->fhttp)
-		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
 
+/***********************************************************************
+ * The event decoder service functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_service_read_events
+ *
+ * flowthings_io_service_read with an event decoder in place of the decoder.
+ */
+flowthings_io_result_code flowthings_io_service_read_events(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_decode_events decoder, void *result)
+{
 	if (!decoder)
 		return FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
 
-	char path[FLOWTHINGS_IO_MAX_PATH_SIZE] = "";
-	flowthings_io_string *response = flowthings_io_string_init();
+	return __flowthings_io_op_perform(__flowthings_io_read_op(svc,
+			path_ext, api, id, params, NULL, decoder, NULL, NULL, result, NULL, NULL));
+}
 
-	struct __flowthings_io_service_info_item *service_item =
-			&__flowthings_io_service_info[svc];
+/*
+ * NAME: flowthings_io_service_create_events
+ *
+ * flowthings_io_service_create with an event decoder in place of the decoder.
+ */
+flowthings_io_result_code flowthings_io_service_create_events(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_events decoder, void *object)
+{
+	return __flowthings_io_op_perform(__flowthings_io_create_op(svc,
+			path_ext, api, params, encoder, NULL, decoder, NULL, object, NULL, NULL));
+}
 
-	api->fhttp->base_path = service_item->base_path;
+/*
+ * NAME: flowthings_io_service_update_events
+ *
+ * flowthings_io_service_update with an event decoder in place of the decoder.
+ */
+flowthings_io_result_code flowthings_io_service_update_events(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_events decoder, void *object)
+{
+	return __flowthings_io_op_perform(__flowthings_io_update_op(svc,
+			path_ext, api, id, params, encoder, NULL, decoder, NULL, object, NULL, NULL));
+}
 
-	__flowthings_io_add_path_ext(path, path_ext);
-	flowthings_io_strcat(path, "?flatten=flat", FLOWTHINGS_IO_MAX_PATH_SIZE);
+/*
+ * NAME: flowthings_io_service_find_events
+ *
+ * flowthings_io_service_find with an event decoder in place of the decoder.
+ */
+flowthings_io_result_code flowthings_io_service_find_events(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, flowthings_io_cb_decode_events decoder,
+		void *result[],
+		int *result_count)
+{
+	if (!decoder)
+		return FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
 
-	if (!idlist)
-		return FLOWTHINGS_IO_ERROR_BAD_REQUEST;
+	return __flowthings_io_op_perform(__flowthings_io_find_op(svc,
+			path_ext, api, filter, params, NULL, decoder, NULL, NULL, result, result_count,
+			NULL, NULL));
+}
 
-	in_root = cJSON_CreateArray();
 
-	flowthings_io_idlistitem *item = idlist->start;
-	flowthings_io_params *params;
-	flowthings_io_param *param;
+/***********************************************************************
+ * The tape decoder service functions
+ ***********************************************************************/
 
-	while (item != NULL) {
+/*
+ * NAME: flowthings_io_service_read_tape
+ *
+ * flowthings_io_service_read with a tape decoder.
+ */
+flowthings_io_result_code flowthings_io_service_read_tape(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_decode_tape decoder, void *result)
+{
+	return __flowthings_io_op_perform(__flowthings_io_read_op(svc,
+			path_ext, api, id, params, NULL, NULL, decoder, NULL, result, NULL, NULL));
+}
 
-		if (!item->id) {
-			FAIL;
-		}
+/*
+ * NAME: flowthings_io_service_find_tape
+ *
+ * flowthings_io_service_find with a tape decoder.
+ */
+flowthings_io_result_code flowthings_io_service_find_tape(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, flowthings_io_cb_decode_tape decoder,
+		void *result[],
+		int *result_count)
+{
+	return __flowthings_io_op_perform(__flowthings_io_find_op(svc,
+			path_ext, api, filter, params, NULL, NULL, decoder, NULL, result, result_count,
+			NULL, NULL));
+}
+
+/*
+ * NAME: flowthings_io_service_find_tape_async
+ *
+ * The asynchronous version of flowthings_io_service_find_tape.
+ */
+flowthings_io_op *flowthings_io_service_find_tape_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, flowthings_io_cb_decode_tape decoder,
+		void *result[],
+		int *result_count,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	return __flowthings_io_op_submit(__flowthings_io_find_op(svc,
+			path_ext, api, filter, params, NULL, NULL, decoder, NULL, result, result_count,
+			complete, user_data));
+}
+
+
+/***********************************************************************
+ * The projected service functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_service_read_projected
+ *
+ * flowthings_io_service_read, giving the decoder only what is on projection's paths.
+ */
+flowthings_io_result_code flowthings_io_service_read_projected(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		const flowthings_io_json_projection *projection,
+		flowthings_io_cb_decode_object decoder, void *result)
+{
+	if (!projection)
+		return FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
 
-		jitem = cJSON_CreateObject();
-		cJSON_AddStringToObject(jitem, "flowId", item->id);
+	return __flowthings_io_op_perform(__flowthings_io_op_project(__flowthings_io_read_op(svc,
+			path_ext, api, id, params, decoder, NULL, NULL, NULL, result, NULL, NULL), projection));
+}
 
-		jsubitem = cJSON_CreateObject();
-		params = (flowthings_io_params *)item->item;
-		param = params->start;
+/*
+ * NAME: flowthings_io_service_find_projected
+ *
+ * flowthings_io_service_find, giving the decoder only what is on projection's paths.
+ */
+flowthings_io_result_code flowthings_io_service_find_projected(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, const flowthings_io_json_projection *projection,
+		flowthings_io_cb_decode_object decoder,
+		void *result[],
+		int *result_count)
+{
+	if (!projection)
+		return FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
 
-		while (param != NULL) {
+	return __flowthings_io_op_perform(__flowthings_io_op_project(__flowthings_io_find_op(svc,
+			path_ext, api, filter, params, decoder, NULL, NULL, NULL, result, result_count,
+			NULL, NULL), projection));
+}
 
-			cJSON_AddStringToObject(jsubitem, param->key->ptr, param->value->ptr);
-			param = param->next;
+/*
+ * NAME: flowthings_io_service_find_projected_async
+ *
+ * The asynchronous version of flowthings_io_service_find_projected.
+ */
+flowthings_io_op *flowthings_io_service_find_projected_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, const flowthings_io_json_projection *projection,
+		flowthings_io_cb_decode_object decoder,
+		void *result[],
+		int *result_count,
+		flowthings_io_cb_complete complete, void *user_data)
+{
+	if (!projection)
+		return NULL;
 
-		}
+	return __flowthings_io_op_submit(__flowthings_io_op_project(__flowthings_io_find_op(svc,
+			path_ext, api, filter, params, decoder, NULL, NULL, NULL, result, result_count,
+			complete, user_data), projection));
+}
 
-		cJSON_AddItemToObject(jitem, "params", jsubitem);
-		cJSON_AddItemToArray(in_root, jitem);
 
-		item = item->next;
+/***********************************************************************
+ * The flow path functions
+ ***********************************************************************/
+
+/*
+ * NAME: __flowthings_io_flow_path
+ *
+ * A flow's ID and path, decoded from a find on flows.
+ */
+typedef struct __flowthings_io_flow_path {
+	char id[FLOWTHINGS_IO_ID_LEN];
+	char path[FLOWTHINGS_IO_MAX_PATH_SIZE];
+} __flowthings_io_flow_path;
+
+static BOOL __flowthings_io_decode_flow_path(cJSON *json_in, void *obj_out)
+{
+	__flowthings_io_flow_path *fp = (__flowthings_io_flow_path *)obj_out;
+	cJSON *id = cJSON_GetObjectItem(json_in, "id");
+	cJSON *path = cJSON_GetObjectItem(json_in, "path");
+
+	if (!id || id->type != cJSON_String || !path || path->type != cJSON_String
+			|| strlen(id->valuestring) >= sizeof(fp->id)
+			|| strlen(path->valuestring) >= sizeof(fp->path))
+		return FALSE;
+
+	strcpy(fp->id, id->valuestring);
+	strcpy(fp->path, path->valuestring);
+
+	return TRUE;
+}
+
+/*
+ * NAME: __flowthings_io_flow_path_filter
+ *
+ * Writes the filter for the flow with the given path into filter, or if prefix is TRUE, for the
+ * flows whose paths start with it.  Returns FALSE if it doesn't fit.
+ */
+static BOOL __flowthings_io_flow_path_filter(char *filter, size_t size, const char *path,
+		BOOL prefix)
+{
+	const char *special = prefix ? "\\^$.|?*+()[]{}/" : "\\\"";
+	size_t len;
+
+	len = snprintf(filter, size, "%s", prefix ? "path =~ /^" : "path == \"");
+
+	for (; *path && len + 4 < size; path++) {
+		if (strchr(special, *path))
+			filter[len++] = '\\';
+		filter[len++] = *path;
 	}
 
-	int http_response_code = flowthings_io_http_request(api->fhttp,
-			FLOWTHINGS_IO_HTTP_METHOD_MGET, path, cJSON_Print(in_root), response);
+	if (*path)
+		return FALSE;
+
+	strcpy(filter + len, prefix ? "/" : "\"");
+
+	return TRUE;
+}
+
+/*
+ * NAME: flowthings_io_flow_resolve
+ *
+ * Finds the ID of the flow with the given path.
+ *
+ * PARAMS:
+ * api - the API object
+ * path - the flow path
+ * flow_id - a buffer of FLOWTHINGS_IO_ID_LEN, set to the flow ID
+ */
+flowthings_io_result_code flowthings_io_flow_resolve(flowthings_io_api *api, const char *path,
+		char *flow_id)
+{
+	char filter[2 * FLOWTHINGS_IO_MAX_PATH_SIZE];
+	__flowthings_io_flow_path found;
+	flowthings_io_params *params;
+	flowthings_io_result_code code;
+	unsigned long version = 0;
+	int count = 1;
+
+	if (!api || !api->fhttp)
+		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+
+	if (!path || !flow_id)
+		return FLOWTHINGS_IO_ERROR_BAD_REQUEST;
 
-	if (http_response_code < 200 || http_response_code >= 400) {
-		switch (http_response_code) {
-		case 400:
-			return FLOWTHINGS_IO_ERROR_BAD_REQUEST;
-		case 403:
-			return FLOWTHINGS_IO_ERROR_FORBIDDEN;
-		case 404:
+	if (api->resolver) {
+		switch (flowthings_io_resolver_lookup(api->resolver, path, flow_id, &version)) {
+		case FLOWTHINGS_IO_RESOLVER_FOUND:
+			return FLOWTHINGS_IO_OK;
+		case FLOWTHINGS_IO_RESOLVER_MISSING:
 			return FLOWTHINGS_IO_ERROR_NOT_FOUND;
-		case 500:
-			return FLOWTHINGS_IO_ERROR_SERVER_ERROR;
-		default:
-			return FLOWTHINGS_IO_ERROR_UNKNOWN;
 		}
 	}
 
-	cJSON *root = cJSON_Parse(response->ptr);
-	flowthings_io_string_cleanup(response);
+	if (!__flowthings_io_flow_path_filter(filter, sizeof(filter), path, FALSE))
+		return FLOWTHINGS_IO_ERROR_BAD_REQUEST;
 
-	cJSON *body = cJSON_GetObjectItem(root, "body");
-	if (!body)
-		return FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE;
+	params = flowthings_io_params_init();
+	flowthings_io_params_add(params, "limit", "1");
+
+	/* one result, so the pointer-sized stride of the result array doesn't matter */
+	code = flowthings_io_service_find(FLOWTHINGS_IO_SERVICE_TYPE_FLOW, NULL, api, filter, params,
+			__flowthings_io_decode_flow_path, (void **)&found, &count);
+
+	flowthings_io_params_cleanup(params);
+
+	if (code != FLOWTHINGS_IO_OK)
+		return code;
+
+	if (count < 1 || strcmp(found.path, path)) {
+		if (api->resolver)
+			flowthings_io_resolver_store(api->resolver, path, NULL, version);
+		return FLOWTHINGS_IO_ERROR_NOT_FOUND;
+	}
+
+	if (api->resolver)
+		flowthings_io_resolver_store(api->resolver, path, found.id, version);
+
+	strcpy(flow_id, found.id);
+
+	return FLOWTHINGS_IO_OK;
+}
+
+/*
+ * NAME: flowthings_io_flow_resolve_prefix
+ *
+ * Fills the API's resolver with every flow whose path starts with prefix.
+ *
+ * PARAMS:
+ * api - the API object
+ * prefix - the start of the flow paths
+ * count - if not NULL, set to the number of flows found
+ */
+flowthings_io_result_code flowthings_io_flow_resolve_prefix(flowthings_io_api *api,
+		const char *prefix, int *count)
+{
+	char filter[2 * FLOWTHINGS_IO_MAX_PATH_SIZE];
+	__flowthings_io_flow_path found;
+	flowthings_io_find_iter *iter;
+	flowthings_io_result_code code;
+	unsigned long version;
+	int found_count = 0;
+
+	if (count)
+		*count = 0;
+
+	if (!api || !api->fhttp || !api->resolver)
+		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+
+	if (!prefix || !__flowthings_io_flow_path_filter(filter, sizeof(filter), prefix, TRUE))
+		return FLOWTHINGS_IO_ERROR_BAD_REQUEST;
+
+	version = flowthings_io_resolver_version(api->resolver);
+
+	iter = flowthings_io_service_find_iter_open(FLOWTHINGS_IO_SERVICE_TYPE_FLOW, NULL, api, filter,
+			NULL, __flowthings_io_decode_flow_path, 0);
 
-	for (i = 0; i < *result_count && body->type == cJSON_Array && i < cJSON_GetArraySize(body); i++) {
+	while (flowthings_io_find_iter_next(iter, &found)) {
 
-		code = decoder(cJSON_GetArrayItem(body, i), &result[i]) ? FLOWTHINGS_IO_OK : FLOWTHINGS_IO_ERROR_COULDNT_DECODE;
-		if (code != FLOWTHINGS_IO_OK) break;
+		/* in case the platform matches more loosely than a prefix */
+		if (strncmp(found.path, prefix, strlen(prefix)))
+			continue;
 
+		flowthings_io_resolver_store(api->resolver, found.path, found.id, version);
+		found_count++;
 	}
 
-	*result_count = i;
+	code = flowthings_io_find_iter_result(iter);
+	flowthings_io_find_iter_close(iter);
 
-	cJSON_Delete(root);
+	if (count)
+		*count = found_count;
 
 	return code;
 }
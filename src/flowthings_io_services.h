@@ -12,7 +12,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <curl/curl.h>
 
 #ifdef  __cplusplus
 extern "C" {
@@ -25,6 +24,9 @@ extern "C" {
 #include "cJSON.h"
 #include "flowthings_io.h"
 #include "flowthings_io_api.h"
+#include "flowthings_io_codec.h"
+#include "flowthings_io_json.h"
+#include "flowthings_io_tape.h"
 
 
 /***********************************************************************
@@ -63,19 +65,12 @@ struct __flowthings_io_service_info_item {
 /*
  * NAME: __flowthings_io_service_info
  *
- * A structure with service definitions; should not be used outside this library
- */
-static struct __flowthings_io_service_info_item __flowthings_io_service_info[] = {
-	{ FLOWTHINGS_IO_SERVICE_TYPE_FLOW, "flow", "/flow", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_UPDATE | FLOWTHINGS_IO_ACTION_DELETE },
-	{ FLOWTHINGS_IO_SERVICE_TYPE_DROP, "drop", "/drop", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_UPDATE | FLOWTHINGS_IO_ACTION_DELETE },
-	{ FLOWTHINGS_IO_SERVICE_TYPE_IDENTITY, "identity", "/identity", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_UPDATE },
-	{ FLOWTHINGS_IO_SERVICE_TYPE_GROUP, "group", "/group", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_UPDATE | FLOWTHINGS_IO_ACTION_DELETE },
-	{ FLOWTHINGS_IO_SERVICE_TYPE_TRACK, "track", "/track", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_UPDATE | FLOWTHINGS_IO_ACTION_DELETE },
-	{ FLOWTHINGS_IO_SERVICE_TYPE_API_TASK, "api-task", "/api-task", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_UPDATE | FLOWTHINGS_IO_ACTION_DELETE },
-	{ FLOWTHINGS_IO_SERVICE_TYPE_MQTT_TASK, "mqtt", "/mqtt", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_UPDATE | FLOWTHINGS_IO_ACTION_DELETE },
-	{ FLOWTHINGS_IO_SERVICE_TYPE_TOKEN, "token", "/token", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_DELETE },
-	{ FLOWTHINGS_IO_SERVICE_TYPE_SHARE, "share", "/share", FLOWTHINGS_IO_ACTION_READ | FLOWTHINGS_IO_ACTION_CREATE | FLOWTHINGS_IO_ACTION_DELETE }
-};
+ * A structure with service definitions, indexed by service type; should not be used outside this
+ * library
+ */
+#define __FLOWTHINGS_IO_SERVICE_COUNT (FLOWTHINGS_IO_SERVICE_TYPE_SHARE + 1)
+
+extern struct __flowthings_io_service_info_item __flowthings_io_service_info[__FLOWTHINGS_IO_SERVICE_COUNT];
 
 
 /***********************************************************************
@@ -106,6 +101,98 @@ typedef BOOL (*flowthings_io_cb_encode_object)(void *obj_in, cJSON *json_out);
  */
 typedef BOOL (*flowthings_io_cb_decode_object)(cJSON *json_in, void *obj_out);
 
+/*
+ * NAME: flowthings_io_cb_decode_events
+ *
+ * A decoder that reads each object from the JSON text with a pull reader (see flowthings_io_json.h)
+ * instead of being given a cJSON tree, so nothing is allocated for the object and only the values
+ * the decoder reads are converted.  Used by the *_events service functions.
+ *
+ * reader - a reader over the object; its first event is FLOWTHINGS_IO_JSON_BEGIN_OBJECT.  Members
+ *     that aren't needed can be passed over with flowthings_io_json_skip, and the decoder may
+ *     return without reading the rest of the object once it has what it needs.
+ * obj_out - as for flowthings_io_cb_decode_object
+ */
+typedef BOOL (*flowthings_io_cb_decode_events)(flowthings_io_json_reader *reader, void *obj_out);
+
+/*
+ * NAME: flowthings_io_cb_decode_tape
+ *
+ * A decoder that is given an object parsed onto a tape (see flowthings_io_tape.h) instead of a
+ * cJSON tree.  Used by the *_tape service functions.
+ *
+ * value - the object; it and its strings are only valid until the decoder returns
+ * obj_out - as for flowthings_io_cb_decode_object
+ */
+typedef BOOL (*flowthings_io_cb_decode_tape)(flowthings_io_tape_value value, void *obj_out);
+
+
+/***********************************************************************
+ * Asynchronous operations
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_op
+ *
+ * A handle to a service call started with one of the flowthings_io_service_*_async functions.
+ * The call runs while flowthings_io_api_poll or flowthings_io_api_run is being called on its API
+ * object.
+ */
+typedef struct flowthings_io_op flowthings_io_op;
+
+/*
+ * NAME: flowthings_io_cb_complete
+ *
+ * This callback is called exactly once for every asynchronous service call, from inside
+ * flowthings_io_api_poll/flowthings_io_api_run, after the result has been decoded.  It may start
+ * new calls, and it may call flowthings_io_op_cleanup on op.
+ *
+ * op - the operation that completed
+ * code - the result of the call, the same value flowthings_io_op_result will return
+ * user_data - the pointer that was passed to the *_async function
+ */
+typedef void (*flowthings_io_cb_complete)(flowthings_io_op *op,
+		flowthings_io_result_code code, void *user_data);
+
+/*
+ * NAME: flowthings_io_op_done
+ *
+ * Returns TRUE once the operation has completed.
+ */
+BOOL flowthings_io_op_done(flowthings_io_op *op);
+
+/*
+ * NAME: flowthings_io_op_result
+ *
+ * Returns the result of a completed operation.  For find operations, the result_count passed in
+ * is set when the operation completes.
+ */
+flowthings_io_result_code flowthings_io_op_result(flowthings_io_op *op);
+
+/*
+ * NAME: flowthings_io_op_wait
+ *
+ * Runs the API's calls until this operation has completed, and returns its result.  Other calls
+ * in flight on the same API object will also make progress.
+ */
+flowthings_io_result_code flowthings_io_op_wait(flowthings_io_op *op);
+
+/*
+ * NAME: flowthings_io_op_cleanup
+ *
+ * Frees an operation.  Must be called once for every operation returned by a *_async function.
+ * If the operation hasn't completed yet it is cancelled, and its callback will not be called.
+ */
+void flowthings_io_op_cleanup(flowthings_io_op *op);
+
+/*
+ * NAME: __flowthings_io_op_free
+ *
+ * Frees an operation without returning it to its API object's pool; should not be used outside
+ * this library
+ */
+void __flowthings_io_op_free(flowthings_io_op *op);
+
 
 /***********************************************************************
  * The generic service functions
@@ -142,6 +229,26 @@ flowthings_io_result_code flowthings_io_service_read(
 #define flowthings_io_token_read(...) flowthings_io_service_read(FLOWTHINGS_IO_SERVICE_TYPE_TOKEN, NULL, __VA_ARGS__)
 #define flowthings_io_share_read(...) flowthings_io_service_read(FLOWTHINGS_IO_SERVICE_TYPE_SHARE, NULL, __VA_ARGS__)
 
+/*
+ * NAME: flowthings_io_service_read_async
+ *
+ * The asynchronous version of flowthings_io_service_read.  It takes the same parameters, plus:
+ *
+ * complete - called when the call completes (see flowthings_io_cb_complete), may be NULL
+ * user_data - passed to complete
+ *
+ * RETURN:
+ * Returns a handle to the call, which must be freed with flowthings_io_op_cleanup, or NULL if the
+ * API isn't initialized.  Any objects passed in must stay valid until the call completes.
+ */
+flowthings_io_op *flowthings_io_service_read_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_decode_object decoder, void *result,
+		flowthings_io_cb_complete complete, void *user_data);
+
+#define flowthings_io_drop_read_async(...) flowthings_io_service_read_async(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
 /*
  * NAME: flowthings_io_service_create
  *
@@ -175,6 +282,75 @@ flowthings_io_result_code flowthings_io_service_create(
 #define flowthings_io_token_create(...) flowthings_io_service_create(FLOWTHINGS_IO_SERVICE_TYPE_TOKEN, NULL, __VA_ARGS__)
 #define flowthings_io_share_create(...) flowthings_io_service_create(FLOWTHINGS_IO_SERVICE_TYPE_SHARE, NULL, __VA_ARGS__)
 
+/*
+ * NAME: flowthings_io_service_create_async
+ *
+ * The asynchronous version of flowthings_io_service_create.  It takes the same parameters, plus:
+ *
+ * complete - called when the call completes (see flowthings_io_cb_complete), may be NULL
+ * user_data - passed to complete
+ *
+ * RETURN:
+ * Returns a handle to the call, which must be freed with flowthings_io_op_cleanup, or NULL if the
+ * API isn't initialized.  Any objects passed in must stay valid until the call completes.
+ */
+flowthings_io_op *flowthings_io_service_create_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_object decoder, void *object,
+		flowthings_io_cb_complete complete, void *user_data);
+
+#define flowthings_io_drop_create_async(...) flowthings_io_service_create_async(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
+/*
+ * NAME: flowthings_io_service_create_batch
+ *
+ * Creates many objects with as few requests as possible.  The objects are encoded into JSON arrays
+ * and POSTed in requests of at most the API's batch limits (see flowthings_io_api_set_batch_limits);
+ * the platform answers each with an array holding a { "head": ..., "body": ... } result for every
+ * object, in the same order.  This function should not be called directly -- one of the defines
+ * below should be called depending on the object type.
+ *
+ * PARAMS:
+ * svc - the service type
+ * path_ext - any path extension to add in creating the URL
+ * api - the API object
+ * params - any additional query string parameters to be passed to the platform
+ * encoder - the object encoder, which will be called on each object (see flowthings_io_cb_encode_object)
+ * decoder - the object decoder (see flowthings_io_cb_decode_object), or NULL to not decode the
+ *     created objects
+ * objects - the objects to create; each one that is created is filled with the resulting object
+ *     from the platform
+ * object_count - the number of objects
+ * results - if not NULL, an array of object_count codes that is filled with the result for each
+ *     object
+ *
+ * RETURN:
+ * Returns FLOWTHINGS_IO_OK if every object was created, or else the first error.
+ */
+flowthings_io_result_code flowthings_io_service_create_batch(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_object decoder,
+		void *objects[], int object_count,
+		flowthings_io_result_code results[]);
+
+#define flowthings_io_drop_create_batch(...) flowthings_io_service_create_batch(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
+/*
+ * NAME: __flowthings_io_service_create_encoded
+ *
+ * Like flowthings_io_service_create_batch, for objects that have already been encoded to compact
+ * JSON; the created objects aren't decoded.  Should not be used outside this library
+ */
+flowthings_io_result_code __flowthings_io_service_create_encoded(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_params *params,
+		char *encoded[], int count,
+		flowthings_io_result_code results[]);
+
 /*
  * NAME: flowthings_io_service_update
  *
@@ -208,6 +384,27 @@ flowthings_io_result_code flowthings_io_service_update(
 #define flowthings_io_api_task_update(...) flowthings_io_service_update(FLOWTHINGS_IO_SERVICE_TYPE_API_TASK, NULL, __VA_ARGS__)
 #define flowthings_io_mqtt_task_update(...) flowthings_io_service_update(FLOWTHINGS_IO_SERVICE_TYPE_MQTT_TASK, NULL, __VA_ARGS__)
 
+/*
+ * NAME: flowthings_io_service_update_async
+ *
+ * The asynchronous version of flowthings_io_service_update.  It takes the same parameters, plus:
+ *
+ * complete - called when the call completes (see flowthings_io_cb_complete), may be NULL
+ * user_data - passed to complete
+ *
+ * RETURN:
+ * Returns a handle to the call, which must be freed with flowthings_io_op_cleanup, or NULL if the
+ * API isn't initialized.  Any objects passed in must stay valid until the call completes.
+ */
+flowthings_io_op *flowthings_io_service_update_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_object decoder, void *object,
+		flowthings_io_cb_complete complete, void *user_data);
+
+#define flowthings_io_drop_update_async(...) flowthings_io_service_update_async(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
 /*
  * NAME: flowthings_io_service_delete
  *
@@ -235,6 +432,25 @@ flowthings_io_result_code flowthings_io_service_delete(
 #define flowthings_io_token_delete(...) flowthings_io_service_delete(FLOWTHINGS_IO_SERVICE_TYPE_TOKEN, NULL, __VA_ARGS__)
 #define flowthings_io_share_delete(...) flowthings_io_service_delete(FLOWTHINGS_IO_SERVICE_TYPE_SHARE, NULL, __VA_ARGS__)
 
+/*
+ * NAME: flowthings_io_service_delete_async
+ *
+ * The asynchronous version of flowthings_io_service_delete.  It takes the same parameters, plus:
+ *
+ * complete - called when the call completes (see flowthings_io_cb_complete), may be NULL
+ * user_data - passed to complete
+ *
+ * RETURN:
+ * Returns a handle to the call, which must be freed with flowthings_io_op_cleanup, or NULL if the
+ * API isn't initialized.  Any objects passed in must stay valid until the call completes.
+ */
+flowthings_io_op *flowthings_io_service_delete_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_complete complete, void *user_data);
+
+#define flowthings_io_drop_delete_async(...) flowthings_io_service_delete_async(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
 
 /***********************************************************************
  * The drop-only service functions
@@ -268,6 +484,110 @@ flowthings_io_result_code flowthings_io_service_find(
 
 #define flowthings_io_drop_find(...) flowthings_io_service_find(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
 
+/*
+ * NAME: flowthings_io_service_find_async
+ *
+ * The asynchronous version of flowthings_io_service_find.  It takes the same parameters, plus:
+ *
+ * complete - called when the call completes (see flowthings_io_cb_complete), may be NULL
+ * user_data - passed to complete
+ *
+ * RETURN:
+ * Returns a handle to the call, which must be freed with flowthings_io_op_cleanup, or NULL if the
+ * API isn't initialized.  Any objects passed in must stay valid until the call completes.
+ */
+flowthings_io_op *flowthings_io_service_find_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, flowthings_io_cb_decode_object decoder,
+		void *result[],
+		int *result_count,
+		flowthings_io_cb_complete complete, void *user_data);
+
+#define flowthings_io_drop_find_async(...) flowthings_io_service_find_async(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
+/* the default number of objects a find iterator asks for at a time */
+#define FLOWTHINGS_IO_FIND_ITER_PAGE_SIZE 100
+
+/*
+ * NAME: flowthings_io_find_iter
+ *
+ * A find that pages through every matching object, see flowthings_io_service_find_iter_open.
+ */
+typedef struct flowthings_io_find_iter flowthings_io_find_iter;
+
+/*
+ * NAME: flowthings_io_service_find_iter_open
+ *
+ * Starts a find that returns every matching object, one at a time, however many there are.  The
+ * objects are fetched a page at a time with the start and limit parameters; while the caller
+ * works through one page, the next is fetched on the API's asynchronous engine, so at most two
+ * pages are held in memory.  The next page's transfer only moves while the engine is polled: each
+ * flowthings_io_find_iter_next polls it once without waiting, so a caller that does a lot of work
+ * between objects should call flowthings_io_api_poll(api, 0) now and then to keep it going.
+ * Paging stops at the first page that is empty or shorter than page_size, or that starts with the
+ * same object as the page before it (a server that ignores start would otherwise return the first
+ * page forever).  This function should not be called directly -- one of the defines
+ * below should be called depending on the object type.  The caller is responsible for calling
+ * flowthings_io_find_iter_close when done.
+ *
+ * PARAMS:
+ * svc - the service type
+ * path_ext - any path extension to add in creating the URL
+ * api - the API object
+ * filter - a filter string for drops (see https://flowthings.io/docs/flow-filter-language)
+ * params - any additional query string parameters to be passed to the platform, other than start
+ *     and limit; they're copied, so they can be freed once this returns
+ * decoder - the object decoder (see flowthings_io_cb_decode_object)
+ * page_size - the number of objects to ask for at a time, or 0 for
+ *     FLOWTHINGS_IO_FIND_ITER_PAGE_SIZE
+ *
+ * RETURN:
+ * Returns the iterator, or NULL if the API isn't initialized.
+ */
+flowthings_io_find_iter *flowthings_io_service_find_iter_open(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, flowthings_io_cb_decode_object decoder,
+		int page_size);
+
+#define flowthings_io_drop_find_iter_open(...) flowthings_io_service_find_iter_open(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
+/*
+ * NAME: flowthings_io_find_iter_next
+ *
+ * Decodes the next object.  Waits for its page if it hasn't arrived yet.
+ *
+ * PARAMS:
+ * iter - the iterator
+ * result - must be preallocated; will be filled with the output of decode, as for
+ *     flowthings_io_service_read
+ *
+ * RETURN:
+ * Returns TRUE if an object was decoded, or FALSE once there are no more objects or the find
+ * failed; flowthings_io_find_iter_result tells which.
+ */
+BOOL flowthings_io_find_iter_next(flowthings_io_find_iter *iter, void *result);
+
+#define flowthings_io_drop_find_iter_next flowthings_io_find_iter_next
+
+/*
+ * NAME: flowthings_io_find_iter_result
+ *
+ * Returns FLOWTHINGS_IO_OK unless a page couldn't be fetched or an object couldn't be decoded, in
+ * which case it returns the error.
+ */
+flowthings_io_result_code flowthings_io_find_iter_result(flowthings_io_find_iter *iter);
+
+/*
+ * NAME: flowthings_io_find_iter_close
+ *
+ * Frees an iterator, abandoning any page that is still being fetched.
+ */
+void flowthings_io_find_iter_close(flowthings_io_find_iter *iter);
+
+#define flowthings_io_drop_find_iter_close flowthings_io_find_iter_close
+
 /*
  * NAME: flowthings_io_service_find_many
  *
@@ -296,6 +616,395 @@ flowthings_io_result_code flowthings_io_service_find_many(
 
 #define flowthings_io_drop_find_many(...) flowthings_io_service_find_many(FLOWTHINGS_IO_SERVICE_TYPE_DROP, NULL, __VA_ARGS__)
 
+/*
+ * NAME: flowthings_io_service_find_many_async
+ *
+ * The asynchronous version of flowthings_io_service_find_many.  It takes the same parameters, plus:
+ *
+ * complete - called when the call completes (see flowthings_io_cb_complete), may be NULL
+ * user_data - passed to complete
+ *
+ * RETURN:
+ * Returns a handle to the call, which must be freed with flowthings_io_op_cleanup, or NULL if the
+ * API isn't initialized.  Any objects passed in must stay valid until the call completes.
+ */
+flowthings_io_op *flowthings_io_service_find_many_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_cb_decode_object decoder,
+		flowthings_io_idlist *idlist,
+		void *result[],
+		int *result_count,
+		flowthings_io_cb_complete complete, void *user_data);
+
+#define flowthings_io_drop_find_many_async(...) flowthings_io_service_find_many_async(FLOWTHINGS_IO_SERVICE_TYPE_DROP, NULL, __VA_ARGS__)
+
+/* the defaults for flowthings_io_service_find_many_sharded */
+#define FLOWTHINGS_IO_FIND_MANY_SHARD_SIZE 10
+#define FLOWTHINGS_IO_FIND_MANY_MAX_IN_FLIGHT 16
+
+/*
+ * NAME: flowthings_io_find_many_flow
+ *
+ * The outcome for one flow of flowthings_io_service_find_many_sharded.
+ *
+ * flow_id - the flow ID, which points into the idlist
+ * code - FLOWTHINGS_IO_OK, the error for the request the flow was sent in, or
+ *     FLOWTHINGS_IO_ERROR_COULDNT_DECODE if one of its objects couldn't be decoded
+ * first - the index in the result array of the flow's first object
+ * count - the number of the flow's objects in the result array
+ */
+typedef struct flowthings_io_find_many_flow {
+	const char *flow_id;
+	flowthings_io_result_code code;
+	int first;
+	int count;
+} flowthings_io_find_many_flow;
+
+/*
+ * NAME: flowthings_io_service_find_many_sharded
+ *
+ * Like flowthings_io_service_find_many, but the flows are split into shards of shard_size that are
+ * sent as separate requests, up to max_in_flight at once, so a slow flow only holds up its own
+ * shard.  Each shard is decoded as soon as its response arrives, and its objects are added to the
+ * result array in the order the shards complete; the objects for one flow are always together.
+ * This only pays when the server spends time on each flow: against a server that answers at once,
+ * the extra requests make it slower than one flowthings_io_service_find_many (about half the
+ * calls per second at 100 flows in bench/find_many_bench.c), and it breaks even at about 5
+ * microseconds of server time per flow.
+ * The requests are run on the API's asynchronous engine, so this must not be called while another
+ * thread is running the API's asynchronous calls.  This function should not be called directly --
+ * one of the defines below should be called depending on the object type.
+ *
+ * PARAMS:
+ * svc - the service type
+ * path_ext - any path extension to add in creating the URL
+ * api - the API object
+ * decoder - the object decoder (see flowthings_io_cb_decode_object)
+ * idlist - the list of [ flowId => { param1=value, param2=value, ... } ], as for
+ *     flowthings_io_service_find_many
+ * shard_size - the most flows in one request, or 0 for FLOWTHINGS_IO_FIND_MANY_SHARD_SIZE
+ * max_in_flight - the most requests at once, or 0 for FLOWTHINGS_IO_FIND_MANY_MAX_IN_FLIGHT
+ * result - the array of result pointers, as for flowthings_io_service_find_many; once it's full,
+ *     further objects are dropped
+ * result_count - must initially be set to the allocated size of the result array; when this
+ *     function completes, it will be set to the number of items in the array
+ * flows - if not NULL, an array with an entry for each flow in idlist, in the same order, which is
+ *     filled with the outcome for that flow
+ *
+ * RETURN:
+ * Returns FLOWTHINGS_IO_OK if every flow succeeded, or else the code of the first flow in idlist
+ * that didn't.
+ */
+flowthings_io_result_code flowthings_io_service_find_many_sharded(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_cb_decode_object decoder,
+		flowthings_io_idlist *idlist,
+		int shard_size, int max_in_flight,
+		void *result[],
+		int *result_count,
+		flowthings_io_find_many_flow flows[]);
+
+#define flowthings_io_drop_find_many_sharded(...) flowthings_io_service_find_many_sharded(FLOWTHINGS_IO_SERVICE_TYPE_DROP, NULL, __VA_ARGS__)
+
+
+/***********************************************************************
+ * The codec service functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_service_read_codec
+ *
+ * flowthings_io_service_read with a codec (see flowthings_io_codec.h) in place of the decoder.
+ * The response is decoded straight into result, without building a cJSON tree, as it arrives if
+ * stream decoding is on.
+ */
+flowthings_io_result_code flowthings_io_service_read_codec(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		const flowthings_io_codec *codec, void *result);
+
+#define flowthings_io_drop_read_codec(...) flowthings_io_service_read_codec(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+#define flowthings_io_flow_read_codec(...) flowthings_io_service_read_codec(FLOWTHINGS_IO_SERVICE_TYPE_FLOW, NULL, __VA_ARGS__)
+
+/*
+ * NAME: flowthings_io_service_create_codec
+ *
+ * flowthings_io_service_create with a codec in place of the encoder and decoder.  The object is
+ * written as the request body and the created object is decoded back into it.
+ */
+flowthings_io_result_code flowthings_io_service_create_codec(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_params *params,
+		const flowthings_io_codec *codec, void *object);
+
+#define flowthings_io_drop_create_codec(...) flowthings_io_service_create_codec(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+#define flowthings_io_flow_create_codec(...) flowthings_io_service_create_codec(FLOWTHINGS_IO_SERVICE_TYPE_FLOW, NULL, __VA_ARGS__)
+
+/*
+ * NAME: flowthings_io_service_update_codec
+ *
+ * flowthings_io_service_update with a codec in place of the encoder and decoder.
+ */
+flowthings_io_result_code flowthings_io_service_update_codec(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		const flowthings_io_codec *codec, void *object);
+
+#define flowthings_io_drop_update_codec(...) flowthings_io_service_update_codec(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+#define flowthings_io_flow_update_codec(...) flowthings_io_service_update_codec(FLOWTHINGS_IO_SERVICE_TYPE_FLOW, NULL, __VA_ARGS__)
+
+/*
+ * NAME: flowthings_io_service_find_codec
+ *
+ * flowthings_io_service_find with a codec in place of the decoder.  Unlike flowthings_io_service_find,
+ * results is an array of the codec's struct rather than of pointers, so it can be allocated in one
+ * piece, e.g. struct my_drop results[100].
+ *
+ * PARAMS:
+ * results - the array of result_count structs of codec->size
+ * result_count - must initially be set to the number of structs in results; when this function
+ *     completes, it will be set to the number found
+ */
+flowthings_io_result_code flowthings_io_service_find_codec(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, const flowthings_io_codec *codec,
+		void *results, int *result_count);
+
+#define flowthings_io_drop_find_codec(...) flowthings_io_service_find_codec(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
+
+/***********************************************************************
+ * The event decoder service functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_service_read_events
+ *
+ * flowthings_io_service_read with an event decoder (see flowthings_io_cb_decode_events) in place
+ * of the decoder.  The response is decoded without building a cJSON tree, as it arrives if stream
+ * decoding is on.
+ */
+flowthings_io_result_code flowthings_io_service_read_events(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_decode_events decoder, void *result);
+
+#define flowthings_io_drop_read_events(...) flowthings_io_service_read_events(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+#define flowthings_io_flow_read_events(...) flowthings_io_service_read_events(FLOWTHINGS_IO_SERVICE_TYPE_FLOW, NULL, __VA_ARGS__)
+
+/*
+ * NAME: flowthings_io_service_create_events
+ *
+ * flowthings_io_service_create with an event decoder in place of the decoder.
+ */
+flowthings_io_result_code flowthings_io_service_create_events(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_events decoder, void *object);
+
+#define flowthings_io_drop_create_events(...) flowthings_io_service_create_events(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+#define flowthings_io_flow_create_events(...) flowthings_io_service_create_events(FLOWTHINGS_IO_SERVICE_TYPE_FLOW, NULL, __VA_ARGS__)
+
+/*
+ * NAME: flowthings_io_service_update_events
+ *
+ * flowthings_io_service_update with an event decoder in place of the decoder.
+ */
+flowthings_io_result_code flowthings_io_service_update_events(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_encode_object encoder,
+		flowthings_io_cb_decode_events decoder, void *object);
+
+#define flowthings_io_drop_update_events(...) flowthings_io_service_update_events(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+#define flowthings_io_flow_update_events(...) flowthings_io_service_update_events(FLOWTHINGS_IO_SERVICE_TYPE_FLOW, NULL, __VA_ARGS__)
+
+/*
+ * NAME: flowthings_io_service_find_events
+ *
+ * flowthings_io_service_find with an event decoder in place of the decoder.  No tree of the
+ * response is built; with stream decoding on, each result is also decoded as soon as it has
+ * arrived, so the whole response isn't held either.
+ */
+flowthings_io_result_code flowthings_io_service_find_events(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, flowthings_io_cb_decode_events decoder,
+		void *result[],
+		int *result_count);
+
+#define flowthings_io_drop_find_events(...) flowthings_io_service_find_events(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
+
+/***********************************************************************
+ * The tape decoder service functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_service_read_tape
+ *
+ * flowthings_io_service_read with a tape decoder (see flowthings_io_cb_decode_tape) in place of
+ * the decoder.  The body is parsed onto a tape kept with the call, as it arrives if stream decoding
+ * is on.
+ */
+flowthings_io_result_code flowthings_io_service_read_tape(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		flowthings_io_cb_decode_tape decoder, void *result);
+
+#define flowthings_io_drop_read_tape(...) flowthings_io_service_read_tape(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+#define flowthings_io_flow_read_tape(...) flowthings_io_service_read_tape(FLOWTHINGS_IO_SERVICE_TYPE_FLOW, NULL, __VA_ARGS__)
+
+/*
+ * NAME: flowthings_io_service_find_tape
+ *
+ * flowthings_io_service_find with a tape decoder in place of the decoder.  The whole body is
+ * parsed onto one tape, or with stream decoding on, each result is parsed onto the same tape as
+ * soon as it has arrived, so the call holds one result's tape at a time.
+ */
+flowthings_io_result_code flowthings_io_service_find_tape(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, flowthings_io_cb_decode_tape decoder,
+		void *result[],
+		int *result_count);
+
+#define flowthings_io_drop_find_tape(...) flowthings_io_service_find_tape(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
+/*
+ * NAME: flowthings_io_service_find_tape_async
+ *
+ * The asynchronous version of flowthings_io_service_find_tape.  It takes the same parameters,
+ * plus:
+ *
+ * complete - called when the call completes (see flowthings_io_cb_complete), may be NULL
+ * user_data - passed to complete
+ *
+ * RETURN:
+ * Returns a handle to the call, which must be freed with flowthings_io_op_cleanup, or NULL if the
+ * API isn't initialized.
+ */
+flowthings_io_op *flowthings_io_service_find_tape_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, flowthings_io_cb_decode_tape decoder,
+		void *result[],
+		int *result_count,
+		flowthings_io_cb_complete complete, void *user_data);
+
+#define flowthings_io_drop_find_tape_async(...) flowthings_io_service_find_tape_async(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
+
+/***********************************************************************
+ * The projected service functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_service_read_projected
+ *
+ * flowthings_io_service_read, except that the decoder is given a cJSON tree of only what is on
+ * projection's paths (see flowthings_io_json_projection).  Everything else in the response is
+ * skipped without being parsed.  The paths start at the top of the response, so they go through
+ * its body, e.g. body.elems.num.value.  The response is decoded as it arrives if stream decoding
+ * is on.
+ *
+ * PARAMS:
+ * projection - the paths to keep, which must stay valid until the call completes; one projection
+ *     can be used for any number of calls at once
+ */
+flowthings_io_result_code flowthings_io_service_read_projected(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *id, flowthings_io_params *params,
+		const flowthings_io_json_projection *projection,
+		flowthings_io_cb_decode_object decoder, void *result);
+
+#define flowthings_io_drop_read_projected(...) flowthings_io_service_read_projected(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+#define flowthings_io_flow_read_projected(...) flowthings_io_service_read_projected(FLOWTHINGS_IO_SERVICE_TYPE_FLOW, NULL, __VA_ARGS__)
+
+/*
+ * NAME: flowthings_io_service_find_projected
+ *
+ * flowthings_io_service_find, giving the decoder only what is on projection's paths, e.g.
+ * body[].id and body[].elems.num.value.
+ */
+flowthings_io_result_code flowthings_io_service_find_projected(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, const flowthings_io_json_projection *projection,
+		flowthings_io_cb_decode_object decoder,
+		void *result[],
+		int *result_count);
+
+#define flowthings_io_drop_find_projected(...) flowthings_io_service_find_projected(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
+/*
+ * NAME: flowthings_io_service_find_projected_async
+ *
+ * The asynchronous version of flowthings_io_service_find_projected.  It takes the same
+ * parameters, plus:
+ *
+ * complete - called when the call completes (see flowthings_io_cb_complete), may be NULL
+ * user_data - passed to complete
+ *
+ * RETURN:
+ * Returns a handle to the call, which must be freed with flowthings_io_op_cleanup, or NULL if the
+ * API isn't initialized or projection is NULL.
+ */
+flowthings_io_op *flowthings_io_service_find_projected_async(
+		flowthings_io_service_type svc, const char *path_ext,
+		flowthings_io_api *api, const char *filter,
+		flowthings_io_params *params, const flowthings_io_json_projection *projection,
+		flowthings_io_cb_decode_object decoder,
+		void *result[],
+		int *result_count,
+		flowthings_io_cb_complete complete, void *user_data);
+
+#define flowthings_io_drop_find_projected_async(...) flowthings_io_service_find_projected_async(FLOWTHINGS_IO_SERVICE_TYPE_DROP, __VA_ARGS__)
+
+
+/***********************************************************************
+ * The flow path functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_flow_resolve
+ *
+ * Finds the ID of the flow with the given path, so it can be passed to the drop service
+ * functions.  If the API has a resolver (see flowthings_io_api_set_resolver), the answer is taken
+ * from it when it can be, and kept in it otherwise.
+ *
+ * PARAMS:
+ * api - the API object
+ * path - the flow path, e.g. /myaccountname/sensors/kitchen
+ * flow_id - a buffer of FLOWTHINGS_IO_ID_LEN, set to the flow ID
+ *
+ * RETURN:
+ * Returns FLOWTHINGS_IO_OK, FLOWTHINGS_IO_ERROR_NOT_FOUND if there's no flow with that path, or
+ * the error for the request to the platform.
+ */
+flowthings_io_result_code flowthings_io_flow_resolve(flowthings_io_api *api, const char *path,
+		char *flow_id);
+
+/*
+ * NAME: flowthings_io_flow_resolve_prefix
+ *
+ * Fills the API's resolver with every flow whose path starts with prefix, listing them a page at
+ * a time, so that later calls to flowthings_io_flow_resolve for them don't make a request.  The
+ * flows are listed on the API's asynchronous engine, as for flowthings_io_service_find_iter_open.
+ *
+ * PARAMS:
+ * api - the API object, which must have a resolver
+ * prefix - the start of the flow paths, e.g. /myaccountname/sensors/
+ * count - if not NULL, set to the number of flows found
+ *
+ * RETURN:
+ * Returns FLOWTHINGS_IO_OK, or the error for a request to the platform.
+ */
+flowthings_io_result_code flowthings_io_flow_resolve_prefix(flowthings_io_api *api,
+		const char *prefix, int *count);
+
 #ifdef  __cplusplus
 }
 #endif
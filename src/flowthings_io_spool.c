@@ -0,0 +1,773 @@
+/*
+ * flowthings_io_spool.c
+ *
+ * A store-and-forward queue for drops in a memory-mapped file.
+ *
+ * The file is a header page followed by a ring of records.  Records are addressed by a logical
+ * offset that only increases; a record lives at offset % capacity, and holds its own offset, so a
+ * record left over from an earlier trip around the ring never looks valid.  Each record also has
+ * a CRC, so the end of the queue is found on open by walking forward from the front until a
+ * record doesn't check out, and only the front of the queue needs to be stored in the header.
+ */
+
+/* mmap, ftruncate and the clocks are POSIX */
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "cJSON.h"
+#include "flowthings_io_json.h"
+#include "flowthings_io_spool.h"
+
+
+/***********************************************************************
+ * The file format
+ ***********************************************************************/
+
+#define FLOWTHINGS_IO_SPOOL_MAGIC "FTIOSPL1"
+#define FLOWTHINGS_IO_SPOOL_VERSION 1
+#define FLOWTHINGS_IO_SPOOL_HEADER_SIZE 4096
+
+/* the len of a record that says the rest of the ring is unused and the next record is at 0 */
+#define FLOWTHINGS_IO_SPOOL_WRAP 0xFFFFFFFFu
+
+#define FLOWTHINGS_IO_SPOOL_ALIGN(n) (((n) + 7) & ~(unsigned long long)7)
+
+/*
+ * The front of the queue.  The header holds two, written alternately, so that one is always
+ * whole; the valid one with the higher gen is current.
+ */
+typedef struct __flowthings_io_spool_commit {
+	unsigned long long head;
+	unsigned long long gen;
+	unsigned int crc;
+	unsigned int unused;
+} __flowthings_io_spool_commit;
+
+typedef struct __flowthings_io_spool_header {
+	char magic[8];
+	unsigned int version;
+	unsigned int header_size;
+	unsigned long long capacity;
+	__flowthings_io_spool_commit commit[2];
+} __flowthings_io_spool_header;
+
+/* followed by len bytes: the flow ID and the drop JSON, each null terminated */
+typedef struct __flowthings_io_spool_record {
+	unsigned long long offset;
+	unsigned long long time_ms;
+	unsigned int len;
+	unsigned int crc;
+} __flowthings_io_spool_record;
+
+/* the CRC of a record covers everything in the record header before it */
+#define FLOWTHINGS_IO_SPOOL_RECORD_CRC_SIZE 20
+
+
+/***********************************************************************
+ * The spool object
+ ***********************************************************************/
+
+struct flowthings_io_spool {
+
+	int fd;
+	unsigned char *map;
+	size_t map_size;
+	__flowthings_io_spool_header *header;
+	unsigned char *data;
+	unsigned long long capacity;
+	BOOL overwrite;
+
+	/* guards everything below; held only while the map is being read or written, not while
+	 * replayed drops are being sent */
+	pthread_mutex_t lock;
+
+	unsigned long long head;
+	unsigned long long tail;
+	unsigned long long gen;
+	unsigned long records;
+
+	/* appended data up to synced_to has been written through */
+	unsigned long long sync_bytes;
+	unsigned long long synced_to;
+
+	/* records before this are being sent by flowthings_io_spool_replay, and mustn't be
+	 * overwritten */
+	unsigned long long replaying_to;
+
+	/* one replay at a time */
+	pthread_mutex_t replay_lock;
+};
+
+
+/***********************************************************************
+ * Helper functions
+ ***********************************************************************/
+
+static unsigned int __flowthings_io_spool_crc_table[256];
+static pthread_once_t __flowthings_io_spool_crc_once = PTHREAD_ONCE_INIT;
+
+static void __flowthings_io_spool_crc_init(void)
+{
+	unsigned int c, i, k;
+
+	for (i = 0; i < 256; i++) {
+		for (c = i, k = 0; k < 8; k++)
+			c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		__flowthings_io_spool_crc_table[i] = c;
+	}
+}
+
+/*
+ * NAME: __flowthings_io_spool_crc
+ *
+ * Continues a CRC-32 over len more bytes; start with crc = 0.
+ */
+static unsigned int __flowthings_io_spool_crc(unsigned int crc, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+
+	crc = ~crc;
+	while (len--)
+		crc = __flowthings_io_spool_crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+static unsigned long long __flowthings_io_spool_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (unsigned long long)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static __flowthings_io_spool_record *__flowthings_io_spool_at(flowthings_io_spool *spool,
+		unsigned long long pos)
+{
+	return (__flowthings_io_spool_record *)(spool->data + pos % spool->capacity);
+}
+
+/*
+ * NAME: __flowthings_io_spool_skip
+ *
+ * Returns where the record at pos really starts: at the start of the ring if there isn't room
+ * left before its end for a record header.
+ */
+static unsigned long long __flowthings_io_spool_skip(flowthings_io_spool *spool,
+		unsigned long long pos)
+{
+	unsigned long long left = spool->capacity - pos % spool->capacity;
+
+	return left < sizeof(__flowthings_io_spool_record) ? pos + left : pos;
+}
+
+/*
+ * NAME: __flowthings_io_spool_next
+ *
+ * Returns the offset after the record at pos.
+ */
+static unsigned long long __flowthings_io_spool_next(flowthings_io_spool *spool,
+		unsigned long long pos, __flowthings_io_spool_record *rec)
+{
+	if (rec->len == FLOWTHINGS_IO_SPOOL_WRAP)
+		return pos + spool->capacity - pos % spool->capacity;
+
+	return pos + sizeof(__flowthings_io_spool_record) + FLOWTHINGS_IO_SPOOL_ALIGN(rec->len);
+}
+
+/*
+ * NAME: __flowthings_io_spool_valid
+ *
+ * Returns the record at pos (which must have been through __flowthings_io_spool_skip) if it was
+ * written whole at that offset, or else NULL.
+ */
+static __flowthings_io_spool_record *__flowthings_io_spool_valid(flowthings_io_spool *spool,
+		unsigned long long pos)
+{
+	__flowthings_io_spool_record *rec = __flowthings_io_spool_at(spool, pos);
+	unsigned long long left = spool->capacity - pos % spool->capacity;
+	unsigned int crc;
+
+	if (rec->offset != pos)
+		return NULL;
+
+	if (rec->len != FLOWTHINGS_IO_SPOOL_WRAP && rec->len > left - sizeof(__flowthings_io_spool_record))
+		return NULL;
+
+	crc = __flowthings_io_spool_crc(0, rec, FLOWTHINGS_IO_SPOOL_RECORD_CRC_SIZE);
+	if (rec->len != FLOWTHINGS_IO_SPOOL_WRAP)
+		crc = __flowthings_io_spool_crc(crc, rec + 1, rec->len);
+
+	return crc == rec->crc ? rec : NULL;
+}
+
+/*
+ * NAME: __flowthings_io_spool_write
+ *
+ * Writes a record header at pos; its data must already be in place.
+ */
+static void __flowthings_io_spool_write(flowthings_io_spool *spool, unsigned long long pos,
+		unsigned int len)
+{
+	__flowthings_io_spool_record *rec = __flowthings_io_spool_at(spool, pos);
+	unsigned int crc;
+
+	rec->offset = pos;
+	rec->time_ms = __flowthings_io_spool_now_ms();
+	rec->len = len;
+
+	crc = __flowthings_io_spool_crc(0, rec, FLOWTHINGS_IO_SPOOL_RECORD_CRC_SIZE);
+	if (len != FLOWTHINGS_IO_SPOOL_WRAP)
+		crc = __flowthings_io_spool_crc(crc, rec + 1, len);
+	rec->crc = crc;
+}
+
+/*
+ * NAME: __flowthings_io_spool_save_head
+ *
+ * Records the front of the queue in the header.  Must be called with the lock held.
+ */
+static void __flowthings_io_spool_save_head(flowthings_io_spool *spool)
+{
+	__flowthings_io_spool_commit *commit = &spool->header->commit[++spool->gen & 1];
+
+	commit->head = spool->head;
+	commit->gen = spool->gen;
+	commit->unused = 0;
+	commit->crc = __flowthings_io_spool_crc(0, commit, 16);
+}
+
+/*
+ * NAME: __flowthings_io_spool_msync
+ *
+ * Writes the pages holding len bytes at addr through to the device.
+ */
+static void __flowthings_io_spool_msync(flowthings_io_spool *spool, unsigned char *addr, size_t len)
+{
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t start = (size_t)(addr - spool->map) / page * page;
+
+	msync(spool->map + start, (size_t)(addr - spool->map) + len - start, MS_SYNC);
+}
+
+/*
+ * NAME: __flowthings_io_spool_sync_data
+ *
+ * Writes appended records through to the device.  Must be called with the lock held.
+ */
+static void __flowthings_io_spool_sync_data(flowthings_io_spool *spool)
+{
+	unsigned long long from = spool->synced_to, len;
+
+	if (from < spool->head)
+		from = spool->head;
+
+	while (from < spool->tail) {
+		len = spool->capacity - from % spool->capacity;
+		if (len > spool->tail - from)
+			len = spool->tail - from;
+		__flowthings_io_spool_msync(spool, spool->data + from % spool->capacity, len);
+		from += len;
+	}
+
+	spool->synced_to = spool->tail;
+}
+
+/*
+ * NAME: __flowthings_io_spool_evict
+ *
+ * Throws away the oldest record to make room.  Returns FALSE if there isn't one that can go.
+ * Must be called with the lock held.
+ */
+static BOOL __flowthings_io_spool_evict(flowthings_io_spool *spool)
+{
+	__flowthings_io_spool_record *rec;
+	unsigned long long pos = spool->head;
+
+	if (spool->replaying_to > spool->head)
+		return FALSE;
+
+	while (pos < spool->tail) {
+		pos = __flowthings_io_spool_skip(spool, pos);
+		if (pos >= spool->tail)
+			break;
+
+		rec = __flowthings_io_spool_at(spool, pos);
+		pos = __flowthings_io_spool_next(spool, pos, rec);
+
+		if (rec->len != FLOWTHINGS_IO_SPOOL_WRAP) {
+			spool->head = pos;
+			spool->records--;
+			__flowthings_io_spool_save_head(spool);
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * NAME: __flowthings_io_spool_transient
+ *
+ * Returns TRUE for errors that replaying the drop later might not get.
+ */
+static BOOL __flowthings_io_spool_transient(flowthings_io_result_code code)
+{
+	switch (code) {
+	case FLOWTHINGS_IO_OK:
+	case FLOWTHINGS_IO_ERROR_COULDNT_DECODE:
+	case FLOWTHINGS_IO_ERROR_COULDNT_ENCODE:
+	case FLOWTHINGS_IO_ERROR_NOT_FOUND:
+	case FLOWTHINGS_IO_ERROR_BAD_REQUEST:
+		return FALSE;
+	default:
+		return TRUE;
+	}
+}
+
+
+/***********************************************************************
+ * The spool functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_spool_init
+ *
+ * Opens a spool file, creating it if it doesn't exist, and finds the drops left in it.
+ *
+ * PARAMS:
+ * path - the file
+ * capacity - the size of the ring in bytes, for a new file
+ * overwrite - if TRUE, a full spool throws away its oldest drops
+ */
+flowthings_io_spool *flowthings_io_spool_init(const char *path, unsigned long long capacity,
+		BOOL overwrite)
+{
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	flowthings_io_spool *spool;
+	__flowthings_io_spool_commit *commit;
+	__flowthings_io_spool_record *rec;
+	struct stat st;
+	BOOL created = FALSE;
+	unsigned long long pos, end;
+	int fd, i;
+
+	pthread_once(&__flowthings_io_spool_crc_once, __flowthings_io_spool_crc_init);
+
+	if (!path || (fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+		return NULL;
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+
+	if (st.st_size == 0) {
+		capacity = (capacity + page - 1) / page * page;
+		if (capacity == 0 || ftruncate(fd, FLOWTHINGS_IO_SPOOL_HEADER_SIZE + capacity)) {
+			close(fd);
+			return NULL;
+		}
+		created = TRUE;
+	}
+	else if (st.st_size <= FLOWTHINGS_IO_SPOOL_HEADER_SIZE) {
+		close(fd);
+		return NULL;
+	}
+	else {
+		capacity = st.st_size - FLOWTHINGS_IO_SPOOL_HEADER_SIZE;
+	}
+
+	spool = malloc(sizeof(flowthings_io_spool));
+	if (!spool) FAIL;
+
+	memset(spool, 0, sizeof(flowthings_io_spool));
+	spool->fd = fd;
+	spool->capacity = capacity;
+	spool->overwrite = overwrite;
+	spool->map_size = FLOWTHINGS_IO_SPOOL_HEADER_SIZE + capacity;
+	spool->map = mmap(NULL, spool->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (spool->map == MAP_FAILED) {
+		close(fd);
+		free(spool);
+		return NULL;
+	}
+
+	spool->header = (__flowthings_io_spool_header *)spool->map;
+	spool->data = spool->map + FLOWTHINGS_IO_SPOOL_HEADER_SIZE;
+
+	if (created) {
+		memcpy(spool->header->magic, FLOWTHINGS_IO_SPOOL_MAGIC, 8);
+		spool->header->version = FLOWTHINGS_IO_SPOOL_VERSION;
+		spool->header->header_size = FLOWTHINGS_IO_SPOOL_HEADER_SIZE;
+		spool->header->capacity = capacity;
+		__flowthings_io_spool_save_head(spool);
+		__flowthings_io_spool_msync(spool, spool->map, FLOWTHINGS_IO_SPOOL_HEADER_SIZE);
+	}
+	else if (memcmp(spool->header->magic, FLOWTHINGS_IO_SPOOL_MAGIC, 8)
+			|| spool->header->version != FLOWTHINGS_IO_SPOOL_VERSION
+			|| spool->header->header_size != FLOWTHINGS_IO_SPOOL_HEADER_SIZE
+			|| spool->header->capacity != capacity) {
+		munmap(spool->map, spool->map_size);
+		close(fd);
+		free(spool);
+		return NULL;
+	}
+
+	/* the newest whole commit says where the queue starts */
+	for (i = 0; i < 2; i++) {
+		commit = &spool->header->commit[i];
+		if (commit->crc == __flowthings_io_spool_crc(0, commit, 16) && commit->gen >= spool->gen) {
+			spool->gen = commit->gen;
+			spool->head = commit->head;
+		}
+	}
+
+	/* and the records that check out after it are the queue; it ends after the last of them, as
+	 * flowthings_io_spool_append leaves it, not after any space skipped at the end of the ring */
+	for (pos = end = spool->head; pos - spool->head < capacity; ) {
+
+		pos = __flowthings_io_spool_skip(spool, pos);
+		if (pos - spool->head >= capacity || !(rec = __flowthings_io_spool_valid(spool, pos)))
+			break;
+
+		if (rec->len != FLOWTHINGS_IO_SPOOL_WRAP)
+			spool->records++;
+
+		pos = end = __flowthings_io_spool_next(spool, pos, rec);
+	}
+
+	spool->tail = end < spool->head + capacity ? end : spool->head + capacity;
+	spool->synced_to = spool->tail;
+
+	pthread_mutex_init(&spool->lock, NULL);
+	pthread_mutex_init(&spool->replay_lock, NULL);
+
+	return spool;
+}
+
+/*
+ * NAME: flowthings_io_spool_set_sync
+ *
+ * Sets how many appended bytes are written through to the device at a time.
+ *
+ * PARAMS:
+ * spool - the spool
+ * sync_bytes - sync after this many bytes, or 0 to not sync on append
+ */
+void flowthings_io_spool_set_sync(flowthings_io_spool *spool, unsigned long long sync_bytes)
+{
+	if (!spool) FAIL;
+
+	pthread_mutex_lock(&spool->lock);
+	spool->sync_bytes = sync_bytes;
+	pthread_mutex_unlock(&spool->lock);
+}
+
+/*
+ * NAME: flowthings_io_spool_append
+ *
+ * Adds an encoded drop to the end of the spool.
+ *
+ * PARAMS:
+ * spool - the spool
+ * flow_id - the ID of the flow to create the drop in
+ * json - the drop, as compact JSON
+ */
+flowthings_io_result_code flowthings_io_spool_append(flowthings_io_spool *spool,
+		const char *flow_id, const char *json)
+{
+	size_t flow_len, json_len;
+	unsigned long long need, left, waste, next;
+	unsigned char *data;
+
+	if (!spool || !flow_id || !json)
+		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+
+	flow_len = strlen(flow_id) + 1;
+	json_len = strlen(json) + 1;
+	need = sizeof(__flowthings_io_spool_record) + FLOWTHINGS_IO_SPOOL_ALIGN(flow_len + json_len);
+
+	if (need > spool->capacity || flow_len + json_len >= FLOWTHINGS_IO_SPOOL_WRAP)
+		return FLOWTHINGS_IO_ERROR_QUEUE_FULL;
+
+	pthread_mutex_lock(&spool->lock);
+
+	/* a record doesn't wrap around the end of the ring; the space left there is skipped */
+	for (;;) {
+		left = spool->capacity - spool->tail % spool->capacity;
+		waste = left < need ? left : 0;
+
+		if (spool->tail - spool->head + waste + need <= spool->capacity)
+			break;
+
+		if (!spool->overwrite || !__flowthings_io_spool_evict(spool)) {
+			pthread_mutex_unlock(&spool->lock);
+			return FLOWTHINGS_IO_ERROR_QUEUE_FULL;
+		}
+	}
+
+	if (waste >= sizeof(__flowthings_io_spool_record))
+		__flowthings_io_spool_write(spool, spool->tail, FLOWTHINGS_IO_SPOOL_WRAP);
+	spool->tail += waste;
+
+	data = (unsigned char *)(__flowthings_io_spool_at(spool, spool->tail) + 1);
+	memcpy(data, flow_id, flow_len);
+	memcpy(data + flow_len, json, json_len);
+	__flowthings_io_spool_write(spool, spool->tail, (unsigned int)(flow_len + json_len));
+
+	spool->tail += need;
+	spool->records++;
+
+	/* so that a record left after a torn one by a crash isn't taken for the next one */
+	next = __flowthings_io_spool_skip(spool, spool->tail);
+	if (next + sizeof(__flowthings_io_spool_record) <= spool->head + spool->capacity)
+		__flowthings_io_spool_at(spool, next)->offset = ~0ULL;
+
+	if (spool->sync_bytes && spool->tail - spool->synced_to >= spool->sync_bytes)
+		__flowthings_io_spool_sync_data(spool);
+
+	pthread_mutex_unlock(&spool->lock);
+
+	return FLOWTHINGS_IO_OK;
+}
+
+/*
+ * NAME: flowthings_io_spool_append_object
+ *
+ * Encodes a drop and adds it to the end of the spool.
+ *
+ * PARAMS:
+ * spool - the spool
+ * flow_id - the ID of the flow to create the drop in
+ * encoder - the drop encoder
+ * object - the drop
+ */
+flowthings_io_result_code flowthings_io_spool_append_object(flowthings_io_spool *spool,
+		const char *flow_id, flowthings_io_cb_encode_object encoder, void *object)
+{
+	flowthings_io_result_code code;
+	cJSON *in_root;
+	char *json;
+
+	if (!encoder)
+		return FLOWTHINGS_IO_ERROR_COULDNT_ENCODE;
+
+	in_root = cJSON_CreateObject();
+	json = encoder(object, in_root) ? flowthings_io_json_print(in_root) : NULL;
+	cJSON_Delete(in_root);
+
+	if (!json)
+		return FLOWTHINGS_IO_ERROR_COULDNT_ENCODE;
+
+	code = flowthings_io_spool_append(spool, flow_id, json);
+	free(json);
+
+	return code;
+}
+
+/*
+ * NAME: flowthings_io_spool_replay
+ *
+ * Sends spooled drops to the platform in order, in batches, until the spool is empty, max_records
+ * have been sent, or a drop fails in a way that may not last.
+ *
+ * PARAMS:
+ * spool - the spool
+ * api - the API object to send with
+ * max_records - the most drops to send, or 0 for all of them
+ */
+flowthings_io_result_code flowthings_io_spool_replay(flowthings_io_spool *spool,
+		flowthings_io_api *api, int max_records)
+{
+	flowthings_io_result_code code = FLOWTHINGS_IO_OK, *codes;
+	unsigned long long pos, *ends;
+	__flowthings_io_spool_record *rec;
+	char **jsons, *flow_id, *rec_flow_id;
+	int limit, count, sent = 0, i;
+
+	if (!spool || !api)
+		return FLOWTHINGS_IO_ERROR_NOT_INITIALIZED;
+
+	limit = api->batch_max_items;
+	jsons = malloc(sizeof(char *) * limit);
+	ends = malloc(sizeof(unsigned long long) * limit);
+	codes = malloc(sizeof(flowthings_io_result_code) * limit);
+	if (!jsons || !ends || !codes) FAIL;
+
+	pthread_mutex_lock(&spool->replay_lock);
+
+	while (max_records <= 0 || sent < max_records) {
+
+		/* take the drops for one flow from the front; they stay in the map, and can't be
+		 * overwritten while replaying_to is past them */
+		pthread_mutex_lock(&spool->lock);
+
+		flow_id = NULL;
+		count = 0;
+
+		for (pos = spool->head; pos < spool->tail && count < limit
+				&& (max_records <= 0 || sent + count < max_records); ) {
+
+			pos = __flowthings_io_spool_skip(spool, pos);
+			if (pos >= spool->tail)
+				break;
+
+			rec = __flowthings_io_spool_at(spool, pos);
+
+			if (rec->len != FLOWTHINGS_IO_SPOOL_WRAP) {
+				rec_flow_id = (char *)(rec + 1);
+				if (flow_id && strcmp(flow_id, rec_flow_id))
+					break;
+				flow_id = rec_flow_id;
+				jsons[count] = rec_flow_id + strlen(rec_flow_id) + 1;
+			}
+
+			pos = __flowthings_io_spool_next(spool, pos, rec);
+
+			if (rec->len != FLOWTHINGS_IO_SPOOL_WRAP)
+				ends[count++] = pos;
+		}
+
+		spool->replaying_to = count > 0 ? ends[count - 1] : 0;
+
+		pthread_mutex_unlock(&spool->lock);
+
+		if (count == 0)
+			break;
+
+		__flowthings_io_service_create_encoded(FLOWTHINGS_IO_SERVICE_TYPE_DROP, flow_id, api, NULL,
+				jsons, count, codes);
+
+		for (i = 0; i < count && !__flowthings_io_spool_transient(codes[i]); i++)
+			;
+
+		pthread_mutex_lock(&spool->lock);
+		if (i > 0) {
+			spool->head = ends[i - 1];
+			spool->records -= i;
+			__flowthings_io_spool_save_head(spool);
+			__flowthings_io_spool_msync(spool, spool->map, FLOWTHINGS_IO_SPOOL_HEADER_SIZE);
+		}
+		spool->replaying_to = 0;
+		pthread_mutex_unlock(&spool->lock);
+
+		sent += i;
+
+		if (i < count) {
+			code = codes[i];
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&spool->replay_lock);
+
+	free(jsons);
+	free(ends);
+	free(codes);
+
+	return code;
+}
+
+/*
+ * NAME: flowthings_io_spool_get_stats
+ *
+ * Fills in the spool's depth and age.
+ *
+ * PARAMS:
+ * spool - the spool
+ * stats - filled in
+ */
+void flowthings_io_spool_get_stats(flowthings_io_spool *spool, flowthings_io_spool_stats *stats)
+{
+	__flowthings_io_spool_record *rec;
+	unsigned long long pos, now = __flowthings_io_spool_now_ms();
+
+	if (!spool || !stats) FAIL;
+
+	pthread_mutex_lock(&spool->lock);
+
+	stats->records = spool->records;
+	stats->bytes = spool->tail - spool->head;
+	stats->capacity = spool->capacity;
+	stats->oldest_age_ms = 0;
+
+	for (pos = spool->head; pos < spool->tail; ) {
+		pos = __flowthings_io_spool_skip(spool, pos);
+		if (pos >= spool->tail)
+			break;
+
+		rec = __flowthings_io_spool_at(spool, pos);
+		if (rec->len != FLOWTHINGS_IO_SPOOL_WRAP) {
+			stats->oldest_age_ms = now > rec->time_ms ? now - rec->time_ms : 0;
+			break;
+		}
+		pos = __flowthings_io_spool_next(spool, pos, rec);
+	}
+
+	pthread_mutex_unlock(&spool->lock);
+}
+
+/*
+ * NAME: flowthings_io_spool_sync
+ *
+ * Writes everything appended so far through to the device.
+ *
+ * PARAMS:
+ * spool - the spool
+ */
+void flowthings_io_spool_sync(flowthings_io_spool *spool)
+{
+	if (!spool) FAIL;
+
+	pthread_mutex_lock(&spool->lock);
+	__flowthings_io_spool_sync_data(spool);
+	__flowthings_io_spool_msync(spool, spool->map, FLOWTHINGS_IO_SPOOL_HEADER_SIZE);
+	pthread_mutex_unlock(&spool->lock);
+}
+
+/*
+ * NAME: flowthings_io_spool_cleanup
+ *
+ * Syncs and closes the spool.
+ *
+ * PARAMS:
+ * spool - the spool
+ */
+void flowthings_io_spool_cleanup(flowthings_io_spool *spool)
+{
+	if (!spool) return;
+
+	flowthings_io_spool_sync(spool);
+
+	munmap(spool->map, spool->map_size);
+	close(spool->fd);
+
+	pthread_mutex_destroy(&spool->lock);
+	pthread_mutex_destroy(&spool->replay_lock);
+	free(spool);
+}
+
+
+#ifdef  __cplusplus
+}
+#endif
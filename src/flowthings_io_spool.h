@@ -0,0 +1,181 @@
+/*
+ * flowthings_io_spool.h
+ *
+ * A store-and-forward queue for drops, kept in a memory-mapped file so that drops created while
+ * the platform can't be reached survive until they can be sent, even across restarts.
+ */
+
+#ifndef FLOWTHINGS_IO_SPOOL_H_
+#define FLOWTHINGS_IO_SPOOL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io.h"
+#include "flowthings_io_api.h"
+#include "flowthings_io_services.h"
+
+
+/***********************************************************************
+ * The spool object
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_spool
+ *
+ * An append-only ring of encoded drops in a file.  Appending a drop only writes the drop itself;
+ * the file's header is only rewritten when drops are taken off the front, so a flash device sees
+ * little more than the bytes that were spooled.
+ */
+typedef struct flowthings_io_spool flowthings_io_spool;
+
+/*
+ * NAME: flowthings_io_spool_stats
+ *
+ * records - the number of drops waiting
+ * bytes - the space they take in the file
+ * capacity - the size of the ring
+ * oldest_age_ms - how long ago the oldest waiting drop was spooled, or 0 if there are none
+ */
+typedef struct flowthings_io_spool_stats {
+	unsigned long records;
+	unsigned long long bytes;
+	unsigned long long capacity;
+	unsigned long long oldest_age_ms;
+} flowthings_io_spool_stats;
+
+
+/***********************************************************************
+ * The spool functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_spool_init
+ *
+ * Opens a spool file, creating it if it doesn't exist, and finds the drops left in it.  The
+ * caller is responsible for calling flowthings_io_spool_cleanup when done.
+ *
+ * PARAMS:
+ * path - the file
+ * capacity - the size of the ring in bytes, for a new file; an existing file keeps its size
+ * overwrite - if TRUE, a full spool makes room by throwing away its oldest drops; otherwise
+ *     appending to a full spool fails
+ *
+ * RETURN:
+ * Returns the spool, or NULL if the file can't be opened or isn't a spool file.
+ */
+flowthings_io_spool *flowthings_io_spool_init(const char *path, unsigned long long capacity,
+		BOOL overwrite);
+
+/*
+ * NAME: flowthings_io_spool_set_sync
+ *
+ * Sets how often appended drops are written through to the device.  By default they are left to
+ * the operating system, and to flowthings_io_spool_sync.
+ *
+ * PARAMS:
+ * spool - the spool
+ * sync_bytes - sync after this many bytes have been appended, or 0 to not sync on append
+ */
+void flowthings_io_spool_set_sync(flowthings_io_spool *spool, unsigned long long sync_bytes);
+
+/*
+ * NAME: flowthings_io_spool_append
+ *
+ * Adds an encoded drop to the end of the spool.  May be called from any thread.
+ *
+ * PARAMS:
+ * spool - the spool
+ * flow_id - the ID of the flow to create the drop in
+ * json - the drop, as compact JSON
+ *
+ * RETURN:
+ * Returns FLOWTHINGS_IO_OK, or FLOWTHINGS_IO_ERROR_QUEUE_FULL if there's no room.
+ */
+flowthings_io_result_code flowthings_io_spool_append(flowthings_io_spool *spool,
+		const char *flow_id, const char *json);
+
+/*
+ * NAME: flowthings_io_spool_append_object
+ *
+ * Encodes a drop and adds it to the end of the spool.
+ *
+ * PARAMS:
+ * spool - the spool
+ * flow_id - the ID of the flow to create the drop in
+ * encoder - the drop encoder (see flowthings_io_cb_encode_object)
+ * object - the drop
+ *
+ * RETURN:
+ * Returns FLOWTHINGS_IO_OK, FLOWTHINGS_IO_ERROR_COULDNT_ENCODE or FLOWTHINGS_IO_ERROR_QUEUE_FULL.
+ */
+flowthings_io_result_code flowthings_io_spool_append_object(flowthings_io_spool *spool,
+		const char *flow_id, flowthings_io_cb_encode_object encoder, void *object);
+
+/*
+ * NAME: flowthings_io_spool_replay
+ *
+ * Sends spooled drops to the platform in order, in batches (see flowthings_io_drop_create_batch),
+ * taking each one off the spool once the platform has answered for it.  Drops the platform
+ * rejects (bad request, not found) are thrown away; replay stops at the first drop that fails
+ * for a reason that may go away (no connection, server error, forbidden), which stays at the
+ * front of the spool.  A drop may be sent again if replay stops partway through a batch, or the
+ * process stops before the spool records that it was sent.
+ *
+ * PARAMS:
+ * spool - the spool
+ * api - the API object to send with
+ * max_records - the most drops to send, or 0 for all of them
+ *
+ * RETURN:
+ * Returns FLOWTHINGS_IO_OK if replay stopped because the spool was empty or max_records were
+ * sent, or else the error that stopped it.
+ */
+flowthings_io_result_code flowthings_io_spool_replay(flowthings_io_spool *spool,
+		flowthings_io_api *api, int max_records);
+
+/*
+ * NAME: flowthings_io_spool_get_stats
+ *
+ * Fills in the spool's depth and age.
+ *
+ * PARAMS:
+ * spool - the spool
+ * stats - filled in
+ */
+void flowthings_io_spool_get_stats(flowthings_io_spool *spool, flowthings_io_spool_stats *stats);
+
+/*
+ * NAME: flowthings_io_spool_sync
+ *
+ * Writes everything appended so far through to the device.
+ *
+ * PARAMS:
+ * spool - the spool
+ */
+void flowthings_io_spool_sync(flowthings_io_spool *spool);
+
+/*
+ * NAME: flowthings_io_spool_cleanup
+ *
+ * Syncs and closes the spool.  The drops in it stay in the file.
+ *
+ * PARAMS:
+ * spool - the spool
+ */
+void flowthings_io_spool_cleanup(flowthings_io_spool *spool);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* FLOWTHINGS_IO_SPOOL_H_ */
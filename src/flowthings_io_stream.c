@@ -0,0 +1,270 @@
+/*
+ * flowthings_io_stream.c
+ *
+ * An incremental scanner for platform responses.  Only the value currently being received is
+ * kept in memory; everything else in the response is scanned and dropped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io.h"
+#include "flowthings_io_stream.h"
+
+
+/***********************************************************************
+ * Helper functions
+ ***********************************************************************/
+
+/*
+ * NAME: __flowthings_io_stream_emit
+ *
+ * Finish the value being captured with the last len bytes at data, and pass it to the callback.
+ */
+static void __flowthings_io_stream_emit(flowthings_io_stream *stream, const char *data, size_t len)
+{
+	flowthings_io_string_append(stream->value, data, len);
+
+	stream->capturing = FALSE;
+	stream->count++;
+
+	if (stream->capture_depth == 1) {
+		stream->capture_depth = 0;
+		stream->body_done = TRUE;
+	}
+
+	if (!stream->stopped && !stream->on_value(stream->value->ptr, stream->value->len, stream->user_data))
+		stream->stopped = TRUE;
+
+	flowthings_io_string_reset(stream->value);
+}
+
+
+/***********************************************************************
+ * The stream functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_stream_init
+ *
+ * Initialize a stream, the caller is responsible for calling flowthings_io_stream_cleanup when
+ * done.
+ *
+ * PARAMS:
+ * split_arrays - if TRUE and the body is an array, on_value is called for each element, and a
+ *     body that isn't an array is skipped; if FALSE, on_value is called once with the whole body
+ * on_value - the callback for each value
+ * user_data - passed to on_value
+ */
+flowthings_io_stream *flowthings_io_stream_init(BOOL split_arrays,
+		flowthings_io_stream_cb_value on_value, void *user_data)
+{
+	flowthings_io_stream *stream = malloc(sizeof(flowthings_io_stream));
+
+	if (!stream || !on_value) {
+		FAIL;
+	}
+
+	memset(stream, 0, sizeof(flowthings_io_stream));
+
+	stream->split_arrays = split_arrays;
+	stream->on_value = on_value;
+	stream->user_data = user_data;
+	stream->value = flowthings_io_string_init();
+
+	return stream;
+}
+
+/*
+ * NAME: flowthings_io_stream_reset
+ *
+ * Gets a stream ready to scan a new response, keeping its callback and its value buffer.
+ *
+ * PARAMS:
+ * stream - the stream
+ * split_arrays - as for flowthings_io_stream_init
+ */
+void flowthings_io_stream_reset(flowthings_io_stream *stream, BOOL split_arrays)
+{
+	flowthings_io_stream_cb_value on_value;
+	flowthings_io_string *value;
+	void *user_data;
+
+	if (!stream) FAIL;
+
+	on_value = stream->on_value;
+	user_data = stream->user_data;
+	value = stream->value;
+
+	memset(stream, 0, sizeof(flowthings_io_stream));
+
+	stream->split_arrays = split_arrays;
+	stream->on_value = on_value;
+	stream->user_data = user_data;
+	stream->value = value;
+
+	flowthings_io_string_reset(stream->value);
+}
+
+/*
+ * NAME: flowthings_io_stream_feed
+ *
+ * Scan the next chunk of the response.  Chunks can be split anywhere, including inside strings
+ * and escapes.
+ *
+ * PARAMS:
+ * stream - the stream
+ * data - the chunk
+ * len - the length of the chunk
+ */
+void flowthings_io_stream_feed(flowthings_io_stream *stream, const char *data, size_t len)
+{
+	size_t i, seg = 0;
+	char c;
+
+	if (!stream || !data) FAIL;
+
+	for (i = 0; i < len; i++) {
+
+		c = data[i];
+
+		if (stream->in_string) {
+
+			if (stream->escape) {
+				stream->escape = FALSE;
+			}
+			else if (c == '\\') {
+				stream->escape = TRUE;
+			}
+			else if (c == '"') {
+				stream->in_string = FALSE;
+
+				if (stream->in_key) {
+					stream->in_key = FALSE;
+					stream->key_is_body = stream->key_len == 4 && !memcmp(stream->key, "body", 4);
+				}
+			}
+			else if (stream->in_key) {
+				if (stream->key_len < sizeof(stream->key))
+					stream->key[stream->key_len] = c;
+				stream->key_len++;
+			}
+
+			continue;
+		}
+
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+			continue;
+
+		/* a number, true, false or null ends at the next separator */
+		if (stream->capturing && !stream->capture_composite && stream->depth == stream->capture_depth
+				&& (c == ',' || c == ']' || c == '}'))
+			__flowthings_io_stream_emit(stream, data + seg, i - seg);
+
+		/* the first character of the body, or of an element of a body array */
+		if (stream->body_pending) {
+
+			stream->body_pending = FALSE;
+			stream->found_body = TRUE;
+
+			if (!stream->split_arrays) {
+				stream->capture_depth = 1;
+				stream->capturing = TRUE;
+				stream->capture_composite = (c == '{' || c == '[');
+				seg = i;
+			}
+			else if (c == '[') {
+				stream->capture_depth = 2;
+			}
+			else {
+				stream->body_done = TRUE;
+			}
+		}
+		else if (stream->capture_depth && !stream->capturing && !stream->stopped
+				&& stream->depth == stream->capture_depth && c != ',' && c != ']' && c != '}') {
+
+			stream->capturing = TRUE;
+			stream->capture_composite = (c == '{' || c == '[');
+			seg = i;
+		}
+
+		switch (c) {
+		case '"':
+			stream->in_string = TRUE;
+			if (stream->depth == 1 && stream->expect_key && !stream->capturing) {
+				stream->in_key = TRUE;
+				stream->key_len = 0;
+			}
+			break;
+		case '{':
+		case '[':
+			stream->depth++;
+			if (stream->depth == 1)
+				stream->expect_key = (c == '{');
+			break;
+		case '}':
+		case ']':
+			stream->depth--;
+			if (stream->capturing && stream->capture_composite && stream->depth == stream->capture_depth)
+				__flowthings_io_stream_emit(stream, data + seg, i + 1 - seg);
+			if (stream->capture_depth == 2 && stream->depth == 1) {
+				stream->capture_depth = 0;
+				stream->body_done = TRUE;
+			}
+			break;
+		case ':':
+			if (stream->depth == 1 && !stream->capturing) {
+				stream->expect_key = FALSE;
+				stream->body_pending = stream->key_is_body && !stream->found_body;
+				stream->key_is_body = FALSE;
+			}
+			break;
+		case ',':
+			if (stream->depth == 1 && !stream->capturing)
+				stream->expect_key = TRUE;
+			break;
+		}
+	}
+
+	if (stream->capturing)
+		flowthings_io_string_append(stream->value, data + seg, len - seg);
+}
+
+/*
+ * NAME: flowthings_io_stream_complete
+ *
+ * Returns TRUE if the whole body of the response has been scanned.
+ */
+BOOL flowthings_io_stream_complete(flowthings_io_stream *stream)
+{
+	return stream && stream->found_body && stream->body_done;
+}
+
+/*
+ * NAME: flowthings_io_stream_cleanup
+ *
+ * Cleans up the object.
+ *
+ * PARAMS:
+ * stream - the object to free
+ */
+void flowthings_io_stream_cleanup(flowthings_io_stream *stream)
+{
+	if (stream) {
+		flowthings_io_string_cleanup(stream->value);
+		free(stream);
+	}
+}
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,143 @@
+/*
+ * flowthings_io_stream.h
+ *
+ * An incremental scanner for platform responses, which finds the "body" of a response as it
+ * arrives and hands it on one value at a time, so decoding can start before the whole response
+ * has been received.
+ */
+
+#ifndef FLOWTHINGS_IO_STREAM_H_
+#define FLOWTHINGS_IO_STREAM_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io.h"
+
+
+/***********************************************************************
+ * The stream object
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_stream_cb_value
+ *
+ * Called for each complete value found in the response body.
+ *
+ * json - the JSON text of the value, null terminated; it may be modified, and is only valid
+ *     until the callback returns
+ * len - the length of json
+ * user_data - the pointer passed to flowthings_io_stream_init
+ *
+ * RETURN:
+ * Return TRUE to keep receiving values, or FALSE to skip the rest of the body.
+ */
+typedef BOOL (*flowthings_io_stream_cb_value)(char *json, size_t len, void *user_data);
+
+typedef struct flowthings_io_stream {
+
+	flowthings_io_stream_cb_value on_value;
+	void *user_data;
+	BOOL split_arrays;
+
+	/* lexical state */
+	int depth;
+	BOOL in_string;
+	BOOL escape;
+
+	/* root object key tracking */
+	BOOL expect_key;
+	BOOL in_key;
+	char key[8];
+	size_t key_len;
+	BOOL key_is_body;
+	BOOL body_pending;
+
+	/* value capture; capture_depth is 0 outside the body */
+	int capture_depth;
+	BOOL capturing;
+	BOOL capture_composite;
+	flowthings_io_string *value;
+
+	BOOL found_body;
+	BOOL body_done;
+	BOOL stopped;
+	int count;
+
+} flowthings_io_stream;
+
+
+/***********************************************************************
+ * The stream functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_stream_init
+ *
+ * Initialize a stream, the caller is responsible for calling flowthings_io_stream_cleanup when
+ * done.
+ *
+ * PARAMS:
+ * split_arrays - if TRUE and the body is an array, on_value is called for each element, and a
+ *     body that isn't an array is skipped; if FALSE, on_value is called once with the whole body
+ * on_value - the callback for each value
+ * user_data - passed to on_value
+ */
+flowthings_io_stream *flowthings_io_stream_init(BOOL split_arrays,
+		flowthings_io_stream_cb_value on_value, void *user_data);
+
+/*
+ * NAME: flowthings_io_stream_reset
+ *
+ * Gets a stream ready to scan a new response, keeping its callback and its value buffer.
+ *
+ * PARAMS:
+ * stream - the stream
+ * split_arrays - as for flowthings_io_stream_init
+ */
+void flowthings_io_stream_reset(flowthings_io_stream *stream, BOOL split_arrays);
+
+/*
+ * NAME: flowthings_io_stream_feed
+ *
+ * Scan the next chunk of the response.  Chunks can be split anywhere, including inside strings
+ * and escapes.
+ *
+ * PARAMS:
+ * stream - the stream
+ * data - the chunk
+ * len - the length of the chunk
+ */
+void flowthings_io_stream_feed(flowthings_io_stream *stream, const char *data, size_t len);
+
+/*
+ * NAME: flowthings_io_stream_complete
+ *
+ * Returns TRUE if the whole body of the response has been scanned.
+ */
+BOOL flowthings_io_stream_complete(flowthings_io_stream *stream);
+
+/*
+ * NAME: flowthings_io_stream_cleanup
+ *
+ * Cleans up the object.
+ *
+ * PARAMS:
+ * stream - the object to free
+ */
+void flowthings_io_stream_cleanup(flowthings_io_stream *stream);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* FLOWTHINGS_IO_STREAM_H_ */
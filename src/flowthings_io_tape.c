@@ -0,0 +1,707 @@
+/*
+ * flowthings_io_tape.c
+ *
+ * Builds a tape from the pull reader's events.  Each word has a tag, the character the value
+ * starts with in JSON ('l' and 'd' for whole and other numbers), in its top byte, and in the rest:
+ *
+ *   { [ - the word after the matching } or ] in the low 32 bits, and the number of members or
+ *         elements in the next 24, so an object or array can be stepped over and counted at once
+ *   } ] - the word of the matching { or [
+ *   "   - the offset of the key or string in the string area in the low 32 bits, and its length
+ *         in the next 24
+ *   l d - nothing; the number is in the next word
+ *
+ * A member of an object is its key's word followed by its value's.  Keys are stored once for as
+ * long as they keep coming back, as they do in every element of a find result, so the string
+ * area mostly holds the strings.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io_json.h"
+#include "flowthings_io_tape.h"
+
+
+/***********************************************************************
+ * The tape object
+ ***********************************************************************/
+
+/* the most words on a tape, as the ends of objects and arrays are kept in 32 bits */
+#define FLOWTHINGS_IO_TAPE_MAX_WORDS 0xFFFFFFFFULL
+
+/* the count kept with an object or array; one with more members or elements is counted by walking it */
+#define FLOWTHINGS_IO_TAPE_MAX_COUNT 0xFFFFFFULL
+
+/* the length kept with a key or string; a longer one is measured with strlen */
+#define FLOWTHINGS_IO_TAPE_MAX_LEN 0xFFFFFFULL
+
+/* the most bytes of keys and strings, as their offsets are kept in 32 bits */
+#define FLOWTHINGS_IO_TAPE_MAX_STRINGS 0xFFFFFFFFULL
+
+/* the keys remembered while parsing, so a repeated one can be stored once */
+#define FLOWTHINGS_IO_TAPE_KEY_SLOTS 64
+
+#define FLOWTHINGS_IO_TAPE_WORD(tag, payload) (((unsigned long long)(unsigned char)(tag) << 56) | (payload))
+#define FLOWTHINGS_IO_TAPE_TAG(word) ((unsigned char)((word) >> 56))
+
+/*
+ * words - the tape
+ * count - the words in use
+ * capacity - the words allocated
+ * strings - the keys and strings, each followed by a null
+ * strings_len - the bytes of strings in use
+ * strings_capacity - the bytes of strings allocated
+ */
+struct flowthings_io_tape {
+	unsigned long long *words;
+	size_t count;
+	size_t capacity;
+
+	char *strings;
+	size_t strings_len;
+	size_t strings_capacity;
+};
+
+static const flowthings_io_tape_value __flowthings_io_tape_none;
+
+
+/***********************************************************************
+ * Helper functions
+ ***********************************************************************/
+
+/*
+ * NAME: __flowthings_io_tape_reserve
+ *
+ * Makes room for words more words and bytes more bytes of strings.  Returns FALSE if they can't
+ * be allocated.
+ */
+static BOOL __flowthings_io_tape_reserve(flowthings_io_tape *tape, size_t words, size_t bytes)
+{
+	size_t capacity;
+	void *p;
+
+	if (tape->count + words > tape->capacity) {
+		for (capacity = tape->capacity ? tape->capacity * 2 : 256; capacity < tape->count + words; )
+			capacity *= 2;
+		if (capacity > FLOWTHINGS_IO_TAPE_MAX_WORDS)
+			capacity = FLOWTHINGS_IO_TAPE_MAX_WORDS;
+		if (tape->count + words > capacity)
+			return FALSE;
+		p = realloc(tape->words, capacity * sizeof(unsigned long long));
+		if (!p)
+			return FALSE;
+		tape->words = p;
+		tape->capacity = capacity;
+	}
+
+	if (tape->strings_len + bytes > tape->strings_capacity) {
+		for (capacity = tape->strings_capacity ? tape->strings_capacity * 2 : 1024;
+				capacity < tape->strings_len + bytes; )
+			capacity *= 2;
+		if (capacity > FLOWTHINGS_IO_TAPE_MAX_STRINGS)
+			capacity = FLOWTHINGS_IO_TAPE_MAX_STRINGS;
+		if (tape->strings_len + bytes > capacity)
+			return FALSE;
+		p = realloc(tape->strings, capacity);
+		if (!p)
+			return FALSE;
+		tape->strings = p;
+		tape->strings_capacity = capacity;
+	}
+
+	return TRUE;
+}
+
+/*
+ * NAME: __flowthings_io_tape_add_string
+ *
+ * Adds the key or string just read to the string area, decoded, and its word to the tape.
+ * Returns FALSE if it has a malformed escape or there is no room for it.
+ */
+static BOOL __flowthings_io_tape_add_string(flowthings_io_tape *tape, flowthings_io_json_reader *reader)
+{
+	size_t offset = tape->strings_len;
+	size_t len = reader->str_len;
+	char *s;
+
+	/* a string is never longer decoded than it is in the text */
+	if (offset + len + 1 > tape->strings_capacity
+			&& !__flowthings_io_tape_reserve(tape, 0, len + 1))
+		return FALSE;
+
+	s = tape->strings + offset;
+
+	if (reader->escaped) {
+		if (!flowthings_io_json_reader_string(reader, s, len + 1))
+			return FALSE;
+		len = strlen(s);
+	}
+	else {
+		memcpy(s, reader->str, len);
+		s[len] = '\0';
+	}
+
+	tape->strings_len = offset + len + 1;
+	tape->words[tape->count++] = FLOWTHINGS_IO_TAPE_WORD('"',
+			(len < FLOWTHINGS_IO_TAPE_MAX_LEN ? len : FLOWTHINGS_IO_TAPE_MAX_LEN) << 32 | offset);
+
+	return TRUE;
+}
+
+/*
+ * NAME: __flowthings_io_tape_add_key
+ *
+ * Adds the key just read, reusing the copy of it in the string area if it is one of the keys in
+ * slots, which are kept by a hash of the key's first, middle and last characters and its length.
+ */
+static BOOL __flowthings_io_tape_add_key(flowthings_io_tape *tape, flowthings_io_json_reader *reader,
+		unsigned long long slots[])
+{
+	const char *key = reader->str;
+	size_t len = reader->str_len;
+	unsigned long long word;
+	unsigned int slot;
+
+	if (reader->escaped || len == 0 || len >= FLOWTHINGS_IO_TAPE_MAX_LEN)
+		return __flowthings_io_tape_add_string(tape, reader);
+
+	slot = (unsigned int)(len * 7 + (unsigned char)key[0] * 3 + (unsigned char)key[len / 2] * 5
+			+ (unsigned char)key[len - 1]) % FLOWTHINGS_IO_TAPE_KEY_SLOTS;
+	word = slots[slot];
+
+	if (word && ((word >> 32) & FLOWTHINGS_IO_TAPE_MAX_LEN) == len
+			&& !memcmp(tape->strings + (word & 0xFFFFFFFFULL), key, len)) {
+		tape->words[tape->count++] = word;
+		return TRUE;
+	}
+
+	if (!__flowthings_io_tape_add_string(tape, reader))
+		return FALSE;
+
+	slots[slot] = tape->words[tape->count - 1];
+
+	return TRUE;
+}
+
+/*
+ * NAME: __flowthings_io_tape_tag
+ *
+ * Returns the tag of a value's word, or 0 for no value.
+ */
+static unsigned char __flowthings_io_tape_tag(flowthings_io_tape_value value)
+{
+	return value.tape ? FLOWTHINGS_IO_TAPE_TAG(value.tape->words[value.at]) : 0;
+}
+
+/*
+ * NAME: __flowthings_io_tape_text
+ *
+ * Returns the key or string at a word, and its length.
+ */
+static const char *__flowthings_io_tape_text(const flowthings_io_tape *tape, size_t at, size_t *len)
+{
+	unsigned long long word = tape->words[at];
+	const char *s = tape->strings + (word & 0xFFFFFFFFULL);
+
+	if (len) {
+		*len = (size_t)((word >> 32) & FLOWTHINGS_IO_TAPE_MAX_LEN);
+		if (*len == FLOWTHINGS_IO_TAPE_MAX_LEN)
+			*len = strlen(s);
+	}
+
+	return s;
+}
+
+/*
+ * NAME: __flowthings_io_tape_member
+ *
+ * Returns the member of an object whose key is the len bytes of key.
+ */
+static flowthings_io_tape_value __flowthings_io_tape_member(flowthings_io_tape_value value,
+		const char *key, size_t len)
+{
+	flowthings_io_tape_value member;
+	const char *s;
+	size_t n;
+
+	if (__flowthings_io_tape_tag(value) != '{')
+		return __flowthings_io_tape_none;
+
+	flowthings_io_tape_for_each(member, value) {
+		s = __flowthings_io_tape_text(member.tape, member.key, &n);
+		if (n == len && !memcmp(s, key, len))
+			return member;
+	}
+
+	return __flowthings_io_tape_none;
+}
+
+
+/***********************************************************************
+ * The tape functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_tape_init
+ *
+ * Creates an empty tape.
+ */
+flowthings_io_tape *flowthings_io_tape_init(void)
+{
+	return calloc(1, sizeof(flowthings_io_tape));
+}
+
+/*
+ * NAME: flowthings_io_tape_cleanup
+ *
+ * Frees a tape and its buffers.
+ */
+void flowthings_io_tape_cleanup(flowthings_io_tape *tape)
+{
+	if (!tape)
+		return;
+
+	free(tape->words);
+	free(tape->strings);
+	free(tape);
+}
+
+/*
+ * NAME: flowthings_io_tape_parse
+ *
+ * Adds a word for every event.  The { or [ of each open object or array is kept, with how many
+ * values it has had so far, and filled in when its end is reached.
+ */
+BOOL flowthings_io_tape_parse(flowthings_io_tape *tape, const char *json, size_t len)
+{
+	flowthings_io_json_reader reader;
+	flowthings_io_json_event event;
+	size_t open[FLOWTHINGS_IO_JSON_MAX_DEPTH];
+	size_t counts[FLOWTHINGS_IO_JSON_MAX_DEPTH];
+	unsigned long long slots[FLOWTHINGS_IO_TAPE_KEY_SLOTS];
+	unsigned long long count;
+	int depth = 0;
+
+	tape->count = 0;
+	tape->strings_len = 0;
+	memset(slots, 0, sizeof(slots));
+
+	flowthings_io_json_reader_init(&reader, json, len);
+
+	while ((event = flowthings_io_json_next(&reader)) != FLOWTHINGS_IO_JSON_END) {
+
+		/* enough for any value; strings make their own room in the string area */
+		if (tape->count + 2 > tape->capacity && !__flowthings_io_tape_reserve(tape, 2, 0))
+			break;
+
+		if (depth > 0 && event != FLOWTHINGS_IO_JSON_KEY && event != FLOWTHINGS_IO_JSON_END_OBJECT
+				&& event != FLOWTHINGS_IO_JSON_END_ARRAY)
+			counts[depth - 1]++;
+
+		switch (event) {
+
+		case FLOWTHINGS_IO_JSON_BEGIN_OBJECT:
+		case FLOWTHINGS_IO_JSON_BEGIN_ARRAY:
+			/* the reader fails anything nested deeper than this */
+			open[depth] = tape->count;
+			counts[depth++] = 0;
+			tape->words[tape->count++] = FLOWTHINGS_IO_TAPE_WORD(
+					event == FLOWTHINGS_IO_JSON_BEGIN_OBJECT ? '{' : '[', 0);
+			continue;
+
+		case FLOWTHINGS_IO_JSON_END_OBJECT:
+		case FLOWTHINGS_IO_JSON_END_ARRAY:
+			depth--;
+			count = counts[depth] < FLOWTHINGS_IO_TAPE_MAX_COUNT ? counts[depth] : FLOWTHINGS_IO_TAPE_MAX_COUNT;
+			tape->words[open[depth]] |= count << 32 | (tape->count + 1);
+			tape->words[tape->count++] = FLOWTHINGS_IO_TAPE_WORD(
+					event == FLOWTHINGS_IO_JSON_END_OBJECT ? '}' : ']', open[depth]);
+			continue;
+
+		case FLOWTHINGS_IO_JSON_KEY:
+			if (!__flowthings_io_tape_add_key(tape, &reader, slots))
+				break;
+			continue;
+
+		case FLOWTHINGS_IO_JSON_STRING:
+			if (!__flowthings_io_tape_add_string(tape, &reader))
+				break;
+			continue;
+
+		case FLOWTHINGS_IO_JSON_NUMBER:
+			/* keep whole numbers past 2^53 exact, as the parser does */
+			if (reader.number == (double)reader.integer) {
+				tape->words[tape->count++] = FLOWTHINGS_IO_TAPE_WORD('l', 0);
+				memcpy(&tape->words[tape->count++], &reader.integer, 8);
+			}
+			else {
+				tape->words[tape->count++] = FLOWTHINGS_IO_TAPE_WORD('d', 0);
+				memcpy(&tape->words[tape->count++], &reader.number, 8);
+			}
+			continue;
+
+		case FLOWTHINGS_IO_JSON_TRUE:
+			tape->words[tape->count++] = FLOWTHINGS_IO_TAPE_WORD('t', 0);
+			continue;
+
+		case FLOWTHINGS_IO_JSON_FALSE:
+			tape->words[tape->count++] = FLOWTHINGS_IO_TAPE_WORD('f', 0);
+			continue;
+
+		case FLOWTHINGS_IO_JSON_NULL:
+			tape->words[tape->count++] = FLOWTHINGS_IO_TAPE_WORD('n', 0);
+			continue;
+
+		default:
+			break;
+		}
+
+		/* only failures get here */
+		break;
+	}
+
+	if (event == FLOWTHINGS_IO_JSON_END)
+		return TRUE;
+
+	tape->count = 0;
+	tape->strings_len = 0;
+
+	return FALSE;
+}
+
+/*
+ * NAME: flowthings_io_tape_size
+ *
+ * Returns the bytes allocated for a tape and its buffers.
+ */
+size_t flowthings_io_tape_size(const flowthings_io_tape *tape)
+{
+	if (!tape)
+		return 0;
+
+	return sizeof(flowthings_io_tape) + tape->capacity * sizeof(unsigned long long) + tape->strings_capacity;
+}
+
+/*
+ * NAME: flowthings_io_tape_used
+ *
+ * Returns the bytes of a tape and its buffers in use.
+ */
+size_t flowthings_io_tape_used(const flowthings_io_tape *tape)
+{
+	if (!tape)
+		return 0;
+
+	return sizeof(flowthings_io_tape) + tape->count * sizeof(unsigned long long) + tape->strings_len;
+}
+
+/*
+ * NAME: flowthings_io_tape_root
+ *
+ * Returns the value at the start of a tape.
+ */
+flowthings_io_tape_value flowthings_io_tape_root(const flowthings_io_tape *tape)
+{
+	flowthings_io_tape_value value = __flowthings_io_tape_none;
+
+	if (tape && tape->count)
+		value.tape = tape;
+
+	return value;
+}
+
+
+/***********************************************************************
+ * The value functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_tape_value_type
+ *
+ * Returns the type of a value from its tag.
+ */
+flowthings_io_tape_type flowthings_io_tape_value_type(flowthings_io_tape_value value)
+{
+	switch (__flowthings_io_tape_tag(value)) {
+	case '{': return FLOWTHINGS_IO_TAPE_OBJECT;
+	case '[': return FLOWTHINGS_IO_TAPE_ARRAY;
+	case '"': return FLOWTHINGS_IO_TAPE_STRING;
+	case 'l': return FLOWTHINGS_IO_TAPE_INT;
+	case 'd': return FLOWTHINGS_IO_TAPE_DOUBLE;
+	case 't': return FLOWTHINGS_IO_TAPE_TRUE;
+	case 'f': return FLOWTHINGS_IO_TAPE_FALSE;
+	case 'n': return FLOWTHINGS_IO_TAPE_NULL;
+	default: return FLOWTHINGS_IO_TAPE_NONE;
+	}
+}
+
+/*
+ * NAME: flowthings_io_tape_count
+ *
+ * Returns the count kept with an object or array, walking it only if it is too big to keep.
+ */
+size_t flowthings_io_tape_count(flowthings_io_tape_value value)
+{
+	flowthings_io_tape_value item;
+	unsigned char tag = __flowthings_io_tape_tag(value);
+	size_t count;
+
+	if (tag != '{' && tag != '[')
+		return 0;
+
+	count = (value.tape->words[value.at] >> 32) & FLOWTHINGS_IO_TAPE_MAX_COUNT;
+	if (count < FLOWTHINGS_IO_TAPE_MAX_COUNT)
+		return count;
+
+	count = 0;
+	flowthings_io_tape_for_each(item, value)
+		count++;
+
+	return count;
+}
+
+/*
+ * NAME: flowthings_io_tape_first
+ *
+ * Returns the first member or element, after the { or [.
+ */
+flowthings_io_tape_value flowthings_io_tape_first(flowthings_io_tape_value value)
+{
+	unsigned char tag = __flowthings_io_tape_tag(value);
+	unsigned char next;
+
+	if (tag != '{' && tag != '[')
+		return __flowthings_io_tape_none;
+
+	next = FLOWTHINGS_IO_TAPE_TAG(value.tape->words[value.at + 1]);
+	if (next == '}' || next == ']')
+		return __flowthings_io_tape_none;
+
+	if (tag == '{') {
+		value.key = value.at + 1;
+		value.at += 2;
+	}
+	else {
+		value.key = 0;
+		value.at++;
+	}
+
+	return value;
+}
+
+/*
+ * NAME: flowthings_io_tape_next
+ *
+ * Returns the value after this one, stepping over an object or array with its end word.
+ */
+flowthings_io_tape_value flowthings_io_tape_next(flowthings_io_tape_value value)
+{
+	unsigned long long word;
+	unsigned char tag;
+	size_t after;
+
+	if (!value.tape)
+		return __flowthings_io_tape_none;
+
+	word = value.tape->words[value.at];
+	tag = FLOWTHINGS_IO_TAPE_TAG(word);
+
+	if (tag == '{' || tag == '[')
+		after = (size_t)(word & 0xFFFFFFFFULL);
+	else if (tag == 'l' || tag == 'd')
+		after = value.at + 2;
+	else
+		after = value.at + 1;
+
+	/* the end of the object or array, or of the tape after the top value */
+	if (after >= value.tape->count)
+		return __flowthings_io_tape_none;
+
+	tag = FLOWTHINGS_IO_TAPE_TAG(value.tape->words[after]);
+	if (tag == '}' || tag == ']')
+		return __flowthings_io_tape_none;
+
+	if (value.key) {
+		value.key = after;
+		value.at = after + 1;
+	}
+	else {
+		value.at = after;
+	}
+
+	return value;
+}
+
+/*
+ * NAME: flowthings_io_tape_get
+ *
+ * Returns the member of an object called key.
+ */
+flowthings_io_tape_value flowthings_io_tape_get(flowthings_io_tape_value value, const char *key)
+{
+	if (!key)
+		return __flowthings_io_tape_none;
+
+	return __flowthings_io_tape_member(value, key, strlen(key));
+}
+
+/*
+ * NAME: flowthings_io_tape_path
+ *
+ * Looks up each key of a path in turn; a missing one gives no value for the rest.
+ */
+flowthings_io_tape_value flowthings_io_tape_path(flowthings_io_tape_value value, const char *path)
+{
+	const char *dot;
+
+	if (!path)
+		return __flowthings_io_tape_none;
+
+	while ((dot = strchr(path, '.')) != NULL) {
+		value = __flowthings_io_tape_member(value, path, dot - path);
+		path = dot + 1;
+	}
+
+	return __flowthings_io_tape_member(value, path, strlen(path));
+}
+
+/*
+ * NAME: flowthings_io_tape_index
+ *
+ * Returns the member or element at index, walking the object or array.
+ */
+flowthings_io_tape_value flowthings_io_tape_index(flowthings_io_tape_value value, size_t index)
+{
+	flowthings_io_tape_value item;
+
+	if (index >= flowthings_io_tape_count(value))
+		return __flowthings_io_tape_none;
+
+	for (item = flowthings_io_tape_first(value); index > 0; index--)
+		item = flowthings_io_tape_next(item);
+
+	return item;
+}
+
+/*
+ * NAME: flowthings_io_tape_key
+ *
+ * Returns the key of a member of an object.
+ */
+const char *flowthings_io_tape_key(flowthings_io_tape_value value)
+{
+	if (!value.tape || !value.key)
+		return NULL;
+
+	return __flowthings_io_tape_text(value.tape, value.key, NULL);
+}
+
+/*
+ * NAME: flowthings_io_tape_string
+ *
+ * Returns a string.
+ */
+const char *flowthings_io_tape_string(flowthings_io_tape_value value)
+{
+	if (__flowthings_io_tape_tag(value) != '"')
+		return NULL;
+
+	return __flowthings_io_tape_text(value.tape, value.at, NULL);
+}
+
+/*
+ * NAME: flowthings_io_tape_string_len
+ *
+ * Returns the length of a string, kept in its word on the tape; one too long to keep there is
+ * measured with strlen.
+ */
+size_t flowthings_io_tape_string_len(flowthings_io_tape_value value)
+{
+	size_t len = 0;
+
+	if (__flowthings_io_tape_tag(value) == '"')
+		__flowthings_io_tape_text(value.tape, value.at, &len);
+
+	return len;
+}
+
+/*
+ * NAME: flowthings_io_tape_int
+ *
+ * Returns a number as a 64-bit integer.
+ */
+long long flowthings_io_tape_int(flowthings_io_tape_value value)
+{
+	unsigned char tag = __flowthings_io_tape_tag(value);
+	long long i;
+	double d;
+
+	if (tag == 'l') {
+		memcpy(&i, &value.tape->words[value.at + 1], 8);
+		return i;
+	}
+
+	if (tag != 'd')
+		return 0;
+
+	/* converting a double out of range is undefined */
+	memcpy(&d, &value.tape->words[value.at + 1], 8);
+	if (d != d)
+		return 0;
+	if (d >= 9223372036854775807.0)
+		return 9223372036854775807LL;
+	if (d <= -9223372036854775807.0)
+		return -9223372036854775807LL - 1;
+
+	return (long long)d;
+}
+
+/*
+ * NAME: flowthings_io_tape_number
+ *
+ * Returns a number as a double.
+ */
+double flowthings_io_tape_number(flowthings_io_tape_value value)
+{
+	unsigned char tag = __flowthings_io_tape_tag(value);
+	long long i;
+	double d;
+
+	if (tag == 'l') {
+		memcpy(&i, &value.tape->words[value.at + 1], 8);
+		return (double)i;
+	}
+
+	if (tag != 'd')
+		return 0;
+
+	memcpy(&d, &value.tape->words[value.at + 1], 8);
+
+	return d;
+}
+
+/*
+ * NAME: flowthings_io_tape_bool
+ *
+ * Returns TRUE for true.
+ */
+BOOL flowthings_io_tape_bool(flowthings_io_tape_value value)
+{
+	return __flowthings_io_tape_tag(value) == 't';
+}
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,224 @@
+/*
+ * flowthings_io_tape.h
+ *
+ * A read-only JSON document stored as a tape: one array of 64-bit words, one for each value (two
+ * for numbers) in the order they appear in the text, and one area holding every key and string,
+ * decoded and null terminated.  A cJSON tree spends a node of 72 bytes on every value and links
+ * the nodes with pointers; a tape spends 8 or 16 bytes, is read front to back, and is freed in one
+ * call.  It is not faster: building a tape costs more than parsing a cJSON tree in place, so a
+ * find decoded from a tape takes about 1.6 times as long per drop (see bench/op_cost), for about
+ * 3.6 times less memory (see bench/parse_bench).  Use one where memory is what is short.
+ *
+ * A document is read through flowthings_io_tape_value, a position on the tape that is passed
+ * around by value:
+ *
+ *   flowthings_io_tape_value drop;
+ *
+ *   flowthings_io_tape_for_each(drop, flowthings_io_tape_get(flowthings_io_tape_root(tape), "body"))
+ *       printf("%s %lld\n", flowthings_io_tape_string(flowthings_io_tape_get(drop, "id")),
+ *               flowthings_io_tape_int(flowthings_io_tape_path(drop, "elems.num.value")));
+ *
+ * Looking up something that isn't there gives a value of type FLOWTHINGS_IO_TAPE_NONE, which
+ * every function accepts, so lookups can be chained without checking each step.
+ */
+
+#ifndef FLOWTHINGS_IO_TAPE_H_
+#define FLOWTHINGS_IO_TAPE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************
+ * Flowthings includes
+ ***********************************************************************/
+
+#include "flowthings_io.h"
+
+
+/***********************************************************************
+ * The tape object
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_tape_type
+ *
+ * The type of a value.  Whole numbers that fit in 64 bits are FLOWTHINGS_IO_TAPE_INT, and are
+ * kept exact; other numbers are FLOWTHINGS_IO_TAPE_DOUBLE.
+ *
+ * FLOWTHINGS_IO_TAPE_NONE - no value: a missing key, an index past the end, or the position after
+ *     the last member or element
+ */
+typedef enum flowthings_io_tape_type {
+	FLOWTHINGS_IO_TAPE_NONE = 0,
+	FLOWTHINGS_IO_TAPE_OBJECT,
+	FLOWTHINGS_IO_TAPE_ARRAY,
+	FLOWTHINGS_IO_TAPE_STRING,
+	FLOWTHINGS_IO_TAPE_INT,
+	FLOWTHINGS_IO_TAPE_DOUBLE,
+	FLOWTHINGS_IO_TAPE_TRUE,
+	FLOWTHINGS_IO_TAPE_FALSE,
+	FLOWTHINGS_IO_TAPE_NULL
+} flowthings_io_tape_type;
+
+typedef struct flowthings_io_tape flowthings_io_tape;
+
+/*
+ * NAME: flowthings_io_tape_value
+ *
+ * tape - the tape the value is on, or NULL for no value
+ * at - the value's first word
+ * key - for a member of an object, the word of its key, otherwise 0
+ */
+typedef struct flowthings_io_tape_value {
+	const flowthings_io_tape *tape;
+	size_t at;
+	size_t key;
+} flowthings_io_tape_value;
+
+
+/***********************************************************************
+ * The tape functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_tape_init
+ *
+ * Creates an empty tape, which must be freed with flowthings_io_tape_cleanup.
+ */
+flowthings_io_tape *flowthings_io_tape_init(void);
+
+/*
+ * NAME: flowthings_io_tape_cleanup
+ *
+ * Frees a tape and everything parsed onto it.
+ */
+void flowthings_io_tape_cleanup(flowthings_io_tape *tape);
+
+/*
+ * NAME: flowthings_io_tape_parse
+ *
+ * Parses len bytes of JSON text, followed by a null, onto a tape, replacing what was on it
+ * before.  The tape keeps its buffers, so one that is parsed again and again stops allocating
+ * once it fits the largest document.  Nothing points into the text afterwards.
+ *
+ * RETURN:
+ * Returns FALSE if the text is malformed, or nested deeper than FLOWTHINGS_IO_JSON_MAX_DEPTH; the
+ * tape is then empty.
+ */
+BOOL flowthings_io_tape_parse(flowthings_io_tape *tape, const char *json, size_t len);
+
+/*
+ * NAME: flowthings_io_tape_size
+ *
+ * Returns the bytes a tape has allocated, or 0 for NULL.
+ */
+size_t flowthings_io_tape_size(const flowthings_io_tape *tape);
+
+/*
+ * NAME: flowthings_io_tape_used
+ *
+ * Returns the bytes of a tape and its buffers that hold what was last parsed onto it, or 0 for
+ * NULL.  The rest of flowthings_io_tape_size is room the buffers have grown into.
+ */
+size_t flowthings_io_tape_used(const flowthings_io_tape *tape);
+
+/*
+ * NAME: flowthings_io_tape_root
+ *
+ * Returns the value a tape holds, or no value if nothing has been parsed onto it.
+ */
+flowthings_io_tape_value flowthings_io_tape_root(const flowthings_io_tape *tape);
+
+
+/***********************************************************************
+ * The value functions
+ ***********************************************************************/
+
+/*
+ * NAME: flowthings_io_tape_value_type
+ *
+ * Returns the type of a value.
+ */
+flowthings_io_tape_type flowthings_io_tape_value_type(flowthings_io_tape_value value);
+
+/*
+ * NAME: flowthings_io_tape_count
+ *
+ * Returns the number of members of an object or elements of an array, or 0 for anything else.
+ * The count is kept on the tape, so this doesn't walk the object or array.
+ */
+size_t flowthings_io_tape_count(flowthings_io_tape_value value);
+
+/*
+ * NAME: flowthings_io_tape_first, flowthings_io_tape_next
+ *
+ * Return the first member or element of an object or array, and the one after value in the
+ * object or array it is in.  Either returns no value at the end.  An object or array is stepped
+ * over in one jump, however much is in it.
+ */
+flowthings_io_tape_value flowthings_io_tape_first(flowthings_io_tape_value value);
+flowthings_io_tape_value flowthings_io_tape_next(flowthings_io_tape_value value);
+
+/* iterates over value with each member or element of container */
+#define flowthings_io_tape_for_each(value, container) \
+	for ((value) = flowthings_io_tape_first(container); \
+			(value).tape; (value) = flowthings_io_tape_next(value))
+
+/*
+ * NAME: flowthings_io_tape_get
+ *
+ * Returns the member of an object called key.
+ */
+flowthings_io_tape_value flowthings_io_tape_get(flowthings_io_tape_value value, const char *key);
+
+/*
+ * NAME: flowthings_io_tape_path
+ *
+ * Returns the value at a path of keys with a dot between them, e.g. elems.num.value, as a codec's
+ * fields are named.
+ */
+flowthings_io_tape_value flowthings_io_tape_path(flowthings_io_tape_value value, const char *path);
+
+/*
+ * NAME: flowthings_io_tape_index
+ *
+ * Returns the element of an array, or member of an object, at index.
+ */
+flowthings_io_tape_value flowthings_io_tape_index(flowthings_io_tape_value value, size_t index);
+
+/*
+ * NAME: flowthings_io_tape_key
+ *
+ * Returns the key of a member of an object, or NULL for anything else.
+ */
+const char *flowthings_io_tape_key(flowthings_io_tape_value value);
+
+/*
+ * NAME: flowthings_io_tape_string, flowthings_io_tape_string_len
+ *
+ * Return a string and its length, or NULL and 0 if value isn't a string.  The string belongs to
+ * the tape, and is valid until the tape is parsed again or freed.
+ */
+const char *flowthings_io_tape_string(flowthings_io_tape_value value);
+size_t flowthings_io_tape_string_len(flowthings_io_tape_value value);
+
+/*
+ * NAME: flowthings_io_tape_int, flowthings_io_tape_number, flowthings_io_tape_bool
+ *
+ * Return a number as a 64-bit integer (the whole part, for one that isn't whole) or as a double,
+ * and true or false as TRUE or FALSE.  Anything else gives 0.
+ */
+long long flowthings_io_tape_int(flowthings_io_tape_value value);
+double flowthings_io_tape_number(flowthings_io_tape_value value);
+BOOL flowthings_io_tape_bool(flowthings_io_tape_value value);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* FLOWTHINGS_IO_TAPE_H_ */
@@ -3,8 +3,14 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "flowthings_io_services.h"
+#include "flowthings_io_http_mock.h"
+#include "flowthings_io_producer.h"
+#include "flowthings_io_spool.h"
+#include "flowthings_io_codec.h"
 
 #ifdef  __cplusplus
 extern "C" {
@@ -72,11 +78,2273 @@ BOOL encode_my_drop(void *obj_in, cJSON *json_out) {
 	return TRUE;
 }
 
-int main()
+
+/***********************************************************************
+ * The offline tests
+ *
+ * These answer requests with the mock transport (see flowthings_io_http_mock.h), so they run
+ * without a server.  Run them alone with "flowthings_io_test --offline".
+ ***********************************************************************/
+
+static int test_failures;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define DROP(n) "{\"id\":\"d" #n "\",\"elems\":{\"num\":{\"type\":\"integer\",\"value\":" #n "}}}"
+#define RESPONSE(body) "{\"head\":{\"status\":200,\"errors\":[],\"messages\":[]},\"body\":" body "}"
+
+/* the last request the mock handler saw, and what it answers with: bodies[n] for the n-th
+ * request if it is set, or body */
+static struct {
+	int calls;
+	char method[8];
+	char path[256];
+	char data[1024];
+
+	int http_response_code;
+	const char *body;
+	const char *bodies[4];
+} mock;
+
+static int mock_handler(const char *method, const char *path, const char *data,
+		flowthings_io_string *body, void *user_data)
+{
+	const char *answer = mock.calls < 4 && mock.bodies[mock.calls] ? mock.bodies[mock.calls] : mock.body;
+
+	mock.calls++;
+	snprintf(mock.method, sizeof(mock.method), "%s", method);
+	snprintf(mock.path, sizeof(mock.path), "%s", path);
+	snprintf(mock.data, sizeof(mock.data), "%s", data ? data : "");
+
+	if (answer)
+		flowthings_io_string_strcat(body, answer);
+
+	return mock.http_response_code;
+}
+
+static void mock_answer(int http_response_code, const char *body)
+{
+	memset(&mock, 0, sizeof(mock));
+	mock.http_response_code = http_response_code;
+	mock.body = body;
+}
+
+/* an API whose requests are answered by mock_handler, after the table in config */
+static flowthings_io_api *mock_api(flowthings_io_http_mock_config *config)
+{
+	static flowthings_io_token creds = { "myaccountname", "mytoken" };
+	flowthings_io_api *api = flowthings_io_api_init(FLOWTHINGS_IO_VERSION, FLOWTHINGS_IO_HOST, FALSE, &creds);
+
+	config->handler = mock_handler;
+	flowthings_io_api_set_transport(api, &flowthings_io_http_transport_mock, config);
+
+	return api;
+}
+
+/* a decoder that keeps part of the tree rather than copying out of it */
+static BOOL decode_keep_elems(cJSON *json_in, void *obj_out)
+{
+	*(cJSON **)obj_out = cJSON_DetachItemFromObject(json_in, "elems");
+
+	return *(cJSON **)obj_out != NULL;
+}
+
+/* a find decodes each result into its slot of the result array, see flowthings_io_service_find */
+static int slot_num(void *slots[], int i)
+{
+	return ((struct my_drop *)&slots[i])->num;
+}
+
+static void test_services(void)
+{
+	static const flowthings_io_http_mock_response responses[] = {
+		{ "GET", "/drop/f2/", 200, RESPONSE(DROP(3)) },
+	};
+	flowthings_io_http_mock_config config;
+	flowthings_io_api *api;
+	struct my_drop drop;
+
+	memset(&config, 0, sizeof(config));
+	config.responses = responses;
+	config.response_count = 1;
+	api = mock_api(&config);
+
+	/* the table answers before the handler */
+	mock_answer(200, RESPONSE(DROP(7)));
+	drop.num = 0;
+	CHECK(flowthings_io_drop_read("f2", api, "d3", NULL, decode_my_drop, &drop) == FLOWTHINGS_IO_OK);
+	CHECK(drop.num == 3);
+	CHECK(mock.calls == 0);
+
+	/* read */
+	mock_answer(200, RESPONSE(DROP(7)));
+	drop.num = 0;
+	CHECK(flowthings_io_drop_read("f1", api, "d7", NULL, decode_my_drop, &drop) == FLOWTHINGS_IO_OK);
+	CHECK(drop.num == 7);
+	CHECK(strcmp(mock.method, "GET") == 0);
+	CHECK(strncmp(mock.path, "/drop/f1/d7", 11) == 0);
+
+	/* create sends the encoded object and decodes what comes back into it */
+	mock_answer(200, RESPONSE(DROP(6)));
+	drop.num = 5;
+	CHECK(flowthings_io_drop_create("f1", api, NULL, encode_my_drop, decode_my_drop, &drop) == FLOWTHINGS_IO_OK);
+	CHECK(drop.num == 6);
+	CHECK(strcmp(mock.method, "POST") == 0);
+	CHECK(strncmp(mock.path, "/drop/f1", 8) == 0);
+	CHECK(strstr(mock.data, "\"num\":5") != NULL);
+
+	/* update and delete */
+	mock_answer(200, RESPONSE(DROP(8)));
+	drop.num = 8;
+	CHECK(flowthings_io_drop_update("f1", api, "d8", NULL, encode_my_drop, decode_my_drop, &drop) == FLOWTHINGS_IO_OK);
+	CHECK(strcmp(mock.method, "PUT") == 0);
+	CHECK(strncmp(mock.path, "/drop/f1/d8", 11) == 0);
+
+	mock_answer(200, RESPONSE("{}"));
+	CHECK(flowthings_io_drop_delete("f1", api, "d8", NULL) == FLOWTHINGS_IO_OK);
+	CHECK(strcmp(mock.method, "DELETE") == 0);
+
+	/* HTTP errors, bad responses and bad arguments */
+	mock_answer(404, "");
+	CHECK(flowthings_io_drop_read("f1", api, "d7", NULL, decode_my_drop, &drop) == FLOWTHINGS_IO_ERROR_NOT_FOUND);
+	mock_answer(403, "");
+	CHECK(flowthings_io_drop_read("f1", api, "d7", NULL, decode_my_drop, &drop) == FLOWTHINGS_IO_ERROR_FORBIDDEN);
+	mock_answer(400, "");
+	CHECK(flowthings_io_drop_create("f1", api, NULL, encode_my_drop, decode_my_drop, &drop) == FLOWTHINGS_IO_ERROR_BAD_REQUEST);
+	mock_answer(500, "");
+	CHECK(flowthings_io_drop_read("f1", api, "d7", NULL, decode_my_drop, &drop) == FLOWTHINGS_IO_ERROR_SERVER_ERROR);
+	mock_answer(502, "");
+	CHECK(flowthings_io_drop_read("f1", api, "d7", NULL, decode_my_drop, &drop) == FLOWTHINGS_IO_ERROR_UNKNOWN);
+	mock_answer(200, "{\"head\":{},\"body\":");
+	CHECK(flowthings_io_drop_read("f1", api, "d7", NULL, decode_my_drop, &drop) == FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE);
+	mock_answer(200, "{\"head\":{}}");
+	CHECK(flowthings_io_drop_read("f1", api, "d7", NULL, decode_my_drop, &drop) == FLOWTHINGS_IO_ERROR_MALFORMED_RESPONSE);
+	mock_answer(200, RESPONSE(DROP(7)));
+	CHECK(flowthings_io_drop_read("f1", api, "d7", NULL, NULL, &drop) == FLOWTHINGS_IO_ERROR_COULDNT_DECODE);
+	CHECK(flowthings_io_drop_read("f1", NULL, "d7", NULL, decode_my_drop, &drop) == FLOWTHINGS_IO_ERROR_NOT_INITIALIZED);
+	CHECK(mock.calls == 0);
+
+	flowthings_io_api_cleanup(api);
+}
+
+static void test_json_arena(void)
+{
+	flowthings_io_http_mock_config config;
+	flowthings_io_api *api;
+	struct my_drop drop;
+	cJSON *elems = NULL, *num;
+
+	memset(&config, 0, sizeof(config));
+	api = mock_api(&config);
+
+	/* arenas are off by default, so a decoder may keep what it is given, in place or streamed */
+	mock_answer(200, RESPONSE(DROP(7)));
+	CHECK(flowthings_io_drop_read("f1", api, "d7", NULL, decode_keep_elems, &elems) == FLOWTHINGS_IO_OK);
+	num = elems ? cJSON_GetObjectItem(elems, "num") : NULL;
+	CHECK(num && cJSON_GetObjectItem(num, "value")->valueint == 7);
+	cJSON_Delete(elems);
+
+	flowthings_io_api_set_stream_decode(api, TRUE);
+	elems = NULL;
+	mock_answer(200, RESPONSE(DROP(9)));
+	CHECK(flowthings_io_drop_read("f1", api, "d9", NULL, decode_keep_elems, &elems) == FLOWTHINGS_IO_OK);
+	num = elems ? cJSON_GetObjectItem(elems, "num") : NULL;
+	CHECK(num && cJSON_GetObjectItem(num, "value")->valueint == 9);
+	cJSON_Delete(elems);
+
+	/* turned on, decoders that copy work as before */
+	flowthings_io_api_set_stream_decode(api, FALSE);
+	flowthings_io_api_set_json_arena(api, TRUE);
+	mock_answer(200, RESPONSE(DROP(6)));
+	drop.num = 5;
+	CHECK(flowthings_io_drop_create("f1", api, NULL, encode_my_drop, decode_my_drop, &drop) == FLOWTHINGS_IO_OK);
+	CHECK(drop.num == 6);
+	CHECK(strstr(mock.data, "\"num\":5") != NULL);
+
+	flowthings_io_api_cleanup(api);
+}
+
+/* "[", n spaces, a string of n a's, an escaped newline and 80-n b's, n spaces and "]"; and the string it holds */
+static void scan_text(int n, char *text, char *want)
+{
+	text += sprintf(text, "[%*s\"", n, "");
+	memset(text, 'a', n);
+	text += n;
+	text += sprintf(text, "\\n");
+	memset(text, 'b', 80 - n);
+	text += 80 - n;
+	sprintf(text, "\"%*s]", n, "");
+
+	memset(want, 'a', n);
+	want[n] = '\n';
+	memset(want + n + 1, 'b', 80 - n);
+	want[81] = 0;
+}
+
+static BOOL scan_parses(const char *text, const char *want)
+{
+	cJSON *root = cJSON_Parse(text);
+	BOOL ok = root && root->child && strcmp(root->child->valuestring, want) == 0;
+
+	cJSON_Delete(root);
+
+	return ok;
+}
+
+static void *scan_thread(void *failed)
+{
+	char text[256], want[128];
+	int round, n;
+
+	for (round = 0; round < 50; round++)
+		for (n = 0; n < 80; n++) {
+			scan_text(n, text, want);
+			if (!scan_parses(text, want))
+				(*(int *)failed)++;
+		}
+
+	return NULL;
+}
+
+static void test_json_scan(void)
+{
+	char text[256], want[128], copy[256];
+	cJSON_Arena *arena = cJSON_ArenaCreate(), *prev;
+	cJSON *root;
+	pthread_t thread;
+	int n, failed = 0;
+
+	/* the escape and the end of each whitespace run fall at every offset of a vector */
+	for (n = 0; n < 80; n++) {
+		scan_text(n, text, want);
+		CHECK(scan_parses(text, want));
+
+		prev = cJSON_ArenaUse(arena);
+		strcpy(copy, text);
+		root = cJSON_ParseInSitu(copy);
+		CHECK(root && root->child && strcmp(root->child->valuestring, want) == 0);
+		cJSON_ArenaReset(arena);
+		cJSON_ArenaUse(prev);
+
+		/* cut off before the closing quote */
+		text[strlen(text) - n - 2] = 0;
+		CHECK(cJSON_Parse(text) == NULL);
+	}
+
+	/* each thread scans up to the end of its own text */
+	CHECK(pthread_create(&thread, NULL, scan_thread, &failed) == 0);
+	scan_thread(&failed);
+	pthread_join(thread, NULL);
+	CHECK(failed == 0);
+
+	cJSON_ArenaDelete(arena);
+}
+
+static void test_json_writer(void)
+{
+	flowthings_io_http_mock_config config;
+	flowthings_io_json_writer writer;
+	flowthings_io_string *out = flowthings_io_string_init();
+	flowthings_io_api *api;
+	struct my_drop drop;
+	cJSON *tree;
+	char *text;
+
+	/* values, nesting and the commas between them */
+	flowthings_io_json_writer_init(&writer, out);
+	flowthings_io_json_begin_object(&writer);
+	flowthings_io_json_key(&writer, "a");
+	flowthings_io_json_begin_array(&writer);
+	flowthings_io_json_integer(&writer, -9007199254740993LL);
+	flowthings_io_json_number(&writer, 0.1);
+	flowthings_io_json_number(&writer, 1.0 / 0.0);
+	flowthings_io_json_bool(&writer, TRUE);
+	flowthings_io_json_null(&writer);
+	flowthings_io_json_string(&writer, NULL);
+	flowthings_io_json_begin_object(&writer);
+	flowthings_io_json_end_object(&writer);
+	flowthings_io_json_end_array(&writer);
+	flowthings_io_json_key(&writer, "q\"\x01");
+	flowthings_io_json_string(&writer, "\"\\/\b\f\n\r\t\x1f\xc3\xa9");
+	flowthings_io_json_key(&writer, "r");
+	flowthings_io_json_raw(&writer, "[1]", 3);
+	flowthings_io_json_end_object(&writer);
+	CHECK(flowthings_io_json_writer_done(&writer));
+	CHECK(!strcmp(out->ptr, "{\"a\":[-9007199254740993,0.1,null,true,null,null,{}],"
+			"\"q\\\"\\u0001\":\"\\\"\\\\/\\b\\f\\n\\r\\t\\u001f\xc3\xa9\",\"r\":[1]}"));
+
+	/* what it writes reads back as the same tree, and a tree writes as cJSON would */
+	tree = cJSON_Parse(out->ptr);
+	CHECK(tree != NULL);
+	text = flowthings_io_json_print(tree);
+	CHECK(text && !strcmp(text, out->ptr));
+	free(text);
+	cJSON_Delete(tree);
+
+	/* out of place, or not finished */
+	flowthings_io_string_reset(out);
+	flowthings_io_json_writer_init(&writer, out);
+	flowthings_io_json_begin_object(&writer);
+	flowthings_io_json_integer(&writer, 1);
+	flowthings_io_json_end_object(&writer);
+	CHECK(!flowthings_io_json_writer_done(&writer));
+	flowthings_io_json_writer_init(&writer, out);
+	flowthings_io_json_begin_array(&writer);
+	flowthings_io_json_end_object(&writer);
+	CHECK(!flowthings_io_json_writer_done(&writer));
+	flowthings_io_json_writer_init(&writer, out);
+	flowthings_io_json_begin_array(&writer);
+	CHECK(!flowthings_io_json_writer_done(&writer));
+	flowthings_io_json_writer_init(&writer, out);
+	flowthings_io_json_integer(&writer, 1);
+	flowthings_io_json_integer(&writer, 2);
+	CHECK(!flowthings_io_json_writer_done(&writer));
+	flowthings_io_string_cleanup(out);
+
+	/* request bodies are the same written up front and streamed as they are sent */
+	memset(&config, 0, sizeof(config));
+	api = mock_api(&config);
+	mock_answer(200, RESPONSE(DROP(5)));
+	drop.num = 5;
+	CHECK(flowthings_io_drop_create("f1", api, NULL, encode_my_drop, decode_my_drop, &drop) == FLOWTHINGS_IO_OK);
+	CHECK(!strcmp(mock.data, "{\"elems\":{\"num\":5}}"));
+	flowthings_io_api_set_stream_upload(api, TRUE);
+	mock_answer(200, RESPONSE(DROP(5)));
+	CHECK(flowthings_io_drop_create("f1", api, NULL, encode_my_drop, decode_my_drop, &drop) == FLOWTHINGS_IO_OK);
+	CHECK(!strcmp(mock.data, "{\"elems\":{\"num\":5}}"));
+	flowthings_io_api_cleanup(api);
+}
+
+/* looks up every key k0..k(n-1) of a wide object, checks each holds its number, and that the
+ * other case only matches without the case-sensitive lookup */
+static BOOL wide_lookups(cJSON *object, int n)
+{
+	char key[16];
+	cJSON *item;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		snprintf(key, sizeof(key), "k%d", i);
+		item = cJSON_GetObjectItemCaseSensitive(object, key);
+		if (!item || item->valueint != i || cJSON_GetObjectItem(object, key) != item)
+			return FALSE;
+		key[0] = 'K';
+		if (cJSON_GetObjectItem(object, key) != item || cJSON_GetObjectItemCaseSensitive(object, key))
+			return FALSE;
+	}
+
+	return !cJSON_GetObjectItem(object, "missing") && !cJSON_GetObjectItemCaseSensitive(object, "missing");
+}
+
+static void test_json_index(void)
+{
+	flowthings_io_string *text = flowthings_io_string_init();
+	cJSON_Arena *arena = cJSON_ArenaCreate(), *prev;
+	cJSON *parsed, *built, *item;
+	char key[16];
+	int i;
+
+	/* parsed, in an arena or not, and built with the Add calls, below and above the threshold */
+	flowthings_io_string_strcat(text, "{");
+	for (i = 0; i < 40; i++) {
+		snprintf(key, sizeof(key), "%s\"k%d\":%d", i ? "," : "", i, i);
+		flowthings_io_string_strcat(text, key);
+	}
+	flowthings_io_string_strcat(text, ",\"k0\":-1}");
+
+	parsed = cJSON_Parse(text->ptr);
+	built = cJSON_CreateObject();
+	for (i = 0; i < 40; i++) {
+		snprintf(key, sizeof(key), "k%d", i);
+		cJSON_AddNumberToObject(built, key, i);
+		if (i == cJSON_IndexThreshold - 2 || i == 39)
+			CHECK(wide_lookups(built, i + 1));
+	}
+	/* a repeated key finds the first */
+	CHECK(wide_lookups(parsed, 40));
+	CHECK(cJSON_GetArraySize(parsed) == 41);
+
+	prev = cJSON_ArenaUse(arena);
+	item = cJSON_Parse(text->ptr);
+	CHECK(item && wide_lookups(item, 40));
+	cJSON_ArenaReset(arena);
+	cJSON_ArenaUse(prev);
+	cJSON_ArenaDelete(arena);
+
+	/* detaching, deleting and replacing keep the index up to date */
+	item = cJSON_DetachItemFromObject(parsed, "K5");
+	CHECK(item && item->valueint == 5 && !cJSON_GetObjectItem(parsed, "k5"));
+	cJSON_Delete(item);
+	cJSON_DeleteItemFromObject(parsed, "k0");
+	CHECK(cJSON_GetObjectItem(parsed, "k0") && cJSON_GetObjectItem(parsed, "k0")->valueint == -1);
+	cJSON_ReplaceItemInObject(parsed, "k7", cJSON_CreateString("seven"));
+	CHECK(!strcmp(cJSON_GetObjectItemCaseSensitive(parsed, "k7")->valuestring, "seven"));
+	cJSON_AddNumberToObject(parsed, "k5", 55);
+	CHECK(cJSON_GetObjectItem(parsed, "K5")->valueint == 55);
+	CHECK(cJSON_GetObjectItem(parsed, "k39")->valueint == 39);
+
+	cJSON_Delete(parsed);
+	cJSON_Delete(built);
+	flowthings_io_string_cleanup(text);
+}
+
+/* TRUE if array holds exactly the numbers in want, in order, front to back and back to front */
+static BOOL array_is(cJSON *array, const int want[], int n)
+{
+	cJSON *item, *last = NULL;
+	int i = 0;
+
+	cJSON_ArrayForEach(item, array) {
+		if (i >= n || item->valueint != want[i++] || (last && item->prev != last))
+			return FALSE;
+		last = item;
+	}
+	if (i != n || cJSON_GetArraySize(array) != n)
+		return FALSE;
+
+	/* the first item's prev is the last, which is where appends go */
+	if (n && array->child->prev != last)
+		return FALSE;
+	for (item = last; n > 1 && item != array->child; item = item->prev)
+		if (item->valueint != want[--i])
+			return FALSE;
+
+	return TRUE;
+}
+
+static void test_json_array(void)
+{
+	static const int after_detach[] = { 1, 2, 3, 4 }, after_append[] = { 1, 2, 3, 4, 9 };
+	static const int after_replace[] = { 1, 2, 3, 4, 8 }, after_delete[] = { 1, 3, 4, 8 };
+	int want[1000], i;
+	cJSON *array = cJSON_CreateArray(), *copy, *item;
+
+	for (i = 0; i < 1000; i++) {
+		want[i] = i;
+		cJSON_AddItemToArray(array, cJSON_CreateNumber(i));
+	}
+	CHECK(array_is(array, want, 1000));
+	copy = cJSON_Duplicate(array, 1);
+	CHECK(array_is(copy, want, 1000));
+	cJSON_Delete(array);
+	cJSON_Delete(copy);
+
+	/* the last item is tracked through detach, replace and delete, at either end */
+	array = cJSON_Parse("[0,1,2,3,4,5]");
+	item = cJSON_DetachItemFromArray(array, 5);
+	cJSON_Delete(item);
+	item = cJSON_DetachItemFromArray(array, 0);
+	cJSON_Delete(item);
+	CHECK(array_is(array, after_detach, 4));
+	cJSON_AddItemToArray(array, cJSON_CreateNumber(9));
+	CHECK(array_is(array, after_append, 5));
+	cJSON_ReplaceItemInArray(array, 4, cJSON_CreateNumber(8));
+	CHECK(array_is(array, after_replace, 5));
+	cJSON_DeleteItemFromArray(array, 1);
+	CHECK(array_is(array, after_delete, 4));
+	for (i = 0; i < 4; i++)
+		cJSON_DeleteItemFromArray(array, 0);
+	CHECK(array_is(array, NULL, 0) && !array->child);
+	cJSON_AddItemToArray(array, cJSON_CreateNumber(7));
+	CHECK(cJSON_GetArraySize(array) == 1 && array->child->prev == array->child);
+	cJSON_Delete(array);
+}
+
+static void test_json_insitu(void)
+{
+	static const char text[] = "{\"a\\tb\":\"x\\\"y\\u00e9\\ud83d\\ude00\",\"list\":[\"\",\"plain\"],\"n\":1}";
+	cJSON_Arena *arena = cJSON_ArenaCreate(), *prev;
+	char buffer[sizeof(text)];
+	cJSON *root, *item;
+
+	/* with an arena, strings and names are decoded where they are and point into the text */
+	memcpy(buffer, text, sizeof(text));
+	prev = cJSON_ArenaUse(arena);
+	root = cJSON_ParseInSitu(buffer);
+	CHECK(root != NULL);
+	item = root ? root->child : NULL;
+	CHECK(item && !strcmp(item->string, "a\tb") && !strcmp(item->valuestring, "x\"y\xc3\xa9\xf0\x9f\x98\x80"));
+	CHECK(item && item->string > buffer && item->string < buffer + sizeof(buffer));
+	CHECK(item && item->valuestring > buffer && item->valuestring < buffer + sizeof(buffer));
+	item = root ? cJSON_GetObjectItem(root, "list") : NULL;
+	CHECK(item && cJSON_GetArraySize(item) == 2 && !strcmp(item->child->valuestring, "")
+			&& !strcmp(item->child->next->valuestring, "plain"));
+	CHECK(root && cJSON_GetObjectItem(root, "n")->valueint == 1);
+	cJSON_ArenaReset(arena);
+
+	/* truncated text fails the same way */
+	strcpy(buffer, "{\"a\":\"x\\\"y");
+	CHECK(cJSON_ParseInSitu(buffer) == NULL);
+	cJSON_ArenaUse(prev);
+	cJSON_ArenaDelete(arena);
+
+	/* without one it is cJSON_Parse, and the text is left alone */
+	memcpy(buffer, text, sizeof(text));
+	root = cJSON_ParseInSitu(buffer);
+	CHECK(root && !memcmp(buffer, text, sizeof(text)));
+	CHECK(root && root->child->valuestring && (root->child->valuestring < buffer
+			|| root->child->valuestring >= buffer + sizeof(buffer)));
+	CHECK(root && !strcmp(root->child->valuestring, "x\"y\xc3\xa9\xf0\x9f\x98\x80"));
+	cJSON_Delete(root);
+}
+
+/* a number's text, the double and 64-bit integer it reads as, and how the double is written */
+static const struct {
+	const char *text;
+	double number;
+	long long integer;
+	const char *written;
+} number_cases[] = {
+	{ "0", 0.0, 0, "0" },
+	{ "0.1", 0.1, 0, "0.1" },
+	{ "-2.5e2", -250.0, -250, "-250" },
+	{ "1E2", 100.0, 100, "100" },
+	{ "1.5", 1.5, 1, "1.5" },
+	{ "1e-7", 1e-7, 0, "1e-7" },
+	{ "1e21", 1e21, 9223372036854775807LL, "1e+21" },
+	{ "5e-324", 5e-324, 0, "5e-324" },
+	{ "1.7976931348623157e308", 1.7976931348623157e308, 9223372036854775807LL, "1.7976931348623157e+308" },
+	/* whole numbers are exact as integers, beyond what a double holds */
+	{ "123456789012345678", 123456789012345678.0, 123456789012345678LL, "123456789012345680" },
+	{ "9223372036854775807", 9223372036854775807.0, 9223372036854775807LL, "9223372036854776000" },
+	{ "-9223372036854775808", -9223372036854775807.0 - 1, -9223372036854775807LL - 1, "-9223372036854776000" },
+	{ "9223372036854775808", 9223372036854775808.0, 9223372036854775807LL, "9223372036854776000" },
+};
+
+/* the digits of a number's text from its first nonzero digit to its last */
+static int significant_digits(const char *text)
+{
+	int first = -1, last = -1, n = 0;
+
+	for (; *text && *text != 'e' && *text != 'E'; text++) {
+		if (*text < '0' || *text > '9')
+			continue;
+		if (*text != '0') {
+			if (first < 0)
+				first = n;
+			last = n;
+		}
+		n++;
+	}
+
+	return first < 0 ? 1 : last - first + 1;
+}
+
+static void test_json_numbers(void)
+{
+	char buffer[cJSON_NumberBufferSize], digits[32], *text;
+	unsigned long long bits = 88172645463325252ULL;
+	const char *end;
+	long long integer;
+	double number, d;
+	cJSON *item;
+	int i, p, longer = 0;
+
+	for (i = 0; i < (int)(sizeof(number_cases) / sizeof(number_cases[0])); i++) {
+		end = cJSON_ReadNumber(number_cases[i].text, &number, &integer);
+		cJSON_WriteNumber(number, buffer);
+		if (end != number_cases[i].text + strlen(number_cases[i].text) || number != number_cases[i].number
+				|| integer != number_cases[i].integer || strcmp(buffer, number_cases[i].written)) {
+			printf("number case %d: read %.17g and %lld, wrote %s\n", i, number, integer, buffer);
+			test_failures++;
+		}
+	}
+
+	CHECK(cJSON_WriteNumber(1.0 / 0.0, buffer) == 4 && !strcmp(buffer, "null"));
+	CHECK(cJSON_WriteNumber(0.0 / 0.0, buffer) == 4 && !strcmp(buffer, "null"));
+	CHECK(cJSON_WriteInt64(-9223372036854775807LL - 1, buffer) == 20 && !strcmp(buffer, "-9223372036854775808"));
+
+	/* integers survive a round trip through a tree */
+	item = cJSON_Parse("[9007199254740993,-4611686018427387905]");
+	CHECK(item && item->child->valueint64 == 9007199254740993LL
+			&& item->child->next->valueint64 == -4611686018427387905LL);
+	cJSON_Delete(item);
+	item = cJSON_CreateInt64(9007199254740993LL);
+	text = cJSON_PrintUnformatted(item);
+	CHECK(text && !strcmp(text, "9007199254740993"));
+	free(text);
+	cJSON_Delete(item);
+
+	/* doubles from random bits read back the same, and all but a few in 1000 in the fewest digits */
+	for (i = 0; i < 20000; i++) {
+		bits ^= bits << 13;
+		bits ^= bits >> 7;
+		bits ^= bits << 17;
+		memcpy(&d, &bits, sizeof(d));
+		if (d != d || d - d != 0.0)
+			continue;
+
+		cJSON_WriteNumber(d, buffer);
+		if (strtod(buffer, NULL) != d) {
+			printf("number %.17g wrote as %s\n", d, buffer);
+			test_failures++;
+		}
+
+		for (p = 1; p < 17; p++) {
+			snprintf(digits, sizeof(digits), "%.*g", p, d);
+			if (strtod(digits, NULL) == d)
+				break;
+		}
+		if (significant_digits(buffer) > p)
+			longer++;
+	}
+	CHECK(longer < 40);
+}
+
+static void test_find(void)
+{
+	flowthings_io_http_mock_config config;
+	flowthings_io_params *params;
+	flowthings_io_idlist *idlist;
+	flowthings_io_api *api;
+	void *slots[10];
+	int count, stream;
+
+	memset(&config, 0, sizeof(config));
+	api = mock_api(&config);
+
+	for (stream = 0; stream < 2; stream++) {
+
+		flowthings_io_api_set_stream_decode(api, stream);
+
+		/* the filter goes in the query string, and results stop at the size of the array */
+		mock_answer(200, RESPONSE("[" DROP(1) "," DROP(2) "," DROP(3) "]"));
+		count = 10;
+		CHECK(flowthings_io_drop_find("f1", api, "elems.num > 0", NULL, decode_my_drop, slots, &count) == FLOWTHINGS_IO_OK);
+		CHECK(count == 3);
+		CHECK(slot_num(slots, 0) == 1 && slot_num(slots, 2) == 3);
+		CHECK(strncmp(mock.path, "/drop/f1?", 9) == 0);
+		CHECK(strstr(mock.path, "filter=") != NULL);
+
+		count = 2;
+		CHECK(flowthings_io_drop_find("f1", api, NULL, NULL, decode_my_drop, slots, &count) == FLOWTHINGS_IO_OK);
+		CHECK(count == 2);
+
+		mock_answer(200, RESPONSE("[]"));
+		count = 10;
+		CHECK(flowthings_io_drop_find("f1", api, NULL, NULL, decode_my_drop, slots, &count) == FLOWTHINGS_IO_OK);
+		CHECK(count == 0);
+
+		/* find_many asks for every flow in one MGET, and the platform flattens the results */
+		mock_answer(200, RESPONSE("[" DROP(4) "," DROP(5) "]"));
+		params = flowthings_io_params_init();
+		flowthings_io_params_add(params, "filter", "elems.num > 3");
+		idlist = flowthings_io_idlist_init();
+		flowthings_io_idlist_add(idlist, "f1", params);
+		flowthings_io_idlist_add(idlist, "f2", params);
+		count = 10;
+		CHECK(flowthings_io_drop_find_many(api, decode_my_drop, idlist, slots, &count) == FLOWTHINGS_IO_OK);
+		CHECK(count == 2);
+		CHECK(slot_num(slots, 0) == 4 && slot_num(slots, 1) == 5);
+		CHECK(mock.calls == 1);
+		CHECK(strcmp(mock.method, "MGET") == 0);
+		CHECK(strstr(mock.data, "f1") != NULL && strstr(mock.data, "f2") != NULL);
+		CHECK(strstr(mock.data, "elems.num > 3") != NULL);
+		flowthings_io_idlist_cleanup(idlist);
+		flowthings_io_params_cleanup(params);
+
+		mock_answer(404, "");
+		count = 10;
+		CHECK(flowthings_io_drop_find("f1", api, NULL, NULL, decode_my_drop, slots, &count) == FLOWTHINGS_IO_ERROR_NOT_FOUND);
+	}
+
+	flowthings_io_api_cleanup(api);
+}
+
+static void test_batch(void)
+{
+	flowthings_io_http_mock_config config;
+	flowthings_io_result_code codes[3];
+	struct my_drop drops[3];
+	void *objects[3];
+	flowthings_io_api *api;
+	int i;
+
+	memset(&config, 0, sizeof(config));
+	api = mock_api(&config);
+
+	/* two objects to a request, so three objects take two requests */
+	flowthings_io_api_set_batch_limits(api, 2, 0);
+	mock_answer(200, NULL);
+	mock.bodies[0] = RESPONSE("[{\"head\":{\"status\":200},\"body\":" DROP(11) "},"
+			"{\"head\":{\"status\":400},\"body\":{}}]");
+	mock.bodies[1] = RESPONSE("[{\"head\":{\"status\":200},\"body\":" DROP(13) "}]");
+
+	for (i = 0; i < 3; i++) {
+		drops[i].num = i;
+		objects[i] = &drops[i];
+	}
+
+	CHECK(flowthings_io_drop_create_batch("f1", api, NULL, encode_my_drop, decode_my_drop, objects, 3, codes)
+			== FLOWTHINGS_IO_ERROR_BAD_REQUEST);
+	CHECK(codes[0] == FLOWTHINGS_IO_OK && drops[0].num == 11);
+	CHECK(codes[1] == FLOWTHINGS_IO_ERROR_BAD_REQUEST && drops[1].num == 1);
+	CHECK(codes[2] == FLOWTHINGS_IO_OK && drops[2].num == 13);
+	CHECK(mock.calls == 2);
+	CHECK(mock.data[0] == '[' && strstr(mock.data, "\"num\":2") != NULL);
+
+	/* a request that fails gives its code to every object in it */
+	mock_answer(500, "");
+	CHECK(flowthings_io_drop_create_batch("f1", api, NULL, encode_my_drop, decode_my_drop, objects, 3, codes)
+			== FLOWTHINGS_IO_ERROR_SERVER_ERROR);
+	CHECK(codes[0] == FLOWTHINGS_IO_ERROR_SERVER_ERROR && codes[2] == FLOWTHINGS_IO_ERROR_SERVER_ERROR);
+
+	flowthings_io_api_cleanup(api);
+}
+
+/* records the order the async calls completed in */
+static int completions[8], completion_count;
+
+static void on_complete(flowthings_io_op *op, flowthings_io_result_code code, void *user_data)
+{
+	completions[completion_count++] = (int)(long)user_data;
+	CHECK(flowthings_io_op_done(op));
+	CHECK(flowthings_io_op_result(op) == code);
+}
+
+static void test_async(void)
+{
+	flowthings_io_http_mock_config config;
+	flowthings_io_op *ops[4];
+	struct my_drop drops[4];
+	flowthings_io_api *api;
+	int i;
+
+	memset(&config, 0, sizeof(config));
+	api = mock_api(&config);
+	mock_answer(200, RESPONSE(DROP(9)));
+	completion_count = 0;
+
+	for (i = 0; i < 4; i++) {
+		drops[i].num = 0;
+		ops[i] = flowthings_io_drop_read_async("f1", api, "d9", NULL, decode_my_drop, &drops[i], on_complete, (void *)(long)i);
+		CHECK(ops[i] != NULL);
+	}
+
+	/* nothing is answered until the engine is polled */
+	CHECK(mock.calls == 0);
+	CHECK(!flowthings_io_op_done(ops[0]));
+
+	/* a call cleaned up before it completes is cancelled, and its callback isn't called */
+	flowthings_io_op_cleanup(ops[2]);
+
+	flowthings_io_api_run(api);
+
+	CHECK(completion_count == 3);
+	CHECK(completions[0] == 0 && completions[1] == 1 && completions[2] == 3);
+	CHECK(drops[0].num == 9 && drops[3].num == 9 && drops[2].num == 0);
+
+	flowthings_io_op_cleanup(ops[0]);
+	flowthings_io_op_cleanup(ops[1]);
+	flowthings_io_op_cleanup(ops[3]);
+
+	/* op_wait runs the engine until the call is done */
+	mock_answer(404, "");
+	ops[0] = flowthings_io_drop_read_async("f1", api, "d9", NULL, decode_my_drop, &drops[0], NULL, NULL);
+	CHECK(flowthings_io_op_wait(ops[0]) == FLOWTHINGS_IO_ERROR_NOT_FOUND);
+	CHECK(flowthings_io_op_result(ops[0]) == FLOWTHINGS_IO_ERROR_NOT_FOUND);
+	flowthings_io_op_cleanup(ops[0]);
+
+	/* polling with nothing in flight returns at once */
+	CHECK(flowthings_io_api_poll(api, 0) == 0);
+
+	flowthings_io_api_cleanup(api);
+}
+
+/* the producer's requests, as its background thread sends them; the handler holds each one until
+ * the gate is opened, so a test can fill the queue behind a request in flight */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	int gate_open;
+	int http_response_code;
+
+	int requests;
+	int request_items[16];
+
+	int deliveries;
+	int delivered[16];
+	flowthings_io_result_code delivered_codes[16];
+} producer_mock = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static void test_sleep_ms(int ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+}
+
+static void producer_mock_reset(int gate_open, int http_response_code)
+{
+	pthread_mutex_lock(&producer_mock.lock);
+	producer_mock.gate_open = gate_open;
+	producer_mock.http_response_code = http_response_code;
+	producer_mock.requests = 0;
+	producer_mock.deliveries = 0;
+	pthread_mutex_unlock(&producer_mock.lock);
+}
+
+static void producer_mock_open_gate(void)
+{
+	pthread_mutex_lock(&producer_mock.lock);
+	producer_mock.gate_open = TRUE;
+	pthread_cond_broadcast(&producer_mock.changed);
+	pthread_mutex_unlock(&producer_mock.lock);
+}
+
+/* waits up to a second for the producer to have sent requests requests; returns how many it has */
+static int producer_mock_wait_requests(int requests)
+{
+	int i, n = 0;
+
+	for (i = 0; i < 100; i++) {
+		pthread_mutex_lock(&producer_mock.lock);
+		n = producer_mock.requests;
+		pthread_mutex_unlock(&producer_mock.lock);
+		if (n >= requests)
+			break;
+		test_sleep_ms(10);
+	}
+
+	return n;
+}
+
+static int producer_handler(const char *method, const char *path, const char *data,
+		flowthings_io_string *body, void *user_data)
+{
+	const char *s = data;
+	int items = 0, i, code;
+
+	while (s && (s = strstr(s, "\"elems\"")) != NULL) {
+		items++;
+		s++;
+	}
+
+	pthread_mutex_lock(&producer_mock.lock);
+	if (producer_mock.requests < 16)
+		producer_mock.request_items[producer_mock.requests] = items;
+	producer_mock.requests++;
+	pthread_cond_broadcast(&producer_mock.changed);
+	while (!producer_mock.gate_open)
+		pthread_cond_wait(&producer_mock.changed, &producer_mock.lock);
+	code = producer_mock.http_response_code;
+	pthread_mutex_unlock(&producer_mock.lock);
+
+	flowthings_io_string_strcat(body, "{\"head\":{\"status\":200},\"body\":[");
+	for (i = 0; i < items; i++)
+		flowthings_io_string_strcat(body, i ? ",{\"head\":{\"status\":200},\"body\":{}}"
+				: "{\"head\":{\"status\":200},\"body\":{}}");
+	flowthings_io_string_strcat(body, "]}");
+
+	return code;
+}
+
+static void on_delivery(void *object, flowthings_io_result_code code, void *user_data)
+{
+	pthread_mutex_lock(&producer_mock.lock);
+	if (producer_mock.deliveries < 16) {
+		producer_mock.delivered[producer_mock.deliveries] = ((struct my_drop *)object)->num;
+		producer_mock.delivered_codes[producer_mock.deliveries] = code;
+	}
+	producer_mock.deliveries++;
+	pthread_mutex_unlock(&producer_mock.lock);
+}
+
+/* a producer on an API answered by producer_handler */
+static flowthings_io_producer *mock_producer(flowthings_io_api **api, flowthings_io_http_mock_config *mock_config,
+		int capacity, int batch_size, int linger_ms, flowthings_io_producer_overflow overflow)
+{
+	static flowthings_io_token creds = { "myaccountname", "mytoken" };
+	flowthings_io_producer_config config;
+
+	memset(mock_config, 0, sizeof(flowthings_io_http_mock_config));
+	mock_config->handler = producer_handler;
+	*api = flowthings_io_api_init(FLOWTHINGS_IO_VERSION, FLOWTHINGS_IO_HOST, FALSE, &creds);
+	flowthings_io_api_set_transport(*api, &flowthings_io_http_transport_mock, mock_config);
+
+	memset(&config, 0, sizeof(config));
+	config.capacity = capacity;
+	config.batch_size = batch_size;
+	config.linger_ms = linger_ms;
+	config.overflow = overflow;
+	config.delivery = on_delivery;
+
+	return flowthings_io_producer_init(*api, "f1", encode_my_drop, &config);
+}
+
+/* fills a queue of 4 behind a request of 4 drops that is held at the gate */
+static void producer_fill(flowthings_io_producer *producer, struct my_drop drops[])
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		CHECK(flowthings_io_producer_send(producer, &drops[i]) == FLOWTHINGS_IO_OK);
+	CHECK(producer_mock_wait_requests(1) == 1);
+
+	for (i = 4; i < 8; i++)
+		CHECK(flowthings_io_producer_send(producer, &drops[i]) == FLOWTHINGS_IO_OK);
+}
+
+static void *send_ninth(void *producer)
+{
+	static struct my_drop drop = { 8 };
+
+	return (void *)(long)flowthings_io_producer_send((flowthings_io_producer *)producer, &drop);
+}
+
+static void test_producer_overflow(void)
+{
+	flowthings_io_http_mock_config mock_config;
+	flowthings_io_producer *producer;
+	flowthings_io_api *api;
+	struct my_drop drops[9];
+	pthread_t sender;
+	void *code;
+	int i;
+
+	for (i = 0; i < 9; i++)
+		drops[i].num = i;
+
+	/* DROP_NEWEST turns the ninth drop away */
+	producer_mock_reset(FALSE, 200);
+	producer = mock_producer(&api, &mock_config, 4, 4, 10000, FLOWTHINGS_IO_PRODUCER_DROP_NEWEST);
+	producer_fill(producer, drops);
+	CHECK(flowthings_io_producer_send(producer, &drops[8]) == FLOWTHINGS_IO_ERROR_QUEUE_FULL);
+	producer_mock_open_gate();
+	flowthings_io_producer_flush(producer);
+	CHECK(producer_mock.deliveries == 8);
+	CHECK(producer_mock.delivered[7] == 7 && producer_mock.delivered_codes[7] == FLOWTHINGS_IO_OK);
+	flowthings_io_producer_cleanup(producer);
+	flowthings_io_api_cleanup(api);
+
+	/* DROP_OLDEST pushes the fifth drop out, and delivers it as QUEUE_FULL at once */
+	producer_mock_reset(FALSE, 200);
+	producer = mock_producer(&api, &mock_config, 4, 4, 10000, FLOWTHINGS_IO_PRODUCER_DROP_OLDEST);
+	producer_fill(producer, drops);
+	CHECK(flowthings_io_producer_send(producer, &drops[8]) == FLOWTHINGS_IO_OK);
+	CHECK(producer_mock.deliveries == 1);
+	CHECK(producer_mock.delivered[0] == 4 && producer_mock.delivered_codes[0] == FLOWTHINGS_IO_ERROR_QUEUE_FULL);
+	producer_mock_open_gate();
+	flowthings_io_producer_flush(producer);
+	CHECK(producer_mock.deliveries == 9);
+	CHECK(producer_mock.delivered[5] == 5 && producer_mock.delivered[8] == 8);
+	flowthings_io_producer_cleanup(producer);
+	flowthings_io_api_cleanup(api);
+
+	/* BLOCK holds the ninth drop's sender until there is room */
+	producer_mock_reset(FALSE, 200);
+	producer = mock_producer(&api, &mock_config, 4, 4, 10000, FLOWTHINGS_IO_PRODUCER_BLOCK);
+	producer_fill(producer, drops);
+	pthread_create(&sender, NULL, send_ninth, producer);
+	test_sleep_ms(50);
+	CHECK(producer_mock.deliveries == 0);
+	producer_mock_open_gate();
+	pthread_join(sender, &code);
+	CHECK((flowthings_io_result_code)(long)code == FLOWTHINGS_IO_OK);
+	flowthings_io_producer_flush(producer);
+	CHECK(producer_mock.deliveries == 9);
+	for (i = 0; i < 9 && i < producer_mock.deliveries; i++)
+		CHECK(producer_mock.delivered[i] == i && producer_mock.delivered_codes[i] == FLOWTHINGS_IO_OK);
+	flowthings_io_producer_cleanup(producer);
+	flowthings_io_api_cleanup(api);
+}
+
+static void test_producer_batches(void)
+{
+	flowthings_io_http_mock_config mock_config;
+	flowthings_io_producer *producer;
+	flowthings_io_api *api;
+	struct my_drop drops[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		drops[i].num = i;
+
+	/* a full batch goes at once; the rest waits to linger, or for a flush */
+	producer_mock_reset(TRUE, 200);
+	producer = mock_producer(&api, &mock_config, 16, 2, 10000, FLOWTHINGS_IO_PRODUCER_BLOCK);
+	for (i = 0; i < 5; i++)
+		CHECK(flowthings_io_producer_send(producer, &drops[i]) == FLOWTHINGS_IO_OK);
+	CHECK(producer_mock_wait_requests(2) == 2);
+	test_sleep_ms(50);
+	CHECK(producer_mock.requests == 2);
+	CHECK(producer_mock.request_items[0] == 2 && producer_mock.request_items[1] == 2);
+
+	flowthings_io_producer_flush(producer);
+	CHECK(producer_mock.requests == 3 && producer_mock.request_items[2] == 1);
+	CHECK(producer_mock.deliveries == 5);
+	for (i = 0; i < 5 && i < producer_mock.deliveries; i++)
+		CHECK(producer_mock.delivered[i] == i);
+
+	/* a flush with nothing queued returns at once */
+	flowthings_io_producer_flush(producer);
+	CHECK(producer_mock.requests == 3);
+
+	/* cleanup sends what is still queued, and a failed request is every drop's result */
+	producer_mock_reset(TRUE, 500);
+	for (i = 0; i < 3; i++)
+		CHECK(flowthings_io_producer_send(producer, &drops[i]) == FLOWTHINGS_IO_OK);
+	flowthings_io_producer_cleanup(producer);
+	CHECK(producer_mock.requests == 2);
+	CHECK(producer_mock.deliveries == 3);
+	CHECK(producer_mock.delivered_codes[2] == FLOWTHINGS_IO_ERROR_SERVER_ERROR);
+	flowthings_io_api_cleanup(api);
+
+	/* a short batch goes once its oldest drop has lingered */
+	producer_mock_reset(TRUE, 200);
+	producer = mock_producer(&api, &mock_config, 16, 10, 100, FLOWTHINGS_IO_PRODUCER_BLOCK);
+	for (i = 0; i < 3; i++)
+		CHECK(flowthings_io_producer_send(producer, &drops[i]) == FLOWTHINGS_IO_OK);
+	test_sleep_ms(20);
+	CHECK(producer_mock.requests == 0);
+	CHECK(producer_mock_wait_requests(1) == 1);
+	CHECK(producer_mock.request_items[0] == 3);
+	flowthings_io_producer_cleanup(producer);
+	CHECK(producer_mock.deliveries == 3);
+	flowthings_io_api_cleanup(api);
+}
+
+static int shard_requests;
+
+/* answers a shard of a sharded find_many with a drop for each flow, numbered after the flow, and
+ * fails the shard with flow f5 in it */
+static int shard_handler(const char *method, const char *path, const char *data,
+		flowthings_io_string *body, void *user_data)
+{
+	const char *s = data;
+	char entry[128];
+	int flows = 0, flow;
+
+	shard_requests++;
+
+	if (strstr(data, "\"f5\""))
+		return 500;
+
+	flowthings_io_string_strcat(body, "{\"head\":{\"status\":200},\"body\":{");
+
+	while ((s = strstr(s, "\"flowId\":\"f")) != NULL) {
+		s += strlen("\"flowId\":\"f");
+		flow = atoi(s);
+		snprintf(entry, sizeof(entry), "%s\"f%d\":[{\"id\":\"d%d\",\"elems\":{\"num\":{\"type\":\"integer\",\"value\":%d}}}]",
+				flows++ ? "," : "", flow, flow, flow);
+		flowthings_io_string_strcat(body, entry);
+	}
+
+	flowthings_io_string_strcat(body, "}}");
+
+	return 200;
+}
+
+static void test_find_many_sharded(void)
+{
+	flowthings_io_http_mock_config config;
+	flowthings_io_find_many_flow flows[6];
+	flowthings_io_idlist *idlist;
+	flowthings_io_api *api;
+	void *slots[10];
+	char id[8];
+	int count, flow, i;
+
+	memset(&config, 0, sizeof(config));
+	api = mock_api(&config);
+	config.handler = shard_handler;
+
+	idlist = flowthings_io_idlist_init();
+	for (i = 1; i <= 6; i++) {
+		snprintf(id, sizeof(id), "f%d", i);
+		flowthings_io_idlist_add(idlist, id, NULL);
+	}
+
+	/* six flows in shards of two (an ID list keeps the last added first, so f6 and f5 are the
+	 * first shard): the shard with f5 fails, and the other two aren't lost */
+	shard_requests = 0;
+	count = 10;
+	CHECK(flowthings_io_drop_find_many_sharded(api, decode_my_drop, idlist, 2, 2, slots, &count, flows)
+			== FLOWTHINGS_IO_ERROR_SERVER_ERROR);
+	CHECK(shard_requests == 3);
+	CHECK(count == 4);
+
+	for (i = 0; i < 6; i++) {
+		flow = atoi(flows[i].flow_id + 1);
+		CHECK(flow == 6 - i);
+		CHECK(flows[i].code == (flow < 5 ? FLOWTHINGS_IO_OK : FLOWTHINGS_IO_ERROR_SERVER_ERROR));
+		CHECK(flows[i].count == (flow < 5 ? 1 : 0));
+		if (flows[i].count == 1)
+			CHECK(slot_num(slots, flows[i].first) == flow);
+	}
+
+	/* the result array stops taking objects once it's full */
+	count = 3;
+	flowthings_io_drop_find_many_sharded(api, decode_my_drop, idlist, 2, 0, slots, &count, NULL);
+	CHECK(count == 3);
+
+	flowthings_io_idlist_cleanup(idlist);
+	flowthings_io_api_cleanup(api);
+}
+
+/* pages through what the mock answers, two drops a page; returns the drops' numbers, summed */
+static int iterate(flowthings_io_api *api, int *count, flowthings_io_result_code *code)
+{
+	flowthings_io_find_iter *iter = flowthings_io_drop_find_iter_open("f1", api, NULL, NULL, decode_my_drop, 2);
+	struct my_drop drop;
+	int sum = 0;
+
+	*count = 0;
+	while (flowthings_io_drop_find_iter_next(iter, &drop)) {
+		sum += drop.num;
+		(*count)++;
+	}
+
+	*code = flowthings_io_find_iter_result(iter);
+	flowthings_io_drop_find_iter_close(iter);
+
+	return sum;
+}
+
+static void test_find_iter(void)
+{
+	flowthings_io_http_mock_config config;
+	flowthings_io_result_code code;
+	flowthings_io_api *api;
+	int count;
+
+	memset(&config, 0, sizeof(config));
+	api = mock_api(&config);
+
+	/* a short page is the last */
+	mock_answer(200, NULL);
+	mock.bodies[0] = RESPONSE("[" DROP(1) "," DROP(2) "]");
+	mock.bodies[1] = RESPONSE("[" DROP(3) "," DROP(4) "]");
+	mock.bodies[2] = RESPONSE("[" DROP(5) "]");
+	CHECK(iterate(api, &count, &code) == 15 && count == 5 && code == FLOWTHINGS_IO_OK);
+	CHECK(mock.calls == 3);
+	CHECK(strstr(mock.path, "start=4") != NULL && strstr(mock.path, "limit=2") != NULL);
+
+	/* so is an empty one */
+	mock_answer(200, RESPONSE("[]"));
+	mock.bodies[0] = RESPONSE("[" DROP(1) "," DROP(2) "]");
+	CHECK(iterate(api, &count, &code) == 3 && count == 2 && code == FLOWTHINGS_IO_OK);
+	CHECK(mock.calls == 2);
+
+	/* a server that ignores start sends the first page again, which ends the find */
+	mock_answer(200, RESPONSE("[" DROP(1) "," DROP(2) "]"));
+	CHECK(iterate(api, &count, &code) == 3 && count == 2 && code == FLOWTHINGS_IO_OK);
+	CHECK(mock.calls == 2);
+
+	/* a page that fails stops the find with its error */
+	mock_answer(500, "");
+	CHECK(iterate(api, &count, &code) == 0 && count == 0 && code == FLOWTHINGS_IO_ERROR_SERVER_ERROR);
+
+	flowthings_io_api_cleanup(api);
+}
+
+static void test_cache(void)
+{
+	static const flowthings_io_http_mock_response responses[] = {
+		{ "GET", "/flow/", 200, RESPONSE("{\"id\":\"f1\",\"path\":\"/me/a\",\"description\":\"a\"}") },
+	};
+	flowthings_io_http_mock_config config;
+	flowthings_io_cache_stats stats;
+	flowthings_io_params *params;
+	flowthings_io_api *api;
+	struct my_flow flow;
+	int stream;
+
+	for (stream = 0; stream < 2; stream++) {
+
+		memset(&config, 0, sizeof(config));
+		config.responses = responses;
+		config.response_count = 1;
+		config.etags = TRUE;
+		api = mock_api(&config);
+		flowthings_io_api_set_stream_decode(api, stream);
+		flowthings_io_api_set_cache(api, 2, 60000);
+		mock_answer(200, RESPONSE("{}"));
+
+		/* a second read is answered from the cache */
+		memset(&flow, 0, sizeof(flow));
+		CHECK(flowthings_io_flow_read(api, "f1", NULL, decode_my_flow, &flow) == FLOWTHINGS_IO_OK);
+		memset(&flow, 0, sizeof(flow));
+		CHECK(flowthings_io_flow_read(api, "f1", NULL, decode_my_flow, &flow) == FLOWTHINGS_IO_OK);
+		CHECK(!strcmp(flow.path, "/me/a"));
+		flowthings_io_api_get_cache_stats(api, &stats);
+		CHECK(stats.misses == 1 && stats.hits == 1 && stats.entries == 1);
+
+		/* reads with parameters aren't cached */
+		params = flowthings_io_params_init();
+		flowthings_io_params_add(params, "hints", "0");
+		CHECK(flowthings_io_flow_read(api, "f1", params, decode_my_flow, &flow) == FLOWTHINGS_IO_OK);
+		flowthings_io_params_cleanup(params);
+		flowthings_io_api_get_cache_stats(api, &stats);
+		CHECK(stats.misses == 1 && stats.hits == 1);
+
+		/* an update through the API drops the entry */
+		CHECK(flowthings_io_flow_update(api, "f1", NULL, encode_my_flow, NULL, &flow) == FLOWTHINGS_IO_OK);
+		CHECK(strcmp(mock.method, "PUT") == 0);
+		CHECK(flowthings_io_flow_read(api, "f1", NULL, decode_my_flow, &flow) == FLOWTHINGS_IO_OK);
+		flowthings_io_api_get_cache_stats(api, &stats);
+		CHECK(stats.invalidations == 1 && stats.misses == 2);
+
+		/* the least recently used entry goes to make room */
+		CHECK(flowthings_io_flow_read(api, "f2", NULL, decode_my_flow, &flow) == FLOWTHINGS_IO_OK);
+		CHECK(flowthings_io_flow_read(api, "f3", NULL, decode_my_flow, &flow) == FLOWTHINGS_IO_OK);
+		CHECK(flowthings_io_flow_read(api, "f1", NULL, decode_my_flow, &flow) == FLOWTHINGS_IO_OK);
+		flowthings_io_api_get_cache_stats(api, &stats);
+		CHECK(stats.evictions == 2 && stats.entries == 2 && stats.misses == 5);
+
+		flowthings_io_api_cleanup(api);
+
+		/* with no TTL every read is revalidated, and a 304 uses the entry */
+		api = mock_api(&config);
+		flowthings_io_api_set_stream_decode(api, stream);
+		flowthings_io_api_set_cache(api, 2, 0);
+		CHECK(flowthings_io_flow_read(api, "f1", NULL, decode_my_flow, &flow) == FLOWTHINGS_IO_OK);
+		memset(&flow, 0, sizeof(flow));
+		CHECK(flowthings_io_flow_read(api, "f1", NULL, decode_my_flow, &flow) == FLOWTHINGS_IO_OK);
+		CHECK(!strcmp(flow.id, "f1"));
+		flowthings_io_api_get_cache_stats(api, &stats);
+		CHECK(stats.misses == 1 && stats.stale == 1 && stats.revalidated == 1 && stats.hits == 0);
+		flowthings_io_api_cleanup(api);
+	}
+}
+
+static void test_resolver(void)
+{
+	flowthings_io_http_mock_config config;
+	flowthings_io_api *api;
+	struct my_flow flow;
+	char flow_id[FLOWTHINGS_IO_ID_LEN];
+	int count;
+
+	memset(&config, 0, sizeof(config));
+	api = mock_api(&config);
+	flowthings_io_api_set_resolver(api, 16, 0, 60000);
+	memset(&flow, 0, sizeof(flow));
+
+	/* a path is asked for once */
+	mock_answer(200, RESPONSE("[{\"id\":\"f9\",\"path\":\"/me/a\"}]"));
+	CHECK(flowthings_io_flow_resolve(api, "/me/a", flow_id) == FLOWTHINGS_IO_OK);
+	CHECK(!strcmp(flow_id, "f9") && mock.calls == 1);
+	CHECK(strncmp(mock.path, "/flow?", 6) == 0 && strstr(mock.path, "limit=1") != NULL);
+	CHECK(flowthings_io_flow_resolve(api, "/me/a", flow_id) == FLOWTHINGS_IO_OK);
+	CHECK(!strcmp(flow_id, "f9") && mock.calls == 1);
+
+	/* and so is a path with no flow, until a flow is created */
+	CHECK(flowthings_io_flow_resolve(api, "/me/b", flow_id) == FLOWTHINGS_IO_ERROR_NOT_FOUND);
+	CHECK(flowthings_io_flow_resolve(api, "/me/b", flow_id) == FLOWTHINGS_IO_ERROR_NOT_FOUND);
+	CHECK(mock.calls == 2);
+	CHECK(flowthings_io_flow_create(api, NULL, encode_my_flow, NULL, &flow) == FLOWTHINGS_IO_OK);
+	CHECK(flowthings_io_flow_resolve(api, "/me/b", flow_id) == FLOWTHINGS_IO_ERROR_NOT_FOUND);
+	CHECK(mock.calls == 4);
+
+	/* updating a flow forgets its path */
+	CHECK(flowthings_io_flow_update(api, "f9", NULL, encode_my_flow, NULL, &flow) == FLOWTHINGS_IO_OK);
+	CHECK(flowthings_io_flow_resolve(api, "/me/a", flow_id) == FLOWTHINGS_IO_OK);
+	CHECK(mock.calls == 6);
+
+	/* a prefix fills the resolver with every flow under it */
+	mock_answer(200, RESPONSE("[{\"id\":\"f1\",\"path\":\"/me/s/1\"},{\"id\":\"f2\",\"path\":\"/me/s/2\"}]"));
+	CHECK(flowthings_io_flow_resolve_prefix(api, "/me/s/", &count) == FLOWTHINGS_IO_OK);
+	CHECK(count == 2 && mock.calls == 1);
+	CHECK(flowthings_io_flow_resolve(api, "/me/s/2", flow_id) == FLOWTHINGS_IO_OK);
+	CHECK(!strcmp(flow_id, "f2") && mock.calls == 1);
+
+	/* failures aren't remembered */
+	mock_answer(500, "");
+	CHECK(flowthings_io_flow_resolve(api, "/me/c", flow_id) == FLOWTHINGS_IO_ERROR_SERVER_ERROR);
+	CHECK(flowthings_io_flow_resolve(api, "/me/c", flow_id) == FLOWTHINGS_IO_ERROR_SERVER_ERROR);
+	CHECK(mock.calls == 2);
+
+	flowthings_io_api_cleanup(api);
+}
+
+struct codec_rec {
+	char id[16];
+	int num;
+	long long big;
+	double x;
+	BOOL flag;
+	char label[8];
+};
+
+#define CODEC_REC_FIELDS(X) \
+	X(struct codec_rec, id, "id", FLOWTHINGS_IO_FIELD_STRING | FLOWTHINGS_IO_FIELD_READ_ONLY) \
+	X(struct codec_rec, num, "elems.num", FLOWTHINGS_IO_FIELD_INT) \
+	X(struct codec_rec, big, "elems.big", FLOWTHINGS_IO_FIELD_LONG) \
+	X(struct codec_rec, x, "elems.x", FLOWTHINGS_IO_FIELD_DOUBLE) \
+	X(struct codec_rec, flag, "elems.flag", FLOWTHINGS_IO_FIELD_BOOL) \
+	X(struct codec_rec, label, "elems.label", FLOWTHINGS_IO_FIELD_STRING)
+
+FLOWTHINGS_IO_CODEC_DEFINE(codec_rec_codec, struct codec_rec, CODEC_REC_FIELDS)
+
+/* what a decode starts from, so that members left alone can be seen */
+static const struct codec_rec codec_base = { "-", -1, -1, -1.0, -1, "-" };
+
+/* a JSON object, whether it decodes, and what it decodes to */
+static const struct {
+	const char *json;
+	BOOL ok;
+	struct codec_rec want;
+} codec_cases[] = {
+	{ "{\"id\":\"d1\",\"elems\":{\"num\":3,\"big\":1234567890123,\"x\":1.5e3,\"flag\":true,\"label\":\"abc\"}}",
+		TRUE, { "d1", 3, 1234567890123LL, 1500.0, TRUE, "abc" } },
+	/* the platform's { "type": ..., "value": ... } elems */
+	{ "{\"elems\":{\"num\":{\"type\":\"integer\",\"value\":7},\"flag\":{\"value\":false,\"type\":\"boolean\"}}}",
+		TRUE, { "-", 7, -1, -1.0, FALSE, "-" } },
+	/* escapes, a \u escape and a surrogate pair */
+	{ "{\"id\":\"a\\\"b\\\\c\\n\\/\",\"elems\":{\"label\":\"\\u00e9\\ud83d\\ude00\"}}",
+		TRUE, { "a\"b\\c\n/", -1, -1, -1.0, -1, "\xc3\xa9\xf0\x9f\x98\x80" } },
+	/* strings too long for their members are cut */
+	{ "{\"elems\":{\"label\":\"abcdefghij\"}}", TRUE, { "-", -1, -1, -1.0, -1, "abcdefg" } },
+	/* unknown keys, nested objects and arrays are skipped, whatever is in them */
+	{ "{\"x\":{\"y\":[1,{\"z\":\"}\"}]},\"elems\":{\"other\":{\"a\":[[],{}]},\"num\":2},\"tags\":[\"a\",null],\"id\":\"d2\"}",
+		TRUE, { "d2", 2, -1, -1.0, -1, "-" } },
+	/* values of the wrong type, and nulls, leave members alone */
+	{ "{\"id\":5,\"elems\":{\"num\":\"3\",\"big\":[1],\"x\":true,\"flag\":1,\"label\":{\"a\":1}}}",
+		TRUE, { "-", -1, -1, -1.0, -1, "-" } },
+	{ "{\"id\":null,\"elems\":{\"num\":null,\"label\":null}}", TRUE, { "-", -1, -1, -1.0, -1, "-" } },
+	{ "{\"elems\":null}", TRUE, { "-", -1, -1, -1.0, -1, "-" } },
+	/* an integer sent as a fraction gets its whole part */
+	{ "{\"elems\":{\"num\":3.9,\"big\":-2e3}}", TRUE, { "-", 3, -2000, -1.0, -1, "-" } },
+	{ "{}", TRUE, { "-", -1, -1, -1.0, -1, "-" } },
+	/* truncated and malformed input */
+	{ "{\"elems\":{\"num\":3", FALSE },
+	{ "{\"id\":\"d1", FALSE },
+	{ "{\"id\":\"d1\",", FALSE },
+	{ "{\"id\":\"\\x\"}", FALSE },
+	{ "{\"id\" \"d1\"}", FALSE },
+	{ "{\"elems\":{\"num\":-}}", FALSE },
+	{ "[{}]", FALSE },
+	{ "\"d1\"", FALSE },
+	{ "", FALSE },
+};
+
+static BOOL codec_rec_equal(const struct codec_rec *a, const struct codec_rec *b)
+{
+	return !strcmp(a->id, b->id) && a->num == b->num && a->big == b->big && a->x == b->x
+			&& a->flag == b->flag && !strcmp(a->label, b->label);
+}
+
+static void test_codec(void)
+{
+	flowthings_io_http_mock_config config;
+	flowthings_io_result_code code;
+	flowthings_io_string *out;
+	flowthings_io_api *api;
+	struct codec_rec rec, recs[3];
+	char response[512];
+	int i, mode, count;
+
+	/* each case straight from the text, then as a read response buffered, and streamed in pieces
+	 * of 3 bytes */
+	for (i = 0; i < (int)(sizeof(codec_cases) / sizeof(codec_cases[0])); i++) {
+
+		rec = codec_base;
+		if (flowthings_io_codec_decode(&codec_rec_codec, codec_cases[i].json, strlen(codec_cases[i].json), &rec)
+				!= codec_cases[i].ok) {
+			printf("codec case %d: decode didn't return %d\n", i, codec_cases[i].ok);
+			test_failures++;
+		}
+		else if (codec_cases[i].ok && !codec_rec_equal(&rec, &codec_cases[i].want)) {
+			printf("codec case %d: decoded the wrong values\n", i);
+			test_failures++;
+		}
+
+		snprintf(response, sizeof(response), "{\"head\":{\"status\":200},\"body\":%s}", codec_cases[i].json);
+
+		for (mode = 0; mode < 2; mode++) {
+
+			memset(&config, 0, sizeof(config));
+			config.chunk_size = mode ? 3 : 0;
+			api = mock_api(&config);
+			flowthings_io_api_set_stream_decode(api, mode);
+			mock_answer(200, response);
+
+			rec = codec_base;
+			code = flowthings_io_drop_read_codec("f1", api, "d1", NULL, &codec_rec_codec, &rec);
+
+			if ((code == FLOWTHINGS_IO_OK) != codec_cases[i].ok
+					|| (code == FLOWTHINGS_IO_OK && !codec_rec_equal(&rec, &codec_cases[i].want))) {
+				printf("codec case %d: %s read returned %d\n", i, mode ? "streamed" : "buffered", code);
+				test_failures++;
+			}
+
+			flowthings_io_api_cleanup(api);
+		}
+	}
+
+	/* text after the object; in a response, what follows the body isn't read */
+	CHECK(!flowthings_io_codec_decode(&codec_rec_codec, "{} x", 4, &rec));
+
+	/* a find fills structs, not pointers, and stops at the size of the array */
+	for (mode = 0; mode < 2; mode++) {
+		memset(&config, 0, sizeof(config));
+		config.chunk_size = mode ? 5 : 0;
+		api = mock_api(&config);
+		flowthings_io_api_set_stream_decode(api, mode);
+		mock_answer(200, RESPONSE("[{\"elems\":{\"num\":1}},{\"id\":\"d2\",\"elems\":{\"num\":2,\"label\":\"\\u00e9\"}},"
+				"{\"elems\":{\"num\":3}},{\"elems\":{\"num\":4}}]"));
+		count = 3;
+		CHECK(flowthings_io_drop_find_codec("f1", api, NULL, NULL, &codec_rec_codec, recs, &count) == FLOWTHINGS_IO_OK);
+		CHECK(count == 3);
+		CHECK(recs[0].num == 1 && recs[1].num == 2 && recs[2].num == 3);
+		CHECK(!strcmp(recs[1].id, "d2") && !strcmp(recs[1].label, "\xc3\xa9"));
+
+		mock_answer(200, RESPONSE("[{\"elems\":{\"num\":1}},{\"elems\":"));
+		count = 3;
+		CHECK(flowthings_io_drop_find_codec("f1", api, NULL, NULL, &codec_rec_codec, recs, &count) != FLOWTHINGS_IO_OK);
+		flowthings_io_api_cleanup(api);
+	}
+
+	/* encoding escapes what it must, leaves out read-only fields, and decodes back the same */
+	rec = codec_base;
+	strcpy(rec.id, "d1");
+	rec.num = -42;
+	rec.big = -9007199254740993LL;
+	rec.x = 0.1;
+	rec.flag = TRUE;
+	strcpy(rec.label, "\"\\\n\x01\xc3\xa9");
+
+	out = flowthings_io_string_init();
+	CHECK(flowthings_io_codec_encode(&codec_rec_codec, &rec, out));
+	CHECK(strstr(out->ptr, "\"id\"") == NULL);
+	CHECK(strstr(out->ptr, "\"label\":\"\\\"\\\\\\n\\u0001\xc3\xa9\"") != NULL);
+	CHECK(strstr(out->ptr, "-9007199254740993") != NULL);
+
+	recs[0] = codec_base;
+	CHECK(flowthings_io_codec_decode(&codec_rec_codec, out->ptr, out->len, &recs[0]));
+	strcpy(rec.id, "-");
+	CHECK(codec_rec_equal(&rec, &recs[0]));
+	flowthings_io_string_cleanup(out);
+}
+
+/* the events a pull reader reads from a text, one character each as in events_marks, up to the
+ * end or an error */
+static const char events_marks[] = "!${}[]ksntfz";
+
+static void reader_events(const char *json, char *out)
+{
+	flowthings_io_json_reader reader;
+	flowthings_io_json_event event;
+
+	flowthings_io_json_reader_init(&reader, json, strlen(json));
+	do {
+		event = flowthings_io_json_next(&reader);
+		*out++ = events_marks[event];
+	} while (event != FLOWTHINGS_IO_JSON_END && event != FLOWTHINGS_IO_JSON_ERROR);
+	*out = 0;
+}
+
+static const struct {
+	const char *json;
+	const char *events;
+} reader_cases[] = {
+	{ "{\"a\":1,\"b\":[true,false,null,\"x\"],\"c\":{}}", "{knk[tfzs]k{}}$" },
+	{ " [ ]\n", "[]$" },
+	{ "\"s\"", "s$" },
+	{ "-1.5e3", "n$" },
+	{ "[\"a\\\"b\",\"}\"]", "[ss]$" },
+	/* malformed */
+	{ "{\"a\":1,}", "{kn!" },
+	{ "[1,]", "[n!" },
+	{ "[1 2]", "[n!" },
+	{ "[1,,2]", "[n!" },
+	{ "{\"a\":1 \"b\":2}", "{kn!" },
+	{ "{\"a\" 1}", "{!" },
+	{ "{1:2}", "{!" },
+	{ "{\"a\":[}", "{k[!" },
+	{ "[truex]", "[t!" },
+	{ "tru", "!" },
+	{ "-", "!" },
+	{ ".5", "!" },
+	{ "", "!" },
+	/* truncated, or followed by more */
+	{ "{\"a\":1", "{kn!" },
+	{ "[", "[!" },
+	{ "\"abc", "!" },
+	{ "{} x", "{}!" },
+	{ "{}{}", "{}!" },
+};
+
+/* a string, the buffer size it is decoded into, whether it decodes and what to */
+static const struct {
+	const char *json;
+	size_t size;
+	BOOL ok;
+	const char *want;
+} reader_strings[] = {
+	{ "\"plain\"", 16, TRUE, "plain" },
+	{ "\"a\\\"b\\\\c\\/d\\b\\f\\n\\r\\t\"", 16, TRUE, "a\"b\\c/d\b\f\n\r\t" },
+	{ "\"\\u0041\\u00e9\\u20ac\"", 16, TRUE, "A\xc3\xa9\xe2\x82\xac" },
+	{ "\"\\ud83d\\ude00!\"", 16, TRUE, "\xf0\x9f\x98\x80!" },
+	/* cut to fit, never inside a character, even when what follows would fit */
+	{ "\"abcdef\"", 4, TRUE, "abc" },
+	{ "\"ab\xc3\xa9\"", 4, TRUE, "ab" },
+	{ "\"ab\\u00e9\\n\"", 4, TRUE, "ab" },
+	{ "\"\\ud83d\\ude00\"", 4, TRUE, "" },
+	/* malformed escapes, also after the cut, and half a surrogate pair */
+	{ "\"ab\\x\"", 16, FALSE, NULL },
+	{ "\"abcdef\\x\"", 4, FALSE, NULL },
+	{ "\"\\u12\"", 16, FALSE, NULL },
+	{ "\"\\u12g4\"", 16, FALSE, NULL },
+	{ "\"\\ud83d\"", 16, FALSE, NULL },
+	{ "\"\\ud83dx\"", 16, FALSE, NULL },
+	{ "\"\\ud83d\\u0041\"", 16, FALSE, NULL },
+	{ "\"\\ude00\"", 16, FALSE, NULL },
+};
+
+/* the id and num of a flat object, skipping anything else; a wrong type is an error */
+struct event_rec {
+	char id[8];
+	int num;
+};
+
+static BOOL read_event_fields(flowthings_io_json_reader *reader, char *id, size_t id_size, int *num)
+{
+	flowthings_io_json_event event;
+
+	if (flowthings_io_json_next(reader) != FLOWTHINGS_IO_JSON_BEGIN_OBJECT)
+		return FALSE;
+
+	while ((event = flowthings_io_json_next(reader)) == FLOWTHINGS_IO_JSON_KEY) {
+		if (id && flowthings_io_json_key_is(reader, "id")) {
+			if (flowthings_io_json_next(reader) != FLOWTHINGS_IO_JSON_STRING
+					|| !flowthings_io_json_reader_string(reader, id, id_size))
+				return FALSE;
+		}
+		else if (flowthings_io_json_key_is(reader, "num")) {
+			if (flowthings_io_json_next(reader) != FLOWTHINGS_IO_JSON_NUMBER)
+				return FALSE;
+			*num = (int)reader->integer;
+		}
+		else if (!flowthings_io_json_skip(reader)) {
+			return FALSE;
+		}
+	}
+
+	return event == FLOWTHINGS_IO_JSON_END_OBJECT;
+}
+
+static BOOL read_event_rec(flowthings_io_json_reader *reader, void *obj_out)
+{
+	struct event_rec *rec = (struct event_rec *)obj_out;
+
+	return read_event_fields(reader, rec->id, sizeof(rec->id), &rec->num);
+}
+
+static BOOL read_event_num(flowthings_io_json_reader *reader, void *obj_out)
+{
+	return read_event_fields(reader, NULL, 0, &((struct my_drop *)obj_out)->num);
+}
+
+/* a drop, and what an event decoder reads from it as a read response */
+static const struct {
+	const char *json;
+	flowthings_io_result_code code;
+	struct event_rec want;
+} event_cases[] = {
+	{ "{\"id\":\"d1\",\"num\":3}", FLOWTHINGS_IO_OK, { "d1", 3 } },
+	{ "{\"id\":\"\\u00e9\\ud83d\\ude00\",\"num\":-4}", FLOWTHINGS_IO_OK, { "\xc3\xa9\xf0\x9f\x98\x80", -4 } },
+	/* unknown members are skipped, whatever is in them */
+	{ "{\"x\":{\"y\":[1,{\"z\":\"}\"}]},\"num\":2,\"tags\":[\"]\",null],\"id\":\"d2\"}",
+		FLOWTHINGS_IO_OK, { "d2", 2 } },
+	{ "{}", FLOWTHINGS_IO_OK, { "-", -1 } },
+	/* the decoder turns down values of the wrong type and malformed escapes */
+	{ "{\"num\":\"3\"}", FLOWTHINGS_IO_ERROR_COULDNT_DECODE },
+	{ "{\"id\":5}", FLOWTHINGS_IO_ERROR_COULDNT_DECODE },
+	{ "{\"id\":\"\\ud83d\"}", FLOWTHINGS_IO_ERROR_COULDNT_DECODE },
+	{ "[]", FLOWTHINGS_IO_ERROR_COULDNT_DECODE },
+};
+
+static void test_events(void)
+{
+	flowthings_io_http_mock_config config;
+	flowthings_io_json_reader reader;
+	flowthings_io_result_code code;
+	flowthings_io_api *api;
+	struct event_rec rec;
+	void *slots[3];
+	char events[64], dest[16], response[256];
+	int i, mode, count;
+
+	for (i = 0; i < (int)(sizeof(reader_cases) / sizeof(reader_cases[0])); i++) {
+		reader_events(reader_cases[i].json, events);
+		if (strcmp(events, reader_cases[i].events)) {
+			printf("reader case %d: read %s\n", i, events);
+			test_failures++;
+		}
+	}
+
+	for (i = 0; i < (int)(sizeof(reader_strings) / sizeof(reader_strings[0])); i++) {
+		flowthings_io_json_reader_init(&reader, reader_strings[i].json, strlen(reader_strings[i].json));
+		CHECK(flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_STRING);
+		if (flowthings_io_json_reader_string(&reader, dest, reader_strings[i].size) != reader_strings[i].ok
+				|| (reader_strings[i].ok && strcmp(dest, reader_strings[i].want))) {
+			printf("reader string %d: didn't decode as it should\n", i);
+			test_failures++;
+		}
+	}
+
+	/* skipping a key's value, then the rest of the object */
+	snprintf(response, sizeof(response), "{\"a\":{\"b\":[1,{\"c\":\"}\"}]},\"d\":[2],\"e\":3}");
+	flowthings_io_json_reader_init(&reader, response, strlen(response));
+	CHECK(flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_BEGIN_OBJECT);
+	CHECK(flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_KEY && flowthings_io_json_skip(&reader));
+	CHECK(flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_KEY && flowthings_io_json_key_is(&reader, "d"));
+	CHECK(flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_BEGIN_ARRAY && flowthings_io_json_skip(&reader));
+	CHECK(flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_KEY && flowthings_io_json_skip(&reader));
+	CHECK(flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_END_OBJECT);
+	CHECK(flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_END);
+	snprintf(response, sizeof(response), "{\"a\":[1,{");
+	flowthings_io_json_reader_init(&reader, response, strlen(response));
+	CHECK(flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_BEGIN_OBJECT);
+	CHECK(!flowthings_io_json_skip(&reader));
+
+	/* each case as a read response buffered, and streamed in pieces of 3 bytes */
+	for (i = 0; i < (int)(sizeof(event_cases) / sizeof(event_cases[0])); i++) {
+
+		snprintf(response, sizeof(response), "{\"head\":{\"status\":200},\"body\":%s}", event_cases[i].json);
+
+		for (mode = 0; mode < 2; mode++) {
+
+			memset(&config, 0, sizeof(config));
+			config.chunk_size = mode ? 3 : 0;
+			api = mock_api(&config);
+			flowthings_io_api_set_stream_decode(api, mode);
+			mock_answer(200, response);
+
+			strcpy(rec.id, "-");
+			rec.num = -1;
+			code = flowthings_io_drop_read_events("f1", api, "d1", NULL, read_event_rec, &rec);
+
+			if (code != event_cases[i].code || (code == FLOWTHINGS_IO_OK
+					&& (strcmp(rec.id, event_cases[i].want.id) || rec.num != event_cases[i].want.num))) {
+				printf("event case %d: %s read returned %d\n", i, mode ? "streamed" : "buffered", code);
+				test_failures++;
+			}
+
+			flowthings_io_api_cleanup(api);
+		}
+	}
+
+	/* a find decodes each result into its slot, and stops at the size of the array; a truncated
+	 * response fails */
+	for (mode = 0; mode < 2; mode++) {
+		memset(&config, 0, sizeof(config));
+		config.chunk_size = mode ? 5 : 0;
+		api = mock_api(&config);
+		flowthings_io_api_set_stream_decode(api, mode);
+
+		mock_answer(200, RESPONSE("[{\"num\":1},{\"id\":\"d2\",\"x\":[{}],\"num\":2},{\"num\":3},{\"num\":4}]"));
+		count = 3;
+		CHECK(flowthings_io_drop_find_events("f1", api, NULL, NULL, read_event_num, slots, &count) == FLOWTHINGS_IO_OK);
+		CHECK(count == 3);
+		CHECK(slot_num(slots, 0) == 1 && slot_num(slots, 1) == 2 && slot_num(slots, 2) == 3);
+
+		mock_answer(200, RESPONSE("[{\"num\":1},{\"num\":\"2\"}]"));
+		count = 3;
+		CHECK(flowthings_io_drop_find_events("f1", api, NULL, NULL, read_event_num, slots, &count) != FLOWTHINGS_IO_OK);
+
+		mock_answer(200, RESPONSE("[{\"num\":1},{\"num\":"));
+		count = 3;
+		CHECK(flowthings_io_drop_find_events("f1", api, NULL, NULL, read_event_num, slots, &count) != FLOWTHINGS_IO_OK);
+
+		flowthings_io_api_cleanup(api);
+	}
+}
+
+/* a text, and the tree projected from it onto projection_paths as compact JSON, or NULL if it
+ * doesn't parse */
+static const char *const projection_paths[] = { "id", "elems.num.value", "list[].a" };
+
+static const struct {
+	const char *json;
+	const char *want;
+} projection_cases[] = {
+	{ "{\"id\":\"d1\",\"x\":1,\"elems\":{\"num\":{\"type\":\"integer\",\"value\":7},\"other\":2}}",
+		"{\"id\":\"d1\",\"elems\":{\"num\":{\"value\":7}}}" },
+	/* escapes are decoded, and written back out */
+	{ "{\"id\":\"a\\\"b\\n\\u00e9\\ud83d\\ude00\"}", "{\"id\":\"a\\\"b\\n\xc3\xa9\xf0\x9f\x98\x80\"}" },
+	/* the value at the end of a path is kept whole, whatever it is */
+	{ "{\"elems\":{\"num\":{\"value\":{\"a\":[1,{}]}}}}", "{\"elems\":{\"num\":{\"value\":{\"a\":[1,{}]}}}}" },
+	{ "{\"id\":{\"a\":1}}", "{\"id\":{\"a\":1}}" },
+	/* arrays keep all their elements, and the path goes on into them */
+	{ "{\"list\":[{\"a\":1,\"b\":2},3,{\"b\":4}]}", "{\"list\":[{\"a\":1},3,{}]}" },
+	{ "[{\"id\":1,\"q\":2}]", "[{\"id\":1}]" },
+	/* a value of another type where the path expects an object is kept as it is */
+	{ "{\"elems\":5}", "{\"elems\":5}" },
+	{ "{\"elems\":[{\"num\":1},{\"x\":2}]}", "{\"elems\":[{\"num\":1},{}]}" },
+	/* everything off the paths is skipped, whatever is in it */
+	{ "{\"x\":{\"y\":[1,{\"z\":\"}\"}]},\"tags\":[\"]\"]}", "{}" },
+	{ "\"s\"", "\"s\"" },
+	/* truncated and malformed input, on a path or off one */
+	{ "{\"id\":\"d1\"", NULL },
+	{ "{\"id\":\"d1\",}", NULL },
+	{ "{\"x\":[1,}", NULL },
+	{ "{\"id\":\"\\ud83d\"}", NULL },
+	{ "{\"id\":\"\\x\"}", NULL },
+	{ "{} x", NULL },
+	{ "", NULL },
+};
+
+static void test_projection(void)
+{
+	static const char *const bad_paths[] = { "", "a..b", "a.", ".a" };
+	static const char *const body_paths[] = { "body.elems.num.value", "body[].elems.num.value" };
+	flowthings_io_json_projection *projection, *body_projection;
+	flowthings_io_http_mock_config config;
+	flowthings_io_json_reader reader;
+	flowthings_io_api *api;
+	struct my_drop drop;
+	void *slots[3];
+	char deep[128], *out;
+	const char *deep_path = deep, *text;
+	cJSON *tree;
+	int i, mode, count;
+
+	projection = flowthings_io_json_projection_init(projection_paths, 3);
+	CHECK(projection != NULL);
+
+	for (i = 0; i < (int)(sizeof(projection_cases) / sizeof(projection_cases[0])); i++) {
+		tree = flowthings_io_json_parse_projected(projection, projection_cases[i].json, strlen(projection_cases[i].json));
+		out = tree ? flowthings_io_json_print(tree) : NULL;
+		if (projection_cases[i].want ? !out || strcmp(out, projection_cases[i].want) : out != NULL) {
+			printf("projection case %d: parsed %s\n", i, out ? out : "nothing");
+			test_failures++;
+		}
+		free(out);
+		cJSON_Delete(tree);
+	}
+
+	/* no projection keeps nothing from an object */
+	tree = flowthings_io_json_parse_projected(NULL, "{\"a\":1}", 7);
+	CHECK(tree && tree->type == cJSON_Object && !tree->child);
+	cJSON_Delete(tree);
+
+	/* the part below a key, and the elements of an array parsed where they are */
+	CHECK(flowthings_io_json_projection_at(projection, "elems") != NULL);
+	CHECK(flowthings_io_json_projection_at(projection, "x") == NULL);
+	text = "[{\"num\":{\"value\":1,\"x\":0}},{\"num\":{\"value\":2}}]";
+	flowthings_io_json_reader_init(&reader, text, strlen(text));
+	CHECK(flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_BEGIN_ARRAY);
+	for (i = 1; i <= 2; i++) {
+		tree = flowthings_io_json_parse_projected_next(flowthings_io_json_projection_at(projection, "elems"), &reader);
+		out = tree ? flowthings_io_json_print(tree) : NULL;
+		CHECK(out && (i == 1 ? !strcmp(out, "{\"num\":{\"value\":1}}") : !strcmp(out, "{\"num\":{\"value\":2}}")));
+		free(out);
+		cJSON_Delete(tree);
+	}
+	CHECK(flowthings_io_json_next(&reader) == FLOWTHINGS_IO_JSON_END_ARRAY);
+	flowthings_io_json_projection_cleanup(projection);
+
+	/* paths that don't compile */
+	for (i = 0; i < (int)(sizeof(bad_paths) / sizeof(bad_paths[0])); i++)
+		CHECK(flowthings_io_json_projection_init(&bad_paths[i], 1) == NULL);
+	for (i = 0, deep[0] = 0; i <= FLOWTHINGS_IO_JSON_MAX_DEPTH; i++)
+		strcat(deep, i ? ".a" : "a");
+	CHECK(flowthings_io_json_projection_init(&deep_path, 1) == NULL);
+
+	/* read and find, buffered and streamed in small pieces */
+	body_projection = flowthings_io_json_projection_init(body_paths, 2);
+	for (mode = 0; mode < 2; mode++) {
+		memset(&config, 0, sizeof(config));
+		config.chunk_size = mode ? 3 : 0;
+		api = mock_api(&config);
+		flowthings_io_api_set_stream_decode(api, mode);
+
+		mock_answer(200, RESPONSE("{\"id\":\"d\\\"7\",\"x\":[{}],\"elems\":{\"a\":\"}\",\"num\":{\"type\":\"integer\",\"value\":7}}}"));
+		drop.num = 0;
+		CHECK(flowthings_io_drop_read_projected("f1", api, "d7", NULL, body_projection, decode_my_drop, &drop) == FLOWTHINGS_IO_OK);
+		CHECK(drop.num == 7);
+
+		mock_answer(200, "{\"head\":{},\"body\":{\"elems\":{\"num\":{\"value\":");
+		CHECK(flowthings_io_drop_read_projected("f1", api, "d7", NULL, body_projection, decode_my_drop, &drop) != FLOWTHINGS_IO_OK);
+
+		mock_answer(200, RESPONSE("[" DROP(1) ",{\"x\":{\"y\":[]}," "\"elems\":{\"num\":{\"value\":2}}}," DROP(3) "," DROP(4) "]"));
+		count = 3;
+		CHECK(flowthings_io_drop_find_projected("f1", api, NULL, NULL, body_projection, decode_my_drop, slots, &count) == FLOWTHINGS_IO_OK);
+		CHECK(count == 3);
+		CHECK(slot_num(slots, 0) == 1 && slot_num(slots, 1) == 2 && slot_num(slots, 2) == 3);
+
+		mock_answer(200, RESPONSE("[" DROP(1) ",{\"elems\":"));
+		count = 3;
+		CHECK(flowthings_io_drop_find_projected("f1", api, NULL, NULL, body_projection, decode_my_drop, slots, &count) != FLOWTHINGS_IO_OK);
+
+		flowthings_io_api_cleanup(api);
+	}
+	flowthings_io_json_projection_cleanup(body_projection);
+}
+
+/* writes a value on a tape back out as compact JSON, checking each object's and array's count
+ * against what is in it */
+static void tape_write(flowthings_io_json_writer *writer, flowthings_io_tape_value value)
+{
+	flowthings_io_tape_value item;
+	size_t count = 0;
+
+	switch (flowthings_io_tape_value_type(value)) {
+	case FLOWTHINGS_IO_TAPE_OBJECT:
+		flowthings_io_json_begin_object(writer);
+		flowthings_io_tape_for_each(item, value) {
+			flowthings_io_json_key(writer, flowthings_io_tape_key(item));
+			tape_write(writer, item);
+			count++;
+		}
+		flowthings_io_json_end_object(writer);
+		CHECK(flowthings_io_tape_count(value) == count);
+		break;
+	case FLOWTHINGS_IO_TAPE_ARRAY:
+		flowthings_io_json_begin_array(writer);
+		flowthings_io_tape_for_each(item, value) {
+			tape_write(writer, item);
+			count++;
+		}
+		flowthings_io_json_end_array(writer);
+		CHECK(flowthings_io_tape_count(value) == count);
+		break;
+	case FLOWTHINGS_IO_TAPE_STRING:
+		flowthings_io_json_string(writer, flowthings_io_tape_string(value));
+		break;
+	case FLOWTHINGS_IO_TAPE_INT:
+		flowthings_io_json_integer(writer, flowthings_io_tape_int(value));
+		break;
+	case FLOWTHINGS_IO_TAPE_DOUBLE:
+		flowthings_io_json_number(writer, flowthings_io_tape_number(value));
+		break;
+	case FLOWTHINGS_IO_TAPE_TRUE:
+	case FLOWTHINGS_IO_TAPE_FALSE:
+		flowthings_io_json_bool(writer, flowthings_io_tape_bool(value));
+		break;
+	case FLOWTHINGS_IO_TAPE_NULL:
+		flowthings_io_json_null(writer);
+		break;
+	default:
+		flowthings_io_string_strcat(writer->out, "?");
+		break;
+	}
+}
+
+/* a text, and the tape parsed from it written back out, or NULL if it doesn't parse */
+static const struct {
+	const char *json;
+	const char *want;
+} tape_cases[] = {
+	{ "{\"id\":\"d1\",\"elems\":{\"num\":{\"type\":\"integer\",\"value\":7}},\"tags\":[]}",
+		"{\"id\":\"d1\",\"elems\":{\"num\":{\"type\":\"integer\",\"value\":7}},\"tags\":[]}" },
+	{ " [ 1 , -2.5 , true , false , null , \"\" , {} ] ", "[1,-2.5,true,false,null,\"\",{}]" },
+	/* whole numbers are kept exact, others as doubles */
+	{ "[9007199254740993,-9223372036854775808,1e3,1.5]", "[9007199254740993,-9223372036854775808,1000,1.5]" },
+	/* escapes, \u escapes and surrogate pairs are decoded, in keys too */
+	{ "{\"a\\\"b\":\"c\\\\d\\n\\u00e9\\ud83d\\ude00\"}", "{\"a\\\"b\":\"c\\\\d\\n\xc3\xa9\xf0\x9f\x98\x80\"}" },
+	/* keys that come back are stored once, and read back the same */
+	{ "[{\"k\":1},{\"k\":2},{\"j\":3,\"k\":4}]", "[{\"k\":1},{\"k\":2},{\"j\":3,\"k\":4}]" },
+	{ "\"s\"", "\"s\"" },
+	{ "[[[[]]]]", "[[[[]]]]" },
+	/* truncated and malformed input */
+	{ "{\"id\":\"d1\"", NULL },
+	{ "{\"id\":\"d1\",}", NULL },
+	{ "[1,]", NULL },
+	{ "{\"a\":\"\\ud83d\"}", NULL },
+	{ "{\"a\":\"\\x\"}", NULL },
+	{ "{} x", NULL },
+	{ "", NULL },
+};
+
+static BOOL tape_num(flowthings_io_tape_value value, void *obj_out)
+{
+	flowthings_io_tape_value num = flowthings_io_tape_path(value, "elems.num.value");
+
+	((struct my_drop *)obj_out)->num = (int)flowthings_io_tape_int(num);
+
+	return flowthings_io_tape_value_type(num) == FLOWTHINGS_IO_TAPE_INT;
+}
+
+static void test_tape(void)
+{
+	flowthings_io_http_mock_config config;
+	flowthings_io_json_writer writer;
+	flowthings_io_tape_value root, value;
+	flowthings_io_tape *tape = flowthings_io_tape_init();
+	flowthings_io_string *out = flowthings_io_string_init();
+	flowthings_io_api *api;
+	struct my_drop drop;
+	const char *text;
+	void *slots[3];
+	int i, mode, count;
+
+	for (i = 0; i < (int)(sizeof(tape_cases) / sizeof(tape_cases[0])); i++) {
+		flowthings_io_string_reset(out);
+		if (flowthings_io_tape_parse(tape, tape_cases[i].json, strlen(tape_cases[i].json))) {
+			flowthings_io_json_writer_init(&writer, out);
+			tape_write(&writer, flowthings_io_tape_root(tape));
+		}
+		else {
+			/* a tape that failed holds nothing */
+			CHECK(flowthings_io_tape_value_type(flowthings_io_tape_root(tape)) == FLOWTHINGS_IO_TAPE_NONE);
+		}
+		if (tape_cases[i].want ? strcmp(out->ptr, tape_cases[i].want) : out->len != 0) {
+			printf("tape case %d: parsed %s\n", i, out->len ? out->ptr : "nothing");
+			test_failures++;
+		}
+	}
+
+	/* lookups, and chains of them through what isn't there */
+	text = "{\"id\":\"d\\u00001\",\"elems\":{\"num\":{\"value\":7},\"s\":\"x\"},\"list\":[10,\"a\",{\"b\":true}]}";
+	CHECK(flowthings_io_tape_parse(tape, text, strlen(text)));
+	root = flowthings_io_tape_root(tape);
+	CHECK(flowthings_io_tape_int(flowthings_io_tape_path(root, "elems.num.value")) == 7);
+	CHECK(flowthings_io_tape_number(flowthings_io_tape_path(root, "elems.num.value")) == 7.0);
+	/* a \u0000 ends a string, as in cJSON */
+	CHECK(flowthings_io_tape_string_len(flowthings_io_tape_get(root, "id")) == 1);
+	CHECK(!strcmp(flowthings_io_tape_key(flowthings_io_tape_index(root, 1)), "elems"));
+	value = flowthings_io_tape_get(root, "list");
+	CHECK(flowthings_io_tape_int(flowthings_io_tape_index(value, 0)) == 10);
+	CHECK(!strcmp(flowthings_io_tape_string(flowthings_io_tape_index(value, 1)), "a"));
+	CHECK(flowthings_io_tape_bool(flowthings_io_tape_get(flowthings_io_tape_index(value, 2), "b")));
+	CHECK(flowthings_io_tape_value_type(flowthings_io_tape_index(value, 3)) == FLOWTHINGS_IO_TAPE_NONE);
+	CHECK(flowthings_io_tape_key(flowthings_io_tape_index(value, 0)) == NULL);
+	/* wrong types give nothing */
+	CHECK(flowthings_io_tape_string(flowthings_io_tape_index(value, 0)) == NULL);
+	CHECK(flowthings_io_tape_string_len(flowthings_io_tape_index(value, 0)) == 0);
+	CHECK(flowthings_io_tape_int(flowthings_io_tape_index(value, 1)) == 0);
+	CHECK(flowthings_io_tape_count(flowthings_io_tape_index(value, 1)) == 0);
+	CHECK(flowthings_io_tape_value_type(flowthings_io_tape_get(value, "b")) == FLOWTHINGS_IO_TAPE_NONE);
+	CHECK(flowthings_io_tape_value_type(flowthings_io_tape_path(root, "elems.s.value.x")) == FLOWTHINGS_IO_TAPE_NONE);
+	CHECK(flowthings_io_tape_value_type(flowthings_io_tape_path(root, "nope.num")) == FLOWTHINGS_IO_TAPE_NONE);
+	CHECK(flowthings_io_tape_count(flowthings_io_tape_first(flowthings_io_tape_get(root, "nope"))) == 0);
+	CHECK(flowthings_io_tape_used(tape) > 0 && flowthings_io_tape_used(tape) <= flowthings_io_tape_size(tape));
+	flowthings_io_tape_cleanup(tape);
+	flowthings_io_string_cleanup(out);
+
+	/* read and find, buffered and streamed in small pieces */
+	for (mode = 0; mode < 2; mode++) {
+		memset(&config, 0, sizeof(config));
+		config.chunk_size = mode ? 3 : 0;
+		api = mock_api(&config);
+		flowthings_io_api_set_stream_decode(api, mode);
+
+		mock_answer(200, RESPONSE("{\"id\":\"d\\\"7\",\"x\":[{}],\"elems\":{\"a\":\"}\",\"num\":{\"type\":\"integer\",\"value\":7}}}"));
+		drop.num = 0;
+		CHECK(flowthings_io_drop_read_tape("f1", api, "d7", NULL, tape_num, &drop) == FLOWTHINGS_IO_OK);
+		CHECK(drop.num == 7);
+
+		mock_answer(200, RESPONSE("{\"elems\":{\"num\":{\"value\":\"7\"}}}"));
+		CHECK(flowthings_io_drop_read_tape("f1", api, "d7", NULL, tape_num, &drop) == FLOWTHINGS_IO_ERROR_COULDNT_DECODE);
+
+		mock_answer(200, "{\"head\":{},\"body\":{\"elems\":{\"num\":{\"value\":");
+		CHECK(flowthings_io_drop_read_tape("f1", api, "d7", NULL, tape_num, &drop) != FLOWTHINGS_IO_OK);
+
+		mock_answer(200, RESPONSE("[" DROP(1) ",{\"x\":{\"y\":[]}," "\"elems\":{\"num\":{\"value\":2}}}," DROP(3) "," DROP(4) "]"));
+		count = 3;
+		CHECK(flowthings_io_drop_find_tape("f1", api, NULL, NULL, tape_num, slots, &count) == FLOWTHINGS_IO_OK);
+		CHECK(count == 3);
+		CHECK(slot_num(slots, 0) == 1 && slot_num(slots, 1) == 2 && slot_num(slots, 2) == 3);
+
+		mock_answer(200, RESPONSE("[" DROP(1) ",{\"elems\":"));
+		count = 3;
+		CHECK(flowthings_io_drop_find_tape("f1", api, NULL, NULL, tape_num, slots, &count) != FLOWTHINGS_IO_OK);
+
+		flowthings_io_api_cleanup(api);
+	}
+}
+
+/* the spool file layout, from flowthings_io_spool.c: a 4096 byte header with the two commits of
+ * { head, gen, crc, unused } at 24 and 48, then the ring of records */
+#define SPOOL_HEADER_SIZE 4096
+#define SPOOL_COMMIT(i) (24 + (i) * 24)
+
+/* a drop of 172 bytes, which makes a record of 200 bytes: 20 fill a ring of 4096 */
+#define SPOOL_RECORD_SIZE 200
+
+/* what the spool replayed: the drops' numbers in the order they were sent, and the flow of each
+ * request */
+static struct {
+	int http_response_code;
+	int item_status;
+
+	int requests;
+	char flows[8][8];
+
+	int count;
+	int nums[64];
+} spool_mock;
+
+static int spool_handler(const char *method, const char *path, const char *data,
+		flowthings_io_string *body, void *user_data)
+{
+	const char *s = data;
+	char item[64];
+	int items = 0;
+
+	if (spool_mock.requests < 8)
+		sscanf(path, "/drop/%7[^/?]", spool_mock.flows[spool_mock.requests]);
+	spool_mock.requests++;
+
+	flowthings_io_string_strcat(body, "{\"head\":{\"status\":200},\"body\":[");
+
+	while (s && (s = strstr(s, "\"n\":")) != NULL) {
+		if (spool_mock.count < 64)
+			spool_mock.nums[spool_mock.count++] = atoi(s + 4);
+		snprintf(item, sizeof(item), "%s{\"head\":{\"status\":%d},\"body\":{}}", items++ ? "," : "",
+				spool_mock.item_status);
+		flowthings_io_string_strcat(body, item);
+		s++;
+	}
+
+	flowthings_io_string_strcat(body, "]}");
+
+	return spool_mock.http_response_code;
+}
+
+static void spool_mock_reset(int http_response_code, int item_status)
+{
+	memset(&spool_mock, 0, sizeof(spool_mock));
+	spool_mock.http_response_code = http_response_code;
+	spool_mock.item_status = item_status;
+}
+
+static flowthings_io_result_code spool_append(flowthings_io_spool *spool, const char *flow_id, int num)
+{
+	char json[SPOOL_RECORD_SIZE];
+
+	/* 24 bytes of record header, then the flow ID and the drop, null terminated; the drop is 18
+	 * bytes and its padding */
+	snprintf(json, sizeof(json), "{\"n\":%03d,\"pad\":\"%*s\"}",
+			num, (int)(SPOOL_RECORD_SIZE - 24 - (strlen(flow_id) + 1) - 1 - 18), "");
+
+	return flowthings_io_spool_append(spool, flow_id, json);
+}
+
+static unsigned long spool_records(flowthings_io_spool *spool)
+{
+	flowthings_io_spool_stats stats;
+
+	flowthings_io_spool_get_stats(spool, &stats);
+
+	return stats.records;
+}
+
+/* flips a byte of the spool file */
+static void spool_corrupt(const char *path, long offset)
+{
+	FILE *f = fopen(path, "r+b");
+	int c;
+
+	if (!f) {
+		CHECK(f != NULL);
+		return;
+	}
+
+	fseek(f, offset, SEEK_SET);
+	c = fgetc(f);
+	fseek(f, offset, SEEK_SET);
+	fputc(c ^ 0x5A, f);
+	fclose(f);
+}
+
+/* reads a commit's gen from the spool file */
+static unsigned long long spool_gen(const char *path, int i)
+{
+	FILE *f = fopen(path, "rb");
+	unsigned long long gen = 0;
+
+	if (f) {
+		fseek(f, SPOOL_COMMIT(i) + 8, SEEK_SET);
+		if (fread(&gen, sizeof(gen), 1, f) != 1)
+			gen = 0;
+		fclose(f);
+	}
+
+	return gen;
+}
+
+/* a new spool in a temporary file, whose path is left in path */
+static flowthings_io_spool *spool_create(char path[], BOOL overwrite)
+{
+	int fd;
+
+	strcpy(path, "/tmp/flowthings_io_test_XXXXXX");
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	if (fd >= 0)
+		close(fd);
+
+	return flowthings_io_spool_init(path, 4096, overwrite);
+}
+
+static void test_spool(void)
+{
+	static flowthings_io_token creds = { "myaccountname", "mytoken" };
+	flowthings_io_http_mock_config config;
+	flowthings_io_spool *spool;
+	flowthings_io_api *api;
+	char path[64];
+	int i, full;
+
+	memset(&config, 0, sizeof(config));
+	config.handler = spool_handler;
+	api = flowthings_io_api_init(FLOWTHINGS_IO_VERSION, FLOWTHINGS_IO_HOST, FALSE, &creds);
+	flowthings_io_api_set_transport(api, &flowthings_io_http_transport_mock, &config);
+
+	/* drops survive reopening, and are replayed in order, a request per run of one flow */
+	spool = spool_create(path, FALSE);
+	CHECK(spool != NULL);
+	CHECK(spool_append(spool, "f1", 0) == FLOWTHINGS_IO_OK);
+	CHECK(spool_append(spool, "f1", 1) == FLOWTHINGS_IO_OK);
+	CHECK(spool_append(spool, "f2", 2) == FLOWTHINGS_IO_OK);
+	CHECK(spool_append(spool, "f1", 3) == FLOWTHINGS_IO_OK);
+	flowthings_io_spool_cleanup(spool);
+
+	spool = flowthings_io_spool_init(path, 0, FALSE);
+	CHECK(spool != NULL && spool_records(spool) == 4);
+	spool_mock_reset(200, 200);
+	CHECK(flowthings_io_spool_replay(spool, api, 0) == FLOWTHINGS_IO_OK);
+	CHECK(spool_mock.count == 4);
+	for (i = 0; i < 4 && i < spool_mock.count; i++)
+		CHECK(spool_mock.nums[i] == i);
+	CHECK(spool_mock.requests == 3);
+	CHECK(!strcmp(spool_mock.flows[0], "f1") && !strcmp(spool_mock.flows[1], "f2") && !strcmp(spool_mock.flows[2], "f1"));
+	CHECK(spool_records(spool) == 0);
+
+	/* a failure that may pass keeps the drops; one that won't throws them away */
+	CHECK(spool_append(spool, "f1", 4) == FLOWTHINGS_IO_OK);
+	CHECK(spool_append(spool, "f1", 5) == FLOWTHINGS_IO_OK);
+	spool_mock_reset(500, 200);
+	CHECK(flowthings_io_spool_replay(spool, api, 0) == FLOWTHINGS_IO_ERROR_SERVER_ERROR);
+	CHECK(spool_records(spool) == 2);
+	spool_mock_reset(200, 400);
+	CHECK(flowthings_io_spool_replay(spool, api, 1) == FLOWTHINGS_IO_OK);
+	CHECK(spool_mock.count == 1 && spool_mock.nums[0] == 4);
+	CHECK(spool_records(spool) == 1);
+	flowthings_io_spool_cleanup(spool);
+	unlink(path);
+
+	/* a full spool turns drops away; skipping the end of the ring writes a WRAP record, and the
+	 * queue is found across it on reopening */
+	spool = spool_create(path, FALSE);
+	for (full = 0; spool_append(spool, "f1", full) == FLOWTHINGS_IO_OK; full++)
+		;
+	CHECK(full == 4096 / SPOOL_RECORD_SIZE);
+	spool_mock_reset(200, 200);
+	CHECK(flowthings_io_spool_replay(spool, api, 2) == FLOWTHINGS_IO_OK);
+	/* 96 bytes are left at the end of the ring, so two records fit in the 400 freed */
+	CHECK(spool_append(spool, "f1", 100) == FLOWTHINGS_IO_OK);
+	CHECK(spool_append(spool, "f1", 101) == FLOWTHINGS_IO_OK);
+	CHECK(spool_append(spool, "f1", 102) == FLOWTHINGS_IO_ERROR_QUEUE_FULL);
+	flowthings_io_spool_cleanup(spool);
+
+	spool = flowthings_io_spool_init(path, 0, FALSE);
+	CHECK(spool != NULL && spool_records(spool) == (unsigned long)full);
+	spool_mock_reset(200, 200);
+	CHECK(flowthings_io_spool_replay(spool, api, 0) == FLOWTHINGS_IO_OK);
+	CHECK(spool_mock.count == full);
+	CHECK(spool_mock.nums[0] == 2 && spool_mock.nums[full - 3] == full - 1);
+	CHECK(spool_mock.nums[full - 2] == 100 && spool_mock.nums[full - 1] == 101);
+	flowthings_io_spool_cleanup(spool);
+	unlink(path);
+
+	/* an overwriting spool evicts its oldest drops to make room */
+	spool = spool_create(path, TRUE);
+	for (i = 0; i < full + 5; i++)
+		CHECK(spool_append(spool, "f1", i) == FLOWTHINGS_IO_OK);
+	CHECK(spool_records(spool) <= (unsigned long)full);
+	spool_mock_reset(200, 200);
+	CHECK(flowthings_io_spool_replay(spool, api, 0) == FLOWTHINGS_IO_OK);
+	CHECK(spool_mock.count > 0 && spool_mock.nums[0] >= 5 && spool_mock.nums[spool_mock.count - 1] == full + 4);
+	flowthings_io_spool_cleanup(spool);
+	unlink(path);
+
+	/* a torn last record, one whose CRC doesn't check out, isn't part of the queue */
+	spool = spool_create(path, FALSE);
+	for (i = 0; i < 3; i++)
+		CHECK(spool_append(spool, "f1", i) == FLOWTHINGS_IO_OK);
+	flowthings_io_spool_cleanup(spool);
+	spool_corrupt(path, SPOOL_HEADER_SIZE + 2 * SPOOL_RECORD_SIZE + 40);
+
+	spool = flowthings_io_spool_init(path, 0, FALSE);
+	CHECK(spool != NULL && spool_records(spool) == 2);
+	CHECK(spool_append(spool, "f1", 3) == FLOWTHINGS_IO_OK);
+	spool_mock_reset(200, 200);
+	CHECK(flowthings_io_spool_replay(spool, api, 0) == FLOWTHINGS_IO_OK);
+	CHECK(spool_mock.count == 3 && spool_mock.nums[1] == 1 && spool_mock.nums[2] == 3);
+	flowthings_io_spool_cleanup(spool);
+	unlink(path);
+
+	/* if the newest commit is torn, the older one is used, and the drops between them are sent
+	 * again */
+	spool = spool_create(path, FALSE);
+	for (i = 0; i < 4; i++)
+		CHECK(spool_append(spool, "f1", i) == FLOWTHINGS_IO_OK);
+	spool_mock_reset(200, 200);
+	CHECK(flowthings_io_spool_replay(spool, api, 1) == FLOWTHINGS_IO_OK);
+	CHECK(flowthings_io_spool_replay(spool, api, 1) == FLOWTHINGS_IO_OK);
+	flowthings_io_spool_cleanup(spool);
+	spool_corrupt(path, SPOOL_COMMIT(spool_gen(path, 1) > spool_gen(path, 0) ? 1 : 0));
+
+	spool = flowthings_io_spool_init(path, 0, FALSE);
+	CHECK(spool != NULL && spool_records(spool) == 3);
+	spool_mock_reset(200, 200);
+	CHECK(flowthings_io_spool_replay(spool, api, 0) == FLOWTHINGS_IO_OK);
+	CHECK(spool_mock.count == 3 && spool_mock.nums[0] == 1);
+	flowthings_io_spool_cleanup(spool);
+
+	/* a file that isn't a spool isn't opened */
+	spool_corrupt(path, 0);
+	CHECK(flowthings_io_spool_init(path, 0, FALSE) == NULL);
+	unlink(path);
+
+	flowthings_io_api_cleanup(api);
+}
+
+/* runs the offline tests, and returns the number of checks that failed */
+static int run_offline_tests(void)
+{
+	test_failures = 0;
+
+	test_services();
+	test_json_arena();
+	test_json_scan();
+	test_json_writer();
+	test_json_index();
+	test_json_array();
+	test_json_insitu();
+	test_json_numbers();
+	test_find();
+	test_batch();
+	test_async();
+	test_find_iter();
+	test_find_many_sharded();
+	test_cache();
+	test_resolver();
+	test_codec();
+	test_events();
+	test_projection();
+	test_tape();
+	test_producer_overflow();
+	test_producer_batches();
+	test_spool();
+
+	printf("offline tests: %d failed\n", test_failures);
+
+	return test_failures;
+}
+
+int main(int argc, char **argv)
 {
 	flowthings_io_token creds;
 	flowthings_io_result_code code;
 
+	if (run_offline_tests() || (argc > 1 && strcmp(argv[1], "--offline") == 0))
+		return test_failures ? 1 : 0;
+
+
 	creds.account = "myaccountname";
 	creds.token = "mytoken";
 
@@ -86,10 +2354,7 @@ int main()
 	flowthings_io_http *fhttp = flowthings_io_http_init(FLOWTHINGS_IO_VERSION,
 			FLOWTHINGS_IO_HOST, FALSE, &creds);
 
-	char base_path[] = "/flow";
-	fhttp->base_path = base_path;
-
-	flowthings_io_http_request(fhttp, "GET", "/f55252d860cf228002a19fd04", NULL, s);
+	flowthings_io_http_request(fhttp, "GET", "/flow", "/f55252d860cf228002a19fd04", NULL, s);
 
 	printf("test 1 result: %s\n", s->ptr);
 